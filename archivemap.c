@@ -0,0 +1,114 @@
+#include "archivemap.h"
+#include "logs.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @description: maps the whole archive in memory for reading, so blocks can
+ * be used in place instead of being copied with fread
+ * @parameter: (archive) the tar FILE
+ * @parameter: (map) the mapping to be set
+ * @output: the exit code, not 0 when the archive can't be mapped
+ */
+int mapArchive(FILE *archive, struct archive_map *map) {
+  char message[100];
+  struct stat status;
+
+  map->data = NULL;
+  map->length = 0;
+
+  if (fstat(fileno(archive), &status) != 0 || status.st_size <= 0) {
+    logVerbose("the archive can't be mapped, reading it with stdio");
+    return 1;
+  }
+
+  void *data = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_SHARED,
+                    fileno(archive), 0);
+
+  if (data == MAP_FAILED) {
+    snprintf(message, 100, "failed to map the archive (%s), reading it with "
+             "stdio", strerror(errno));
+    logVerbose(message);
+    return 1;
+  }
+
+  map->data = data;
+  map->length = (size_t)status.st_size;
+
+  snprintf(message, 100, "archive mapped in memory (%zu bytes)", map->length);
+  logVerbose(message);
+
+  return 0;
+}
+
+/**
+ * @description: releases the mapping of the archive
+ * @parameter: (map) the mapping to release
+ * @output: n/a
+ */
+void unmapArchive(struct archive_map *map) {
+  if (map->data != NULL) {
+    munmap((void *)map->data, map->length);
+  }
+
+  map->data = NULL;
+  map->length = 0;
+}
+
+/**
+ * @description: tells the kernel how the archive will be read. Sequential
+ * reads get a bigger read-ahead, random reads only load the pages touched.
+ * @parameter: (map) the mapping of the archive
+ * @parameter: (sequential) true if the archive is read in order
+ * @output: n/a
+ */
+void adviseArchive(struct archive_map *map, bool sequential) {
+  madvise((void *)map->data, map->length,
+          sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+}
+
+/**
+ * @description: asks the kernel to start reading a range of the archive
+ * before it is used
+ * @parameter: (map) the mapping of the archive
+ * @parameter: (offset) the first byte of the range
+ * @parameter: (length) the amount of bytes of the range
+ * @output: n/a
+ */
+void prefetchRange(struct archive_map *map, size_t offset, size_t length) {
+  size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+  size_t start = offset - offset % pageSize;
+
+  if (start >= map->length) {
+    return;
+  }
+
+  if (offset + length > map->length) {
+    length = map->length - offset;
+  }
+
+  madvise((void *)(map->data + start), offset - start + length,
+          MADV_WILLNEED);
+}
+
+/**
+ * @description: returns a range of the archive
+ * @parameter: (map) the mapping of the archive
+ * @parameter: (offset) the first byte of the range
+ * @parameter: (length) the amount of bytes of the range
+ * @output: the start of the range, NULL if it is outside the archive
+ */
+const char *mappedRange(struct archive_map *map, size_t offset,
+                        size_t length) {
+  if (offset > map->length || length > map->length - offset) {
+    return NULL;
+  }
+
+  return map->data + offset;
+}
@@ -0,0 +1,28 @@
+#ifndef ARCHIVEMAP_H
+#define ARCHIVEMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+struct archive_map {
+  const char *data; // the archive mapped in memory
+  size_t length;    // amount of bytes mapped
+};
+
+// maps the whole archive in memory for reading
+int mapArchive(FILE *archive, struct archive_map *map);
+
+// releases the mapping of the archive
+void unmapArchive(struct archive_map *map);
+
+// tells the kernel whether the archive will be read in order or not
+void adviseArchive(struct archive_map *map, bool sequential);
+
+// asks the kernel to start reading a range of the archive
+void prefetchRange(struct archive_map *map, size_t offset, size_t length);
+
+// returns a range of the archive, NULL if it is outside the mapping
+const char *mappedRange(struct archive_map *map, size_t offset, size_t length);
+
+#endif
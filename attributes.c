@@ -0,0 +1,197 @@
+#include "attributes.h"
+#include "dedup.h"
+#include "logs.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @description: prepares the attributes of the members of an archive, where
+ * nothing is known about any of them yet
+ * @parameter: (attributes) the attributes to initialize
+ * @parameter: (memberCount) the amount of members in the archive
+ * @output: n/a
+ */
+void initMemberAttributes(struct member_attributes *attributes,
+                          size_t memberCount) {
+  attributes->mtimes = NULL;
+  attributes->hashes = NULL;
+  attributes->blockHashes = NULL;
+  attributes->blockCounts = NULL;
+  attributes->capacity = 0;
+
+  reserveMemberAttributes(attributes, memberCount);
+}
+
+/**
+ * @description: releases the memory used by the attributes
+ * @parameter: (attributes) the attributes to destroy
+ * @output: n/a
+ */
+void destroyMemberAttributes(struct member_attributes *attributes) {
+  for (size_t member = 0; member < attributes->capacity; member++) {
+    free(attributes->blockHashes[member]);
+  }
+
+  free(attributes->mtimes);
+  free(attributes->hashes);
+  free(attributes->blockHashes);
+  free(attributes->blockCounts);
+
+  attributes->mtimes = NULL;
+  attributes->hashes = NULL;
+  attributes->blockHashes = NULL;
+  attributes->blockCounts = NULL;
+  attributes->capacity = 0;
+}
+
+/**
+ * @description: grows the arrays so they can hold at least the amount of
+ * members requested. The attributes of the new ones are unknown. If there is
+ * an error in realloc it will exit the program.
+ * @parameter: (attributes) the member attributes
+ * @parameter: (members) the minimum amount of members
+ * @output: n/a
+ */
+void reserveMemberAttributes(struct member_attributes *attributes,
+                             size_t members) {
+  if (members <= attributes->capacity) {
+    return;
+  }
+
+  size_t capacity = attributes->capacity > 0 ? attributes->capacity : 64;
+
+  while (capacity < members) {
+    capacity *= 2;
+  }
+
+  uint64_t *mtimes = realloc(attributes->mtimes, capacity * sizeof(uint64_t));
+
+  if (mtimes) {
+    attributes->mtimes = mtimes;
+  }
+
+  uint64_t *hashes = realloc(attributes->hashes, capacity * sizeof(uint64_t));
+
+  if (hashes) {
+    attributes->hashes = hashes;
+  }
+
+  uint64_t **blockHashes =
+      realloc(attributes->blockHashes, capacity * sizeof(uint64_t *));
+
+  if (blockHashes) {
+    attributes->blockHashes = blockHashes;
+  }
+
+  size_t *blockCounts =
+      realloc(attributes->blockCounts, capacity * sizeof(size_t));
+
+  if (blockCounts) {
+    attributes->blockCounts = blockCounts;
+  }
+
+  if (!mtimes || !hashes || !blockHashes || !blockCounts) {
+    logError("memory allocation for the member attributes failed");
+    exit(EXIT_FAILURE);
+  }
+
+  size_t added = capacity - attributes->capacity;
+
+  memset(mtimes + attributes->capacity, 0, added * sizeof(uint64_t));
+  memset(hashes + attributes->capacity, 0, added * sizeof(uint64_t));
+  memset(blockHashes + attributes->capacity, 0, added * sizeof(uint64_t *));
+  memset(blockCounts + attributes->capacity, 0, added * sizeof(size_t));
+
+  attributes->capacity = capacity;
+}
+
+/**
+ * @description: sets what is known about the file a member was written from
+ * @parameter: (attributes) the member attributes
+ * @parameter: (member) the position of the member in the header
+ * @parameter: (mtime) the modification time of the file in nanoseconds
+ * @parameter: (hash) the hash of the data of the member, 0 if it is unknown
+ * @output: n/a
+ */
+void setMemberAttributes(struct member_attributes *attributes, size_t member,
+                         uint64_t mtime, uint64_t hash) {
+  reserveMemberAttributes(attributes, member + 1);
+
+  attributes->mtimes[member] = mtime;
+  attributes->hashes[member] = hash;
+}
+
+/**
+ * @description: sets the hashes of the blocks of a member, replacing the ones
+ * it had
+ * @parameter: (attributes) the member attributes
+ * @parameter: (member) the position of the member in the header
+ * @parameter: (hashes) the hash of the data of each block in chain order,
+ * allocated with malloc. The attributes free them when they are replaced.
+ * @parameter: (count) the amount of blocks
+ * @output: n/a
+ */
+void setMemberBlockHashes(struct member_attributes *attributes, size_t member,
+                          uint64_t *hashes, size_t count) {
+  reserveMemberAttributes(attributes, member + 1);
+
+  free(attributes->blockHashes[member]);
+  attributes->blockHashes[member] = hashes;
+  attributes->blockCounts[member] = count;
+}
+
+/**
+ * @description: drops the hashes of the blocks of a member, after its data
+ * changed without them being taken again
+ * @parameter: (attributes) the member attributes
+ * @parameter: (member) the position of the member in the header
+ * @output: n/a
+ */
+void forgetMemberBlockHashes(struct member_attributes *attributes,
+                             size_t member) {
+  if (member < attributes->capacity) {
+    setMemberBlockHashes(attributes, member, NULL, 0);
+  }
+}
+
+/**
+ * @description: moves the attributes of a member to another position, and
+ * the position it leaves becomes unknown
+ * @parameter: (attributes) the member attributes
+ * @parameter: (from) the position the member leaves
+ * @parameter: (to) the new position of the member
+ * @output: n/a
+ */
+void moveMemberAttributes(struct member_attributes *attributes, size_t from,
+                          size_t to) {
+  reserveMemberAttributes(attributes, (from > to ? from : to) + 1);
+
+  uint64_t mtime = attributes->mtimes[from];
+  uint64_t hash = attributes->hashes[from];
+
+  setMemberAttributes(attributes, from, 0, 0);
+  setMemberAttributes(attributes, to, mtime, hash);
+
+  if (from != to) {
+    setMemberBlockHashes(attributes, to, attributes->blockHashes[from],
+                         attributes->blockCounts[from]);
+
+    attributes->blockHashes[from] = NULL;
+    attributes->blockCounts[from] = 0;
+  }
+}
+
+/**
+ * @description: adds the hash of a block to the hash of its member. The
+ * blocks are folded in order, so the same data in another order gives another
+ * hash.
+ * @parameter: (contentHash) the hash of the blocks folded so far, 0 at first
+ * @parameter: (blockHash) the hash of the data of the next block
+ * @output: the hash of the member up to the block, never 0
+ */
+uint64_t foldContentHash(uint64_t contentHash, uint64_t blockHash) {
+  uint64_t hash = mixHash(contentHash ^ mixHash(blockHash + 1));
+
+  return hash != 0 ? hash : 1;
+}
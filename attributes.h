@@ -0,0 +1,49 @@
+#ifndef ATTRIBUTES_H
+#define ATTRIBUTES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// What is known about the file each member was written from, so an update
+// can tell the files that didn't change without reading the archive.
+struct member_attributes {
+  uint64_t *mtimes; // modification time of each file in nanoseconds, 0 when
+                    // it is not known
+  uint64_t *hashes; // hash of the data of each member, 0 when it is not known
+  uint64_t **blockHashes; // hash of the data of each block of a member in
+                          // chain order, NULL when they are not known
+  size_t *blockCounts;    // amount of blocks with a hash of each member
+  size_t capacity;        // amount of members the arrays can hold
+};
+
+// prepares the attributes of a certain amount of members, all of them unknown
+void initMemberAttributes(struct member_attributes *attributes,
+                          size_t memberCount);
+
+// releases the memory used by the attributes
+void destroyMemberAttributes(struct member_attributes *attributes);
+
+// grows the attributes to hold at least a certain amount of members
+void reserveMemberAttributes(struct member_attributes *attributes,
+                             size_t members);
+
+// sets the modification time and the hash of a member
+void setMemberAttributes(struct member_attributes *attributes, size_t member,
+                         uint64_t mtime, uint64_t hash);
+
+// moves the attributes of a member to another position
+void moveMemberAttributes(struct member_attributes *attributes, size_t from,
+                          size_t to);
+
+// sets the hashes of the blocks of a member, the attributes keep the array
+void setMemberBlockHashes(struct member_attributes *attributes, size_t member,
+                          uint64_t *hashes, size_t count);
+
+// drops the hashes of the blocks of a member, after its data changed
+void forgetMemberBlockHashes(struct member_attributes *attributes,
+                             size_t member);
+
+// adds the hash of a block of data to the hash of its member
+uint64_t foldContentHash(uint64_t contentHash, uint64_t blockHash);
+
+#endif
@@ -0,0 +1,154 @@
+#include "blocktable.h"
+#include "logs.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @description: prepares a table where the blocks of every member are still
+ * unknown
+ * @parameter: (table) the block table to initialize
+ * @parameter: (memberCount) the amount of members in the archive
+ * @output: n/a
+ */
+void initBlockTable(struct block_table *table, size_t memberCount) {
+  table->blocks = NULL;
+  table->counts = NULL;
+  table->capacity = 0;
+
+  reserveBlockTable(table, memberCount);
+}
+
+/**
+ * @description: releases the memory used by the table
+ * @parameter: (table) the block table to destroy
+ * @output: n/a
+ */
+void destroyBlockTable(struct block_table *table) {
+  for (size_t member = 0; member < table->capacity; member++) {
+    free(table->blocks[member]);
+  }
+
+  free(table->blocks);
+  free(table->counts);
+
+  table->blocks = NULL;
+  table->counts = NULL;
+  table->capacity = 0;
+}
+
+/**
+ * @description: grows the table so it can hold at least the amount of
+ * members requested. The blocks of the new ones are unknown. If there is an
+ * error in realloc it will exit the program.
+ * @parameter: (table) the block table
+ * @parameter: (members) the minimum amount of members
+ * @output: n/a
+ */
+void reserveBlockTable(struct block_table *table, size_t members) {
+  if (members <= table->capacity) {
+    return;
+  }
+
+  size_t capacity = table->capacity > 0 ? table->capacity : 64;
+
+  while (capacity < members) {
+    capacity *= 2;
+  }
+
+  size_t **blocks = realloc(table->blocks, capacity * sizeof(size_t *));
+
+  if (blocks) {
+    table->blocks = blocks;
+  }
+
+  size_t *counts = realloc(table->counts, capacity * sizeof(size_t));
+
+  if (counts) {
+    table->counts = counts;
+  }
+
+  if (!blocks || !counts) {
+    logError("memory allocation for the block table failed");
+    exit(EXIT_FAILURE);
+  }
+
+  size_t added = capacity - table->capacity;
+
+  memset(blocks + table->capacity, 0, added * sizeof(size_t *));
+  memset(counts + table->capacity, 0, added * sizeof(size_t));
+
+  table->capacity = capacity;
+}
+
+/**
+ * @description: sets the blocks of a member, replacing the ones it had
+ * @parameter: (table) the block table
+ * @parameter: (member) the position of the member in the header
+ * @parameter: (blocks) the blocks in chain order, allocated with malloc. The
+ * table frees them when they are replaced.
+ * @parameter: (count) the amount of blocks
+ * @output: n/a
+ */
+void setMemberBlocks(struct block_table *table, size_t member, size_t *blocks,
+                     size_t count) {
+  reserveBlockTable(table, member + 1);
+
+  free(table->blocks[member]);
+  table->blocks[member] = blocks;
+  table->counts[member] = count;
+}
+
+/**
+ * @description: drops the blocks of a member, after its chain changed
+ * @parameter: (table) the block table
+ * @parameter: (member) the position of the member in the header
+ * @output: n/a
+ */
+void forgetMemberBlocks(struct block_table *table, size_t member) {
+  if (member < table->capacity) {
+    setMemberBlocks(table, member, NULL, 0);
+  }
+}
+
+/**
+ * @description: moves the blocks of a member to another position, dropping
+ * the ones that were there
+ * @parameter: (table) the block table
+ * @parameter: (from) the position the member leaves
+ * @parameter: (to) the new position of the member
+ * @output: n/a
+ */
+void moveMemberBlocks(struct block_table *table, size_t from, size_t to) {
+  if (from == to) {
+    return;
+  }
+
+  reserveBlockTable(table, (from > to ? from : to) + 1);
+
+  setMemberBlocks(table, to, table->blocks[from], table->counts[from]);
+
+  table->blocks[from] = NULL;
+  table->counts[from] = 0;
+}
+
+/**
+ * @description: moves every block of the table to its new position after the
+ * archive is packed. The chains keep their order, only the positions change.
+ * @parameter: (table) the block table
+ * @parameter: (remap) the new position of each block
+ * @parameter: (blockCount) the amount of blocks before packing
+ * @output: n/a
+ */
+void remapBlockTable(struct block_table *table, size_t *remap,
+                     size_t blockCount) {
+  for (size_t member = 0; member < table->capacity; member++) {
+    size_t *blocks = table->blocks[member];
+
+    for (size_t b = 0; blocks && b < table->counts[member]; b++) {
+      if (blocks[b] < blockCount) {
+        blocks[b] = remap[blocks[b]];
+      }
+    }
+  }
+}
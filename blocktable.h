@@ -0,0 +1,37 @@
+#ifndef BLOCKTABLE_H
+#define BLOCKTABLE_H
+
+#include <stddef.h>
+
+// The blocks of every member in chain order, so the block that holds any
+// position of a member is found without following the chain up to it.
+struct block_table {
+  size_t **blocks; // blocks of each member, NULL when they are not known yet
+  size_t *counts;  // amount of blocks of each member
+  size_t capacity; // amount of members the arrays can hold
+};
+
+// prepares a table where the blocks of every member are unknown
+void initBlockTable(struct block_table *table, size_t memberCount);
+
+// releases the memory used by the table
+void destroyBlockTable(struct block_table *table);
+
+// grows the table to hold at least a certain amount of members
+void reserveBlockTable(struct block_table *table, size_t members);
+
+// sets the blocks of a member, the table keeps the array
+void setMemberBlocks(struct block_table *table, size_t member, size_t *blocks,
+                     size_t count);
+
+// drops the blocks of a member, they are unknown until set again
+void forgetMemberBlocks(struct block_table *table, size_t member);
+
+// moves the blocks of a member to another position of the table
+void moveMemberBlocks(struct block_table *table, size_t from, size_t to);
+
+// moves every block to its new position after the archive is packed
+void remapBlockTable(struct block_table *table, size_t *remap,
+                     size_t blockCount);
+
+#endif
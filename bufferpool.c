@@ -0,0 +1,183 @@
+#include "bufferpool.h"
+#include "logs.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define HUGE_PAGE_SIZE (1024 * 1024 * 2)
+
+/**
+ * @description: creates a pool of buffers in a single mapping. The buffers
+ * are page aligned, so they can be used with O_DIRECT and asynchronous I/O.
+ * Huge pages are used when the system has them reserved, otherwise the
+ * kernel is asked to back the region with transparent huge pages.
+ * @parameter: (pool) the pool to initialize
+ * @parameter: (bufferSize) the size of each buffer, a multiple of the page size
+ * @parameter: (bufferCount) the amount of buffers
+ * @output: the exit code
+ */
+int initBufferPool(struct buffer_pool *pool, size_t bufferSize,
+                   size_t bufferCount) {
+  char message[100];
+  size_t length = bufferSize * bufferCount;
+
+  pool->bufferSize = bufferSize;
+  pool->bufferCount = bufferCount;
+  pool->isHugePage = false;
+  pool->overflowCount = 0;
+  pool->memory = MAP_FAILED;
+
+  if (length % HUGE_PAGE_SIZE == 0) {
+    pool->memory = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    pool->isHugePage = pool->memory != MAP_FAILED;
+  }
+
+  if (pool->memory == MAP_FAILED) {
+    pool->memory = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  }
+
+  if (pool->memory == MAP_FAILED) {
+    logError("memory allocation for the buffer pool failed.");
+    return 1;
+  }
+
+  if (!pool->isHugePage) {
+    madvise(pool->memory, length, MADV_HUGEPAGE);
+  }
+
+  pool->isUsed = calloc(bufferCount, sizeof(bool));
+
+  if (!pool->isUsed) {
+    logError("memory allocation for the buffer pool failed.");
+    munmap(pool->memory, length);
+    return 1;
+  }
+
+  pthread_mutex_init(&pool->lock, NULL);
+
+  snprintf(message, 100, "buffer pool of %zu buffers of %zu KB%s",
+           bufferCount, bufferSize / 1024,
+           pool->isHugePage ? " in huge pages" : "");
+  logVerbose(message);
+
+  return 0;
+}
+
+/**
+ * @description: releases the memory of the pool. Every buffer must have been
+ * given back.
+ * @parameter: (pool) the pool to destroy
+ * @output: n/a
+ */
+void destroyBufferPool(struct buffer_pool *pool) {
+  char message[100];
+
+  if (pool->overflowCount > 0) {
+    snprintf(message, 100,
+             "%zu buffers were allocated apart, the pool of %zu was full",
+             pool->overflowCount, pool->bufferCount);
+    logVerbose(message);
+  }
+
+  munmap(pool->memory, pool->bufferSize * pool->bufferCount);
+  free(pool->isUsed);
+  pthread_mutex_destroy(&pool->lock);
+
+  pool->memory = NULL;
+  pool->isUsed = NULL;
+}
+
+/**
+ * @description: hands out consecutive buffers, so they can be used as a
+ * single bigger buffer. When the pool doesn't have enough free buffers they
+ * are allocated apart, page aligned like the ones of the pool, so the caller
+ * doesn't have to wait or take another path.
+ * @parameter: (pool) the pool
+ * @parameter: (count) the amount of consecutive buffers needed
+ * @output: the first buffer, NULL if the memory couldn't be allocated
+ */
+void *acquireBuffers(struct buffer_pool *pool, size_t count) {
+  char message[100];
+  void *buffer = NULL;
+  size_t runLength = 0;
+
+  pthread_mutex_lock(&pool->lock);
+
+  for (size_t i = 0; i < pool->bufferCount; i++) {
+    runLength = pool->isUsed[i] ? 0 : runLength + 1;
+
+    if (runLength == count) {
+      size_t first = i + 1 - count;
+
+      for (size_t b = first; b <= i; b++) {
+        pool->isUsed[b] = true;
+      }
+
+      buffer = pool->memory + first * pool->bufferSize;
+      break;
+    }
+  }
+
+  bool isFirstOverflow = !buffer && pool->overflowCount == 0;
+
+  if (!buffer) {
+    pool->overflowCount += count;
+  }
+
+  pthread_mutex_unlock(&pool->lock);
+
+  if (buffer) {
+    return buffer;
+  }
+
+  if (isFirstOverflow) {
+    snprintf(message, 100,
+             "the pool of %zu buffers is full, allocating %zu apart",
+             pool->bufferCount, count);
+    logWarning(message);
+  }
+
+  if (posix_memalign(&buffer, sysconf(_SC_PAGESIZE),
+                     pool->bufferSize * count) != 0) {
+    logError("memory allocation for the buffers failed.");
+    return NULL;
+  }
+
+  return buffer;
+}
+
+/**
+ * @description: gives back buffers to the pool
+ * @parameter: (pool) the pool
+ * @parameter: (buffer) the first buffer, as returned by acquireBuffers
+ * @parameter: (count) the amount of buffers acquired
+ * @output: n/a
+ */
+void releaseBuffers(struct buffer_pool *pool, void *buffer, size_t count) {
+  if (buffer == NULL) {
+    return;
+  }
+
+  // buffers allocated apart when the pool was full
+  if ((char *)buffer < pool->memory ||
+      (char *)buffer >= pool->memory + pool->bufferSize * pool->bufferCount) {
+    free(buffer);
+    return;
+  }
+
+  size_t first = ((char *)buffer - pool->memory) / pool->bufferSize;
+
+  pthread_mutex_lock(&pool->lock);
+
+  for (size_t b = first; b < first + count && b < pool->bufferCount; b++) {
+    pool->isUsed[b] = false;
+  }
+
+  pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,31 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct buffer_pool {
+  char *memory;         // one page aligned region holding every buffer
+  size_t bufferSize;    // size of each buffer, a multiple of the page size
+  size_t bufferCount;   // amount of buffers in the pool
+  bool *isUsed;         // true for the buffers handed out
+  bool isHugePage;      // true when the region is backed by huge pages
+  size_t overflowCount; // buffers allocated apart because the pool was full
+  pthread_mutex_t lock; // the pool can be shared by several threads
+};
+
+// creates a pool of page aligned buffers
+int initBufferPool(struct buffer_pool *pool, size_t bufferSize,
+                   size_t bufferCount);
+
+// releases the memory of the pool
+void destroyBufferPool(struct buffer_pool *pool);
+
+// hands out count consecutive buffers, allocated apart if there are none free
+void *acquireBuffers(struct buffer_pool *pool, size_t count);
+
+// gives back buffers taken with acquireBuffers
+void releaseBuffers(struct buffer_pool *pool, void *buffer, size_t count);
+
+#endif
@@ -0,0 +1,439 @@
+#include "checksum.h"
+#include "logs.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the crc32 instruction of SSE4.2 calculates CRC32C, the target attribute
+// lets it be used without building the whole program for SSE4.2
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define HAVE_CRC32C_INSTRUCTION
+#endif
+
+// The tables are built the first time a checksum is calculated
+pthread_once_t crc32cOnce = PTHREAD_ONCE_INIT;
+uint32_t crc32cTable[8][256];      // a byte at each of 8 positions of a word
+uint32_t crc32cLongZeros[4][256];  // skips CRC32C_LONG zeros
+uint32_t crc32cShortZeros[4][256]; // skips CRC32C_SHORT zeros
+bool isCrc32cHardware = false;
+
+/**
+ * @description: multiplies a matrix by a vector over GF(2), where every bit
+ * is an element
+ * @parameter: (matrix) the rows of the matrix, one per bit of vector
+ * @parameter: (vector) the vector to multiply
+ * @output: the product
+ */
+uint32_t multiplyGF2Matrix(const uint32_t *matrix, uint32_t vector) {
+  uint32_t sum = 0;
+
+  for (; vector != 0; vector >>= 1, matrix++) {
+    if (vector & 1) {
+      sum ^= *matrix;
+    }
+  }
+
+  return sum;
+}
+
+/**
+ * @description: multiplies a 32x32 matrix by itself over GF(2)
+ * @parameter: (square) where the product is written
+ * @parameter: (matrix) the matrix to square
+ * @output: n/a
+ */
+void squareGF2Matrix(uint32_t *square, const uint32_t *matrix) {
+  for (int n = 0; n < 32; n++) {
+    square[n] = multiplyGF2Matrix(matrix, matrix[n]);
+  }
+}
+
+/**
+ * @description: builds the tables that move a crc past a run of zeros. The
+ * lanes of the hardware crc are calculated on their own and then joined this
+ * way, as if the data of each lane came after the one before it.
+ * @parameter: (zeros) the tables to build, one per byte of the crc
+ * @parameter: (length) the amount of zeros, a power of two
+ * @output: n/a
+ */
+void buildZerosTable(uint32_t zeros[4][256], size_t length) {
+  uint32_t odd[32], even[32];
+  uint32_t row = 1;
+
+  // the operator for one zero bit
+  odd[0] = CRC32C_POLYNOMIAL;
+
+  for (int n = 1; n < 32; n++) {
+    odd[n] = row;
+    row <<= 1;
+  }
+
+  // each square doubles the zeros, the third one gives a whole byte
+  squareGF2Matrix(even, odd);
+  squareGF2Matrix(odd, even);
+
+  uint32_t *operator = odd;
+
+  while (length > 0) {
+    squareGF2Matrix(even, odd);
+    operator = even;
+    length >>= 1;
+
+    if (length == 0) {
+      break;
+    }
+
+    squareGF2Matrix(odd, even);
+    operator = odd;
+    length >>= 1;
+  }
+
+  for (uint32_t n = 0; n < 256; n++) {
+    zeros[0][n] = multiplyGF2Matrix(operator, n);
+    zeros[1][n] = multiplyGF2Matrix(operator, n << 8);
+    zeros[2][n] = multiplyGF2Matrix(operator, n << 16);
+    zeros[3][n] = multiplyGF2Matrix(operator, n << 24);
+  }
+}
+
+/**
+ * @description: moves a crc past the run of zeros of a table
+ * @parameter: (zeros) the tables built by buildZerosTable
+ * @parameter: (crc) the crc, without the final inversion
+ * @output: the crc after the zeros
+ */
+uint32_t shiftCrc32c(uint32_t zeros[4][256], uint32_t crc) {
+  return zeros[0][crc & 0xff] ^ zeros[1][(crc >> 8) & 0xff] ^
+         zeros[2][(crc >> 16) & 0xff] ^ zeros[3][crc >> 24];
+}
+
+/**
+ * @description: builds the tables of the software crc and of the lanes of
+ * the hardware one, and checks if the CPU has the crc32 instruction
+ * @output: n/a
+ */
+void initCrc32cTables() {
+  for (uint32_t n = 0; n < 256; n++) {
+    uint32_t crc = n;
+
+    for (int k = 0; k < 8; k++) {
+      crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLYNOMIAL : crc >> 1;
+    }
+
+    crc32cTable[0][n] = crc;
+  }
+
+  for (uint32_t n = 0; n < 256; n++) {
+    uint32_t crc = crc32cTable[0][n];
+
+    for (int k = 1; k < 8; k++) {
+      crc = crc32cTable[0][crc & 0xff] ^ (crc >> 8);
+      crc32cTable[k][n] = crc;
+    }
+  }
+
+  buildZerosTable(crc32cLongZeros, CRC32C_LONG);
+  buildZerosTable(crc32cShortZeros, CRC32C_SHORT);
+
+#ifdef HAVE_CRC32C_INSTRUCTION
+  isCrc32cHardware = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+/**
+ * @description: calculates the CRC32C of some data a word at a time, looking
+ * up each of its 8 bytes in its own table
+ * @parameter: (crc) the crc of the data before, 0 to start
+ * @parameter: (data) the data
+ * @parameter: (length) the amount of bytes of data
+ * @output: the crc
+ */
+uint32_t crc32cSoftware(uint32_t crc, const unsigned char *data,
+                        size_t length) {
+  crc = ~crc;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  while (length > 0 && ((uintptr_t)data & 7) != 0) {
+    crc = crc32cTable[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    length--;
+  }
+
+  for (; length >= 8; data += 8, length -= 8) {
+    uint64_t word;
+
+    memcpy(&word, data, sizeof(word));
+    word ^= crc;
+
+    crc = crc32cTable[7][word & 0xff] ^ crc32cTable[6][(word >> 8) & 0xff] ^
+          crc32cTable[5][(word >> 16) & 0xff] ^
+          crc32cTable[4][(word >> 24) & 0xff] ^
+          crc32cTable[3][(word >> 32) & 0xff] ^
+          crc32cTable[2][(word >> 40) & 0xff] ^
+          crc32cTable[1][(word >> 48) & 0xff] ^ crc32cTable[0][word >> 56];
+  }
+#endif
+
+  while (length > 0) {
+    crc = crc32cTable[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    length--;
+  }
+
+  return ~crc;
+}
+
+#ifdef HAVE_CRC32C_INSTRUCTION
+/**
+ * @description: calculates the CRC32C of some data with the crc32 instruction.
+ * The instruction takes three cycles but a new one can start every cycle, so
+ * the data is split in three lanes calculated at once and joined after.
+ * @parameter: (crc) the crc of the data before, 0 to start
+ * @parameter: (data) the data
+ * @parameter: (length) the amount of bytes of data
+ * @output: the crc
+ */
+__attribute__((target("sse4.2"))) uint32_t
+crc32cHardware(uint32_t crc, const unsigned char *data, size_t length) {
+  uint64_t crc0 = ~crc;
+
+  while (length > 0 && ((uintptr_t)data & 7) != 0) {
+    crc0 = _mm_crc32_u8((uint32_t)crc0, *data++);
+    length--;
+  }
+
+  const size_t lanes[2] = {CRC32C_LONG, CRC32C_SHORT};
+
+  for (int l = 0; l < 2; l++) {
+    size_t lane = lanes[l];
+
+    for (; length >= lane * 3; data += lane * 2, length -= lane * 3) {
+      uint64_t crc1 = 0, crc2 = 0;
+      const unsigned char *end = data + lane;
+
+      for (; data < end; data += 8) {
+        uint64_t word0, word1, word2;
+
+        memcpy(&word0, data, sizeof(word0));
+        memcpy(&word1, data + lane, sizeof(word1));
+        memcpy(&word2, data + lane * 2, sizeof(word2));
+
+        crc0 = _mm_crc32_u64(crc0, word0);
+        crc1 = _mm_crc32_u64(crc1, word1);
+        crc2 = _mm_crc32_u64(crc2, word2);
+      }
+
+      uint32_t(*zeros)[256] = l == 0 ? crc32cLongZeros : crc32cShortZeros;
+
+      crc0 = shiftCrc32c(zeros, (uint32_t)crc0) ^ crc1;
+      crc0 = shiftCrc32c(zeros, (uint32_t)crc0) ^ crc2;
+    }
+  }
+
+  for (; length >= 8; data += 8, length -= 8) {
+    uint64_t word;
+
+    memcpy(&word, data, sizeof(word));
+    crc0 = _mm_crc32_u64(crc0, word);
+  }
+
+  while (length > 0) {
+    crc0 = _mm_crc32_u8((uint32_t)crc0, *data++);
+    length--;
+  }
+
+  return ~(uint32_t)crc0;
+}
+#else
+/**
+ * @description: the CPU has no crc instruction star knows, so the software
+ * crc is used
+ * @parameter: (crc) the crc of the data before, 0 to start
+ * @parameter: (data) the data
+ * @parameter: (length) the amount of bytes of data
+ * @output: the crc
+ */
+uint32_t crc32cHardware(uint32_t crc, const unsigned char *data,
+                        size_t length) {
+  return crc32cSoftware(crc, data, length);
+}
+#endif
+
+/**
+ * @description: calculates the CRC32C of some data. The crc32 instruction of
+ * SSE4.2 is used when the CPU has it.
+ * @parameter: (crc) the crc of the data before, 0 to start
+ * @parameter: (data) the data
+ * @parameter: (length) the amount of bytes of data
+ * @output: the crc
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t length) {
+  pthread_once(&crc32cOnce, initCrc32cTables);
+
+  if (isCrc32cHardware) {
+    return crc32cHardware(crc, data, length);
+  }
+
+  return crc32cSoftware(crc, data, length);
+}
+
+/**
+ * @description: determines if the CRC32C is calculated by the CPU
+ * @output: true when the crc32 instruction is used
+ */
+bool isCrc32cAccelerated() {
+  pthread_once(&crc32cOnce, initCrc32cTables);
+
+  return isCrc32cHardware;
+}
+
+/**
+ * @description: adds the checksum of a block to the checksum of its member.
+ * The bytes are taken in the same order on every CPU.
+ * @parameter: (memberChecksum) the checksum of the blocks before, 0 to start
+ * @parameter: (blockChecksum) the checksum of the block
+ * @output: the checksum of the member up to the block
+ */
+uint32_t foldBlockChecksum(uint32_t memberChecksum, uint32_t blockChecksum) {
+  unsigned char bytes[4] = {blockChecksum & 0xff, (blockChecksum >> 8) & 0xff,
+                            (blockChecksum >> 16) & 0xff, blockChecksum >> 24};
+
+  return crc32c(memberChecksum, bytes, sizeof(bytes));
+}
+
+/**
+ * @description: prepares the checksums of an archive, every one of them 0
+ * @parameter: (checksums) the checksums to initialize
+ * @parameter: (blockCount) the amount of blocks in the archive
+ * @parameter: (memberCount) the amount of members in the archive
+ * @output: n/a
+ */
+void initBlockChecksums(struct block_checksums *checksums, size_t blockCount,
+                        size_t memberCount) {
+  checksums->blocks = NULL;
+  checksums->blockCapacity = 0;
+  checksums->members = NULL;
+  checksums->memberCapacity = 0;
+
+  reserveBlockChecksums(checksums, blockCount);
+  reserveMemberChecksums(checksums, memberCount);
+}
+
+/**
+ * @description: releases the memory used by the checksums
+ * @parameter: (checksums) the checksums to destroy
+ * @output: n/a
+ */
+void destroyBlockChecksums(struct block_checksums *checksums) {
+  free(checksums->blocks);
+  free(checksums->members);
+
+  checksums->blocks = NULL;
+  checksums->blockCapacity = 0;
+  checksums->members = NULL;
+  checksums->memberCapacity = 0;
+}
+
+/**
+ * @description: grows the checksums of the blocks so they can hold at least
+ * the amount of blocks requested. The new ones are 0. If there is an error in
+ * realloc it will exit the program.
+ * @parameter: (checksums) the checksums of the archive
+ * @parameter: (blocks) the minimum amount of blocks
+ * @output: n/a
+ */
+void reserveBlockChecksums(struct block_checksums *checksums, size_t blocks) {
+  if (blocks <= checksums->blockCapacity) {
+    return;
+  }
+
+  size_t capacity =
+      checksums->blockCapacity > 0 ? checksums->blockCapacity : 1024;
+
+  while (capacity < blocks) {
+    capacity *= 2;
+  }
+
+  uint32_t *values = realloc(checksums->blocks, capacity * sizeof(uint32_t));
+
+  if (values == NULL) {
+    logError("memory allocation for block checksums failed");
+    exit(EXIT_FAILURE);
+  }
+
+  memset(values + checksums->blockCapacity, 0,
+         (capacity - checksums->blockCapacity) * sizeof(uint32_t));
+
+  checksums->blocks = values;
+  checksums->blockCapacity = capacity;
+}
+
+/**
+ * @description: grows the checksums of the members so they can hold at least
+ * the amount of members requested. The new ones are 0, not sealed yet. If
+ * there is an error in realloc it will exit the program.
+ * @parameter: (checksums) the checksums of the archive
+ * @parameter: (members) the minimum amount of members
+ * @output: n/a
+ */
+void reserveMemberChecksums(struct block_checksums *checksums,
+                            size_t members) {
+  if (members <= checksums->memberCapacity) {
+    return;
+  }
+
+  size_t capacity =
+      checksums->memberCapacity > 0 ? checksums->memberCapacity : 64;
+
+  while (capacity < members) {
+    capacity *= 2;
+  }
+
+  uint32_t *values = realloc(checksums->members, capacity * sizeof(uint32_t));
+
+  if (values == NULL) {
+    logError("memory allocation for member checksums failed");
+    exit(EXIT_FAILURE);
+  }
+
+  memset(values + checksums->memberCapacity, 0,
+         (capacity - checksums->memberCapacity) * sizeof(uint32_t));
+
+  checksums->members = values;
+  checksums->memberCapacity = capacity;
+}
+
+/**
+ * @description: moves the checksum of every block to its new position after
+ * the archive is packed. The data of the blocks doesn't change, so the
+ * checksums of the members stay the same.
+ * @parameter: (checksums) the checksums of the archive
+ * @parameter: (remap) the new position of each block, any position past the
+ * new amount of blocks when the block is not in use
+ * @parameter: (blockCount) the amount of blocks before packing
+ * @parameter: (newBlockCount) the amount of blocks after packing
+ * @output: n/a
+ */
+void remapBlockChecksums(struct block_checksums *checksums, size_t *remap,
+                         size_t blockCount, size_t newBlockCount) {
+  uint32_t *packed = calloc(newBlockCount > 0 ? newBlockCount : 1,
+                            sizeof(uint32_t));
+
+  if (packed == NULL) {
+    logError("memory allocation for block checksums failed");
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t block = 0;
+       block < blockCount && block < checksums->blockCapacity; block++) {
+    if (remap[block] < newBlockCount) {
+      packed[remap[block]] = checksums->blocks[block];
+    }
+  }
+
+  free(checksums->blocks);
+  checksums->blocks = packed;
+  checksums->blockCapacity = newBlockCount > 0 ? newBlockCount : 1;
+}
@@ -0,0 +1,60 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CRC32C_POLYNOMIAL 0x82f63b78 // CRC-32C (Castagnoli), bits reversed
+#define CRC32C_LONG 8192 // bytes of each lane on long runs of data
+#define CRC32C_SHORT 256 // bytes of each lane on short runs of data
+
+// The checksums of an archive. Every block has the CRC32C of its data, and
+// every member the CRC32C of the checksums of its blocks in chain order, so a
+// member also notices when its chain goes through the wrong blocks.
+struct block_checksums {
+  uint32_t *blocks;      // checksum of the data of each block
+  size_t blockCapacity;  // amount of blocks the array can hold
+  uint32_t *members;     // checksum of each member, 0 until it is sealed
+  size_t memberCapacity; // amount of members the array can hold
+};
+
+// calculates the CRC32C of some data, going on from a previous crc
+uint32_t crc32c(uint32_t crc, const void *data, size_t length);
+
+// determines if the CRC32C is calculated by the CPU
+bool isCrc32cAccelerated();
+
+// adds the checksum of a block to the checksum of its member
+uint32_t foldBlockChecksum(uint32_t memberChecksum, uint32_t blockChecksum);
+
+// prepares the checksums for a certain amount of blocks and members
+void initBlockChecksums(struct block_checksums *checksums, size_t blockCount,
+                        size_t memberCount);
+
+// releases the memory used by the checksums
+void destroyBlockChecksums(struct block_checksums *checksums);
+
+// grows the checksums to hold at least a certain amount of blocks
+void reserveBlockChecksums(struct block_checksums *checksums, size_t blocks);
+
+// grows the checksums to hold at least a certain amount of members
+void reserveMemberChecksums(struct block_checksums *checksums,
+                            size_t members);
+
+// moves the checksum of every block to its new position
+void remapBlockChecksums(struct block_checksums *checksums, size_t *remap,
+                         size_t blockCount, size_t newBlockCount);
+
+// internal helpers of the checksums
+void initCrc32cTables();
+uint32_t crc32cSoftware(uint32_t crc, const unsigned char *data,
+                        size_t length);
+uint32_t crc32cHardware(uint32_t crc, const unsigned char *data,
+                        size_t length);
+uint32_t shiftCrc32c(uint32_t zeros[4][256], uint32_t crc);
+void buildZerosTable(uint32_t zeros[4][256], size_t length);
+uint32_t multiplyGF2Matrix(const uint32_t *matrix, uint32_t vector);
+void squareGF2Matrix(uint32_t *square, const uint32_t *matrix);
+
+#endif
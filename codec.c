@@ -0,0 +1,251 @@
+#include "codec.h"
+#include "logs.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+/**
+ * @description: determines if star was built with a codec, which needs the
+ * zlib headers when it is compiled
+ * @output: true if blocks can be compressed
+ */
+bool isCodecAvailable() {
+#ifdef HAVE_ZLIB
+  return true;
+#else
+  return false;
+#endif
+}
+
+/**
+ * @description: compresses the data of a block. The start of the block is
+ * tried first, so data that doesn't compress, like media or archives, costs
+ * only a small part of the block before it is stored raw.
+ * @parameter: (input) the data of the block
+ * @parameter: (length) the amount of bytes of data
+ * @parameter: (output) where the compressed data is written
+ * @parameter: (capacity) the space of output
+ * @output: the length of the compressed data, 0 when it must be stored raw
+ */
+size_t compressBlock(const char *input, size_t length, char *output,
+                     size_t capacity) {
+#ifdef HAVE_ZLIB
+  size_t limit = length - length / CODEC_MIN_SAVING;
+
+  if (limit > capacity) {
+    limit = capacity;
+  }
+
+  if (length > 2 * CODEC_SAMPLE_SIZE) {
+    uLongf sampleLength =
+        CODEC_SAMPLE_SIZE - CODEC_SAMPLE_SIZE / CODEC_MIN_SAVING;
+
+    if (sampleLength > limit ||
+        compress2((Bytef *)output, &sampleLength, (const Bytef *)input,
+                  CODEC_SAMPLE_SIZE, Z_BEST_SPEED) != Z_OK) {
+      return 0;
+    }
+  }
+
+  uLongf compressedLength = limit;
+
+  if (compress2((Bytef *)output, &compressedLength, (const Bytef *)input,
+                length, Z_BEST_SPEED) != Z_OK) {
+    return 0;
+  }
+
+  return compressedLength;
+#else
+  return 0;
+#endif
+}
+
+/**
+ * @description: decompresses the data of a block
+ * @parameter: (input) the compressed data
+ * @parameter: (length) the amount of bytes of compressed data
+ * @parameter: (output) where the data is written
+ * @parameter: (expected) the amount of bytes the data must have
+ * @output: the exit code
+ */
+int decompressBlock(const char *input, size_t length, char *output,
+                    size_t expected) {
+#ifdef HAVE_ZLIB
+  uLongf outputLength = expected;
+
+  if (uncompress((Bytef *)output, &outputLength, (const Bytef *)input,
+                 length) != Z_OK ||
+      outputLength != expected) {
+    return 1;
+  }
+
+  return 0;
+#else
+  return 1;
+#endif
+}
+
+/**
+ * @description: starts the threads of a codec pool. The thread that runs the
+ * tasks works as well, so one thread less is started.
+ * @parameter: (pool) the pool to initialize
+ * @parameter: (threadCount) the amount of threads that run the tasks
+ * @output: the exit code
+ */
+int initCodecPool(struct codec_pool *pool, int threadCount) {
+  memset(pool, 0, sizeof(*pool));
+
+  if (threadCount > CODEC_MAX_THREADS) {
+    threadCount = CODEC_MAX_THREADS;
+  }
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->hasTasks, NULL);
+  pthread_cond_init(&pool->tasksDone, NULL);
+
+  for (int w = 1; w < threadCount; w++) {
+    if (pthread_create(&pool->workers[pool->workerCount], NULL, codecWorker,
+                       pool) != 0) {
+      logWarning("couldn't start a compression worker");
+      break;
+    }
+
+    pool->workerCount++;
+  }
+
+  return 0;
+}
+
+/**
+ * @description: runs a batch of tasks, sharing them between the threads of
+ * the pool, and waits until all of them are done
+ * @parameter: (pool) the codec pool
+ * @parameter: (tasks) the tasks to run
+ * @parameter: (count) the amount of tasks
+ * @output: n/a
+ */
+void runCodecTasks(struct codec_pool *pool, struct codec_task *tasks,
+                   size_t count) {
+  if (count == 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+
+  pool->tasks = tasks;
+  pool->taskCount = count;
+  pool->nextTask = 0;
+  pool->doneCount = 0;
+
+  pthread_cond_broadcast(&pool->hasTasks);
+
+  while (runNextCodecTask(pool)) {
+  }
+
+  while (pool->doneCount < pool->taskCount) {
+    pthread_cond_wait(&pool->tasksDone, &pool->lock);
+  }
+
+  pool->tasks = NULL;
+  pool->taskCount = 0;
+  pool->nextTask = 0;
+
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @description: stops the threads of the pool
+ * @parameter: (pool) the codec pool
+ * @output: n/a
+ */
+void destroyCodecPool(struct codec_pool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->isStopping = true;
+  pthread_cond_broadcast(&pool->hasTasks);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (int w = 0; w < pool->workerCount; w++) {
+    pthread_join(pool->workers[w], NULL);
+  }
+
+  pthread_cond_destroy(&pool->hasTasks);
+  pthread_cond_destroy(&pool->tasksDone);
+  pthread_mutex_destroy(&pool->lock);
+
+  pool->workerCount = 0;
+}
+
+/**
+ * @description: runs the tasks of each batch until the pool stops
+ * @parameter: (argument) the codec_pool
+ * @output: NULL
+ */
+void *codecWorker(void *argument) {
+  struct codec_pool *pool = argument;
+
+  pthread_mutex_lock(&pool->lock);
+
+  while (true) {
+    while (pool->nextTask >= pool->taskCount && !pool->isStopping) {
+      pthread_cond_wait(&pool->hasTasks, &pool->lock);
+    }
+
+    if (pool->isStopping) {
+      break;
+    }
+
+    runNextCodecTask(pool);
+  }
+
+  pthread_mutex_unlock(&pool->lock);
+
+  return NULL;
+}
+
+/**
+ * @description: takes the next task of the batch and runs it. It is called
+ * with the lock of the pool held, and the lock is released while the task
+ * runs.
+ * @parameter: (pool) the codec pool
+ * @output: false when there were no tasks left to take
+ */
+bool runNextCodecTask(struct codec_pool *pool) {
+  if (pool->nextTask >= pool->taskCount) {
+    return false;
+  }
+
+  struct codec_task *task = &pool->tasks[pool->nextTask++];
+
+  pthread_mutex_unlock(&pool->lock);
+  runCodecTask(task);
+  pthread_mutex_lock(&pool->lock);
+
+  if (++pool->doneCount == pool->taskCount) {
+    pthread_cond_broadcast(&pool->tasksDone);
+  }
+
+  return true;
+}
+
+/**
+ * @description: compresses or decompresses the block of a task
+ * @parameter: (task) the task to run
+ * @output: n/a
+ */
+void runCodecTask(struct codec_task *task) {
+  if (task->isCompress) {
+    task->outputLength = compressBlock(task->input, task->inputLength,
+                                       task->output, task->outputLength);
+    task->result = 0;
+    return;
+  }
+
+  task->result = decompressBlock(task->input, task->inputLength, task->output,
+                                 task->outputLength);
+}
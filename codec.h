@@ -0,0 +1,58 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define CODEC_MAX_THREADS 64 // workers of the pool, the same limit as --jobs
+#define CODEC_SAMPLE_SIZE (16 * 1024) // bytes tried before a whole block
+#define CODEC_MIN_SAVING 8 // data must shrink by 1/8 to be stored compressed
+
+// The compression or decompression of one block, run by the codec pool
+struct codec_task {
+  bool isCompress;
+  const char *input;
+  size_t inputLength;
+  char *output;
+  size_t outputLength; // the space of output, then the bytes produced
+  int result;          // 0 when it worked, set when the task is done
+};
+
+struct codec_pool {
+  pthread_t workers[CODEC_MAX_THREADS];
+  int workerCount;
+  pthread_mutex_t lock;
+  pthread_cond_t hasTasks, tasksDone;
+  struct codec_task *tasks; // the batch being run
+  size_t taskCount, nextTask, doneCount;
+  bool isStopping;
+};
+
+// determines if star was built with a codec
+bool isCodecAvailable();
+
+// compresses a block, 0 when it doesn't shrink enough and is stored raw
+size_t compressBlock(const char *input, size_t length, char *output,
+                     size_t capacity);
+
+// decompresses a block that must give exactly expected bytes
+int decompressBlock(const char *input, size_t length, char *output,
+                    size_t expected);
+
+// starts a pool of threads for a certain amount of threads in total
+int initCodecPool(struct codec_pool *pool, int threadCount);
+
+// runs a batch of tasks on the pool, the calling thread helps as well
+void runCodecTasks(struct codec_pool *pool, struct codec_task *tasks,
+                   size_t count);
+
+// stops the threads of the pool
+void destroyCodecPool(struct codec_pool *pool);
+
+// internal helpers of the pool
+void *codecWorker(void *argument);
+bool runNextCodecTask(struct codec_pool *pool);
+void runCodecTask(struct codec_task *task);
+
+#endif
@@ -1,10 +1,17 @@
 #include "commands.h"
+#include "star.h"
 #include "tar.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+size_t globalReadOffset = 0;
+size_t globalReadLength = SIZE_MAX;
 
 /**
  * @description: is the entry point to handle all commands
@@ -42,6 +49,74 @@ int handleCommands(int argumentCount, char *argumentList[]) {
       isGlobalVerbosed = true;
     }
 
+    if (currentMode == EXTENTS) {
+      isGlobalExtentLayout = true;
+    }
+
+    if (currentMode == MAPPED_READ) {
+      isGlobalMappedRead = true;
+    }
+
+    if (currentMode == DIRECT_IO) {
+      isGlobalDirectIO = true;
+    }
+
+    if (currentMode == ASYNC_IO) {
+      isGlobalAsyncIO = true;
+    }
+
+    if (currentMode == STREAM_OUTPUT) {
+      isGlobalStreamOutput = true;
+    }
+
+    if (currentMode == COMPRESS) {
+      isGlobalCompress = true;
+    }
+
+    if (currentMode == DEDUP) {
+      isGlobalDedup = true;
+    }
+
+    if (currentMode == HASH_CHECK) {
+      isGlobalHashCheck = true;
+    }
+
+    if (currentMode == JOBS) {
+      char *value = getOptionValue(argumentCount, argumentList, flags[i]);
+      char *end = NULL;
+      long jobs = value ? strtol(value, &end, 10) : 0;
+
+      if (!value || *end != '\0' || jobs < 1 || jobs > 64) {
+        logError("--jobs needs a number between 1 and 64");
+        return 1;
+      }
+
+      globalJobCount = jobs;
+    }
+
+    if (currentMode == OFFSET || currentMode == LENGTH) {
+      char *value = getOptionValue(argumentCount, argumentList, flags[i]);
+      size_t *size =
+          currentMode == OFFSET ? &globalReadOffset : &globalReadLength;
+
+      if (!parseSizeOption(value, size)) {
+        char errorMessage[100];
+
+        snprintf(errorMessage, 100, "%s needs a number of bytes", flags[i]);
+        logError(errorMessage);
+
+        return 1;
+      }
+    }
+
+    // the archive of --read can be given without -f
+    if (currentMode == READ) {
+      filename = getOutFilename(argumentCount, argumentList);
+
+      if (filename == NULL)
+        return 1;
+    }
+
     if (currentMode == USE_FILE) {
       filename = getOutFilename(argumentCount, argumentList);
 
@@ -60,7 +135,7 @@ int handleCommands(int argumentCount, char *argumentList[]) {
       return 1;
     }
 
-    if (currentMode != VERBOSE && currentMode != USE_FILE) {
+    if (!isModifierFlag(currentMode)) {
       selectedMode = currentMode;
     }
   }
@@ -85,6 +160,10 @@ int handleCommands(int argumentCount, char *argumentList[]) {
         isGlobalVerbosed = true;
       }
 
+      if (currentMode == COMPRESS) {
+        isGlobalCompress = true;
+      }
+
       if (currentMode == USE_FILE) {
         filename = getOutFilename(argumentCount, argumentList);
 
@@ -103,7 +182,7 @@ int handleCommands(int argumentCount, char *argumentList[]) {
         return 1;
       }
 
-      if (currentMode != VERBOSE && currentMode != USE_FILE) {
+      if (!isModifierFlag(currentMode)) {
         selectedMode = currentMode;
       }
     }
@@ -114,7 +193,30 @@ int handleCommands(int argumentCount, char *argumentList[]) {
 
   getFiles(argumentCount, argumentList, &filesCount, files);
 
-  return callCommands(selectedMode, files, filesCount, filename);
+  int result = callCommands(selectedMode, files, filesCount, filename);
+
+  logPeakMemory();
+  destroyBlockPool();
+
+  return result;
+}
+
+/**
+ * @description: logs the peak resident memory used by the program, so the
+ * memory needed by each command can be measured
+ * @output: n/a
+ */
+void logPeakMemory() {
+  struct rusage usage;
+
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return;
+  }
+
+  char message[100];
+
+  snprintf(message, 100, "peak memory usage: %ld KB", usage.ru_maxrss);
+  logVerbose(message);
 }
 
 /**
@@ -131,7 +233,7 @@ int callCommands(Flags command, char *files[], int fileCount, char *filename) {
     return displayHelp();
   }
   if (command == EXTRACT) {
-    return extract(filename);
+    return extract(files, fileCount, filename);
   }
   if (command == CREATE) {
     return create(files, fileCount, filename);
@@ -151,10 +253,105 @@ int callCommands(Flags command, char *files[], int fileCount, char *filename) {
   if (command == PACK) {
     return pack(filename);
   }
+  if (command == VERIFY) {
+    return verify(filename);
+  }
+  if (command == READ) {
+    return readMember(files, fileCount, filename);
+  }
+  if (command == BATCH) {
+    return batch(files, fileCount, filename);
+  }
 
   return 0;
 }
 
+/**
+ * @description: writes a range of a member to the standard output, from
+ * --offset N and up to --length M bytes, or up to the end of the member. The
+ * archive is read through libstar, which goes straight to the blocks of the
+ * range no matter where it starts.
+ * @parameter: (files) the member to be read
+ * @parameter: (fileCount) the amount of members received, it must be one
+ * @parameter: (filename) the tar filename to be read
+ * @output: the exit code
+ */
+int readMember(char *files[], int fileCount, char *filename) {
+  char message[100];
+
+  // stdout carries the data, so nothing else can be written there
+  isGlobalLogToStderr = true;
+
+  if (fileCount != 1) {
+    logError("--read needs the name of one member");
+    return 1;
+  }
+
+  struct star_archive *archive = starOpen(filename, false);
+
+  if (!archive) {
+    return 1;
+  }
+
+  struct star_stat stat;
+
+  if (starStat(archive, files[0], &stat) != 0) {
+    snprintf(message, 100, "%s is not in the archive", files[0]);
+    logError(message);
+    starClose(archive);
+    return 1;
+  }
+
+  char *buffer = malloc(READ_BUFFER_SIZE);
+  int result = buffer ? 0 : 1;
+  size_t bytesRead = 0;
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  while (result == 0 && bytesRead < globalReadLength) {
+    size_t length = globalReadLength - bytesRead;
+
+    if (length > READ_BUFFER_SIZE) {
+      length = READ_BUFFER_SIZE;
+    }
+
+    ssize_t chunk = starRead(archive, files[0], globalReadOffset + bytesRead,
+                             length, buffer);
+
+    if (chunk < 0 || fwrite(buffer, 1, chunk, stdout) != (size_t)chunk) {
+      result = 1;
+    }
+
+    if (chunk <= 0) {
+      break;
+    }
+
+    bytesRead += chunk;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  if (result == 0) {
+    double milliseconds = (end.tv_sec - start.tv_sec) * 1e3 +
+                          (end.tv_nsec - start.tv_nsec) / 1e6;
+
+    snprintf(message, 100, "read %zu bytes at %zu %s in %.2f ms", bytesRead,
+             globalReadOffset,
+             stat.isIndexed ? "with the block table" : "following the chain",
+             milliseconds);
+    logVerbose(message);
+  }
+
+  free(buffer);
+
+  if (starClose(archive) != 0) {
+    result = 1;
+  }
+
+  return result;
+}
+
 /**
  * @description: determines which flag is received
  * @parameter: (flag) the string flag, either in its long version or short
@@ -203,6 +400,62 @@ Flags determineFlag(char *flag) {
     return PACK;
   }
 
+  if (strcmp(flag, "--verify") == 0) {
+    return VERIFY;
+  }
+
+  if (strcmp(flag, "--read") == 0) {
+    return READ;
+  }
+
+  if (strcmp(flag, "--batch") == 0) {
+    return BATCH;
+  }
+
+  if (strcmp(flag, "--offset") == 0) {
+    return OFFSET;
+  }
+
+  if (strcmp(flag, "--length") == 0) {
+    return LENGTH;
+  }
+
+  if (strcmp(flag, "--extents") == 0) {
+    return EXTENTS;
+  }
+
+  if (strcmp(flag, "--mmap") == 0) {
+    return MAPPED_READ;
+  }
+
+  if (strcmp(flag, "--jobs") == 0) {
+    return JOBS;
+  }
+
+  if (strcmp(flag, "--direct") == 0) {
+    return DIRECT_IO;
+  }
+
+  if (strcmp(flag, "--async") == 0) {
+    return ASYNC_IO;
+  }
+
+  if (strcmp(flag, "--stream") == 0) {
+    return STREAM_OUTPUT;
+  }
+
+  if (strcmp(flag, "--compress") == 0 || flag[0] == 'z') {
+    return COMPRESS;
+  }
+
+  if (strcmp(flag, "--dedup") == 0) {
+    return DEDUP;
+  }
+
+  if (strcmp(flag, "--hash") == 0) {
+    return HASH_CHECK;
+  }
+
   return UNKNOWN;
 }
 
@@ -227,6 +480,59 @@ char *getOutFilename(int argumentCount, char *argumentList[]) {
   return NULL;
 }
 
+/**
+ * @description: retrieves the value given to an option, which is the argument
+ * right after it
+ * @parameter: (argumentCount) the amount of arguments received from command
+ * line
+ * @parameter: (argumentList) the arguments received from command line
+ * @parameter: (option) the option, like --jobs
+ * @output: the value of the option, NULL if there is none
+ */
+char *getOptionValue(int argumentCount, char *argumentList[], char *option) {
+  for (int i = 1; i + 1 < argumentCount; i++) {
+    if (strcmp(argumentList[i], option) == 0) {
+      return argumentList[i + 1];
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * @description: determines if a flag takes the next argument as its value
+ * @parameter: (flag) the string flag
+ * @output: true if the next argument is the value of the flag
+ */
+bool hasOptionValue(char *flag) {
+  return strcmp(flag, "--jobs") == 0 || strcmp(flag, "--offset") == 0 ||
+         strcmp(flag, "--length") == 0;
+}
+
+/**
+ * @description: reads the number of bytes given to an option
+ * @parameter: (value) the value of the option, NULL if there is none
+ * @parameter: (size) where the number is set
+ * @output: true if the value is a number
+ */
+bool parseSizeOption(char *value, size_t *size) {
+  char *end = NULL;
+
+  if (!value || value[0] < '0' || value[0] > '9') {
+    return false;
+  }
+
+  unsigned long long number = strtoull(value, &end, 10);
+
+  if (*end != '\0') {
+    return false;
+  }
+
+  *size = number;
+
+  return true;
+}
+
 /**
  * @description: set all the flags that the user passed as parameter
  * @parameter: (argumentCount) the amount of arguments received from command
@@ -263,16 +569,17 @@ void getFiles(int argumentCount, char *argumentList[], int *fileCount,
               char *files[]) {
   *fileCount = 0;
 
-  int startIndex = 2;
-
-  // just received "star" "<flag>" "<flag>"  "<files>..."
-  if (argumentCount >= 4) {
-    startIndex = 3;
-  }
-
-  for (int i = startIndex; i < argumentCount; i++) {
+  // flags and the tar file can be anywhere, so every argument is checked.
+  // Without a tar file the archive is streamed and the files come right after
+  // the flags.
+  for (int i = 1; i < argumentCount; i++) {
     bool isValidFlag = isFlag(argumentList[i]) || isLongFlag(argumentList[i]);
 
+    // the value of an option is not a file
+    if (hasOptionValue(argumentList[i - 1])) {
+      continue;
+    }
+
     if (!isValidFlag && !endsWithTar(argumentList[i])) {
       files[*fileCount] = argumentList[i];
       (*fileCount)++;
@@ -287,6 +594,21 @@ void getFiles(int argumentCount, char *argumentList[], int *fileCount,
  */
 bool isFlag(char *flag) { return flag[0] == '-' && flag[1] != '-'; }
 
+/**
+ * @description: determines if a flag changes how a command works instead of
+ * selecting the command
+ * @parameter: (flag) the flag enum
+ * @output: true if it is a modifier flag
+ */
+bool isModifierFlag(Flags flag) {
+  return flag == VERBOSE || flag == USE_FILE || flag == EXTENTS ||
+         flag == MAPPED_READ || flag == JOBS || flag == DIRECT_IO ||
+         flag == ASYNC_IO || flag == STREAM_OUTPUT ||
+         flag == COMPRESS || flag == DEDUP || flag == HASH_CHECK ||
+         flag == OFFSET ||
+         flag == LENGTH;
+}
+
 /**
  * @description: determines if it is a long flag
  * @parameter: (flag) the string flag
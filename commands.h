@@ -4,6 +4,13 @@
 #include "logs.h"
 
 #include <stdbool.h>
+#include <stddef.h>
+
+#define READ_BUFFER_SIZE (8 * 1024 * 1024) // bytes written at once by --read
+
+// the range of a member written by --read
+extern size_t globalReadOffset;
+extern size_t globalReadLength;
 
 typedef enum {
   CREATE = 0,
@@ -15,6 +22,20 @@ typedef enum {
   USE_FILE,
   APPEND,
   PACK,
+  VERIFY,
+  READ,
+  BATCH,
+  EXTENTS,
+  MAPPED_READ,
+  DIRECT_IO,
+  ASYNC_IO,
+  STREAM_OUTPUT,
+  COMPRESS,
+  DEDUP,
+  HASH_CHECK,
+  JOBS,
+  OFFSET,
+  LENGTH,
   HELP,
   UNKNOWN
 } Flags;
@@ -23,6 +44,9 @@ int handleCommands(int argumentCount, char *argumentList[]);
 
 int callCommands(Flags command, char *files[], int fileCount, char *filename);
 
+void logPeakMemory();
+int readMember(char *files[], int fileCount, char *filename);
+
 Flags getFromSimpleFlag(char *flag);
 Flags determineFlag(char *flag);
 void getFlags(int argumentCount, char *argumentList[], int *flagCount,
@@ -30,8 +54,12 @@ void getFlags(int argumentCount, char *argumentList[], int *flagCount,
 void getFiles(int argumentCount, char *argumentList[], int *fileCount,
               char *files[]);
 char *getOutFilename(int argumentCount, char *argumentList[]);
+char *getOptionValue(int argumentCount, char *argumentList[], char *option);
+bool hasOptionValue(char *flag);
+bool parseSizeOption(char *value, size_t *size);
 char *applyColor(const char *string, AnsiColor color);
 bool isFlag(char *flag);
+bool isModifierFlag(Flags flag);
 bool isLongFlag(char *flag);
 bool endsWithTar(const char *filename);
 
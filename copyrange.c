@@ -0,0 +1,146 @@
+#define _GNU_SOURCE
+#include "copyrange.h"
+#include "logs.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+
+#define COPY_BUFFER_SIZE (1024 * 64)
+
+// the first method that worked is kept for the rest of the copies. It is
+// shared by the extraction workers.
+static _Atomic CopyMethod selectedCopyMethod = COPY_FILE_RANGE;
+
+/**
+ * @description: copies a range between two files without changing their
+ * offsets. copy_file_range is tried first, then sendfile and then a buffered
+ * copy, moving to the next one when the kernel or the filesystem doesn't
+ * support it.
+ * @parameter: (inputFd) the file to read from
+ * @parameter: (inputOffset) the position of the range in the input
+ * @parameter: (outputFd) the file to write to
+ * @parameter: (outputOffset) the position where the range is written
+ * @parameter: (length) the amount of bytes to copy
+ * @output: the amount of bytes copied, less than length when the input ends,
+ * -1 on errors
+ */
+ssize_t copyRange(int inputFd, off_t inputOffset, int outputFd,
+                  off_t outputOffset, size_t length) {
+  size_t copiedTotal = 0;
+
+  while (copiedTotal < length) {
+    off_t inputPosition = inputOffset + copiedTotal;
+    off_t outputPosition = outputOffset + copiedTotal;
+    size_t remaining = length - copiedTotal;
+    ssize_t copied;
+
+    if (selectedCopyMethod == COPY_FILE_RANGE) {
+      copied = copy_file_range(inputFd, &inputPosition, outputFd,
+                               &outputPosition, remaining, 0);
+
+      if (copied < 0 && (errno == EXDEV || errno == ENOSYS ||
+                         errno == EINVAL || errno == EOPNOTSUPP)) {
+        fallbackCopyMethod(COPY_FILE_RANGE);
+        continue;
+      }
+    } else if (selectedCopyMethod == COPY_SENDFILE) {
+      // sendfile writes at the offset of the output
+      if (lseek(outputFd, outputPosition, SEEK_SET) < 0) {
+        fallbackCopyMethod(COPY_SENDFILE);
+        continue;
+      }
+
+      copied = sendfile(outputFd, inputFd, &inputPosition, remaining);
+
+      if (copied < 0 && (errno == EINVAL || errno == ENOSYS)) {
+        fallbackCopyMethod(COPY_SENDFILE);
+        continue;
+      }
+    } else {
+      copied = copyBuffered(inputFd, inputPosition, outputFd, outputPosition,
+                            remaining);
+    }
+
+    if (copied < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (copied < 0) {
+      return -1;
+    }
+
+    // the input has no more data
+    if (copied == 0) {
+      break;
+    }
+
+    copiedTotal += copied;
+  }
+
+  return copiedTotal;
+}
+
+/**
+ * @description: copies the start of a range reading it into a buffer
+ * @parameter: (inputFd) the file to read from
+ * @parameter: (inputOffset) the position of the range in the input
+ * @parameter: (outputFd) the file to write to
+ * @parameter: (outputOffset) the position where the range is written
+ * @parameter: (length) the amount of bytes to copy
+ * @output: the amount of bytes copied, 0 at the end of the input, -1 on
+ * errors
+ */
+ssize_t copyBuffered(int inputFd, off_t inputOffset, int outputFd,
+                     off_t outputOffset, size_t length) {
+  char buffer[COPY_BUFFER_SIZE];
+
+  if (length > COPY_BUFFER_SIZE) {
+    length = COPY_BUFFER_SIZE;
+  }
+
+  ssize_t bytesRead = pread(inputFd, buffer, length, inputOffset);
+
+  if (bytesRead <= 0) {
+    return bytesRead;
+  }
+
+  for (ssize_t written = 0; written < bytesRead;) {
+    ssize_t result = pwrite(outputFd, buffer + written, bytesRead - written,
+                            outputOffset + written);
+
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (result < 0) {
+      return -1;
+    }
+
+    written += result;
+  }
+
+  return bytesRead;
+}
+
+/**
+ * @description: moves to the next copy method after the current one failed
+ * @parameter: (failedMethod) the method that is not supported
+ * @output: n/a
+ */
+void fallbackCopyMethod(CopyMethod failedMethod) {
+  CopyMethod expected = failedMethod;
+
+  // only the first thread that sees a method fail moves to the next one
+  if (failedMethod == COPY_FILE_RANGE &&
+      atomic_compare_exchange_strong(&selectedCopyMethod, &expected,
+                                     COPY_SENDFILE)) {
+    logVerbose("copy_file_range is not supported, falling back to sendfile");
+  } else if (failedMethod == COPY_SENDFILE &&
+             atomic_compare_exchange_strong(&selectedCopyMethod, &expected,
+                                            COPY_BUFFERED)) {
+    logVerbose("sendfile is not supported, falling back to buffered copies");
+  }
+}
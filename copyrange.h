@@ -0,0 +1,20 @@
+#ifndef COPYRANGE_H
+#define COPYRANGE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+typedef enum { COPY_FILE_RANGE = 0, COPY_SENDFILE, COPY_BUFFERED } CopyMethod;
+
+// copies a range between two files, inside the kernel when possible
+ssize_t copyRange(int inputFd, off_t inputOffset, int outputFd,
+                  off_t outputOffset, size_t length);
+
+// copies part of a range reading it into a buffer
+ssize_t copyBuffered(int inputFd, off_t inputOffset, int outputFd,
+                     off_t outputOffset, size_t length);
+
+// falls back to the next copy method after the current one failed
+void fallbackCopyMethod(CopyMethod failedMethod);
+
+#endif
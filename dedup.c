@@ -0,0 +1,358 @@
+#include "dedup.h"
+#include "logs.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @description: spreads the bits of a hash so every bit of the input changes
+ * about half of the output
+ * @parameter: (hash) the value to mix
+ * @output: the mixed value
+ */
+uint64_t mixHash(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+
+  return hash;
+}
+
+/**
+ * @description: hashes the data of a block. It is read a word at a time in
+ * four independent lanes, so the multiplications of a lane don't wait for the
+ * others.
+ * @parameter: (data) the data of the block
+ * @parameter: (length) the amount of bytes of data
+ * @output: the hash of the data, never 0
+ */
+uint64_t hashBlockData(const char *data, size_t length) {
+  const uint64_t prime = 0x9e3779b97f4a7c15ULL;
+  uint64_t lanes[4] = {length, prime, ~length, prime ^ length};
+  size_t offset = 0;
+
+  for (; offset + sizeof(lanes) <= length; offset += sizeof(lanes)) {
+    for (int l = 0; l < 4; l++) {
+      uint64_t word;
+
+      memcpy(&word, data + offset + l * sizeof(word), sizeof(word));
+      lanes[l] = (lanes[l] ^ word) * prime;
+      lanes[l] ^= lanes[l] >> 29;
+    }
+  }
+
+  uint64_t hash = mixHash(lanes[0]) ^ mixHash(lanes[1] + 1) ^
+                  mixHash(lanes[2] + 2) ^ mixHash(lanes[3] + 3);
+
+  for (; offset < length; offset++) {
+    hash = (hash ^ (unsigned char)data[offset]) * prime;
+  }
+
+  hash = mixHash(hash);
+
+  return hash != 0 ? hash : 1;
+}
+
+/**
+ * @description: hashes a block together with the rest of its chain. The hash
+ * of the next block is used instead of its position, so the hashes stay the
+ * same when the archive is packed.
+ * @parameter: (dataHash) the hash of the data of the block
+ * @parameter: (nextHash) the hash of the next block, 0 for the last block
+ * @output: the hash of the block, never 0
+ */
+uint64_t hashBlockLink(uint64_t dataHash, uint64_t nextHash) {
+  uint64_t hash = mixHash(dataHash ^ mixHash(nextHash + 1));
+
+  return hash != 0 ? hash : 1;
+}
+
+/**
+ * @description: finds the slot that holds a certain block
+ * @parameter: (index) the dedup index
+ * @parameter: (block) the block index
+ * @output: the slot of the block, or the capacity if it is not in the slots
+ */
+size_t findDedupSlot(struct dedup_index *index, size_t block) {
+  size_t mask = index->capacity - 1;
+  size_t slot = index->hashes[block] & mask;
+
+  while (index->slots[slot] != 0) {
+    if (index->slots[slot] == block + 1) {
+      return slot;
+    }
+
+    slot = (slot + 1) & mask;
+  }
+
+  return index->capacity;
+}
+
+/**
+ * @description: places a block in the first empty slot for its hash
+ * @parameter: (index) the dedup index
+ * @parameter: (block) the block index
+ * @output: n/a
+ */
+void insertDedupSlot(struct dedup_index *index, size_t block) {
+  size_t mask = index->capacity - 1;
+  size_t slot = index->hashes[block] & mask;
+
+  while (index->slots[slot] != 0) {
+    slot = (slot + 1) & mask;
+  }
+
+  index->slots[slot] = block + 1;
+}
+
+/**
+ * @description: doubles the amount of slots, placing every block again. If
+ * there is an error in calloc it will exit the program.
+ * @parameter: (index) the dedup index
+ * @output: n/a
+ */
+void growDedupIndex(struct dedup_index *index) {
+  size_t *oldSlots = index->slots;
+  size_t oldCapacity = index->capacity;
+
+  index->capacity = oldCapacity > 0 ? oldCapacity * 2 : 1024;
+  index->slots = calloc(index->capacity, sizeof(size_t));
+
+  if (index->slots == NULL) {
+    logError("memory allocation for dedup index failed");
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t slot = 0; slot < oldCapacity; slot++) {
+    if (oldSlots[slot] != 0) {
+      insertDedupSlot(index, oldSlots[slot] - 1);
+    }
+  }
+
+  free(oldSlots);
+}
+
+/**
+ * @description: prepares an empty index, where every block is free and has
+ * no hash
+ * @parameter: (index) the dedup index to initialize
+ * @parameter: (blockCount) the amount of blocks in the archive
+ * @output: n/a
+ */
+void initDedupIndex(struct dedup_index *index, size_t blockCount) {
+  index->hashes = NULL;
+  index->refCounts = NULL;
+  index->blockCapacity = 0;
+  index->slots = NULL;
+  index->capacity = 0;
+  index->count = 0;
+
+  reserveDedupBlocks(index, blockCount);
+  growDedupIndex(index);
+}
+
+/**
+ * @description: releases the memory used by the index
+ * @parameter: (index) the dedup index to destroy
+ * @output: n/a
+ */
+void destroyDedupIndex(struct dedup_index *index) {
+  free(index->hashes);
+  free(index->refCounts);
+  free(index->slots);
+
+  index->hashes = NULL;
+  index->refCounts = NULL;
+  index->slots = NULL;
+  index->blockCapacity = 0;
+  index->capacity = 0;
+  index->count = 0;
+}
+
+/**
+ * @description: grows the arrays of the index so they can hold at least the
+ * amount of blocks requested. The new blocks are free and have no hash. If
+ * there is an error in realloc it will exit the program.
+ * @parameter: (index) the dedup index
+ * @parameter: (blocks) the minimum amount of blocks the index must hold
+ * @output: n/a
+ */
+void reserveDedupBlocks(struct dedup_index *index, size_t blocks) {
+  if (blocks <= index->blockCapacity) {
+    return;
+  }
+
+  size_t capacity = index->blockCapacity > 0 ? index->blockCapacity : 1024;
+
+  while (capacity < blocks) {
+    capacity *= 2;
+  }
+
+  uint64_t *hashes = realloc(index->hashes, capacity * sizeof(uint64_t));
+
+  if (hashes) {
+    index->hashes = hashes;
+  }
+
+  size_t *refCounts = realloc(index->refCounts, capacity * sizeof(size_t));
+
+  if (refCounts) {
+    index->refCounts = refCounts;
+  }
+
+  if (!hashes || !refCounts) {
+    logError("memory allocation for dedup index failed");
+    exit(EXIT_FAILURE);
+  }
+
+  size_t added = capacity - index->blockCapacity;
+
+  memset(hashes + index->blockCapacity, 0, added * sizeof(uint64_t));
+  memset(refCounts + index->blockCapacity, 0, added * sizeof(size_t));
+
+  index->blockCapacity = capacity;
+}
+
+/**
+ * @description: looks for a block by its hash
+ * @parameter: (index) the dedup index
+ * @parameter: (hash) the hash of the block and the rest of its chain
+ * @output: the block index, DEDUP_NO_BLOCK if there is none
+ */
+size_t findDedupBlock(struct dedup_index *index, uint64_t hash) {
+  size_t mask = index->capacity - 1;
+  size_t slot = hash & mask;
+
+  while (index->slots[slot] != 0) {
+    size_t block = index->slots[slot] - 1;
+
+    if (index->hashes[block] == hash) {
+      return block;
+    }
+
+    slot = (slot + 1) & mask;
+  }
+
+  return DEDUP_NO_BLOCK;
+}
+
+/**
+ * @description: adds a block just written for a member. Block 0 is never
+ * found by its hash, because a next pointer of 0 ends a chain and no other
+ * block can point to it. The index is kept at most half full so lookups stay
+ * short.
+ * @parameter: (index) the dedup index
+ * @parameter: (block) the block index
+ * @parameter: (hash) the hash of the block, 0 if it is not known
+ * @output: n/a
+ */
+void addDedupBlock(struct dedup_index *index, size_t block, uint64_t hash) {
+  reserveDedupBlocks(index, block + 1);
+
+  index->hashes[block] = hash;
+  index->refCounts[block] = 1;
+
+  if (hash == 0 || block == 0) {
+    return;
+  }
+
+  if ((index->count + 1) * 2 > index->capacity) {
+    growDedupIndex(index);
+  }
+
+  insertDedupSlot(index, block);
+  index->count++;
+}
+
+/**
+ * @description: adds a member to the ones that use a block
+ * @parameter: (index) the dedup index
+ * @parameter: (block) the block index
+ * @output: n/a
+ */
+void retainDedupBlock(struct dedup_index *index, size_t block) {
+  reserveDedupBlocks(index, block + 1);
+
+  index->refCounts[block]++;
+}
+
+/**
+ * @description: removes a member from the ones that use a block. When no
+ * member is left the block leaves the slots, and the ones after it in the same
+ * probe sequence are shifted back, so no tombstones are needed.
+ * @parameter: (index) the dedup index
+ * @parameter: (block) the block index
+ * @output: true when the block is not used anymore
+ */
+bool releaseDedupBlock(struct dedup_index *index, size_t block) {
+  if (block >= index->blockCapacity || index->refCounts[block] == 0) {
+    return true;
+  }
+
+  if (--index->refCounts[block] > 0) {
+    return false;
+  }
+
+  size_t mask = index->capacity - 1;
+  size_t hole = index->hashes[block] != 0 ? findDedupSlot(index, block)
+                                          : index->capacity;
+
+  index->hashes[block] = 0;
+
+  if (hole == index->capacity) {
+    return true;
+  }
+
+  index->slots[hole] = 0;
+  index->count--;
+
+  for (size_t slot = (hole + 1) & mask; index->slots[slot] != 0;
+       slot = (slot + 1) & mask) {
+    size_t home = index->hashes[index->slots[slot] - 1] & mask;
+
+    // blocks whose home is between the hole and their slot can't move
+    if (((slot - home) & mask) < ((slot - hole) & mask)) {
+      continue;
+    }
+
+    index->slots[hole] = index->slots[slot];
+    index->slots[slot] = 0;
+    hole = slot;
+  }
+
+  return true;
+}
+
+/**
+ * @description: moves every block to its new position after the archive is
+ * packed. The slots are built again, since the position is part of them.
+ * @parameter: (index) the dedup index
+ * @parameter: (remap) the new position of each block, any position past the
+ * new amount of blocks when the block is not in use
+ * @parameter: (blockCount) the amount of blocks before packing
+ * @parameter: (newBlockCount) the amount of blocks after packing
+ * @output: n/a
+ */
+void remapDedupIndex(struct dedup_index *index, size_t *remap,
+                     size_t blockCount, size_t newBlockCount) {
+  struct dedup_index packed;
+
+  initDedupIndex(&packed, newBlockCount);
+
+  for (size_t block = 0; block < blockCount && block < index->blockCapacity;
+       block++) {
+    if (remap[block] >= newBlockCount || index->refCounts[block] == 0) {
+      continue;
+    }
+
+    addDedupBlock(&packed, remap[block], index->hashes[block]);
+    packed.refCounts[remap[block]] = index->refCounts[block];
+  }
+
+  destroyDedupIndex(index);
+  *index = packed;
+}
@@ -0,0 +1,59 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DEDUP_NO_BLOCK ((size_t)-1) // returned when no block has the hash
+
+// The blocks of an archive that stores identical blocks once. Every block
+// has the hash of its data and of the rest of its chain, and the amount of
+// members whose chain goes through it. The slots find a block by its hash.
+struct dedup_index {
+  uint64_t *hashes;     // hash of each block, 0 when it is not known
+  size_t *refCounts;    // members that use each block, 0 when it is free
+  size_t blockCapacity; // amount of blocks the arrays can hold
+  size_t *slots;        // block plus one, 0 when the slot is empty
+  size_t capacity;      // amount of slots, always a power of two
+  size_t count;         // amount of blocks in the slots
+};
+
+// prepares an empty index for a certain amount of blocks
+void initDedupIndex(struct dedup_index *index, size_t blockCount);
+
+// releases the memory used by the index
+void destroyDedupIndex(struct dedup_index *index);
+
+// grows the index to hold at least a certain amount of blocks
+void reserveDedupBlocks(struct dedup_index *index, size_t blocks);
+
+// hashes the data of a block
+uint64_t hashBlockData(const char *data, size_t length);
+
+// hashes a block together with the hash of the rest of its chain
+uint64_t hashBlockLink(uint64_t dataHash, uint64_t nextHash);
+
+// returns a block with a certain hash, DEDUP_NO_BLOCK if there is none
+size_t findDedupBlock(struct dedup_index *index, uint64_t hash);
+
+// adds a new block used by one member
+void addDedupBlock(struct dedup_index *index, size_t block, uint64_t hash);
+
+// adds a member to the ones that use a block
+void retainDedupBlock(struct dedup_index *index, size_t block);
+
+// removes a member from the ones that use a block, true when none is left
+bool releaseDedupBlock(struct dedup_index *index, size_t block);
+
+// moves every block to a new position, dropping the ones not in use
+void remapDedupIndex(struct dedup_index *index, size_t *remap,
+                     size_t blockCount, size_t newBlockCount);
+
+// internal helpers of the index
+size_t findDedupSlot(struct dedup_index *index, size_t block);
+void insertDedupSlot(struct dedup_index *index, size_t block);
+void growDedupIndex(struct dedup_index *index);
+uint64_t mixHash(uint64_t hash);
+
+#endif
@@ -0,0 +1,163 @@
+#define _GNU_SOURCE
+#include "directio.h"
+#include "logs.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @description: opens a file with O_DIRECT, so its data goes between the disk
+ * and the buffers of the program without passing through the page cache.
+ * Some filesystems, like tmpfs, don't support it.
+ * @parameter: (path) the file to open
+ * @parameter: (flags) the open flags, O_DIRECT is added to them
+ * @output: the file descriptor, -1 when the file can't be opened that way
+ */
+int openDirect(const char *path, int flags) {
+  char message[100];
+  int fd = open(path, flags | O_DIRECT | O_CLOEXEC);
+
+  if (fd < 0) {
+    snprintf(message, sizeof(message),
+             "direct I/O is not available (%s), using the page cache",
+             strerror(errno));
+    logWarning(message);
+  }
+
+  return fd;
+}
+
+/**
+ * @description: reads a range of a file, retrying when the kernel returns
+ * less than requested. With O_DIRECT the buffer, the offset and the length
+ * must be aligned to DIRECT_IO_ALIGNMENT.
+ * @parameter: (fd) the file to read from
+ * @parameter: (buffer) where the data is read
+ * @parameter: (length) the amount of bytes to read
+ * @parameter: (offset) the position of the range in the file
+ * @output: the amount of bytes read, less than length when the file ends, -1
+ * on errors
+ */
+ssize_t preadFull(int fd, void *buffer, size_t length, off_t offset) {
+  size_t done = 0;
+
+  while (done < length) {
+    ssize_t result = pread(fd, (char *)buffer + done, length - done,
+                           offset + done);
+
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (result < 0) {
+      return -1;
+    }
+
+    if (result == 0) {
+      break;
+    }
+
+    done += result;
+  }
+
+  return done;
+}
+
+/**
+ * @description: writes a whole range of a file, retrying when the kernel
+ * writes less than requested
+ * @parameter: (fd) the file to write to
+ * @parameter: (buffer) the data to write
+ * @parameter: (length) the amount of bytes to write
+ * @parameter: (offset) the position of the range in the file
+ * @output: the amount of bytes written, -1 on errors
+ */
+ssize_t pwriteFull(int fd, const void *buffer, size_t length, off_t offset) {
+  size_t done = 0;
+
+  while (done < length) {
+    ssize_t result = pwrite(fd, (const char *)buffer + done, length - done,
+                            offset + done);
+
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (result <= 0) {
+      return -1;
+    }
+
+    done += result;
+  }
+
+  return done;
+}
+
+/**
+ * @description: asks the kernel to drop a range of a file from the page
+ * cache. Only clean pages are dropped, pages still being written stay.
+ * @parameter: (fd) the file
+ * @parameter: (offset) the first byte of the range
+ * @parameter: (length) the amount of bytes of the range
+ * @output: n/a
+ */
+void dropCachedRange(int fd, off_t offset, size_t length) {
+  posix_fadvise(fd, offset, length, POSIX_FADV_DONTNEED);
+}
+
+/**
+ * @description: frees the disk space of a range of a file, keeping its size.
+ * The range reads as zeros afterwards. Filesystems without holes keep the
+ * space, which is only a waste.
+ * @parameter: (fd) the file
+ * @parameter: (offset) the first byte of the range
+ * @parameter: (length) the amount of bytes of the range
+ * @output: n/a
+ */
+void punchHole(int fd, off_t offset, size_t length) {
+  fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, length);
+}
+
+/**
+ * @description: counts the pages of a file that are in the page cache. The
+ * file is mapped without reading it and mincore tells which pages are there.
+ * @parameter: (fd) the file
+ * @output: the amount of bytes in the page cache, 0 if it can't be measured
+ */
+size_t cachedBytes(int fd) {
+  struct stat status;
+
+  if (fstat(fd, &status) != 0 || status.st_size <= 0) {
+    return 0;
+  }
+
+  size_t pageSize = sysconf(_SC_PAGESIZE);
+  size_t length = status.st_size;
+  size_t pages = (length + pageSize - 1) / pageSize;
+
+  void *data = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+
+  if (data == MAP_FAILED) {
+    return 0;
+  }
+
+  unsigned char *residency = malloc(pages);
+  size_t cachedPages = 0;
+
+  if (residency && mincore(data, length, residency) == 0) {
+    for (size_t page = 0; page < pages; page++) {
+      cachedPages += residency[page] & 1;
+    }
+  }
+
+  free(residency);
+  munmap(data, length);
+
+  return cachedPages * pageSize;
+}
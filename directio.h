@@ -0,0 +1,28 @@
+#ifndef DIRECTIO_H
+#define DIRECTIO_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// every offset and length of a direct transfer must be a multiple of this
+#define DIRECT_IO_ALIGNMENT 4096
+
+// opens a file bypassing the page cache, -1 when it is not supported
+int openDirect(const char *path, int flags);
+
+// reads a range of a file as long as the file has data, retrying short reads
+ssize_t preadFull(int fd, void *buffer, size_t length, off_t offset);
+
+// writes a whole range of a file, retrying short writes
+ssize_t pwriteFull(int fd, const void *buffer, size_t length, off_t offset);
+
+// asks the kernel to drop a range of a file from the page cache
+void dropCachedRange(int fd, off_t offset, size_t length);
+
+// frees the disk space of a range of a file, keeping its size
+void punchHole(int fd, off_t offset, size_t length);
+
+// returns how many bytes of a file are in the page cache
+size_t cachedBytes(int fd);
+
+#endif
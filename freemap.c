@@ -0,0 +1,267 @@
+#include "freemap.h"
+#include "logs.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @description: grows the bitmap so it can hold at least the amount of blocks
+ * requested. If there is an error in realloc it will exit the program.
+ * @parameter: (map) the free map to grow
+ * @parameter: (blocks) the minimum amount of blocks the map must hold
+ * @output: n/a
+ */
+void reserveFreeMap(struct free_map *map, size_t blocks) {
+  if (blocks <= map->capacity) {
+    return;
+  }
+
+  size_t capacity = map->capacity > 0 ? map->capacity : 1024;
+
+  while (capacity < blocks) {
+    capacity *= 2;
+  }
+
+  unsigned char *bits = realloc(map->bits, capacity / 8);
+
+  if (bits == NULL) {
+    logError("memory allocation for free map failed");
+    exit(EXIT_FAILURE);
+  }
+
+  memset(bits + map->capacity / 8, 0, (capacity - map->capacity) / 8);
+
+  map->bits = bits;
+  map->capacity = capacity;
+}
+
+/**
+ * @description: prepares a free map for a certain amount of blocks. All the
+ * blocks start as used.
+ * @parameter: (map) the free map to initialize
+ * @parameter: (blockCount) the amount of blocks in the archive
+ * @output: n/a
+ */
+void initFreeMap(struct free_map *map, size_t blockCount) {
+  map->bits = NULL;
+  map->capacity = 0;
+  map->freeCount = 0;
+  map->cursor = 1;
+  map->blockCount = blockCount;
+  map->preferRuns = false;
+
+  reserveFreeMap(map, blockCount);
+}
+
+/**
+ * @description: releases the memory used by a free map
+ * @parameter: (map) the free map to destroy
+ * @output: n/a
+ */
+void destroyFreeMap(struct free_map *map) {
+  free(map->bits);
+
+  map->bits = NULL;
+  map->capacity = 0;
+  map->blockCount = 0;
+  map->freeCount = 0;
+}
+
+/**
+ * @description: determines if a block is free
+ * @parameter: (map) the free map
+ * @parameter: (block) the block index
+ * @output: true if the block is free
+ */
+bool isBlockFree(struct free_map *map, size_t block) {
+  if (block >= map->blockCount) {
+    return false;
+  }
+
+  return (map->bits[block / 8] >> (block % 8)) & 1;
+}
+
+/**
+ * @description: returns a free block and marks it as used. Block 0 is never
+ * recycled because a next pointer of 0 means the end of a chain, so it is only
+ * handed out as the first block of an empty archive. When there are no free
+ * blocks the archive grows by one block.
+ * @parameter: (map) the free map
+ * @output: the index of the allocated block
+ */
+size_t allocateBlock(struct free_map *map) {
+  if (map->freeCount > 0) {
+    size_t byte = map->cursor / 8;
+    size_t lastByte = (map->blockCount + 7) / 8;
+
+    // every block below the cursor is used, so whole bytes can be skipped
+    for (; byte < lastByte; byte++) {
+      unsigned char bits = map->bits[byte];
+
+      if (byte == 0) {
+        bits &= ~1; // block 0 can't be recycled
+      }
+
+      if (bits == 0) {
+        continue;
+      }
+
+      size_t block = byte * 8 + __builtin_ctz(bits);
+
+      markBlockUsed(map, block);
+      map->cursor = block + 1;
+
+      return block;
+    }
+  }
+
+  size_t block = map->blockCount;
+
+  reserveFreeMap(map, block + 1);
+  map->blockCount++;
+
+  return block;
+}
+
+/**
+ * @description: finds the first run of free blocks long enough to hold a whole
+ * file and marks its first block as used. The rest of the run stays free and
+ * is taken block by block with allocateBlockAfter. When there is no run long
+ * enough, the run starts at the free blocks at the end of the archive.
+ * @parameter: (map) the free map
+ * @parameter: (length) the amount of blocks the file needs
+ * @output: the index of the first block of the run
+ */
+size_t allocateRun(struct free_map *map, size_t length) {
+  size_t runStart = 0;
+  size_t runLength = 0;
+
+  for (size_t block = map->cursor; block < map->blockCount; block++) {
+    // whole bytes without free blocks are skipped
+    if (block % 8 == 0 && map->bits[block / 8] == 0) {
+      runLength = 0;
+      block += 7;
+      continue;
+    }
+
+    if (!isBlockFree(map, block)) {
+      runLength = 0;
+      continue;
+    }
+
+    if (runLength == 0) {
+      runStart = block;
+    }
+
+    if (++runLength >= length) {
+      allocateBlockAt(map, runStart);
+      return runStart;
+    }
+  }
+
+  // the free blocks at the end can be extended as much as needed
+  size_t block = runLength > 0 ? runStart : map->blockCount;
+
+  allocateBlockAt(map, block);
+
+  return block;
+}
+
+/**
+ * @description: allocates the block right after a certain block, so the file
+ * stays contiguous. If that block is in use, any free block is returned.
+ * @parameter: (map) the free map
+ * @parameter: (previous) the block the new one should follow
+ * @output: the index of the allocated block
+ */
+size_t allocateBlockAfter(struct free_map *map, size_t previous) {
+  size_t block = previous + 1;
+
+  if (block == map->blockCount || isBlockFree(map, block)) {
+    allocateBlockAt(map, block);
+    return block;
+  }
+
+  return allocateBlock(map);
+}
+
+/**
+ * @description: marks a certain block as used. If the block is after the end
+ * of the archive, the archive grows and the blocks in between become free.
+ * @parameter: (map) the free map
+ * @parameter: (block) the block index to allocate
+ * @output: n/a
+ */
+void allocateBlockAt(struct free_map *map, size_t block) {
+  if (block >= map->blockCount) {
+    size_t firstNewBlock = map->blockCount;
+
+    reserveFreeMap(map, block + 1);
+    map->blockCount = block + 1;
+
+    for (size_t gap = firstNewBlock; gap < block; gap++) {
+      releaseBlock(map, gap);
+    }
+
+    return;
+  }
+
+  markBlockUsed(map, block);
+}
+
+/**
+ * @description: marks a block as free so it can be recycled
+ * @parameter: (map) the free map
+ * @parameter: (block) the block index to release
+ * @output: n/a
+ */
+void releaseBlock(struct free_map *map, size_t block) {
+  if (block >= map->blockCount || isBlockFree(map, block)) {
+    return;
+  }
+
+  map->bits[block / 8] |= 1 << (block % 8);
+  map->freeCount++;
+
+  if (block > 0 && block < map->cursor) {
+    map->cursor = block;
+  }
+}
+
+/**
+ * @description: marks a block as used
+ * @parameter: (map) the free map
+ * @parameter: (block) the block index to mark
+ * @output: n/a
+ */
+void markBlockUsed(struct free_map *map, size_t block) {
+  if (!isBlockFree(map, block)) {
+    return;
+  }
+
+  map->bits[block / 8] &= ~(1 << (block % 8));
+  map->freeCount--;
+}
+
+/**
+ * @description: drops the free blocks at the end of the map, so the archive
+ * can be truncated to the new block count
+ * @parameter: (map) the free map
+ * @output: the amount of blocks removed
+ */
+size_t trimFreeBlocks(struct free_map *map) {
+  size_t removed = 0;
+
+  while (map->blockCount > 0 && isBlockFree(map, map->blockCount - 1)) {
+    markBlockUsed(map, map->blockCount - 1);
+    map->blockCount--;
+    removed++;
+  }
+
+  if (map->cursor > map->blockCount) {
+    map->cursor = map->blockCount > 1 ? map->blockCount : 1;
+  }
+
+  return removed;
+}
@@ -0,0 +1,49 @@
+#ifndef FREEMAP_H
+#define FREEMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct free_map {
+  unsigned char *bits; // one bit per block, set when the block is free
+  size_t blockCount;   // amount of blocks present in the archive
+  size_t capacity;     // amount of blocks the bitmap can hold
+  size_t freeCount;    // amount of free blocks below blockCount
+  size_t cursor;       // every block below this position is in use
+  bool preferRuns;     // keep the blocks of a file contiguous when possible
+};
+
+// prepares a map for blockCount blocks, all of them in use
+void initFreeMap(struct free_map *map, size_t blockCount);
+
+// releases the memory used by the map
+void destroyFreeMap(struct free_map *map);
+
+// grows the bitmap to hold at least a certain amount of blocks
+void reserveFreeMap(struct free_map *map, size_t blocks);
+
+// returns a free block, growing the archive when there is none
+size_t allocateBlock(struct free_map *map);
+
+// returns the first block of a free run long enough for a file
+size_t allocateRun(struct free_map *map, size_t length);
+
+// returns the block after a certain one if it is free, any free block if not
+size_t allocateBlockAfter(struct free_map *map, size_t previous);
+
+// marks a certain block as used, growing the archive if needed
+void allocateBlockAt(struct free_map *map, size_t block);
+
+// marks a block as free so it can be allocated again
+void releaseBlock(struct free_map *map, size_t block);
+
+// marks a block as in use
+void markBlockUsed(struct free_map *map, size_t block);
+
+// determines if a block is free
+bool isBlockFree(struct free_map *map, size_t block);
+
+// drops the free blocks at the end of the map
+size_t trimFreeBlocks(struct free_map *map);
+
+#endif
@@ -0,0 +1,452 @@
+#include "ioengine.h"
+#include "directio.h"
+#include "logs.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * @description: starts an engine that keeps many reads and writes in flight.
+ * io_uring is used when the kernel has it and allows it, otherwise a pool of
+ * threads does the transfers with pread and pwrite.
+ * @parameter: (engine) the engine to initialize
+ * @parameter: (depth) the maximum amount of requests in flight
+ * @output: the exit code
+ */
+int initIOEngine(struct io_engine *engine, unsigned depth) {
+  char message[100];
+
+  memset(engine, 0, sizeof(*engine));
+  engine->depth = depth;
+  engine->ringFd = -1;
+
+  if (initIOUring(engine, depth) == 0) {
+    snprintf(message, sizeof(message),
+             "I/O engine: io_uring with %u requests in flight", depth);
+    logVerbose(message);
+    return 0;
+  }
+
+  if (initIOThreads(engine, depth) == 0) {
+    snprintf(message, sizeof(message),
+             "I/O engine: %d threads with %u requests in flight",
+             engine->workerCount, depth);
+    logVerbose(message);
+    return 0;
+  }
+
+  logError("the I/O engine couldn't be started.");
+  return 1;
+}
+
+/**
+ * @description: waits for the requests still in flight and releases the
+ * engine. The completions are dropped.
+ * @parameter: (engine) the engine to destroy
+ * @output: n/a
+ */
+void destroyIOEngine(struct io_engine *engine) {
+  while (engine->inFlight > 0 && waitIO(engine) != NULL) {
+  }
+
+  if (engine->backend == IO_URING) {
+    destroyIOUring(engine);
+  } else {
+    destroyIOThreads(engine);
+  }
+}
+
+/**
+ * @description: queues a request. The caller must not have more than depth
+ * requests in flight, every one of them is returned by waitIO.
+ * @parameter: (engine) the engine
+ * @parameter: (request) the read or write to do
+ * @output: n/a
+ */
+void submitIO(struct io_engine *engine, struct io_request *request) {
+  engine->inFlight++;
+
+  if (engine->backend == IO_URING) {
+    submitIOUring(engine, request);
+  } else {
+    submitIOThreads(engine, request);
+  }
+}
+
+/**
+ * @description: waits until a request completes. Short transfers are
+ * finished with pread and pwrite, so a read only returns less than its
+ * length at the end of the file.
+ * @parameter: (engine) the engine
+ * @output: the completed request, NULL when there are none in flight
+ */
+struct io_request *waitIO(struct io_engine *engine) {
+  if (engine->inFlight == 0) {
+    return NULL;
+  }
+
+  struct io_request *request = engine->backend == IO_URING
+                                   ? waitIOUring(engine)
+                                   : waitIOThreads(engine);
+
+  if (request) {
+    engine->inFlight--;
+  }
+
+  return request;
+}
+
+/**
+ * @description: does the rest of a transfer with pread or pwrite
+ * @parameter: (request) the request
+ * @parameter: (done) the amount of bytes already transferred
+ * @output: n/a
+ */
+void runRequest(struct io_request *request, size_t done) {
+  char *buffer = (char *)request->buffer + done;
+  size_t length = request->length - done;
+  off_t offset = request->offset + done;
+
+  ssize_t result = request->isWrite
+                       ? pwriteFull(request->fd, buffer, length, offset)
+                       : preadFull(request->fd, buffer, length, offset);
+
+  request->result = result < 0 ? -errno : (ssize_t)done + result;
+}
+
+/**
+ * ------------------------------------------
+ *          IO_URING BACKEND
+ * ------------------------------------------
+ */
+
+/**
+ * @description: creates the rings shared with the kernel. liburing is not
+ * used, the rings are mapped with the raw system calls.
+ * @parameter: (engine) the engine
+ * @parameter: (depth) the amount of entries of the submission ring
+ * @output: the exit code, not 0 when io_uring is not available
+ */
+int initIOUring(struct io_engine *engine, unsigned depth) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+
+  int ringFd = syscall(__NR_io_uring_setup, depth, &params);
+
+  if (ringFd < 0) {
+    return 1;
+  }
+
+  engine->backend = IO_URING;
+  engine->ringFd = ringFd;
+  engine->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  engine->cqRingSize =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  engine->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+  // newer kernels share one mapping for both rings
+  bool isSingleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+
+  if (isSingleMap && engine->cqRingSize > engine->sqRingSize) {
+    engine->sqRingSize = engine->cqRingSize;
+  }
+
+  engine->sqRing = mmap(NULL, engine->sqRingSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+  engine->cqRing =
+      isSingleMap ? engine->sqRing
+                  : mmap(NULL, engine->cqRingSize, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+  engine->sqes = mmap(NULL, engine->sqesSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+
+  if (engine->sqRing == MAP_FAILED || engine->cqRing == MAP_FAILED ||
+      engine->sqes == MAP_FAILED) {
+    destroyIOUring(engine);
+    return 1;
+  }
+
+  char *sq = engine->sqRing;
+  char *cq = engine->cqRing;
+
+  engine->sqHead = (unsigned *)(sq + params.sq_off.head);
+  engine->sqTail = (unsigned *)(sq + params.sq_off.tail);
+  engine->sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+  engine->sqArray = (unsigned *)(sq + params.sq_off.array);
+  engine->cqHead = (unsigned *)(cq + params.cq_off.head);
+  engine->cqTail = (unsigned *)(cq + params.cq_off.tail);
+  engine->cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+  engine->cqes = cq + params.cq_off.cqes;
+
+  return 0;
+}
+
+/**
+ * @description: unmaps the rings and closes the io_uring
+ * @parameter: (engine) the engine
+ * @output: n/a
+ */
+void destroyIOUring(struct io_engine *engine) {
+  if (engine->sqes && engine->sqes != MAP_FAILED) {
+    munmap(engine->sqes, engine->sqesSize);
+  }
+
+  if (engine->cqRing && engine->cqRing != MAP_FAILED &&
+      engine->cqRing != engine->sqRing) {
+    munmap(engine->cqRing, engine->cqRingSize);
+  }
+
+  if (engine->sqRing && engine->sqRing != MAP_FAILED) {
+    munmap(engine->sqRing, engine->sqRingSize);
+  }
+
+  close(engine->ringFd);
+  engine->ringFd = -1;
+}
+
+/**
+ * @description: places a request in the submission ring. The kernel sees it
+ * the next time the engine waits for a completion.
+ * @parameter: (engine) the engine
+ * @parameter: (request) the read or write to do
+ * @output: n/a
+ */
+void submitIOUring(struct io_engine *engine, struct io_request *request) {
+  unsigned tail = *engine->sqTail;
+  unsigned index = tail & *engine->sqMask;
+  struct io_uring_sqe *sqe = (struct io_uring_sqe *)engine->sqes + index;
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = request->isWrite ? IORING_OP_WRITE : IORING_OP_READ;
+  sqe->fd = request->fd;
+  sqe->addr = (unsigned long)request->buffer;
+  sqe->len = request->length;
+  sqe->off = request->offset;
+  sqe->user_data = (unsigned long)request;
+
+  engine->sqArray[index] = index;
+
+  // the entry must be complete before the kernel sees the new tail
+  __atomic_store_n(engine->sqTail, tail + 1, __ATOMIC_RELEASE);
+  engine->toSubmit++;
+}
+
+/**
+ * @description: hands the queued requests to the kernel and takes the next
+ * completion, sleeping until there is one
+ * @parameter: (engine) the engine
+ * @output: the completed request, NULL on errors
+ */
+struct io_request *waitIOUring(struct io_engine *engine) {
+  char message[100];
+
+  // new requests go to the kernel before the completions already there are
+  // taken, so the device doesn't wait for the caller
+  if (engine->toSubmit > 0) {
+    int submitted = syscall(__NR_io_uring_enter, engine->ringFd,
+                            engine->toSubmit, 0, 0, NULL, 0);
+
+    if (submitted > 0) {
+      engine->toSubmit -= submitted;
+    }
+  }
+
+  while (true) {
+    unsigned head = *engine->cqHead;
+
+    if (head != __atomic_load_n(engine->cqTail, __ATOMIC_ACQUIRE)) {
+      struct io_uring_cqe *cqe =
+          (struct io_uring_cqe *)engine->cqes + (head & *engine->cqMask);
+      struct io_request *request = (struct io_request *)cqe->user_data;
+
+      request->result = cqe->res;
+      __atomic_store_n(engine->cqHead, head + 1, __ATOMIC_RELEASE);
+
+      // kernels without IORING_OP_READ and IORING_OP_WRITE answer EINVAL
+      if (request->result == -EINVAL) {
+        runRequest(request, 0);
+      } else if (request->result >= 0 &&
+                 (size_t)request->result < request->length) {
+        runRequest(request, request->result);
+      }
+
+      return request;
+    }
+
+    // the queued requests go to the kernel in the same call that waits
+    int submitted = syscall(__NR_io_uring_enter, engine->ringFd,
+                            engine->toSubmit, 1, IORING_ENTER_GETEVENTS, NULL,
+                            0);
+
+    if (submitted < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+        continue;
+      }
+
+      snprintf(message, sizeof(message), "io_uring failed (%s)",
+               strerror(errno));
+      logError(message);
+      return NULL;
+    }
+
+    engine->toSubmit -= submitted;
+  }
+}
+
+/**
+ * ------------------------------------------
+ *          THREAD POOL BACKEND
+ * ------------------------------------------
+ */
+
+/**
+ * @description: starts a pool of threads that do the requests with pread and
+ * pwrite, for kernels without io_uring or where it is disabled
+ * @parameter: (engine) the engine
+ * @parameter: (depth) the maximum amount of requests in flight
+ * @output: the exit code
+ */
+int initIOThreads(struct io_engine *engine, unsigned depth) {
+  engine->backend = IO_THREADS;
+  engine->queued = calloc(depth, sizeof(struct io_request *));
+  engine->completed = calloc(depth, sizeof(struct io_request *));
+
+  if (!engine->queued || !engine->completed) {
+    free(engine->queued);
+    free(engine->completed);
+    return 1;
+  }
+
+  pthread_mutex_init(&engine->lock, NULL);
+  pthread_cond_init(&engine->hasRequests, NULL);
+  pthread_cond_init(&engine->hasCompletions, NULL);
+
+  for (int w = 0; w < IO_THREAD_COUNT && (unsigned)w < depth; w++) {
+    if (pthread_create(&engine->workers[w], NULL, ioWorker, engine) != 0) {
+      break;
+    }
+
+    engine->workerCount++;
+  }
+
+  if (engine->workerCount == 0) {
+    destroyIOThreads(engine);
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * @description: stops the threads of the pool and releases its queues
+ * @parameter: (engine) the engine
+ * @output: n/a
+ */
+void destroyIOThreads(struct io_engine *engine) {
+  pthread_mutex_lock(&engine->lock);
+  engine->isStopping = true;
+  pthread_cond_broadcast(&engine->hasRequests);
+  pthread_mutex_unlock(&engine->lock);
+
+  for (int w = 0; w < engine->workerCount; w++) {
+    pthread_join(engine->workers[w], NULL);
+  }
+
+  pthread_cond_destroy(&engine->hasRequests);
+  pthread_cond_destroy(&engine->hasCompletions);
+  pthread_mutex_destroy(&engine->lock);
+
+  free(engine->queued);
+  free(engine->completed);
+  engine->workerCount = 0;
+}
+
+/**
+ * @description: queues a request for the threads of the pool
+ * @parameter: (engine) the engine
+ * @parameter: (request) the read or write to do
+ * @output: n/a
+ */
+void submitIOThreads(struct io_engine *engine, struct io_request *request) {
+  pthread_mutex_lock(&engine->lock);
+
+  size_t tail = (engine->queuedHead + engine->queuedCount) % engine->depth;
+
+  engine->queued[tail] = request;
+  engine->queuedCount++;
+
+  pthread_cond_signal(&engine->hasRequests);
+  pthread_mutex_unlock(&engine->lock);
+}
+
+/**
+ * @description: waits until a thread of the pool completes a request
+ * @parameter: (engine) the engine
+ * @output: the completed request
+ */
+struct io_request *waitIOThreads(struct io_engine *engine) {
+  pthread_mutex_lock(&engine->lock);
+
+  while (engine->completedCount == 0) {
+    pthread_cond_wait(&engine->hasCompletions, &engine->lock);
+  }
+
+  struct io_request *request = engine->completed[engine->completedHead];
+
+  engine->completedHead = (engine->completedHead + 1) % engine->depth;
+  engine->completedCount--;
+
+  pthread_mutex_unlock(&engine->lock);
+
+  return request;
+}
+
+/**
+ * @description: takes requests from the queue of the pool and does them
+ * until the engine stops
+ * @parameter: (argument) the io_engine
+ * @output: NULL
+ */
+void *ioWorker(void *argument) {
+  struct io_engine *engine = argument;
+
+  pthread_mutex_lock(&engine->lock);
+
+  while (true) {
+    while (engine->queuedCount == 0 && !engine->isStopping) {
+      pthread_cond_wait(&engine->hasRequests, &engine->lock);
+    }
+
+    if (engine->queuedCount == 0) {
+      break;
+    }
+
+    struct io_request *request = engine->queued[engine->queuedHead];
+
+    engine->queuedHead = (engine->queuedHead + 1) % engine->depth;
+    engine->queuedCount--;
+
+    pthread_mutex_unlock(&engine->lock);
+    runRequest(request, 0);
+    pthread_mutex_lock(&engine->lock);
+
+    size_t tail =
+        (engine->completedHead + engine->completedCount) % engine->depth;
+
+    engine->completed[tail] = request;
+    engine->completedCount++;
+
+    pthread_cond_signal(&engine->hasCompletions);
+  }
+
+  pthread_mutex_unlock(&engine->lock);
+
+  return NULL;
+}
@@ -0,0 +1,73 @@
+#ifndef IOENGINE_H
+#define IOENGINE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define IO_THREAD_COUNT 8 // workers of the thread pool used without io_uring
+
+typedef enum { IO_URING = 0, IO_THREADS } IOBackend;
+
+// A positioned read or write handed to the engine. It must stay in memory
+// until the engine returns it as completed.
+struct io_request {
+  int fd;
+  void *buffer;
+  size_t length;
+  off_t offset;
+  bool isWrite;
+  ssize_t result; // bytes transferred or -errno, set when it completes
+  void *owner;    // free for the caller, to find its state on completion
+};
+
+struct io_engine {
+  IOBackend backend;
+  unsigned depth;    // maximum amount of requests in flight
+  unsigned inFlight; // requests submitted and not returned yet
+
+  // io_uring backend
+  int ringFd;
+  unsigned toSubmit; // requests in the ring the kernel hasn't seen yet
+  void *sqRing, *cqRing, *sqes;
+  size_t sqRingSize, cqRingSize, sqesSize;
+  unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+  unsigned *cqHead, *cqTail, *cqMask;
+  void *cqes;
+
+  // thread pool backend
+  pthread_t workers[IO_THREAD_COUNT];
+  int workerCount;
+  pthread_mutex_t lock;
+  pthread_cond_t hasRequests, hasCompletions;
+  struct io_request **queued, **completed; // rings of depth requests
+  size_t queuedHead, queuedCount, completedHead, completedCount;
+  bool isStopping;
+};
+
+// starts an engine, io_uring when the kernel allows it, a thread pool if not
+int initIOEngine(struct io_engine *engine, unsigned depth);
+
+// waits for the requests in flight and releases the engine
+void destroyIOEngine(struct io_engine *engine);
+
+// queues a request, there can't be more than depth requests in flight
+void submitIO(struct io_engine *engine, struct io_request *request);
+
+// returns a completed request, NULL when there are none in flight
+struct io_request *waitIO(struct io_engine *engine);
+
+// internal helpers of the engine
+int initIOUring(struct io_engine *engine, unsigned depth);
+void destroyIOUring(struct io_engine *engine);
+void submitIOUring(struct io_engine *engine, struct io_request *request);
+struct io_request *waitIOUring(struct io_engine *engine);
+int initIOThreads(struct io_engine *engine, unsigned depth);
+void destroyIOThreads(struct io_engine *engine);
+void submitIOThreads(struct io_engine *engine, struct io_request *request);
+struct io_request *waitIOThreads(struct io_engine *engine);
+void *ioWorker(void *argument);
+void runRequest(struct io_request *request, size_t done);
+
+#endif
@@ -6,6 +6,14 @@
 #include <string.h>
 
 bool isGlobalVerbosed = false;
+bool isGlobalLogToStderr = false;
+
+/**
+ * @description: returns where the logs are written. They go to stderr when
+ * stdout carries the archive.
+ * @output: the stream for the logs
+ */
+FILE *logOutput() { return isGlobalLogToStderr ? stderr : stdout; }
 
 /**
  * @description: logs information
@@ -15,7 +23,7 @@ bool isGlobalVerbosed = false;
 void logInfo(char *message) {
   char *infoText = applyColor("info:", ANSI_BLUE);
 
-  printf("%s %s\n", infoText, message);
+  fprintf(logOutput(), "%s %s\n", infoText, message);
 
   free(infoText);
 }
@@ -28,7 +36,7 @@ void logInfo(char *message) {
 void logError(char *message) {
   char *errorText = applyColor("error:", ANSI_RED);
 
-  printf("%s %s\n", errorText, message);
+  fprintf(logOutput(), "%s %s\n", errorText, message);
 
   free(errorText);
 }
@@ -43,7 +51,7 @@ void logVerbose(char *message) {
   if (isGlobalVerbosed) {
     char *verboseText = applyColor("verbose:", ANSI_GREEN);
 
-    printf("%s %s\n", verboseText, message);
+    fprintf(logOutput(), "%s %s\n", verboseText, message);
 
     free(verboseText);
   }
@@ -57,7 +65,7 @@ void logVerbose(char *message) {
 void logWarning(char *message) {
   char *warningText = applyColor("warning:", ANSI_YELLOW);
 
-  printf("%s %s\n", warningText, message);
+  fprintf(logOutput(), "%s %s\n", warningText, message);
 
   free(warningText);
 }
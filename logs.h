@@ -2,6 +2,7 @@
 #define LOGS_H
 
 #include <stdbool.h>
+#include <stdio.h>
 
 typedef enum {
   ANSI_RESET = 0,
@@ -29,6 +30,12 @@ static const char *AnsiColorStrings[] = {
 
 extern bool isGlobalVerbosed;
 
+// set when the archive is written to stdout, so the logs go to stderr
+extern bool isGlobalLogToStderr;
+
+// stream where the logs are written
+FILE *logOutput();
+
 void logInfo(char *message);
 void logError(char *message);
 void logVerbose(char *message);
@@ -0,0 +1,267 @@
+#include "nameindex.h"
+#include "logs.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @description: calculates the FNV-1a hash of a name
+ * @parameter: (name) the name to hash
+ * @output: the hash of the name
+ */
+uint64_t hashName(const char *name) {
+  uint64_t hash = 14695981039346656037ULL;
+
+  for (; *name != '\0'; name++) {
+    hash ^= (unsigned char)*name;
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+/**
+ * @description: returns the name of the entry at a certain position
+ * @parameter: (index) the name index
+ * @parameter: (position) the position of the entry in the table
+ * @output: the name of the entry
+ */
+const char *nameAt(struct name_index *index, int position) {
+  return index->names + (size_t)position * index->stride;
+}
+
+/**
+ * @description: finds the slot that holds a certain position
+ * @parameter: (index) the name index
+ * @parameter: (position) the position of the entry in the table
+ * @output: the slot of the entry, or the capacity if it is not indexed
+ */
+size_t findSlot(struct name_index *index, int position) {
+  size_t mask = index->capacity - 1;
+  size_t slot = hashName(nameAt(index, position)) & mask;
+
+  while (index->slots[slot] != 0) {
+    if (index->slots[slot] == position + 1) {
+      return slot;
+    }
+
+    slot = (slot + 1) & mask;
+  }
+
+  return index->capacity;
+}
+
+/**
+ * @description: places a position in the first empty slot for its name
+ * @parameter: (index) the name index
+ * @parameter: (position) the position of the entry in the table
+ * @output: n/a
+ */
+void insertSlot(struct name_index *index, int position) {
+  size_t mask = index->capacity - 1;
+  size_t slot = hashName(nameAt(index, position)) & mask;
+
+  while (index->slots[slot] != 0) {
+    slot = (slot + 1) & mask;
+  }
+
+  index->slots[slot] = position + 1;
+}
+
+/**
+ * @description: doubles the amount of slots, placing every entry again. If
+ * there is an error in calloc it will exit the program.
+ * @parameter: (index) the name index
+ * @output: n/a
+ */
+void growNameIndex(struct name_index *index) {
+  int *oldSlots = index->slots;
+  size_t oldCapacity = index->capacity;
+
+  index->capacity = oldCapacity > 0 ? oldCapacity * 2 : 64;
+  index->slots = calloc(index->capacity, sizeof(int));
+
+  if (index->slots == NULL) {
+    logError("memory allocation for name index failed");
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t slot = 0; slot < oldCapacity; slot++) {
+    if (oldSlots[slot] != 0) {
+      insertSlot(index, oldSlots[slot] - 1);
+    }
+  }
+
+  free(oldSlots);
+}
+
+/**
+ * @description: prepares an empty index for a table of names. The names are
+ * read from the table, so the index only stores positions.
+ * @parameter: (index) the name index to initialize
+ * @parameter: (names) the name of the first entry of the table
+ * @parameter: (stride) the distance in bytes between two names of the table
+ * @output: n/a
+ */
+void initNameIndex(struct name_index *index, const char *names, size_t stride) {
+  index->slots = NULL;
+  index->capacity = 0;
+  index->count = 0;
+  index->names = names;
+  index->stride = stride;
+
+  growNameIndex(index);
+}
+
+/**
+ * @description: releases the memory used by the index
+ * @parameter: (index) the name index to destroy
+ * @output: n/a
+ */
+void destroyNameIndex(struct name_index *index) {
+  free(index->slots);
+
+  index->slots = NULL;
+  index->capacity = 0;
+  index->count = 0;
+}
+
+/**
+ * @description: adds the entry at a certain position of the table. The index
+ * is kept at most half full so lookups stay short.
+ * @parameter: (index) the name index
+ * @parameter: (position) the position of the entry in the table
+ * @output: n/a
+ */
+void addName(struct name_index *index, int position) {
+  if ((size_t)(index->count + 1) * 2 > index->capacity) {
+    growNameIndex(index);
+  }
+
+  insertSlot(index, position);
+  index->count++;
+}
+
+/**
+ * @description: looks for an entry by its name
+ * @parameter: (index) the name index
+ * @parameter: (name) the name to look for
+ * @output: the position of the entry, -1 if there is none
+ */
+int findName(struct name_index *index, const char *name) {
+  size_t mask = index->capacity - 1;
+  size_t slot = hashName(name) & mask;
+
+  while (index->slots[slot] != 0) {
+    int position = index->slots[slot] - 1;
+
+    if (strcmp(nameAt(index, position), name) == 0) {
+      return position;
+    }
+
+    slot = (slot + 1) & mask;
+  }
+
+  return -1;
+}
+
+/**
+ * @description: looks for the last entry with a name, for tables where a name
+ * can be repeated and the newest entry wins
+ * @parameter: (index) the name index
+ * @parameter: (name) the name to look for
+ * @output: the position of the entry, -1 if there is none
+ */
+int findLastName(struct name_index *index, const char *name) {
+  size_t mask = index->capacity - 1;
+  size_t slot = hashName(name) & mask;
+  int last = -1;
+
+  while (index->slots[slot] != 0) {
+    int position = index->slots[slot] - 1;
+
+    if (position > last && strcmp(nameAt(index, position), name) == 0) {
+      last = position;
+    }
+
+    slot = (slot + 1) & mask;
+  }
+
+  return last;
+}
+
+/**
+ * @description: removes the entry at a certain position. The entries after it
+ * in the same probe sequence are shifted back, so no tombstones are needed.
+ * @parameter: (index) the name index
+ * @parameter: (position) the position of the entry in the table
+ * @output: n/a
+ */
+void removeName(struct name_index *index, int position) {
+  size_t mask = index->capacity - 1;
+  size_t hole = findSlot(index, position);
+
+  if (hole == index->capacity) {
+    return;
+  }
+
+  index->slots[hole] = 0;
+  index->count--;
+
+  for (size_t slot = (hole + 1) & mask; index->slots[slot] != 0;
+       slot = (slot + 1) & mask) {
+    size_t home = hashName(nameAt(index, index->slots[slot] - 1)) & mask;
+
+    // entries whose home is between the hole and their slot can't move
+    if (((slot - home) & mask) < ((slot - hole) & mask)) {
+      continue;
+    }
+
+    index->slots[hole] = index->slots[slot];
+    index->slots[slot] = 0;
+    hole = slot;
+  }
+}
+
+/**
+ * @description: updates the position of an entry that moves inside the table.
+ * It must be called while the entry is still at its old position.
+ * @parameter: (index) the name index
+ * @parameter: (from) the old position of the entry
+ * @parameter: (to) the new position of the entry
+ * @output: n/a
+ */
+void moveName(struct name_index *index, int from, int to) {
+  size_t slot = findSlot(index, from);
+
+  if (slot != index->capacity) {
+    index->slots[slot] = to + 1;
+  }
+}
+
+/**
+ * @description: updates the position of every entry after the table is
+ * compacted. Every slot is visited once, without hashing any name.
+ * @parameter: (index) the name index
+ * @parameter: (positions) the new position of each entry still in the index
+ * @output: n/a
+ */
+void renumberNames(struct name_index *index, const int *positions) {
+  for (size_t slot = 0; slot < index->capacity; slot++) {
+    if (index->slots[slot] != 0) {
+      index->slots[slot] = positions[index->slots[slot] - 1] + 1;
+    }
+  }
+}
+
+/**
+ * @description: points the index to the table of names after the table moved
+ * in memory. The positions of the entries must be the same.
+ * @parameter: (index) the name index
+ * @parameter: (names) the name of the first entry of the table
+ * @output: n/a
+ */
+void setNameTable(struct name_index *index, const char *names) {
+  index->names = names;
+}
@@ -0,0 +1,49 @@
+#ifndef NAMEINDEX_H
+#define NAMEINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct name_index {
+  int *slots;        // position of the entry plus one, 0 when the slot is empty
+  size_t capacity;   // amount of slots, always a power of two
+  int count;         // amount of entries, also the first free position
+  const char *names; // name of the first entry of the table
+  size_t stride;     // distance in bytes between the names of two entries
+};
+
+// prepares an empty index for a table of names
+void initNameIndex(struct name_index *index, const char *names, size_t stride);
+
+// releases the memory used by the index
+void destroyNameIndex(struct name_index *index);
+
+// adds the entry at a certain position of the table
+void addName(struct name_index *index, int position);
+
+// returns the position of the entry with a name, -1 if there is none
+int findName(struct name_index *index, const char *name);
+
+// returns the position of the last entry with a name, -1 if there is none
+int findLastName(struct name_index *index, const char *name);
+
+// removes the entry at a certain position of the table
+void removeName(struct name_index *index, int position);
+
+// updates the position of an entry that moved inside the table
+void moveName(struct name_index *index, int from, int to);
+
+// updates the position of every entry after the table is compacted
+void renumberNames(struct name_index *index, const int *positions);
+
+// points the index to the table after it moved in memory
+void setNameTable(struct name_index *index, const char *names);
+
+// internal helpers of the index
+uint64_t hashName(const char *name);
+const char *nameAt(struct name_index *index, int position);
+size_t findSlot(struct name_index *index, int position);
+void insertSlot(struct name_index *index, int position);
+void growNameIndex(struct name_index *index);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef STAR_H
+#define STAR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// libstar: the archive kept open inside a program. The header, the name
+// index and the block table are read once when the archive is opened, so
+// each lookup or read only touches the blocks it needs. A handle must be used
+// by one thread at a time, and the options of star, like globalJobCount, are
+// shared by every handle of the program.
+struct star_archive;
+
+// what is known about a member without reading its blocks
+struct star_stat {
+  size_t size;       // amount of bytes of the member
+  size_t blockCount; // amount of blocks the member uses
+  uint32_t checksum; // CRC32C of the member, 0 when it has none
+  bool isIndexed;    // its blocks are found through the block table
+};
+
+// opens an archive, for appending to it as well when isWritable is set
+struct star_archive *starOpen(const char *filename, bool isWritable);
+
+// writes the header of a writable archive when members were added
+int starCommit(struct star_archive *archive);
+
+// commits the archive and releases the handle
+int starClose(struct star_archive *archive);
+
+// finds a member by its name, the last one when the name is repeated
+int starStat(struct star_archive *archive, const char *name,
+             struct star_stat *stat);
+
+// reads a range of a member into a buffer
+ssize_t starRead(struct star_archive *archive, const char *name,
+                 size_t offset, size_t length, char *buffer);
+
+// extracts a member into the working directory
+int starExtract(struct star_archive *archive, const char *name);
+
+// adds a file as a new member, written with the header by starCommit
+int starAppend(struct star_archive *archive, const char *path);
+
+#endif
@@ -1,14 +1,36 @@
 #include "tar.h"
+#include "archivemap.h"
+#include "attributes.h"
+#include "blocktable.h"
+#include "bufferpool.h"
+#include "checksum.h"
+#include "codec.h"
+#include "copyrange.h"
+#include "dedup.h"
+#include "directio.h"
+#include "freemap.h"
+#include "ioengine.h"
 #include "logs.h"
+#include "nameindex.h"
+#include "star.h"
 
+#include <endian.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
-#define MAX_HEADER_SIZE 1024 * 1024 * 2 // Header Size of 2MB
-#define BLOCK_SIZE 1024 * 256           // 256 KB Block Size
+#define MAX_HEADER_SIZE (1024 * 1024 * 2) // Header Size of 2MB
+#define IO_QUEUE_DEPTH 32 // block transfers kept in flight by the I/O engine
+#define BLOCK_SIZE (1024 * 256)           // 256 KB Block Size
+#define BLOCK_DATA_SIZE (BLOCK_SIZE - 12 * 2)
 #define MAX_FILES 10000
 
 struct posix_file_info {
@@ -17,17 +39,409 @@ struct posix_file_info {
   char size[12];
 };
 
+// In memory the FAT table only holds the entries in use. It grows as files
+// are added, so small archives don't pay for the whole table.
 struct posix_header {
-  struct posix_file_info files[sizeof(struct posix_file_info) *
-                               10000]; // List of Files max of HEADER SIZE
+  struct posix_file_info *files;     // List of Files, contiguous
+  size_t count;                      // amount of files in the table
+  size_t capacity;                   // amount of files the table can hold
+  char *tail;                        // the free map stored after the FAT table
+  struct dedup_index *dedup;         // NULL unless the archive shares blocks
+  struct block_checksums *checksums; // NULL for archives without checksums
+  struct block_table *blockTable;    // NULL unless it is written again
+  struct member_attributes *attributes; // NULL for version 1 archives
+  long blockTableOffset; // where the block table is stored, -1 without one
 };
 
+// The header starts with a superblock that describes it, followed by the
+// entries in use and the free map. Only headerLength bytes are read and
+// written, the blocks still start after MAX_HEADER_SIZE so the header can
+// grow in place. Archives without a superblock use the fixed layout, with
+// the whole FAT table first and the free map at FAT_TABLE_SIZE.
+struct archive_superblock {
+  char magic[8];
+  char version[12];
+  char entryCount[12];
+  char entrySize[12];
+  char headerLength[12];
+};
+
+// Archives written as a stream can't go back to the start, so the header is
+// written after the last block and the archive ends with a footer that points
+// to it. The start only holds a superblock that marks the layout, and the
+// blocks still start at MAX_HEADER_SIZE so they are read like in any archive.
+// Every stream pays the 2 MB of zeros before its blocks, even with a few
+// members. That is on purpose, so a stream saved to a file is appended to and
+// updated in place, with its header moved to the start like any other.
+struct stream_footer {
+  char magic[8];
+  char entryCount[12];
+  char blockCount[12]; // the entries start where this block would be
+  char tailLength[12];
+};
+
+// The second field used to mark free blocks, which the free map does now.
+// In compressed archives it holds the length of the compressed data, and it
+// is 0 for blocks whose data is stored as it is. Free blocks are still marked
+// with 1, they are never read.
 struct block_data {
   char next[12];
-  char isFree[12];
-  char data[BLOCK_SIZE - 12 * 2];
+  char storedLength[12];
+  char data[BLOCK_DATA_SIZE];
+};
+
+// The part of a block written from userspace when its data is copied by the
+// kernel
+struct block_metadata {
+  char next[12];
+  char storedLength[12];
+};
+
+// In archives with the extent layout the end of the filename holds the first
+// extents of the file. The chain is still written, and it is followed after
+// the last extent when a file has more extents than the ones recorded.
+struct file_extent {
+  char start[8];
+  char length[8];
+};
+
+#define MAX_EXTENTS 3
+#define MAX_EXTENT_VALUE 07777777 // the biggest value that fits in an extent
+#define EXTENT_NAME_SIZE (176 - sizeof(struct file_extent) * MAX_EXTENTS)
+
+struct extent_list {
+  size_t count;
+  size_t start[MAX_EXTENTS];
+  size_t length[MAX_EXTENTS];
+  bool isComplete; // false when the file has more extents than recorded
+};
+
+// The free map lives in the unused space after the FAT table
+struct free_map_info {
+  char magic[8];
+  char blockCount[12];
+  char flags[12];
+};
+
+// Archives that store identical blocks once keep the hash and the owners of
+// every block right after the last block. It is loaded by the commands that
+// write the archive and written again with the header.
+struct dedup_info {
+  char magic[8];
+  char blockCount[12];
+};
+
+struct dedup_record {
+  char hash[16];     // in hexadecimal, 0 when it is not known
+  char refCount[12]; // members whose chain goes through the block
+};
+
+// Archives with checksums keep the CRC32C of every block and of every member
+// after the last block, behind the dedup index when there is one. Streamed
+// archives keep them between the header and the footer. Each checksum is
+// stored as 8 hexadecimal characters, the blocks first and then the members.
+struct checksum_info {
+  char magic[8];
+  char blockCount[12];
+  char memberCount[12];
+};
+
+// Archives with a block table keep the blocks of every member in chain order
+// after the checksums, or before the footer of streamed archives. The
+// position of the first block of each member in the list comes first, then
+// the list, each record being a number like the ones of the blocks.
+struct block_table_info {
+  char magic[8];
+  char memberCount[12];
+  char entryCount[12]; // records in the list of blocks
+};
+
+// Archives with member attributes keep the modification time and the hash
+// of every member between the checksums and the block table, each one a
+// number like the ones of the blocks.
+struct attributes_info {
+  char magic[8];
+  char memberCount[12];
+};
+
+// Archives with block hashes keep the hash of the data of each block of a
+// member after the block table, in chain order, so an update writes only the
+// blocks whose data changed.
+struct block_hashes_info {
+  char magic[8];
+  char memberCount[12];
+};
+
+// Members handed out to the extraction workers
+struct extract_job {
+  struct posix_header *header;
+  FILE *archive;
+  struct archive_map *mapped;
+  int directFd; // the archive opened with O_DIRECT, -1 when it is not used
+  bool useExtents;
+  bool isOctalFields; // the format of the archive, set in every worker
+  size_t *members;   // members to extract, in the order of their first block
+  size_t memberCount;
+  size_t nextMember; // the position in members of the next one to be taken
+  pthread_mutex_t lock;
+};
+
+// A member to be extracted and where its chain starts, to sort the members
+struct member_position {
+  size_t blockAddress;
+  size_t member;
+};
+
+// Members handed out to the creation workers. Every member already has its
+// first block in the header, so they can be written in any order.
+struct create_job {
+  struct posix_header *header;
+  int archiveFd;
+  char **inputFiles;
+  int *inputFds;     // the inputs kept open since the header was created
+  bool isDirect;     // the archive was opened with O_DIRECT
+  bool isOctalFields; // the format of the archive, set in every worker
+  size_t nextMember; // the next member to be taken by a worker
+  int result;        // the exit code, not 0 when any member failed
+  pthread_mutex_t lock;
 };
 
+// A member whose blocks are copied into the archive by the I/O engine
+struct member_copy {
+  struct posix_header *header;
+  size_t fileIndex; // the header entry, the table can move while appending
+  char *inputPath;
+  int inputFd;
+  bool isOwnFd;         // the input was opened for the copy, closed after it
+  bool isQueued;        // every block of the member was queued
+  bool hasFailed;       // a transfer of the member failed
+  size_t pendingBlocks; // blocks queued and not written yet
+  size_t bytesCopied;   // bytes read from the input
+  size_t *blocks;   // where each block went, NULL when the member is sealed
+                    // with the header
+  uint64_t *hashes; // the hash of the data of each block, NULL when they
+                    // aren't taken
+};
+
+// A block in flight, read from an input and then written to the archive
+struct copy_slot {
+  struct io_request request;
+  struct block_data *block;
+  struct member_copy *member;
+  size_t blockIndex;
+  bool isUsed;
+};
+
+// Blocks copied into the archive with many transfers in flight
+struct block_stream {
+  struct io_engine engine;
+  int archiveFd;
+  bool isDirect; // the archive was opened with O_DIRECT
+  struct block_data *buffers;
+  struct copy_slot slots[IO_QUEUE_DEPTH];
+  int result; // the exit code, not 0 when any transfer failed
+};
+
+// A member being extracted by the I/O engine. Its blocks are read ahead
+// guessing that each one follows the previous, and the guess is checked with
+// the next pointer of every block as it arrives.
+struct chain_reader {
+  struct posix_file_info *fileInfo; // NULL when the reader is not in use
+  int outputFd;
+  size_t fileSize;
+  size_t blockTotal;
+  size_t donePosition;   // position in the chain of the next block to write
+  size_t issuedPosition; // position in the chain of the next block to read
+  size_t issueBlock;     // block guessed for issuedPosition
+  unsigned generation;   // changes when the guessed blocks were wrong
+  size_t inFlight;       // reads in flight, including the discarded ones
+  bool isFinished;
+  struct block_checksums *checksums; // NULL when the blocks aren't checked
+  size_t fileIndex;                  // the position of the member
+  uint32_t memberChecksum;           // of the blocks written so far
+};
+
+// A block read in flight for a chain_reader
+struct read_slot {
+  struct io_request request;
+  struct chain_reader *reader;
+  size_t position;   // position of the block in the chain
+  size_t blockIndex;
+  unsigned generation;
+  bool isUsed;
+  bool isDone;
+};
+
+// Blocks handed out to the verify workers. Each worker reads a run of blocks
+// at once, and the chains are followed after in memory.
+struct verify_job {
+  int archiveFd;
+  bool isOctalFields; // the format of the archive, set in every worker
+  size_t blockCount;
+  size_t nextBlock;   // the first block of the next run to be read
+  size_t *nextBlocks; // next pointer of each block, UNUSED_BLOCK if unread
+  uint32_t *checksums; // checksum of the data of each block
+  size_t bytesRead;
+  int result; // the exit code, not 0 when a worker failed
+  pthread_mutex_t lock;
+};
+
+// A block in flight while packing, read from its position and then written
+// at the new one
+struct move_slot {
+  struct io_request request;
+  size_t block;
+  bool isUsed;
+  bool isRead;    // the read finished, the write waits for its turn
+  bool isWriting;
+};
+
+#define MAX_JOBS 64
+#define BLOCK_POOL_SIZE MAX_JOBS // one buffer per job, enough for a batch
+#define CODEC_BATCH_BLOCKS (BLOCK_POOL_SIZE / 2) // two buffers per block
+#define FREE_MAP_MAGIC "STARFM2"
+#define FREE_MAP_MAGIC_V1 "STARFMP" // stored before the archive flags existed
+#define ARCHIVE_FLAG_EXTENTS 1      // files record their extents
+#define ARCHIVE_FLAG_NO_FREE_MAP 2  // the free map didn't fit in the header
+#define ARCHIVE_FLAG_COMPRESSED 4   // blocks may hold compressed data
+#define ARCHIVE_FLAG_DEDUP 8        // identical blocks are stored once
+#define ARCHIVE_FLAG_CHECKSUMS 16   // blocks and members have a CRC32C
+#define ARCHIVE_FLAG_BLOCK_TABLE 32 // the blocks of each member are listed
+#define ARCHIVE_FLAG_ATTRIBUTES 64  // members keep their mtime and hash
+#define ARCHIVE_FLAG_BLOCK_HASHES 128 // blocks of members have a hash
+#define DEDUP_MAGIC "STARDDP"
+#define CHECKSUM_MAGIC "STARCRC"
+#define CHECKSUM_RECORD_SIZE 8 // hexadecimal characters of each checksum
+#define BLOCK_TABLE_MAGIC "STARBTB"
+#define ATTRIBUTES_MAGIC "STARATR"
+#define BLOCK_HASHES_MAGIC "STARBHS"
+#define UNUSED_BLOCK ((size_t)-1)
+#define BATCH_BLOCKS 32 // blocks read or written at once in bulk transfers
+#define FAT_TABLE_SIZE (sizeof(struct posix_file_info) * MAX_FILES)
+#define ARCHIVE_MAGIC "STARHDR"
+#define ARCHIVE_VERSION 2 // numbers of blocks and entries are binary
+#define ARCHIVE_VERSION_OCTAL 1 // numbers of blocks and entries are octal
+#define FIELD_SIZE 12 // bytes of a number in a block or an entry
+#define STREAM_MAGIC "STARSTM"
+#define STREAM_FOOTER_MAGIC "STARIDX"
+#define HEADER_TAIL_SIZE                                                       \
+  (MAX_HEADER_SIZE - FAT_TABLE_SIZE - sizeof(struct archive_superblock))
+#define HEADER_READ_ENTRIES 256 // FAT entries read or written at once
+#define FREE_MAP_CAPACITY                                                      \
+  ((HEADER_TAIL_SIZE - sizeof(struct free_map_info)) * 8)
+
+// A block of a compressed archive on its way between a file and the archive.
+// The plain buffer holds the data of the file, the stored one the block as it
+// is in the archive.
+struct codec_block {
+  size_t blockIndex;
+  size_t nextBlockIndex;
+  size_t length;     // bytes of data of the file in the block
+  int fd;            // the extracted file
+  size_t fileOffset; // position of the data in the extracted file
+  bool closesFile;   // set on the last block of the extracted file
+  struct block_data *plain;
+  struct block_data *stored;
+  struct codec_task *task; // NULL when the block is stored raw
+};
+
+// The blocks compressed or decompressed at once by the codec pool
+struct codec_batch {
+  struct codec_pool pool;
+  int threadCount;
+  struct codec_block blocks[CODEC_BATCH_BLOCKS];
+  struct codec_task tasks[CODEC_BATCH_BLOCKS];
+  size_t count;
+  char *buffers;
+  FILE *output; // the stream being written, NULL for a file
+  int archiveFd;
+  struct block_checksums *checksums; // taken as the blocks are written, or NULL
+  size_t bytesStored; // bytes of the blocks as they are in the archive
+  int result;
+};
+
+// An operation of a batch, with the file or the member it works on
+struct batch_operation {
+  BatchOperation type;
+  char *argument;
+};
+
+// The blocks of a member visited by an update, compared with the hashes of
+// the blocks it had so only the ones whose data changed are written
+struct block_delta {
+  const uint64_t *storedHashes; // hash of each block the member had, NULL
+                                // when they are not known
+  size_t storedCount;
+  const size_t *storedBlocks; // the chain of the member from the block table,
+                              // NULL when it is read from the blocks
+  size_t storedBlockCount;
+  struct block_checksums *checksums; // NULL when the member is sealed with
+                                     // the header
+  uint32_t memberChecksum; // checksum of the blocks visited so far
+  uint64_t *hashes;        // hash of each block of the new data
+  size_t *blocks;          // position of each block of the new data
+  size_t examinedCount;    // blocks compared
+  size_t writtenCount;     // blocks that changed and were written
+};
+
+// What an update finds out about a file before writing it
+struct member_change {
+  int fileIndex;    // the member of the file, -1 if it is not in the archive
+  size_t size;      // bytes of the file
+  uint64_t mtime;   // modification time of the file in nanoseconds
+  uint64_t hash;    // hash of the data of the file, 0 if it wasn't hashed
+  bool isHashed;    // the file is hashed before deciding
+  bool isUnchanged; // the member already has the data of the file
+};
+
+// Files of an update handed out to the hash workers
+struct hash_job {
+  char **files;
+  struct member_change *changes;
+  size_t count;
+  size_t next; // the next file to be hashed
+  pthread_mutex_t lock;
+};
+
+// An archive kept open by a program using star as a library
+struct star_archive {
+  FILE *file;
+  struct posix_header *header;
+  struct name_index index;
+  struct free_map map; // only loaded for writable archives
+  bool isWritable;
+  bool isOctalFields; // the format of the archive, see isGlobalOctalFields
+  bool isChanged;     // members were added since the last commit
+};
+
+// opens and stats of input files, to measure how many each member costs
+static _Atomic size_t inputOpenCount = 0;
+static _Atomic size_t inputStatCount = 0;
+
+// blocks and members whose data didn't match their checksum
+static _Atomic size_t checksumErrorCount = 0;
+
+// Block buffers come from a single pool, created the first time one is used
+struct buffer_pool blockPool;
+pthread_once_t blockPoolOnce = PTHREAD_ONCE_INIT;
+bool isBlockPoolReady = false;
+
+// Set when the archive in use is a version 1 archive, whose blocks and entries
+// keep their numbers in octal. Each thread has its own, so threads using
+// handles of different archives don't change the format under each other,
+// and the workers of a command take the one of the thread that starts them.
+_Thread_local bool isGlobalOctalFields = false;
+
+bool isGlobalExtentLayout = false;
+bool isGlobalMappedRead = false;
+bool isGlobalDirectIO = false;
+bool isGlobalAsyncIO = false;
+bool isGlobalStreamOutput = false;
+bool isGlobalCompress = false;
+bool isGlobalDedup = false;
+bool isGlobalHashCheck = false;
+int globalJobCount = 1;
+
 /**
  * ------------------------------------------
  *          CREATE COMMAND
@@ -46,1193 +460,8469 @@ int create(char *input_files[], int num_files, char *output_file) {
 
   FILE *output;
 
+  // stdout carries the archive, so nothing else can be written there
+  if (!output_file) {
+    isGlobalLogToStderr = true;
+  }
+
   if (num_files < 1) {
     logError("no files to add...");
     return 1;
   }
 
+  if (isGlobalCompress && !isCodecAvailable()) {
+    logError("star was built without zlib, archives can't be compressed");
+    return 1;
+  }
+
+  if (isGlobalDedup && (isGlobalCompress || isGlobalStreamOutput ||
+                        !output_file)) {
+    logError("--dedup can't be used with compressed or streamed archives");
+    return 1;
+  }
+
   if (num_files > MAX_FILES) {
     logVerbose(
         "star only supports up to 10k files. Since it has a 2MB FAT Table");
     num_files = MAX_FILES;
   }
 
-  snprintf(message, 100, "output of tar file to stdout");
+  // without a file the archive goes to stdout as a stream
+  bool isStream = isGlobalStreamOutput || !output_file;
+
   if (output_file) {
     snprintf(message, 100, "starting to create %s", output_file);
-    output = fopen(output_file, "wb");
+    // blocks copied by the kernel are read back for their checksums, and
+    // with dedup to check they are identical before sharing them
+    output = fopen(output_file, "w+b");
+  } else {
+    snprintf(message, 100, "output of tar file to stdout");
+    output = stdout;
+
+    if (isatty(fileno(stdout))) {
+      logError("refusing to write the archive to a terminal, use -f or a "
+               "pipe");
+      return 1;
+    }
   }
   logVerbose(message);
 
+  if (output == NULL) {
+    snprintf(message, 100, "error creating the tar file. %s", output_file);
+    logError(message);
+    return 1;
+  }
+
   // Creates the File Header
-  struct posix_header *file_header = malloc(sizeof(struct posix_header));
+  struct posix_header *file_header = createEmptyHeader();
 
   if (!file_header) {
-    logError("memory allocation failed");
     return 1;
   }
-  memset(file_header, 0, sizeof(struct posix_header));
-
-  createHeader(file_header, num_files, input_files);
 
-  fwrite(file_header, MAX_HEADER_SIZE, 1, output);
+  // the modification time of each file is taken with the header
+  if (attachMemberAttributes(file_header) != 0) {
+    destroyHeader(file_header);
 
-  // Now it will create the blocks for each file
-  int result = createFATBlocks(file_header, output, num_files, input_files);
+    if (output != stdout) {
+      fclose(output);
+    }
 
-  free(file_header);
-  fclose(output);
+    return 1;
+  }
 
-  return result;
-}
+  // the inputs stay open from the header to the copy of their blocks
+  int *inputFds = malloc(num_files * sizeof(int));
+  size_t blockCount = 0;
 
-/**
- * @description: creates the header for the tar file using FAT table
- * @parameter: (file_header) the header or FAT table to be set.
- * @parameter: (num_files) the amount of input files received
- * @parameter: (input_files) the files to be written.
- * @output: n/a
- */
-void createHeader(struct posix_header *file_header, int num_files,
-                  char *input_files[]) {
-  char message[100];
+  if (!inputFds || createHeader(file_header, num_files, input_files, inputFds,
+                                &blockCount) != 0) {
+    free(inputFds);
+    destroyHeader(file_header);
 
-  // pre-calc of the block to be placed
-  int blocksCreated = 0;
+    if (output != stdout) {
+      fclose(output);
+    }
 
-  for (int i = 0; i < num_files; i++) {
-    FILE *input = fopen(input_files[i], "rb");
+    return 1;
+  }
 
-    long file_size = 0;
-    fseek(input, 0, SEEK_END);
-    file_size = ftell(input);
-    fseek(input, 0, SEEK_SET);
+  if (isGlobalExtentLayout) {
+    logVerbose("files will be stored using extents");
+    setArchiveFlags(file_header, ARCHIVE_FLAG_EXTENTS);
+  }
 
-    const char *filename = get_filename(input_files[i]);
+  if (isGlobalCompress) {
+    logVerbose("blocks will be compressed");
+    setArchiveFlags(file_header,
+                    archiveFlags(file_header) | ARCHIVE_FLAG_COMPRESSED);
+  }
 
-    int numBlocks = (file_size + BLOCK_SIZE - 12 - 1) / (BLOCK_SIZE - 12);
+  if (isGlobalDedup) {
+    logVerbose("identical blocks will be stored once");
+    setArchiveFlags(file_header,
+                    archiveFlags(file_header) | ARCHIVE_FLAG_DEDUP);
+  }
 
-    struct posix_file_info file_info;
+  // every new archive has checksums, they are sealed with the header
+  if (attachBlockChecksums(file_header) != 0) {
+    closeInputFiles(inputFds, num_files);
+    free(inputFds);
+    destroyHeader(file_header);
 
-    snprintf(file_info.filename, sizeof(file_info.filename), "%s", filename);
+    if (output != stdout) {
+      fclose(output);
+    }
 
-    // size is stored in octal
-    snprintf(file_info.size, 12, "%011lo", (unsigned long)file_size);
-    snprintf(file_info.blockAddress, 12, "%011lo",
-             (unsigned long)blocksCreated);
+    return 1;
+  }
 
-    snprintf(message, sizeof(message), "Adding file %s to header", filename);
-    logVerbose(message);
+  setArchiveFlags(file_header,
+                  archiveFlags(file_header) | ARCHIVE_FLAG_CHECKSUMS);
 
-    file_header->files[i] = file_info;
+  // and a block table, filled with the header as well
+  if (attachBlockTable(file_header) != 0) {
+    closeInputFiles(inputFds, num_files);
+    free(inputFds);
+    destroyHeader(file_header);
 
-    blocksCreated += numBlocks;
+    if (output != stdout) {
+      fclose(output);
+    }
 
-    fclose(input);
+    return 1;
   }
-}
-
-/**
- * @description: create the FAT Blocks for the tar file
- * @parameter: (file_header) the header or FAT table to be used.
- * @parameter: (output) the tar FILE to be written.
- * @parameter: (input_files) the files to be written.
- * @parameter: (num_files) the amount of input files received
- * @parameter: (input_files) the files to be written.
- * @output: n/a
- */
-int createFATBlocks(struct posix_header *file_header, FILE *output,
-                    int num_files, char *input_files[]) {
-  char message[100];
-  int blocksCreated = 0;
 
-  for (int i = 0; i < num_files; i++) {
-    struct posix_file_info fileInfo = file_header->files[i];
+  setArchiveFlags(file_header, archiveFlags(file_header) |
+                                   ARCHIVE_FLAG_BLOCK_TABLE |
+                                   ARCHIVE_FLAG_ATTRIBUTES);
 
-    int numBlocks = (octal_to_size_t(fileInfo.size) + BLOCK_SIZE - 12 - 1) /
-                    (BLOCK_SIZE - 12);
+  // A new archive has no free blocks yet. With dedup the blocks are
+  // allocated as members are written, since many of them are shared.
+  struct free_map map;
+  initFreeMap(&map, isGlobalDedup ? 0 : blockCount);
+  map.preferRuns = isGlobalExtentLayout;
+  storeFreeMap(file_header, &map);
 
-    snprintf(message, sizeof(message),
-             "num blocks [%d] for [%s] because of size [%d / %d]", numBlocks,
-             fileInfo.filename, (int) octal_to_size_t(fileInfo.size),
-             BLOCK_SIZE - 12);
-    logVerbose(message);
+  // the members are sealed as their blocks are written, by many workers
+  reserveWrittenMembers(file_header, blockCount);
 
-    FILE *inputFile = fopen(input_files[i], "rb");
+  int result = 0;
 
-    size_t bytes_to_read = BLOCK_SIZE - 12;
+  if (isGlobalDedup) {
+    result = attachDedupIndex(file_header);
 
-    for (int b = 0; b < numBlocks; b++) {
-      struct block_data *block = malloc(sizeof(struct block_data));
+    if (result == 0) {
+      result = createDedupBlocks(file_header, output, &map, num_files,
+                                 input_files, inputFds);
+    }
 
-      if (!block) {
-        logError("Memory allocation for block failed");
-        fclose(inputFile);
-        free(file_header);
-        fclose(output);
-        return 1;
-      }
+    if (result == 0) {
+      result = commitHeader(file_header, output, &map);
+    }
+  } else if (isStream) {
+    result = writeArchiveStream(file_header, output, num_files, input_files,
+                                inputFds);
+  } else if (isGlobalCompress) {
+    result = createCompressedBlocks(file_header, output, num_files,
+                                    input_files, inputFds, blockCount);
+
+    if (result == 0) {
+      result = commitHeader(file_header, output, &map);
+    }
+  } else {
+    // the blocks skip the page cache, the header is still written with stdio
+    int directFd = isGlobalDirectIO ? openDirect(output_file, O_WRONLY) : -1;
 
-      size_t read = fread(block->data, 1, BLOCK_SIZE - 12 * 2, inputFile);
+    // Now it will create the blocks for each file
+    result = createFATBlocks(file_header, output, directFd, num_files,
+                             input_files, inputFds);
 
-      // Zero-fill the rest of the block
-      if (read < BLOCK_SIZE - 12 * 2) {
-        memset(block->data + read, 0, (BLOCK_SIZE - 12 * 2) - read);
-      }
+    if (directFd >= 0) {
+      close(directFd);
+    }
 
-      int nextBlock = b + 1 < numBlocks ? blocksCreated + b + 1 : 0;
+    // the header is written last, with the sizes that were really copied
+    if (result == 0) {
+      result = commitHeader(file_header, output, &map);
+    }
+  }
 
-      snprintf(message, sizeof(message), "block #%d", blocksCreated + b);
-      logVerbose(message);
+  destroyFreeMap(&map);
+  closeInputFiles(inputFds, num_files);
+  free(inputFds);
 
-      snprintf(block->next, sizeof(block->next), "%011lo",
-               (unsigned long)nextBlock);
-      snprintf(block->isFree, sizeof(block->isFree), "%011lo",
-               (unsigned long)0);
+  snprintf(message, 100, "%zu opens and %zu stats for %d members",
+           (size_t)inputOpenCount, (size_t)inputStatCount, num_files);
+  logVerbose(message);
 
-      // Write block to output file
-      fwrite(block, sizeof(struct block_data), 1, output);
+  if (fflush(output) != 0 && result == 0) {
+    logError("failed to write the archive.");
+    result = 1;
+  }
 
-      free(block);
-    }
+  if (output_file) {
+    logArchiveCache(output_file);
+  }
 
-    blocksCreated += numBlocks;
+  destroyHeader(file_header);
 
-    fclose(inputFile);
+  if (output != stdout) {
+    fclose(output);
   }
 
-  return 0;
+  return result;
 }
 
 /**
- * ------------------------------------------
- *          EXTRACT COMMAND
- * ------------------------------------------
- */
-
-/**
- * @description: will extract the files in the current directory
- * @parameter: (filename) the file to be used to extract.
- * @output: the exit code.
+ * @description: writes a new archive as a stream, without seeking. The start
+ * of the archive only marks the layout, then the blocks of every member are
+ * written in order and the header goes after them, followed by a footer that
+ * points to it. This works on pipes, and the archive can still be read from
+ * disk like any other. The members are copied one by one, so --jobs, --async
+ * and --direct are not used.
+ * @parameter: (header) the FAT header, with the blocks already placed one
+ * after the other
+ * @parameter: (output) the FILE where the archive is written
+ * @parameter: (num_files) the amount of input files received
+ * @parameter: (input_files) the files to be written
+ * @parameter: (inputFds) the descriptor of each input, -1 when it was closed
+ * @output: the exit code
  */
-int extract(char *filename) {
+int writeArchiveStream(struct posix_header *header, FILE *output,
+                       int num_files, char *input_files[], int inputFds[]) {
   char message[100];
-  FILE *archive = fopen(filename, "rb");
-  if (!archive) {
-    logError("Failed to open tar archive file. Double check if the input file "
-             "exists.");
-    return 1;
+
+  if (globalJobCount > 1 || isGlobalAsyncIO || isGlobalDirectIO) {
+    logVerbose("the archive is written as a stream, --jobs, --async and "
+               "--direct are not used");
   }
 
-  struct posix_header *header = malloc(sizeof(struct posix_header));
+  struct block_data *block = acquireBlockBuffers(1);
 
-  if (!header) {
-    logError("Memory allocation for header failed.");
-    fclose(archive);
+  if (!block) {
     return 1;
   }
 
-  if (fread(header, MAX_HEADER_SIZE, 1, archive) != 1) {
-    logError("Failed to read header.");
-    free(header);
-    fclose(archive);
-    return 1;
+  // the superblock only marks the layout, the rest of the header is empty and
+  // is written whole, so the blocks are where every archive has them
+  struct archive_superblock superblock;
+
+  memset(&superblock, 0, sizeof(superblock));
+  memcpy(superblock.magic, STREAM_MAGIC, sizeof(superblock.magic));
+  size_t_to_octal(superblock.version, ARCHIVE_VERSION);
+  size_t_to_octal(superblock.entrySize, sizeof(struct posix_file_info));
+
+  memset(block, 0, BLOCK_SIZE);
+  memcpy(block, &superblock, sizeof(superblock));
+
+  int result = 0;
+
+  for (size_t written = 0; written < MAX_HEADER_SIZE && result == 0;
+       written += BLOCK_SIZE) {
+    if (fwrite(block, BLOCK_SIZE, 1, output) != 1) {
+      logError("failed to write the archive.");
+      result = 1;
+    }
+
+    memset(block, 0, sizeof(superblock));
   }
 
-  extractFilesByTarFile(header, archive);
+  releaseBlockBuffers(block, 1);
 
-  free(header);
-  fclose(archive);
-  return 0;
+  size_t blockCount = 0;
+  size_t bytesWritten = 0;
+  struct timespec start, end;
+
+  // a file that got shorter still fills every block it was given
+  for (int i = 0; i < num_files; i++) {
+    blockCount += blocksForSize(field_to_size_t(header->files[i].size));
+  }
+
+  if (header->checksums) {
+    reserveBlockChecksums(header->checksums, blockCount);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  if (result == 0 && isGlobalCompress) {
+    result = compressMembers(header, output, -1, num_files, input_files,
+                             inputFds);
+  } else if (result == 0) {
+    result = writeStreamMembers(header, output, num_files, input_files,
+                                inputFds);
+  }
+
+  for (int i = 0; i < num_files; i++) {
+    bytesWritten += field_to_size_t(header->files[i].size);
+  }
+
+  // the blocks can't be read back, their checksums were taken on the way
+  if (result == 0 && header->checksums) {
+    result = sealMemberChecksums(header, -1, blockCount);
+  }
+
+  if (result == 0 && header->blockTable) {
+    fillBlockTable(header, -1, blockCount);
+  }
+
+  if (result == 0) {
+    result = writeStreamIndex(header, output, blockCount);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double seconds =
+      (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  double megabytes = bytesWritten / (1024.0 * 1024.0);
+
+  snprintf(message, 100, "archived %.1f MB as a stream in %.2fs (%.1f MB/s)",
+           megabytes, seconds, seconds > 0 ? megabytes / seconds : 0.0);
+  logVerbose(message);
+
+  return result;
 }
 
 /**
- * @description: extract all the files out of a tar file
- * @parameter: (header) the FAT header of the tar file
- * @parameter: (archive) the tar file to be read.
- * @output: n/a
+ * @description: writes the blocks of every member to the stream, in order
+ * @parameter: (header) the FAT header, with the blocks already placed
+ * @parameter: (output) the FILE where the archive is written
+ * @parameter: (num_files) the amount of input files received
+ * @parameter: (input_files) the files to be written
+ * @parameter: (inputFds) the descriptor of each input, -1 when it was closed
+ * @output: the exit code
  */
-void extractFilesByTarFile(struct posix_header *header, FILE *archive) {
-  char message[100];
+int writeStreamMembers(struct posix_header *header, FILE *output,
+                       int num_files, char *input_files[], int inputFds[]) {
+  struct block_data *block = acquireBlockBuffers(1);
+
+  if (!block) {
+    return 1;
+  }
 
-  for (int i = 0; i < MAX_FILES && strlen(header->files[i].filename) > 0; i++) {
-    struct posix_file_info fileInfo = header->files[i];
+  int result = 0;
 
-    extractFileByTarFile(archive, &fileInfo);
+  for (int i = 0; i < num_files && result == 0; i++) {
+    result = writeStreamMember(output, header, i, input_files[i], inputFds[i],
+                               block);
   }
+
+  releaseBlockBuffers(block, 1);
+
+  return result;
 }
 
 /**
- * @description: extracts a single file from the tar file
- * @parameter: (header) the FAT header of the tar file
- * @parameter: (archive) the tar file to be read.
- * @parameter: (fileInfo) the info of the specific file to be extracted
- * @output: n/a
+ * @description: writes every block of a member to the stream, in order, and
+ * seals it with the checksums and the hashes taken on the way. The blocks are
+ * written whole, so a file that got shorter is filled with zeros.
+ * @parameter: (output) the FILE where the archive is written
+ * @parameter: (header) the FAT header of the archive
+ * @parameter: (fileIndex) the header entry of the member
+ * @parameter: (inputPath) the path of the file
+ * @parameter: (inputFd) the descriptor of the file, -1 to open it again
+ * @parameter: (block) a buffer for one block
+ * @output: the exit code
  */
-void extractFileByTarFile(FILE *archive, struct posix_file_info *fileInfo) {
-
+int writeStreamMember(FILE *output, struct posix_header *header,
+                      size_t fileIndex, char *inputPath, int inputFd,
+                      struct block_data *block) {
   char message[100];
+  struct posix_file_info *fileInfo = &header->files[fileIndex];
+  struct block_checksums *checksums = header->checksums;
+  size_t fileSize = field_to_size_t(fileInfo->size);
+  size_t firstBlock = field_to_size_t(fileInfo->blockAddress);
+  size_t numBlocks = blocksForSize(fileSize);
+  int input = inputFd;
+
+  if (input < 0) {
+    input = open(inputPath, O_RDONLY | O_CLOEXEC);
+    inputOpenCount++;
+  }
 
-  size_t fileSize = octal_to_size_t(fileInfo->size);
-  size_t filePosition = octal_to_size_t(fileInfo->blockAddress);
-
-  FILE *outputFile = fopen(fileInfo->filename, "wb");
-
-  if (!outputFile) {
-    snprintf(message, sizeof(message), "Failed to create file %s",
-             fileInfo->filename);
+  if (input < 0) {
+    snprintf(message, sizeof(message), "couldn't open file %s", inputPath);
     logError(message);
-    return; // Continue with next files
+    return 1;
   }
 
-  snprintf(message, sizeof(message), "starting to create %s",
-           fileInfo->filename);
-  logVerbose(message);
-
-  size_t currentBlockIndex = filePosition;
-  size_t totalBytesWritten = 0;
+  uint64_t *hashes = checksums && header->attributes && numBlocks > 0
+                         ? malloc(numBlocks * sizeof(uint64_t))
+                         : NULL;
+  size_t bytesCopied = 0;
+  int result = 0;
 
-  while (totalBytesWritten < fileSize) {
-    snprintf(message, sizeof(message), "reading block #%d", (int) currentBlockIndex);
-    logVerbose(message);
+  for (size_t b = 0; b < numBlocks; b++) {
+    size_t nextBlock = b + 1 < numBlocks ? firstBlock + b + 1 : 0;
+    size_t length = fileSize - b * BLOCK_DATA_SIZE;
 
-    // Seek to the current block in the archive file
-    fseek(archive, MAX_HEADER_SIZE + currentBlockIndex * BLOCK_SIZE, SEEK_SET);
+    if (length > BLOCK_DATA_SIZE) {
+      length = BLOCK_DATA_SIZE;
+    }
 
-    struct block_data block;
+    ssize_t copied =
+        preadFull(input, block->data, length, b * BLOCK_DATA_SIZE);
 
-    if (fread(&block, BLOCK_SIZE, 1, archive) != 1) {
-      logError("Failed to read block data.");
+    if (copied < 0) {
+      snprintf(message, sizeof(message), "failed to read %s", inputPath);
+      logError(message);
+      result = 1;
       break;
     }
 
-    // Calculate the size of data to write to the output file
-    size_t writeSize = BLOCK_SIZE - 12 * 2;
-    size_t remainingSize = fileSize - totalBytesWritten;
+    memset(block->data + copied, 0, BLOCK_DATA_SIZE - copied);
+    size_t_to_field(block->next, nextBlock);
+    size_t_to_field(block->storedLength, 0);
 
-    // Adjust write size for the last portion of data
-    if (writeSize > remainingSize) {
-      writeSize = remainingSize;
+    if (checksums) {
+      checksums->blocks[firstBlock + b] = blockDataChecksum(block);
     }
 
-    fwrite(block.data, 1, writeSize, outputFile);
-    totalBytesWritten += writeSize;
-
-    // Convert the next block index from octal to size_t
-    size_t nextBlockIndex = octal_to_size_t(block.next);
+    if (hashes) {
+      hashes[b] = hashBlockData(block->data, copied);
+    }
 
-    if (nextBlockIndex == 0) {
+    if (fwrite(block, BLOCK_SIZE, 1, output) != 1) {
+      logError("failed to write the archive.");
+      result = 1;
       break;
     }
-    currentBlockIndex = nextBlockIndex;
+
+    bytesCopied += copied;
   }
 
-  fclose(outputFile);
-}
+  if (result == 0 && bytesCopied < fileSize) {
+    snprintf(message, sizeof(message), "%s got shorter while it was archived",
+             inputPath);
+    logWarning(message);
+    size_t_to_field(fileInfo->size, bytesCopied);
+    free(hashes);
+  } else if (result == 0 && checksums) {
+    sealWrittenMember(header, fileIndex, NULL, hashes);
+  } else {
+    free(hashes);
+  }
+
+  if (inputFd < 0) {
+    close(input);
+  }
+
+  return result;
+}
+
+/**
+ * @description: writes the header after the last block of a stream, followed
+ * by the checksums, the member attributes, the block table with the block
+ * hashes and the footer that points to the header
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (output) the FILE where the archive is written
+ * @parameter: (blockCount) the amount of blocks written
+ * @output: the exit code
+ */
+int writeStreamIndex(struct posix_header *header, FILE *output,
+                     size_t blockCount) {
+  struct stream_footer footer;
+  size_t tailLength = headerTailLength(header);
+
+  memset(&footer, 0, sizeof(footer));
+  memcpy(footer.magic, STREAM_FOOTER_MAGIC, sizeof(footer.magic));
+  size_t_to_octal(footer.entryCount, header->count);
+  size_t_to_octal(footer.blockCount, blockCount);
+  size_t_to_octal(footer.tailLength, tailLength);
+
+  // the block hashes go right after the table, as when the header is
+  // committed
+  bool hasBlockHashes =
+      header->blockTable && header->attributes && header->checksums;
+
+  if (hasBlockHashes) {
+    setArchiveFlags(header, archiveFlags(header) | ARCHIVE_FLAG_BLOCK_HASHES);
+  }
+
+  if (fwrite(header->files, sizeof(struct posix_file_info), header->count,
+             output) != header->count ||
+      fwrite(header->tail, 1, tailLength, output) != tailLength ||
+      (header->checksums &&
+       storeBlockChecksums(header, output, blockCount) != 0) ||
+      (header->attributes && storeMemberAttributes(header, output) != 0) ||
+      (header->blockTable && storeBlockTable(header, output) != 0) ||
+      (hasBlockHashes && storeBlockHashes(header, output) != 0) ||
+      fwrite(&footer, sizeof(footer), 1, output) != 1) {
+    logError("failed to write the index of the archive.");
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * @description: creates the header for the tar file using FAT table. Each
+ * input is opened once and its size is taken with fstat. The descriptors are
+ * kept open for the copy of the blocks, up to the limit of open files.
+ * @parameter: (file_header) the header or FAT table to be set.
+ * @parameter: (num_files) the amount of input files received
+ * @parameter: (input_files) the files to be written.
+ * @parameter: (inputFds) the descriptor of each input, -1 when it was closed.
+ * This will be set in the function.
+ * @parameter: (blockCount) the amount of blocks the files will use. This will
+ * be set in the function.
+ * @output: the exit code
+ */
+int createHeader(struct posix_header *file_header, int num_files,
+                 char *input_files[], int inputFds[], size_t *blockCount) {
+  char message[100];
+
+  // pre-calc of the block to be placed
+  size_t blocksCreated = 0;
+  size_t fdBudget = inputFdBudget();
+
+  reserveHeader(file_header, num_files);
+
+  for (int i = 0; i < num_files; i++) {
+    struct stat status;
+
+    inputFds[i] = -1;
+
+    if (!isMemberNameValid(get_filename(input_files[i]),
+                           isGlobalExtentLayout)) {
+      closeInputFiles(inputFds, i);
+      return 1;
+    }
+
+    int input = open(input_files[i], O_RDONLY | O_CLOEXEC);
+
+    inputOpenCount++;
+
+    if (input < 0 || fstat(input, &status) != 0) {
+      snprintf(message, sizeof(message), "couldn't open file %s",
+               input_files[i]);
+      logError(message);
+
+      if (input >= 0) {
+        close(input);
+      }
+
+      closeInputFiles(inputFds, i);
+      return 1;
+    }
+
+    inputStatCount++;
+
+    size_t file_size = status.st_size;
+    const char *filename = get_filename(input_files[i]);
+
+    size_t numBlocks = blocksForSize(file_size);
+
+    struct posix_file_info file_info;
+    memset(&file_info, 0, sizeof(file_info));
+
+    snprintf(file_info.filename,
+             isGlobalExtentLayout ? EXTENT_NAME_SIZE : sizeof(file_info.filename),
+             "%s", filename);
+
+    // size is stored in octal
+    size_t_to_field(file_info.size, file_size);
+    size_t_to_field(file_info.blockAddress, blocksCreated);
+
+    // blocks are written one after the other, so each file is one extent
+    if (isGlobalExtentLayout) {
+      struct extent_list extents;
+
+      initExtentList(&extents);
+
+      for (size_t b = 0; b < numBlocks; b++) {
+        addExtentBlock(&extents, blocksCreated + b);
+      }
+
+      storeFileExtents(&file_info, &extents);
+    }
+
+    snprintf(message, sizeof(message), "Adding file %s to header", filename);
+    logVerbose(message);
+
+    file_header->files[i] = file_info;
+    file_header->count++;
+
+    if (file_header->attributes) {
+      setMemberAttributes(file_header->attributes, i,
+                          fileModificationTime(&status), 0);
+    }
+
+    blocksCreated += numBlocks;
+
+    // past the budget the file is opened again when its blocks are copied
+    if ((size_t)i < fdBudget) {
+      inputFds[i] = input;
+    } else {
+      close(input);
+    }
+  }
+
+  (*blockCount) = blocksCreated;
+
+  return 0;
+}
+
+/**
+ * @description: calculates how many inputs can be kept open at once, leaving
+ * room for the archive and the rest of the program
+ * @output: the amount of descriptors that can be kept open
+ */
+size_t inputFdBudget() {
+  struct rlimit limit;
+
+  if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur <= 64) {
+    return 0;
+  }
+
+  return limit.rlim_cur - 64;
+}
+
+/**
+ * @description: closes the inputs that were kept open
+ * @parameter: (inputFds) the descriptor of each input, -1 when it is closed
+ * @parameter: (count) the amount of inputs
+ * @output: n/a
+ */
+void closeInputFiles(int inputFds[], int count) {
+  for (int i = 0; i < count; i++) {
+    if (inputFds[i] >= 0) {
+      close(inputFds[i]);
+      inputFds[i] = -1;
+    }
+  }
+}
+
+/**
+ * @description: create the FAT Blocks for the tar file. With more than one
+ * job the members are shared between a pool of workers, each one writing the
+ * blocks of its files at the positions already set in the header.
+ * @parameter: (file_header) the header or FAT table to be used.
+ * @parameter: (output) the tar FILE to be written.
+ * @parameter: (directFd) the tar file opened with O_DIRECT, -1 to write the
+ * blocks through the page cache
+ * @parameter: (num_files) the amount of input files received
+ * @parameter: (input_files) the files to be written.
+ * @parameter: (inputFds) the descriptor of each input, -1 when it is closed
+ * @output: the exit code
+ */
+int createFATBlocks(struct posix_header *file_header, FILE *output,
+                    int directFd, int num_files, char *input_files[],
+                    int inputFds[]) {
+  char message[100];
+  struct create_job job;
+
+  // the blocks are written through the fd from now on
+  fflush(output);
+
+  job.header = file_header;
+  job.archiveFd = directFd >= 0 ? directFd : fileno(output);
+  job.isDirect = directFd >= 0;
+  job.isOctalFields = isGlobalOctalFields;
+  job.inputFiles = input_files;
+  job.inputFds = inputFds;
+  job.nextMember = 0;
+  job.result = 0;
+  pthread_mutex_init(&job.lock, NULL);
+
+  size_t bytesWritten = 0;
+
+  for (int i = 0; i < num_files; i++) {
+    bytesWritten += field_to_size_t(file_header->files[i].size);
+  }
+
+  // the I/O engine keeps the transfers in flight from a single thread
+  int workerCount = globalJobCount < num_files ? globalJobCount : num_files;
+
+  if (isGlobalAsyncIO) {
+    workerCount = 1;
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  pthread_t workers[MAX_JOBS];
+  int startedWorkers = 0;
+
+  for (int w = 1; w < workerCount; w++) {
+    if (pthread_create(&workers[startedWorkers], NULL, createWorker, &job) !=
+        0) {
+      logWarning("couldn't start a creation worker");
+      break;
+    }
+
+    startedWorkers++;
+  }
+
+  // the calling thread works as well, alone when there is only one job
+  if (isGlobalAsyncIO) {
+    job.result = createAsyncBlocks(&job);
+  } else {
+    createWorker(&job);
+  }
+
+  for (int w = 0; w < startedWorkers; w++) {
+    pthread_join(workers[w], NULL);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double seconds =
+      (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  double megabytes = bytesWritten / (1024.0 * 1024.0);
+
+  snprintf(message, 100,
+           "archived %.1f MB with %d jobs%s%s in %.2fs (%.1f MB/s)", megabytes,
+           startedWorkers + 1, isGlobalAsyncIO ? ", async I/O" : "",
+           job.isDirect ? ", direct I/O" : "", seconds,
+           seconds > 0 ? megabytes / seconds : 0.0);
+  logVerbose(message);
+
+  pthread_mutex_destroy(&job.lock);
+
+  return job.result;
+}
+
+/**
+ * @description: takes members from the job and writes their blocks until
+ * there are no more left or one of them fails
+ * @parameter: (argument) the create_job shared by the workers
+ * @output: NULL
+ */
+void *createWorker(void *argument) {
+  struct create_job *job = argument;
+
+  isGlobalOctalFields = job->isOctalFields;
+
+  while (true) {
+    pthread_mutex_lock(&job->lock);
+    size_t member = job->nextMember++;
+    bool hasFailed = job->result != 0;
+    pthread_mutex_unlock(&job->lock);
+
+    if (member >= job->header->count || hasFailed) {
+      break;
+    }
+
+    if (createMemberBlocks(job->archiveFd, job->header, member,
+                           job->inputFiles[member], job->inputFds[member],
+                           job->isDirect) != 0) {
+      pthread_mutex_lock(&job->lock);
+      job->result = 1;
+      pthread_mutex_unlock(&job->lock);
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * @description: writes the blocks of a member, starting at the block set in
+ * its header entry, and seals it with the checksums of the blocks written. If
+ * the file got shorter since its size was taken, the size in the header is
+ * set to the bytes really copied, and it is sealed with the header.
+ * @parameter: (archiveFd) the file descriptor of the tar file
+ * @parameter: (header) the FAT header, reserved to seal its members
+ * @parameter: (fileIndex) the header entry of the member
+ * @parameter: (inputPath) the file to be written
+ * @parameter: (inputFd) the file already opened, -1 to open it here
+ * @parameter: (isDirect) true if the archive was opened with O_DIRECT
+ * @output: the exit code
+ */
+int createMemberBlocks(int archiveFd, struct posix_header *header,
+                       size_t fileIndex, char *inputPath, int inputFd,
+                       bool isDirect) {
+  char message[100];
+  struct posix_file_info *fileInfo = &header->files[fileIndex];
+  size_t fileSize = field_to_size_t(fileInfo->size);
+  size_t firstBlock = field_to_size_t(fileInfo->blockAddress);
+  size_t numBlocks = blocksForSize(fileSize);
+
+  snprintf(message, sizeof(message),
+           "num blocks [%zu] for [%s] because of size [%zu / %d]", numBlocks,
+           fileInfo->filename, fileSize, BLOCK_DATA_SIZE);
+  logVerbose(message);
+
+  int input = inputFd;
+
+  if (input < 0) {
+    input = open(inputPath, O_RDONLY | O_CLOEXEC);
+    inputOpenCount++;
+  }
+
+  if (input < 0) {
+    snprintf(message, sizeof(message), "couldn't open file %s", inputPath);
+    logError(message);
+    return 1;
+  }
+
+  // the checksums and the hashes are taken from the block buffer as the
+  // blocks are written, so checked blocks go through it instead of being
+  // copied by the kernel
+  struct block_checksums *checksums = header->checksums;
+  uint64_t *hashes = checksums && header->attributes && numBlocks > 0
+                         ? malloc(numBlocks * sizeof(uint64_t))
+                         : NULL;
+
+  // direct writes need a whole aligned block, the data goes through it
+  struct block_data *block = NULL;
+
+  if ((isDirect || checksums) && numBlocks > 0 &&
+      !(block = acquireBlockBuffers(1))) {
+    free(hashes);
+
+    if (inputFd < 0) {
+      close(input);
+    }
+
+    return 1;
+  }
+
+  size_t bytesCopied = 0;
+
+  for (size_t b = 0; b < numBlocks; b++) {
+    size_t nextBlock = b + 1 < numBlocks ? firstBlock + b + 1 : 0;
+    size_t length = fileSize - b * BLOCK_DATA_SIZE;
+
+    if (length > BLOCK_DATA_SIZE) {
+      length = BLOCK_DATA_SIZE;
+    }
+
+    snprintf(message, sizeof(message), "block #%zu", firstBlock + b);
+    logVerbose(message);
+
+    ssize_t copied;
+
+    if (isDirect) {
+      copied = writeDirectBlock(archiveFd, firstBlock + b, nextBlock, input,
+                                b * BLOCK_DATA_SIZE, length, block);
+    } else if (block) {
+      copied = writeBufferedBlock(archiveFd, firstBlock + b, nextBlock, input,
+                                  b * BLOCK_DATA_SIZE, length, block);
+    } else {
+      copied = writeBlockData(archiveFd, firstBlock + b, nextBlock, input,
+                              b * BLOCK_DATA_SIZE, length);
+    }
+
+    if (copied < 0) {
+      free(hashes);
+
+      if (block) {
+        releaseBlockBuffers(block, 1);
+      }
+
+      if (inputFd < 0) {
+        close(input);
+      }
+
+      return 1;
+    }
+
+    if (checksums) {
+      checksums->blocks[firstBlock + b] = blockDataChecksum(block);
+    }
+
+    if (hashes) {
+      hashes[b] = hashBlockData(block->data, copied);
+    }
+
+    bytesCopied += copied;
+  }
+
+  if (bytesCopied < fileSize) {
+    snprintf(message, sizeof(message), "%s got shorter while it was archived",
+             inputPath);
+    logWarning(message);
+    size_t_to_field(fileInfo->size, bytesCopied);
+    free(hashes);
+  } else if (checksums) {
+    sealWrittenMember(header, fileIndex, NULL, hashes);
+  }
+
+  if (block) {
+    releaseBlockBuffers(block, 1);
+  }
+
+  if (inputFd < 0) {
+    close(input);
+  }
+
+  return 0;
+}
+
+/**
+ * @description: writes a block taking its data from a file. Only the next
+ * pointer is written from here, the data is copied by the kernel. The rest of
+ * the block is left as a hole, which reads as zeros. Nothing of the archive
+ * can be left in stdio buffers.
+ * @parameter: (archiveFd) the file descriptor of the tar file
+ * @parameter: (blockIndex) the block to write
+ * @parameter: (nextBlockIndex) the next block of the chain, 0 if it is the last
+ * @parameter: (inputFd) the file the data comes from
+ * @parameter: (inputOffset) the position of the data in the file
+ * @parameter: (length) the amount of bytes to copy, at most BLOCK_DATA_SIZE
+ * @output: the amount of bytes copied, -1 on errors
+ */
+ssize_t writeBlockData(int archiveFd, size_t blockIndex, size_t nextBlockIndex,
+                       int inputFd, size_t inputOffset, size_t length) {
+  struct block_metadata metadata;
+
+  size_t_to_field(metadata.next, nextBlockIndex);
+  size_t_to_field(metadata.storedLength, 0);
+
+  off_t offset = blockOffset(blockIndex);
+
+  if (pwrite(archiveFd, &metadata, sizeof(metadata), offset) !=
+      sizeof(metadata)) {
+    logError("failed to write block data.");
+    return -1;
+  }
+
+  ssize_t copied = copyRange(inputFd, inputOffset, archiveFd,
+                             offset + sizeof(metadata), length);
+
+  if (copied < 0) {
+    logError("failed to write block data.");
+    return -1;
+  }
+
+  // the archive always ends with a whole block
+  char lastByte = 0;
+
+  if (copied < BLOCK_DATA_SIZE &&
+      pwrite(archiveFd, &lastByte, 1, offset + BLOCK_SIZE - 1) != 1) {
+    logError("failed to write block data.");
+    return -1;
+  }
+
+  return copied;
+}
+
+/**
+ * @description: writes a whole block through a buffer. The data is read from
+ * the file into the buffer and written from there, so it can be checked on
+ * the way.
+ * @parameter: (archiveFd) the tar file, opened with O_DIRECT or not
+ * @parameter: (blockIndex) the block to write
+ * @parameter: (nextBlockIndex) the next block of the chain, 0 if it is the last
+ * @parameter: (inputFd) the file the data comes from
+ * @parameter: (inputOffset) the position of the data in the file
+ * @parameter: (length) the amount of bytes to copy, at most BLOCK_DATA_SIZE
+ * @parameter: (block) a page aligned buffer of BLOCK_SIZE bytes
+ * @output: the amount of bytes copied, -1 on errors
+ */
+ssize_t writeBufferedBlock(int archiveFd, size_t blockIndex,
+                           size_t nextBlockIndex, int inputFd,
+                           size_t inputOffset, size_t length,
+                           struct block_data *block) {
+  ssize_t copied = preadFull(inputFd, block->data, length, inputOffset);
+
+  if (copied < 0) {
+    logError("failed to read block data.");
+    return -1;
+  }
+
+  memset(block->data + copied, 0, BLOCK_DATA_SIZE - copied);
+  size_t_to_field(block->next, nextBlockIndex);
+  size_t_to_field(block->storedLength, 0);
+
+  if (pwriteFull(archiveFd, block, BLOCK_SIZE, blockOffset(blockIndex)) !=
+      BLOCK_SIZE) {
+    logError("failed to write block data.");
+    return -1;
+  }
+
+  return copied;
+}
+
+/**
+ * @description: writes a whole block with O_DIRECT. The data goes through an
+ * aligned buffer, and the part of the input already read is dropped from the
+ * page cache, so neither file stays in memory.
+ * @parameter: (archiveFd) the tar file opened with O_DIRECT
+ * @parameter: (blockIndex) the block to write
+ * @parameter: (nextBlockIndex) the next block of the chain, 0 if it is the last
+ * @parameter: (inputFd) the file the data comes from
+ * @parameter: (inputOffset) the position of the data in the file
+ * @parameter: (length) the amount of bytes to copy, at most BLOCK_DATA_SIZE
+ * @parameter: (block) a page aligned buffer of BLOCK_SIZE bytes
+ * @output: the amount of bytes copied, -1 on errors
+ */
+ssize_t writeDirectBlock(int archiveFd, size_t blockIndex,
+                         size_t nextBlockIndex, int inputFd,
+                         size_t inputOffset, size_t length,
+                         struct block_data *block) {
+  ssize_t copied = writeBufferedBlock(archiveFd, blockIndex, nextBlockIndex,
+                                      inputFd, inputOffset, length, block);
+
+  if (copied >= 0) {
+    dropCachedRange(inputFd, inputOffset, copied);
+  }
+
+  return copied;
+}
+
+/**
+ * @description: reads a whole block into an aligned buffer, which reads with
+ * O_DIRECT need
+ * @parameter: (archiveFd) the tar file, opened with O_DIRECT or not
+ * @parameter: (blockIndex) the block to read
+ * @parameter: (block) a page aligned buffer of BLOCK_SIZE bytes
+ * @output: the block read, NULL on errors
+ */
+const struct block_data *readDirectBlock(int archiveFd, size_t blockIndex,
+                                         struct block_data *block) {
+  ssize_t result = preadFull(archiveFd, block, BLOCK_SIZE,
+                             blockOffset(blockIndex));
+
+  if (result < (ssize_t)sizeof(struct block_metadata)) {
+    logError("Failed to read block data.");
+    return NULL;
+  }
+
+  // the last block of old archives can be shorter
+  memset((char *)block + result, 0, BLOCK_SIZE - result);
+
+  return block;
+}
+
+/**
+ * @description: writes the blocks of every member through the I/O engine.
+ * The blocks of the next members are read while the previous ones are still
+ * being written, so many transfers stay in flight.
+ * @parameter: (job) the create_job with the members and the archive
+ * @output: the exit code
+ */
+int createAsyncBlocks(struct create_job *job) {
+  char message[100];
+  struct block_stream stream;
+  struct posix_header *header = job->header;
+
+  if (openBlockStream(&stream, job->archiveFd, job->isDirect) != 0) {
+    return 1;
+  }
+
+  struct member_copy *members =
+      calloc(header->count > 0 ? header->count : 1, sizeof(struct member_copy));
+
+  if (!members) {
+    logError("memory allocation for the members failed.");
+    closeBlockStream(&stream);
+    return 1;
+  }
+
+  for (size_t m = 0; m < header->count && stream.result == 0; m++) {
+    struct member_copy *member = &members[m];
+    size_t fileSize = field_to_size_t(header->files[m].size);
+    size_t firstBlock = field_to_size_t(header->files[m].blockAddress);
+    size_t numBlocks = blocksForSize(fileSize);
+
+    member->header = header;
+    member->fileIndex = m;
+    member->inputPath = job->inputFiles[m];
+    member->inputFd = job->inputFds[m];
+    member->blocks = header->checksums && numBlocks > 0
+                         ? malloc(numBlocks * sizeof(size_t))
+                         : NULL;
+    member->hashes = member->blocks && header->attributes
+                         ? malloc(numBlocks * sizeof(uint64_t))
+                         : NULL;
+
+    if (member->inputFd < 0) {
+      member->inputFd = open(member->inputPath, O_RDONLY | O_CLOEXEC);
+      member->isOwnFd = true;
+      inputOpenCount++;
+    }
+
+    if (member->inputFd < 0) {
+      snprintf(message, sizeof(message), "couldn't open file %s",
+               member->inputPath);
+      logError(message);
+      stream.result = 1;
+      break;
+    }
+
+    for (size_t b = 0; b < numBlocks; b++) {
+      size_t nextBlock = b + 1 < numBlocks ? firstBlock + b + 1 : 0;
+      size_t length = fileSize - b * BLOCK_DATA_SIZE;
+
+      if (length > BLOCK_DATA_SIZE) {
+        length = BLOCK_DATA_SIZE;
+      }
+
+      queueBlockCopy(&stream, member, firstBlock + b, nextBlock,
+                     b * BLOCK_DATA_SIZE, length);
+    }
+
+    finishQueuedMember(&stream, member);
+  }
+
+  int result = closeBlockStream(&stream);
+
+  // members left behind by a failed transfer
+  for (size_t m = 0; m < header->count; m++) {
+    if (members[m].isOwnFd) {
+      close(members[m].inputFd);
+    }
+
+    free(members[m].blocks);
+    free(members[m].hashes);
+  }
+
+  free(members);
+
+  return result;
+}
+
+/**
+ * @description: prepares a stream of block copies into the archive
+ * @parameter: (stream) the stream to open
+ * @parameter: (archiveFd) the file descriptor of the tar file
+ * @parameter: (isDirect) true if the archive was opened with O_DIRECT
+ * @output: the exit code
+ */
+int openBlockStream(struct block_stream *stream, int archiveFd,
+                    bool isDirect) {
+  memset(stream, 0, sizeof(*stream));
+  stream->archiveFd = archiveFd;
+  stream->isDirect = isDirect;
+  stream->buffers = acquireBlockBuffers(IO_QUEUE_DEPTH);
+
+  if (!stream->buffers) {
+    return 1;
+  }
+
+  if (initIOEngine(&stream->engine, IO_QUEUE_DEPTH) != 0) {
+    releaseBlockBuffers(stream->buffers, IO_QUEUE_DEPTH);
+    return 1;
+  }
+
+  for (int s = 0; s < IO_QUEUE_DEPTH; s++) {
+    stream->slots[s].block = &stream->buffers[s];
+    stream->slots[s].request.owner = &stream->slots[s];
+  }
+
+  return 0;
+}
+
+/**
+ * @description: queues the copy of a block from a file into the archive.
+ * When every slot is in flight, it waits until one of them is written.
+ * @parameter: (stream) the block stream
+ * @parameter: (member) the member the block belongs to
+ * @parameter: (blockIndex) the block to write
+ * @parameter: (nextBlockIndex) the next block of the chain, 0 if it is the last
+ * @parameter: (inputOffset) the position of the data in the file
+ * @parameter: (length) the amount of bytes to copy, at most BLOCK_DATA_SIZE
+ * @output: n/a
+ */
+void queueBlockCopy(struct block_stream *stream, struct member_copy *member,
+                    size_t blockIndex, size_t nextBlockIndex,
+                    size_t inputOffset, size_t length) {
+  struct copy_slot *slot = NULL;
+
+  while (!slot) {
+    for (int s = 0; s < IO_QUEUE_DEPTH && !slot; s++) {
+      if (!stream->slots[s].isUsed) {
+        slot = &stream->slots[s];
+      }
+    }
+
+    if (!slot) {
+      struct io_request *request = waitIO(&stream->engine);
+
+      if (!request) {
+        stream->result = 1;
+        return;
+      }
+
+      handleCopyCompletion(stream, request);
+    }
+  }
+
+  slot->isUsed = true;
+  slot->member = member;
+  slot->blockIndex = blockIndex;
+
+  size_t_to_field(slot->block->next, nextBlockIndex);
+  size_t_to_field(slot->block->storedLength, 0);
+
+  // first the data is read into the block, then the whole block is written
+  slot->request.fd = member->inputFd;
+  slot->request.buffer = slot->block->data;
+  slot->request.length = length;
+  slot->request.offset = inputOffset;
+  slot->request.isWrite = false;
+
+  member->pendingBlocks++;
+  submitIO(&stream->engine, &slot->request);
+}
+
+/**
+ * @description: handles a transfer of the stream that completed. A read is
+ * followed by the write of its block, a write frees its slot.
+ * @parameter: (stream) the block stream
+ * @parameter: (request) the completed request
+ * @output: n/a
+ */
+void handleCopyCompletion(struct block_stream *stream,
+                          struct io_request *request) {
+  struct copy_slot *slot = request->owner;
+  struct member_copy *member = slot->member;
+
+  if (!request->isWrite && request->result >= 0) {
+    member->bytesCopied += request->result;
+
+    memset(slot->block->data + request->result, 0,
+           BLOCK_DATA_SIZE - request->result);
+
+    // the checksum and the hash are taken while the block is in memory
+    if (member->blocks) {
+      struct block_checksums *checksums = member->header->checksums;
+      size_t position = request->offset / BLOCK_DATA_SIZE;
+
+      reserveBlockChecksums(checksums, slot->blockIndex + 1);
+      checksums->blocks[slot->blockIndex] = blockDataChecksum(slot->block);
+      member->blocks[position] = slot->blockIndex;
+
+      if (member->hashes) {
+        member->hashes[position] =
+            hashBlockData(slot->block->data, request->result);
+      }
+    }
+
+    if (stream->isDirect) {
+      dropCachedRange(member->inputFd, request->offset, request->result);
+    }
+
+    request->fd = stream->archiveFd;
+    request->buffer = slot->block;
+    request->length = BLOCK_SIZE;
+    request->offset = blockOffset(slot->blockIndex);
+    request->isWrite = true;
+
+    submitIO(&stream->engine, request);
+    return;
+  }
+
+  // reads only get here when they failed
+  if (!request->isWrite || request->result != BLOCK_SIZE) {
+    logError(request->isWrite ? "failed to write block data."
+                              : "failed to read block data.");
+    stream->result = 1;
+    member->hasFailed = true;
+  }
+
+  slot->isUsed = false;
+  member->pendingBlocks--;
+
+  if (member->isQueued && member->pendingBlocks == 0) {
+    completeMemberCopy(member);
+  }
+}
+
+/**
+ * @description: marks that every block of a member was queued, so it is
+ * completed once the last one is written
+ * @parameter: (stream) the block stream
+ * @parameter: (member) the member
+ * @output: n/a
+ */
+void finishQueuedMember(struct block_stream *stream,
+                        struct member_copy *member) {
+  member->isQueued = true;
+
+  if (member->pendingBlocks == 0) {
+    completeMemberCopy(member);
+  }
+}
+
+/**
+ * @description: completes a member after its last block was written, and
+ * seals it with the checksums taken on the way. If the file got shorter since
+ * its size was taken, the size in the header is set to the bytes really
+ * copied, and it is sealed with the header.
+ * @parameter: (member) the member
+ * @output: n/a
+ */
+void completeMemberCopy(struct member_copy *member) {
+  char message[100];
+  struct posix_file_info *fileInfo = &member->header->files[member->fileIndex];
+
+  if (member->bytesCopied < field_to_size_t(fileInfo->size)) {
+    snprintf(message, sizeof(message), "%s got shorter while it was archived",
+             member->inputPath);
+    logWarning(message);
+    size_t_to_field(fileInfo->size, member->bytesCopied);
+  } else if (member->blocks && !member->hasFailed) {
+    sealWrittenMember(member->header, member->fileIndex, member->blocks,
+                      member->hashes);
+    member->blocks = NULL;
+    member->hashes = NULL;
+  }
+
+  free(member->blocks);
+  free(member->hashes);
+  member->blocks = NULL;
+  member->hashes = NULL;
+
+  if (member->isOwnFd) {
+    close(member->inputFd);
+    member->isOwnFd = false;
+  }
+}
+
+/**
+ * @description: waits for every transfer of the stream and releases it
+ * @parameter: (stream) the block stream
+ * @output: the exit code, not 0 when any transfer failed
+ */
+int closeBlockStream(struct block_stream *stream) {
+  struct io_request *request;
+
+  while ((request = waitIO(&stream->engine)) != NULL) {
+    handleCopyCompletion(stream, request);
+  }
+
+  destroyIOEngine(&stream->engine);
+  releaseBlockBuffers(stream->buffers, IO_QUEUE_DEPTH);
+
+  return stream->result;
+}
+
+/**
+ * @description: copies the data of a block to a file. The data is copied by
+ * the kernel, without going through a buffer.
+ * @parameter: (archive) the tar FILE
+ * @parameter: (blockIndex) the block to read
+ * @parameter: (outputFile) the file being extracted
+ * @parameter: (outputOffset) the position of the data in the file
+ * @parameter: (length) the amount of bytes of the block used by the file
+ * @output: the exit code
+ */
+int copyBlockData(FILE *archive, size_t blockIndex, FILE *outputFile,
+                  size_t outputOffset, size_t length) {
+  ssize_t copied = copyRange(fileno(archive),
+                             blockOffset(blockIndex) +
+                                 sizeof(struct block_metadata),
+                             fileno(outputFile), outputOffset, length);
+
+  if (copied < 0 || (size_t)copied != length) {
+    logError("Failed to read block data.");
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * ------------------------------------------
+ *          EXTRACT COMMAND
+ * ------------------------------------------
+ */
+
+/**
+ * @description: will extract the files in the current directory
+ * @parameter: (filename) the file to be used to extract.
+ * @output: the exit code.
+ */
+int extract(char *files[], int fileCount, char *filename) {
+  char message[100];
+  FILE *archive = fopen(filename, "rb");
+  if (!archive) {
+    logError("Failed to open tar archive file. Double check if the input file "
+             "exists.");
+    return 1;
+  }
+
+  struct posix_header *header = loadHeader(archive);
+
+  if (!header) {
+    fclose(archive);
+    return 1;
+  }
+
+  if (!header->checksums) {
+    logVerbose("the archive has no checksums, the blocks won't be checked");
+  }
+
+  size_t memberCount = 0;
+  size_t missingCount = 0;
+  size_t *members =
+      selectMembers(header, files, fileCount, &memberCount, &missingCount);
+
+  if (!members) {
+    destroyHeader(header);
+    fclose(archive);
+    return 1;
+  }
+
+  // a mapping reads through the page cache, so direct I/O goes first
+  int directFd = isGlobalDirectIO ? openDirect(filename, O_RDONLY) : -1;
+
+  struct archive_map mapped;
+  bool isMapped = directFd < 0 && isGlobalMappedRead &&
+                  mapArchive(archive, &mapped) == 0;
+
+  // files are mostly stored one after the other, but the few members asked
+  // for are spread over the archive
+  if (isMapped) {
+    adviseArchive(&mapped, fileCount == 0);
+  }
+
+  extractFilesByTarFile(header, archive, isMapped ? &mapped : NULL, directFd,
+                        members, memberCount);
+
+  if (isMapped) {
+    unmapArchive(&mapped);
+  }
+
+  logArchiveCache(filename);
+
+  if (directFd >= 0) {
+    close(directFd);
+  }
+
+  free(members);
+  destroyHeader(header);
+  fclose(archive);
+
+  if (missingCount > 0) {
+    snprintf(message, 100, "%zu of the files asked for are not in the archive",
+             missingCount);
+    logError(message);
+    return 1;
+  }
+
+  if (checksumErrorCount > 0) {
+    snprintf(message, 100, "%zu checksums didn't match, the extracted files "
+             "are damaged", (size_t)checksumErrorCount);
+    logError(message);
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * @description: extract the selected files out of a tar file. With more than
+ * one job the members are shared between a pool of workers, each one reading
+ * the archive with pread and writing its own files.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archive) the tar file to be read.
+ * @parameter: (mapped) the archive mapped in memory, NULL to read with stdio
+ * @parameter: (directFd) the archive opened with O_DIRECT, -1 if not used
+ * @parameter: (members) the members to extract, in the order they are taken
+ * @parameter: (memberCount) the amount of members to extract
+ * @output: n/a
+ */
+void extractFilesByTarFile(struct posix_header *header, FILE *archive,
+                           struct archive_map *mapped, int directFd,
+                           size_t *members, size_t memberCount) {
+  char message[100];
+  struct extract_job job;
+
+  job.header = header;
+  job.archive = archive;
+  job.mapped = mapped;
+  job.directFd = directFd;
+  job.useExtents = archiveFlags(header) & ARCHIVE_FLAG_EXTENTS;
+  job.isOctalFields = isGlobalOctalFields;
+  job.members = members;
+  job.memberCount = memberCount;
+  job.nextMember = 0;
+
+  if (archiveFlags(header) & ARCHIVE_FLAG_COMPRESSED) {
+    extractCompressedArchive(header, archive, members, memberCount);
+    return;
+  }
+
+  pthread_mutex_init(&job.lock, NULL);
+
+  size_t bytesExtracted = 0;
+
+  for (size_t m = 0; m < memberCount; m++) {
+    bytesExtracted += field_to_size_t(header->files[members[m]].size);
+  }
+
+  int workerCount = globalJobCount;
+
+  if ((size_t)workerCount > memberCount) {
+    workerCount = memberCount > 0 ? memberCount : 1;
+  }
+
+  // the I/O engine keeps the reads in flight from a single thread
+  if (isGlobalAsyncIO) {
+    workerCount = 1;
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  pthread_t workers[MAX_JOBS];
+  int startedWorkers = 0;
+
+  for (int w = 1; w < workerCount; w++) {
+    if (pthread_create(&workers[startedWorkers], NULL, extractWorker, &job) !=
+        0) {
+      logWarning("couldn't start an extraction worker");
+      break;
+    }
+
+    startedWorkers++;
+  }
+
+  // the calling thread works as well, alone when there is only one job
+  if (isGlobalAsyncIO) {
+    extractAsyncMembers(&job);
+  } else {
+    extractWorker(&job);
+  }
+
+  for (int w = 0; w < startedWorkers; w++) {
+    pthread_join(workers[w], NULL);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double seconds =
+      (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  double megabytes = bytesExtracted / (1024.0 * 1024.0);
+
+  snprintf(message, 100,
+           "extracted %.1f MB with %d jobs%s%s in %.2fs (%.1f MB/s)",
+           megabytes, startedWorkers + 1, isGlobalAsyncIO ? ", async I/O" : "",
+           directFd >= 0 ? ", direct I/O" : "", seconds,
+           seconds > 0 ? megabytes / seconds : 0.0);
+  logVerbose(message);
+
+  pthread_mutex_destroy(&job.lock);
+}
+
+/**
+ * @description: takes members from the job and extracts them until there are
+ * no more left
+ * @parameter: (argument) the extract_job shared by the workers
+ * @output: NULL
+ */
+void *extractWorker(void *argument) {
+  struct extract_job *job = argument;
+
+  isGlobalOctalFields = job->isOctalFields;
+
+  while (true) {
+    pthread_mutex_lock(&job->lock);
+    size_t position = job->nextMember++;
+    pthread_mutex_unlock(&job->lock);
+
+    if (position >= job->memberCount) {
+      break;
+    }
+
+    size_t member = job->members[position];
+
+    extractFileByTarFile(job->archive, job->mapped, job->directFd,
+                         &job->header->files[member], job->useExtents,
+                         memberChecksums(job->header, member), member);
+  }
+
+  return NULL;
+}
+
+/**
+ * @description: extracts the members through the I/O engine. Several members
+ * are extracted at once, and the blocks of each one are read ahead guessing
+ * they follow each other, which is how create and pack leave them. The next
+ * pointer of every block checks the guess, and the blocks read by a wrong
+ * guess are dropped and read again from the right position.
+ * @parameter: (job) the extract_job with the members and the archive
+ * @output: the exit code
+ */
+int extractAsyncMembers(struct extract_job *job) {
+  struct io_engine engine;
+  struct read_slot slots[IO_QUEUE_DEPTH];
+  struct chain_reader readers[IO_QUEUE_DEPTH];
+  int archiveFd = job->directFd >= 0 ? job->directFd : fileno(job->archive);
+  char *buffers = acquireBlockBuffers(IO_QUEUE_DEPTH);
+
+  if (!buffers) {
+    return 1;
+  }
+
+  if (initIOEngine(&engine, IO_QUEUE_DEPTH) != 0) {
+    releaseBlockBuffers(buffers, IO_QUEUE_DEPTH);
+    return 1;
+  }
+
+  memset(slots, 0, sizeof(slots));
+  memset(readers, 0, sizeof(readers));
+
+  for (int s = 0; s < IO_QUEUE_DEPTH; s++) {
+    slots[s].request.buffer = buffers + (size_t)s * BLOCK_SIZE;
+    slots[s].request.owner = &slots[s];
+  }
+
+  size_t nextMember = 0;
+
+  while (true) {
+    // a new member takes every reader left free
+    for (int r = 0; r < IO_QUEUE_DEPTH; r++) {
+      while (!readers[r].fileInfo && nextMember < job->memberCount) {
+        size_t member = job->members[nextMember++];
+
+        startChainReader(&readers[r], &job->header->files[member],
+                         memberChecksums(job->header, member), member);
+      }
+    }
+
+    // the readers take turns, so small members don't wait for big ones
+    bool hasIssued = true;
+
+    while (hasIssued) {
+      hasIssued = false;
+
+      for (int r = 0; r < IO_QUEUE_DEPTH; r++) {
+        struct chain_reader *reader = &readers[r];
+
+        if (!reader->fileInfo || reader->isFinished ||
+            reader->issuedPosition >= reader->blockTotal) {
+          continue;
+        }
+
+        struct read_slot *slot = NULL;
+
+        for (int s = 0; s < IO_QUEUE_DEPTH && !slot; s++) {
+          if (!slots[s].isUsed) {
+            slot = &slots[s];
+          }
+        }
+
+        if (!slot) {
+          break;
+        }
+
+        slot->isUsed = true;
+        slot->isDone = false;
+        slot->reader = reader;
+        slot->position = reader->issuedPosition++;
+        slot->blockIndex = reader->issueBlock++;
+        slot->generation = reader->generation;
+        slot->request.fd = archiveFd;
+        slot->request.length = BLOCK_SIZE;
+        slot->request.offset = blockOffset(slot->blockIndex);
+        slot->request.isWrite = false;
+
+        reader->inFlight++;
+        submitIO(&engine, &slot->request);
+        hasIssued = true;
+      }
+    }
+
+    struct io_request *request = waitIO(&engine);
+
+    if (!request) {
+      break;
+    }
+
+    handleChainRead(slots, request->owner);
+  }
+
+  // readers left behind when the engine failed
+  for (int r = 0; r < IO_QUEUE_DEPTH; r++) {
+    if (readers[r].fileInfo) {
+      close(readers[r].outputFd);
+    }
+  }
+
+  destroyIOEngine(&engine);
+  releaseBlockBuffers(buffers, IO_QUEUE_DEPTH);
+
+  return 0;
+}
+
+/**
+ * @description: creates the output of a member and prepares its reader.
+ * Members without blocks are done right away.
+ * @parameter: (reader) the free reader
+ * @parameter: (fileInfo) the info of the member
+ * @parameter: (checksums) the checksums of the archive, NULL if it has none
+ * @parameter: (fileIndex) the position of the member in the header
+ * @output: n/a
+ */
+void startChainReader(struct chain_reader *reader,
+                      struct posix_file_info *fileInfo,
+                      struct block_checksums *checksums, size_t fileIndex) {
+  char message[100];
+  int outputFd = open(fileInfo->filename,
+                      O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+
+  if (outputFd < 0) {
+    snprintf(message, sizeof(message), "Failed to create file %s",
+             fileInfo->filename);
+    logError(message);
+    return;
+  }
+
+  snprintf(message, sizeof(message), "starting to create %s",
+           fileInfo->filename);
+  logVerbose(message);
+
+  memset(reader, 0, sizeof(*reader));
+  reader->fileSize = field_to_size_t(fileInfo->size);
+  reader->blockTotal = blocksForSize(reader->fileSize);
+
+  if (reader->blockTotal == 0) {
+    close(outputFd);
+    return;
+  }
+
+  reader->fileInfo = fileInfo;
+  reader->outputFd = outputFd;
+  reader->issueBlock = field_to_size_t(fileInfo->blockAddress);
+  reader->checksums = checksums;
+  reader->fileIndex = fileIndex;
+}
+
+/**
+ * @description: finds the read in flight for a position of a chain
+ * @parameter: (slots) the read slots
+ * @parameter: (reader) the reader of the chain
+ * @parameter: (position) the position in the chain
+ * @output: the slot, NULL if that position was not read yet
+ */
+struct read_slot *findReadSlot(struct read_slot *slots,
+                               struct chain_reader *reader, size_t position) {
+  for (int s = 0; s < IO_QUEUE_DEPTH; s++) {
+    if (slots[s].isUsed && slots[s].reader == reader &&
+        slots[s].generation == reader->generation &&
+        slots[s].position == position) {
+      return &slots[s];
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * @description: handles a block read that completed. The blocks of a member
+ * are written in the order of its chain, so a block waits until the ones
+ * before it arrive. Reads of a wrong guess are dropped.
+ * @parameter: (slots) the read slots
+ * @parameter: (slot) the slot of the completed read
+ * @output: n/a
+ */
+void handleChainRead(struct read_slot *slots, struct read_slot *slot) {
+  struct chain_reader *reader = slot->reader;
+
+  reader->inFlight--;
+  slot->isDone = true;
+
+  if (slot->generation != reader->generation) {
+    slot->isUsed = false;
+  }
+
+  struct read_slot *current;
+
+  while ((current = findReadSlot(slots, reader, reader->donePosition)) &&
+         current->isDone) {
+    struct block_data *block = current->request.buffer;
+    ssize_t result = current->request.result;
+
+    current->isUsed = false;
+
+    if (result < (ssize_t)sizeof(struct block_metadata)) {
+      logError("Failed to read block data.");
+      finishChainReader(slots, reader);
+      break;
+    }
+
+    // the last block of old archives can be shorter
+    memset((char *)block + result, 0, BLOCK_SIZE - result);
+
+    if (reader->checksums) {
+      checkBlockChecksum(reader->checksums, current->blockIndex, block,
+                         reader->fileInfo->filename, &reader->memberChecksum);
+    }
+
+    size_t offset = reader->donePosition * BLOCK_DATA_SIZE;
+    size_t writeSize = reader->fileSize - offset;
+
+    if (writeSize > BLOCK_DATA_SIZE) {
+      writeSize = BLOCK_DATA_SIZE;
+    }
+
+    if (pwriteFull(reader->outputFd, block->data, writeSize, offset) !=
+        (ssize_t)writeSize) {
+      logError("Failed to write the extracted file.");
+      finishChainReader(slots, reader);
+      break;
+    }
+
+    size_t nextBlockIndex = field_to_size_t(block->next);
+
+    reader->donePosition++;
+
+    if (reader->donePosition >= reader->blockTotal && reader->checksums) {
+      checkMemberChecksum(reader->checksums, reader->fileIndex,
+                          reader->memberChecksum, reader->fileInfo->filename);
+    }
+
+    if (reader->donePosition >= reader->blockTotal || nextBlockIndex == 0) {
+      finishChainReader(slots, reader);
+      break;
+    }
+
+    struct read_slot *following =
+        findReadSlot(slots, reader, reader->donePosition);
+
+    if (!following) {
+      reader->issueBlock = nextBlockIndex;
+    } else if (following->blockIndex != nextBlockIndex) {
+      // the guess was wrong, the reads after this block are dropped
+      dropChainReads(slots, reader);
+      reader->issuedPosition = reader->donePosition;
+      reader->issueBlock = nextBlockIndex;
+    }
+  }
+
+  if (reader->isFinished && reader->inFlight == 0) {
+    close(reader->outputFd);
+    reader->fileInfo = NULL;
+  }
+}
+
+/**
+ * @description: stops reading a member
+ * @parameter: (slots) the read slots
+ * @parameter: (reader) the reader of the member
+ * @output: n/a
+ */
+void finishChainReader(struct read_slot *slots, struct chain_reader *reader) {
+  reader->isFinished = true;
+  dropChainReads(slots, reader);
+}
+
+/**
+ * @description: drops the reads of a member that are no longer needed. The
+ * ones already done free their slot now, the ones in flight when they arrive.
+ * @parameter: (slots) the read slots
+ * @parameter: (reader) the reader of the member
+ * @output: n/a
+ */
+void dropChainReads(struct read_slot *slots, struct chain_reader *reader) {
+  reader->generation++;
+
+  for (int s = 0; s < IO_QUEUE_DEPTH; s++) {
+    if (slots[s].isUsed && slots[s].reader == reader && slots[s].isDone) {
+      slots[s].isUsed = false;
+    }
+  }
+}
+
+/**
+ * @description: selects the members to extract. When two members have the
+ * same name only the last one is extracted, since it would overwrite the
+ * others anyway, so the result doesn't depend on the order of the workers.
+ * When files are named only those members are extracted, found through the
+ * name index, and the chains of the rest are never read. The members are
+ * sorted by their first block, so the archive is read from start to end.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (files) the files to be extracted, every member when empty
+ * @parameter: (fileCount) the amount of files to be extracted
+ * @parameter: (memberCount) the amount of members selected. This will be set
+ * in the function.
+ * @parameter: (missingCount) the amount of files not in the archive. This
+ * will be set in the function.
+ * @output: the members to extract in the order they are read. NULL on errors.
+ */
+size_t *selectMembers(struct posix_header *header, char *files[],
+                      int fileCount, size_t *memberCount,
+                      size_t *missingCount) {
+  char message[100];
+  size_t entries = header->count > 0 ? header->count : 1;
+  bool *isSelected = calloc(entries, sizeof(bool));
+  struct member_position *positions =
+      malloc(entries * sizeof(struct member_position));
+
+  if (!isSelected || !positions) {
+    logError("Memory allocation for the extraction failed.");
+    free(isSelected);
+    free(positions);
+    return NULL;
+  }
+
+  struct name_index index;
+  initNameIndex(&index, header->files[0].filename,
+                sizeof(struct posix_file_info));
+
+  for (size_t i = 0; i < header->count; i++) {
+    int previous = findName(&index, header->files[i].filename);
+
+    if (previous >= 0) {
+      isSelected[previous] = false;
+      removeName(&index, previous);
+    }
+
+    isSelected[i] = fileCount == 0;
+    addName(&index, i);
+  }
+
+  (*missingCount) = 0;
+
+  for (int f = 0; f < fileCount; f++) {
+    int fileIndex;
+
+    if (!isFileInFATTable(&index, files[f], &fileIndex)) {
+      snprintf(message, 100, "file %s not in archive",
+               get_filename(files[f]));
+      logError(message);
+      (*missingCount)++;
+      continue;
+    }
+
+    isSelected[fileIndex] = true;
+  }
+
+  destroyNameIndex(&index);
+
+  (*memberCount) = 0;
+
+  for (size_t i = 0; i < header->count; i++) {
+    if (isSelected[i]) {
+      positions[*memberCount].blockAddress =
+          field_to_size_t(header->files[i].blockAddress);
+      positions[*memberCount].member = i;
+      (*memberCount)++;
+    }
+  }
+
+  qsort(positions, *memberCount, sizeof(struct member_position),
+        compareMemberPositions);
+
+  size_t *members = malloc(entries * sizeof(size_t));
+
+  if (!members) {
+    logError("Memory allocation for the extraction failed.");
+  }
+
+  for (size_t m = 0; members && m < *memberCount; m++) {
+    members[m] = positions[m].member;
+  }
+
+  free(isSelected);
+  free(positions);
+
+  return members;
+}
+
+/**
+ * @description: compares two members by their first block, for qsort. Members
+ * with the same first block keep the order of the header.
+ * @parameter: (first) the first member_position
+ * @parameter: (second) the second member_position
+ * @output: less than 0, 0 or more than 0 like strcmp
+ */
+int compareMemberPositions(const void *first, const void *second) {
+  const struct member_position *a = first;
+  const struct member_position *b = second;
+
+  if (a->blockAddress != b->blockAddress) {
+    return a->blockAddress < b->blockAddress ? -1 : 1;
+  }
+
+  return a->member < b->member ? -1 : a->member > b->member;
+}
+
+/**
+ * @description: extracts a single file from the tar file
+ * @parameter: (archive) the tar file to be read.
+ * @parameter: (mapped) the archive mapped in memory, NULL to read with stdio
+ * @parameter: (directFd) the archive opened with O_DIRECT, -1 if not used
+ * @parameter: (fileInfo) the info of the specific file to be extracted
+ * @parameter: (useExtents) true if the file records its extents
+ * @parameter: (checksums) the checksums of the archive, NULL if it has none
+ * @parameter: (fileIndex) the position of the member in the header
+ * @output: n/a
+ */
+void extractFileByTarFile(FILE *archive, struct archive_map *mapped,
+                          int directFd, struct posix_file_info *fileInfo,
+                          bool useExtents, struct block_checksums *checksums,
+                          size_t fileIndex) {
+
+  char message[100];
+
+  size_t fileSize = field_to_size_t(fileInfo->size);
+  size_t filePosition = field_to_size_t(fileInfo->blockAddress);
+
+  FILE *outputFile = fopen(fileInfo->filename, "wb");
+
+  if (!outputFile) {
+    snprintf(message, sizeof(message), "Failed to create file %s",
+             fileInfo->filename);
+    logError(message);
+    return; // Continue with next files
+  }
+
+  snprintf(message, sizeof(message), "starting to create %s",
+           fileInfo->filename);
+  logVerbose(message);
+
+  struct block_data *directBlock = NULL;
+  int readFd = directFd >= 0 ? directFd : fileno(archive);
+  size_t currentBlockIndex = filePosition;
+  size_t totalBytesWritten = 0;
+  bool hasMoreBlocks = true;
+  uint32_t memberChecksum = 0;
+
+  // extents are read in bulk, the chain only covers what they don't. Their
+  // blocks are checked in the buffers they are read into.
+  if (useExtents) {
+    currentBlockIndex =
+        extractFileExtents(readFd, mapped, fileInfo, outputFile, checksums,
+                           &memberChecksum, &totalBytesWritten);
+    hasMoreBlocks = currentBlockIndex != 0;
+  }
+
+  // direct reads need a whole aligned block, the data goes through it. So
+  // does the data of blocks that are checked, unless the archive is mapped.
+  if (hasMoreBlocks && totalBytesWritten < fileSize &&
+      (directFd >= 0 || (checksums && !mapped)) &&
+      !(directBlock = acquireBlockBuffers(1))) {
+    fclose(outputFile);
+    return;
+  }
+
+  while (hasMoreBlocks && totalBytesWritten < fileSize) {
+    snprintf(message, sizeof(message), "reading block #%d", (int) currentBlockIndex);
+    logVerbose(message);
+
+    // Calculate the size of data to write to the output file
+    size_t writeSize = BLOCK_DATA_SIZE;
+    size_t remainingSize = fileSize - totalBytesWritten;
+
+    // Adjust write size for the last portion of data
+    if (writeSize > remainingSize) {
+      writeSize = remainingSize;
+    }
+
+    size_t nextBlockIndex;
+
+    if (mapped || directBlock) {
+      const struct block_data *block =
+          directBlock
+              ? readDirectBlock(readFd, currentBlockIndex, directBlock)
+              : (const struct block_data *)mappedRange(
+                    mapped, blockOffset(currentBlockIndex), BLOCK_SIZE);
+
+      if (!block) {
+        logError("Failed to read block data.");
+        break;
+      }
+
+      if (checksums) {
+        checkBlockChecksum(checksums, currentBlockIndex, block,
+                           fileInfo->filename, &memberChecksum);
+      }
+
+      fwrite(block->data, 1, writeSize, outputFile);
+
+      // Convert the next block index from octal to size_t
+      nextBlockIndex = field_to_size_t(block->next);
+    } else {
+      if (copyBlockData(archive, currentBlockIndex, outputFile,
+                        totalBytesWritten, writeSize) != 0) {
+        break;
+      }
+
+      nextBlockIndex = preadBlockNext(fileno(archive), currentBlockIndex);
+    }
+
+    totalBytesWritten += writeSize;
+
+    if (nextBlockIndex == 0) {
+      break;
+    }
+    currentBlockIndex = nextBlockIndex;
+  }
+
+  // the checksum of the member covers its whole chain
+  if (checksums && totalBytesWritten >= fileSize) {
+    checkMemberChecksum(checksums, fileIndex, memberChecksum,
+                        fileInfo->filename);
+  }
+
+  if (directBlock) {
+    releaseBlockBuffers(directBlock, 1);
+  }
+
+  fclose(outputFile);
+}
+
+/**
+ * @description: extracts the extents recorded for a file. Each extent is read
+ * sequentially in batches of blocks, without following the chain.
+ * @parameter: (archiveFd) the tar file, opened with O_DIRECT or not
+ * @parameter: (mapped) the archive mapped in memory, NULL to read with pread
+ * @parameter: (fileInfo) the info of the file to be extracted
+ * @parameter: (outputFile) the file being extracted
+ * @parameter: (checksums) the checksums of the archive, NULL if it has none
+ * @parameter: (memberChecksum) the checksum of the blocks of the member read
+ * so far. This will be set in the function.
+ * @parameter: (totalBytesWritten) the amount of bytes extracted. This will be
+ * set in the function.
+ * @output: the block that follows the last extent, 0 if there is none
+ */
+size_t extractFileExtents(int archiveFd, struct archive_map *mapped,
+                          struct posix_file_info *fileInfo, FILE *outputFile,
+                          struct block_checksums *checksums,
+                          uint32_t *memberChecksum,
+                          size_t *totalBytesWritten) {
+  char message[100];
+  struct extent_list extents;
+
+  loadFileExtents(fileInfo, &extents);
+
+  if (extents.count == 0) {
+    return field_to_size_t(fileInfo->blockAddress);
+  }
+
+  if (mapped) {
+    return extractMappedExtents(mapped, &extents, fileInfo, outputFile,
+                                checksums, memberChecksum, totalBytesWritten);
+  }
+
+  size_t fileSize = field_to_size_t(fileInfo->size);
+  size_t batchBlocks = 0;
+
+  for (size_t e = 0; e < extents.count; e++) {
+    batchBlocks += extents.length[e];
+  }
+
+  if (batchBlocks > BATCH_BLOCKS) {
+    batchBlocks = BATCH_BLOCKS;
+  }
+
+  // direct reads need an aligned buffer, and a batch is too big for the pool
+  char *buffer = NULL;
+
+  if (posix_memalign((void **)&buffer, DIRECT_IO_ALIGNMENT,
+                     batchBlocks * BLOCK_SIZE) != 0) {
+    logError("Memory allocation for extent buffer failed.");
+    return 0;
+  }
+
+  size_t nextBlockIndex = 0;
+
+  for (size_t e = 0; e < extents.count; e++) {
+    snprintf(message, sizeof(message), "reading extent #%zu-#%zu",
+             extents.start[e], extents.start[e] + extents.length[e] - 1);
+    logVerbose(message);
+
+    for (size_t done = 0; done < extents.length[e];) {
+      size_t batch = extents.length[e] - done;
+
+      if (batch > batchBlocks) {
+        batch = batchBlocks;
+      }
+
+      ssize_t result = preadFull(archiveFd, buffer, batch * BLOCK_SIZE,
+                                 blockOffset(extents.start[e] + done));
+
+      if (result < (ssize_t)((batch - 1) * BLOCK_SIZE +
+                             sizeof(struct block_metadata))) {
+        logError("Failed to read block data.");
+        free(buffer);
+        return 0;
+      }
+
+      // the last block of old archives can be shorter
+      memset(buffer + result, 0, batch * BLOCK_SIZE - result);
+
+      for (size_t b = 0; b < batch; b++) {
+        const struct block_data *block =
+            (const struct block_data *)(buffer + b * BLOCK_SIZE);
+        size_t writeSize = fileSize - (*totalBytesWritten);
+
+        if (writeSize > BLOCK_DATA_SIZE) {
+          writeSize = BLOCK_DATA_SIZE;
+        }
+
+        if (checksums) {
+          checkBlockChecksum(checksums, extents.start[e] + done + b, block,
+                             fileInfo->filename, memberChecksum);
+        }
+
+        fwrite(block->data, 1, writeSize, outputFile);
+        (*totalBytesWritten) += writeSize;
+
+        // only the last block tells if the chain goes on after the extents
+        nextBlockIndex = field_to_size_t(block->next);
+      }
+
+      done += batch;
+    }
+  }
+
+  free(buffer);
+
+  return nextBlockIndex;
+}
+
+/**
+ * @description: extracts the extents recorded for a file straight from the
+ * archive mapped in memory. Each extent is prefetched before it is written.
+ * @parameter: (mapped) the archive mapped in memory
+ * @parameter: (extents) the extents of the file
+ * @parameter: (fileInfo) the info of the file to be extracted
+ * @parameter: (outputFile) the file being extracted
+ * @parameter: (checksums) the checksums of the archive, NULL if it has none
+ * @parameter: (memberChecksum) the checksum of the blocks of the member read
+ * so far. This will be set in the function.
+ * @parameter: (totalBytesWritten) the amount of bytes extracted. This will be
+ * set in the function.
+ * @output: the block that follows the last extent, 0 if there is none
+ */
+size_t extractMappedExtents(struct archive_map *mapped,
+                            struct extent_list *extents,
+                            struct posix_file_info *fileInfo,
+                            FILE *outputFile, struct block_checksums *checksums,
+                            uint32_t *memberChecksum,
+                            size_t *totalBytesWritten) {
+  char message[100];
+  size_t fileSize = field_to_size_t(fileInfo->size);
+  size_t nextBlockIndex = 0;
+
+  for (size_t e = 0; e < extents->count; e++) {
+    snprintf(message, sizeof(message), "reading mapped extent #%zu-#%zu",
+             extents->start[e], extents->start[e] + extents->length[e] - 1);
+    logVerbose(message);
+
+    const char *extent =
+        mappedRange(mapped, blockOffset(extents->start[e]),
+                    extents->length[e] * BLOCK_SIZE);
+
+    if (!extent) {
+      logError("Failed to read block data.");
+      return 0;
+    }
+
+    prefetchRange(mapped, blockOffset(extents->start[e]),
+                  extents->length[e] * BLOCK_SIZE);
+
+    for (size_t b = 0; b < extents->length[e]; b++) {
+      const struct block_data *block =
+          (const struct block_data *)(extent + b * BLOCK_SIZE);
+      size_t writeSize = fileSize - (*totalBytesWritten);
+
+      if (writeSize > BLOCK_DATA_SIZE) {
+        writeSize = BLOCK_DATA_SIZE;
+      }
+
+      if (checksums) {
+        checkBlockChecksum(checksums, extents->start[e] + b, block,
+                           fileInfo->filename, memberChecksum);
+      }
+
+      fwrite(block->data, 1, writeSize, outputFile);
+      (*totalBytesWritten) += writeSize;
+      nextBlockIndex = field_to_size_t(block->next);
+    }
+  }
+
+  return nextBlockIndex;
+}
+
+/**
+ * ------------------------------------------
+ *          LIST COMMAND
+ * ------------------------------------------
+ */
+
+/**
+ * @description: will list all the filenames
+ * @parameter: (filename) the tar filename to be listed
+ * @output: the exit code
+ */
+int list(char *filename) { char message[100];
+  FILE *archive = fopen(filename, "rb");
+  if (!archive) {
+    logError("Failed to open tar archive file. Double check if the input file "
+             "exists.");
+    return 1;
+  }
+
+  struct posix_header *header = loadHeader(archive);
+
+  if (!header) {
+    fclose(archive);
+    return 1;
+  }
+
+  struct archive_map mapped;
+  bool isMapped = isGlobalMappedRead && mapArchive(archive, &mapped) == 0;
+
+  // only the next pointers of the blocks are read while listing
+  if (isMapped) {
+    adviseArchive(&mapped, false);
+  }
+
+  listFilesByTarFile(header, archive, isMapped ? &mapped : NULL);
+
+  if (isMapped) {
+    unmapArchive(&mapped);
+  }
+
+  destroyHeader(header);
+  fclose(archive);
+  return 0;
+  }
+  /**
+ * @description: list all the files out of a tar file. In verbose mode the
+ * chain of each file is followed to show how many blocks it uses.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archive) the tar file to be read.
+ * @parameter: (mapped) the archive mapped in memory, NULL to read with stdio
+ * @output: n/a
+ */
+void listFilesByTarFile(struct posix_header *header, FILE *archive,
+                        struct archive_map *mapped) {
+  char message[100];
+
+  bool useExtents = archiveFlags(header) & ARCHIVE_FLAG_EXTENTS;
+
+  for (size_t i = 0; i < header->count; i++) {
+    printf("this is a file present: %s\n", header->files[i].filename);
+
+    if (useExtents) {
+      struct extent_list extents;
+
+      loadFileExtents(&header->files[i], &extents);
+
+      for (size_t e = 0; e < extents.count; e++) {
+        snprintf(message, sizeof(message), "extent of %zu blocks at #%zu",
+                 extents.length[e], extents.start[e]);
+        logVerbose(message);
+      }
+    }
+
+    // following the chain reads the archive, so it is only done when shown
+    if (isGlobalVerbosed) {
+      snprintf(message, sizeof(message), "chain of %zu blocks",
+               countChainBlocks(archive, mapped, &header->files[i]));
+      logVerbose(message);
+    }
+  }
+}
+
+/**
+ * @description: follows the chain of a file, reading only the next pointer
+ * of each block
+ * @parameter: (archive) the tar file to be read.
+ * @parameter: (mapped) the archive mapped in memory, NULL to read with stdio
+ * @parameter: (fileInfo) the info of the file
+ * @output: the amount of blocks found in the chain
+ */
+size_t countChainBlocks(FILE *archive, struct archive_map *mapped,
+                        struct posix_file_info *fileInfo) {
+  size_t expectedBlocks = blocksForSize(field_to_size_t(fileInfo->size));
+  size_t currentBlockIndex = field_to_size_t(fileInfo->blockAddress);
+  size_t blocks = 0;
+
+  // a chain longer than the file means it is broken and loops
+  while (blocks < expectedBlocks) {
+    const struct block_data *block = NULL;
+
+    if (mapped) {
+      block = (const struct block_data *)mappedRange(
+          mapped, blockOffset(currentBlockIndex), sizeof(block->next));
+
+      if (!block) {
+        break;
+      }
+    }
+
+    blocks++;
+
+    size_t nextBlockIndex = block ? field_to_size_t(block->next)
+                                  : readBlockNext(archive, currentBlockIndex);
+
+    if (nextBlockIndex == 0) {
+      break;
+    }
+
+    currentBlockIndex = nextBlockIndex;
+  }
+
+  return blocks;
+}
+
+/**
+ * ------------------------------------------
+ *          DELETE COMMAND
+ * ------------------------------------------
+ */
+
+/**
+ * @description: will remove certain files from the tar file
+ * @parameter: (files) the files name to be deleted
+ * @parameter: (fileCount) the amount of files to be deleted
+ * @parameter: (filename) the tar filename to be listed
+ * @output: the exit code
+ */
+int delete(char *files[], int fileCount, char *filename) {
+  char message[100];
+  snprintf(message, 100, "starting to delete archives inside %s", filename);
+  logVerbose(message);
+  FILE *archive = fopen(filename, "r+b");
+  if (!archive) {
+    logError("Failed to open tar archive file. Double check if the input file "
+             "exists.");
+    return 1;
+  }
+
+  struct posix_header *header = loadHeader(archive);
+
+  if (!header) {
+    fclose(archive);
+    return 1;
+  }
+
+  struct free_map map;
+  loadFreeMap(header, archive, &map);
+  loadDedupIndex(header, archive, &map);
+  loadBlockTable(header, archive);
+  loadBlockHashes(header, archive);
+
+  struct name_index index;
+  buildNameIndex(header, &index);
+
+  deleteFilesByTarFile(header, archive, files, fileCount, &map, &index);
+
+  int result = commitHeader(header, archive, &map);
+
+  destroyNameIndex(&index);
+  destroyFreeMap(&map);
+  destroyHeader(header);
+  fclose(archive);
+
+  return result;
+}
+
+/**
+ * @description: delete all the files out of a tar file
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archive) the tar file to be read.
+ * @parameter: (files) the files to be deleted
+ * @parameter: (fileCount) the amount of files to be deleted
+ * @parameter: (map) the free map of the archive
+ * @parameter: (index) the name index of the header
+ * @output: the amount of files deleted
+ */
+int deleteFilesByTarFile(struct posix_header *header, FILE *archive,
+                         char *files[], int fileCount, struct free_map *map,
+                         struct name_index *index) {
+  char message[100];
+  bool *isRemoved = calloc(header->count + 1, sizeof(bool));
+  int removedCount = 0;
+
+  if (!isRemoved) {
+    logError("memory allocation for the removed entries failed");
+    return 0;
+  }
+
+  // the entries leave the index at once and the header is compacted at the
+  // end, so deleting many files moves the entries once
+  for (int x = 0; x < fileCount; x++) {
+    int fileIndex;
+
+    if (!isFileInFATTable(index, files[x], &fileIndex)) {
+      snprintf(message, 100, "file %s not in archive... continuing...",
+               get_filename(files[x]));
+      logWarning(message);
+      continue;
+    }
+
+    struct posix_file_info fileInfo = header->files[fileIndex];
+    deleteFileByTarFile(archive, &fileInfo, map, header->dedup);
+    removeName(index, fileIndex);
+    isRemoved[fileIndex] = true;
+    removedCount++;
+  }
+
+  if (removedCount > 0) {
+    compactHeaderEntries(header, index, isRemoved);
+  }
+
+  free(isRemoved);
+
+  return removedCount;
+}
+
+/**
+ * @description: releases the blocks of a single file in the tar file
+ * @parameter: (archive) the tar file
+ * @parameter: (fileInfo) the info of the file to be deleted
+ * @parameter: (map) the free map of the archive
+ * @parameter: (dedup) the dedup index, NULL when blocks are not shared
+ * @output: n/a
+ */
+void deleteFileByTarFile(FILE *archive, struct posix_file_info *fileInfo,
+                         struct free_map *map, struct dedup_index *dedup) {
+  char message[100];
+  snprintf(message, 100, "INFO: [N : %s] [B : %ld] [S : %ld]", fileInfo->filename, field_to_size_t(fileInfo->blockAddress), field_to_size_t(fileInfo->size));
+  logVerbose(message);
+
+  // empty files don't own any block
+  if (blocksForSize(field_to_size_t(fileInfo->size)) > 0) {
+    size_t blockAddress = field_to_size_t(fileInfo->blockAddress);
+
+    // shared blocks stay until the last member that uses them is deleted
+    if (dedup) {
+      releaseDedupChain(blockAddress, archive, map, dedup);
+    } else {
+      markRemainingBlocksAsFree(&blockAddress, archive, map);
+    }
+  }
+
+  snprintf(message, 100, "file deleted successfully: %s", fileInfo->filename);
+  logVerbose(message);
+}
+
+/**
+ * @description: removes an entry from the header. The entries after it move
+ * back by one, so they keep their order and the last member with a repeated
+ * name is still the newest one.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (index) the name index of the header
+ * @parameter: (position) the position of the entry to remove
+ * @output: n/a
+ */
+void removeHeaderEntry(struct posix_header *header, struct name_index *index,
+                       int position) {
+  bool *isRemoved = calloc(header->count, sizeof(bool));
+
+  if (!isRemoved) {
+    logError("memory allocation for the removed entries failed");
+    exit(EXIT_FAILURE);
+  }
+
+  removeName(index, position);
+  isRemoved[position] = true;
+
+  compactHeaderEntries(header, index, isRemoved);
+
+  free(isRemoved);
+}
+
+/**
+ * @description: drops the removed entries of the header in one pass. The
+ * others move back over them in the same order, taking their checksum,
+ * their blocks and their attributes along. If there is an error in malloc it
+ * will exit the program.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (index) the name index of the header, where the removed entries
+ * are not anymore
+ * @parameter: (isRemoved) the entries to drop
+ * @output: n/a
+ */
+void compactHeaderEntries(struct posix_header *header,
+                          struct name_index *index, const bool *isRemoved) {
+  struct block_checksums *checksums = header->checksums;
+  int *positions = malloc((header->count + 1) * sizeof(int));
+  size_t kept = 0;
+
+  if (!positions) {
+    logError("memory allocation for the removed entries failed");
+    exit(EXIT_FAILURE);
+  }
+
+  if (checksums) {
+    reserveMemberChecksums(checksums, header->count);
+  }
+
+  for (size_t i = 0; i < header->count; i++) {
+    if (isRemoved[i]) {
+      if (checksums) {
+        checksums->members[i] = 0;
+      }
+
+      if (header->blockTable) {
+        forgetMemberBlocks(header->blockTable, i);
+      }
+
+      if (header->attributes) {
+        setMemberAttributes(header->attributes, i, 0, 0);
+        forgetMemberBlockHashes(header->attributes, i);
+      }
+
+      continue;
+    }
+
+    positions[i] = kept;
+
+    if (i != kept) {
+      header->files[kept] = header->files[i];
+
+      if (checksums) {
+        checksums->members[kept] = checksums->members[i];
+        checksums->members[i] = 0;
+      }
+
+      if (header->blockTable) {
+        moveMemberBlocks(header->blockTable, i, kept);
+      }
+
+      if (header->attributes) {
+        moveMemberAttributes(header->attributes, i, kept);
+      }
+    }
+
+    kept++;
+  }
+
+  renumberNames(index, positions);
+
+  memset(&header->files[kept], 0,
+         (header->count - kept) * sizeof(struct posix_file_info));
+  header->count = kept;
+
+  free(positions);
+}
+
+/**
+ * ------------------------------------------
+ *          UPDATE COMMAND
+ * ------------------------------------------
+ */
+
+/**
+ * @description: will update the content of n archives
+ * @parameter: (files) the files name to be deleted
+ * @parameter: (fileCount) the amount of files to be deleted
+ * @parameter: (filename) the tar filename to be listed
+ * @output: the exit code
+ */
+int update(char *files[], int fileCount, char *filename) {
+  char message[100];
+  snprintf(message, 100, "Starting to update archives inside %s", filename);
+  logVerbose(message);
+
+  FILE *archive = fopen(filename, "r+b");
+  if (!archive) {
+    logError("Failed to open tar archive file. Double check if the input file "
+             "exists.");
+    return 1;
+  }
+
+  struct posix_header *header = loadHeader(archive);
+
+  if (!header) {
+    fclose(archive);
+    return 1;
+  }
+
+  struct free_map map;
+  loadFreeMap(header, archive, &map);
+  loadDedupIndex(header, archive, &map);
+  loadBlockTable(header, archive);
+  loadBlockHashes(header, archive);
+
+  struct name_index index;
+  buildNameIndex(header, &index);
+
+  updateBlocksInFile(files, fileCount, header, archive, &map, &index);
+
+  // Rewrite the header if any changes
+  int result = commitHeader(header, archive, &map);
+
+  destroyNameIndex(&index);
+  destroyFreeMap(&map);
+  destroyHeader(header);
+  fclose(archive);
+  return result;
+}
+
+/**
+ * @description: will update the blocks with the new files information
+ * @parameter: (files) the files name to be updated
+ * @parameter: (fileCount) the amount of files to be deleted
+ * @parameter: (header) the FAT Header to be used
+ * @parameter: (archive) the tar FILE
+ * @parameter: (map) the free map used to allocate and release blocks
+ * @parameter: (index) the name index of the header
+ * @output: the amount of files updated, counting the ones that didn't change
+ */
+int updateBlocksInFile(char *files[], int fileCount,
+                       struct posix_header *header, FILE *archive,
+                       struct free_map *map, struct name_index *index) {
+  char message[100];
+  int updatedCount = 0;
+  int skippedCount = 0;
+  size_t skippedBytes = 0;
+  size_t examinedBlocks = 0;
+  size_t writtenBlocks = 0;
+
+  // the files that didn't change are found before writing any of them
+  struct member_change *changes =
+      calloc(fileCount > 0 ? fileCount : 1, sizeof(struct member_change));
+
+  if (changes) {
+    findUnchangedMembers(files, fileCount, header, index, changes);
+  }
+
+  for (int i = 0; i < fileCount; i++) {
+    struct member_change *change = changes ? &changes[i] : NULL;
+
+    if (change && change->isUnchanged) {
+      uint64_t hash = change->hash != 0
+                          ? change->hash
+                          : header->attributes->hashes[change->fileIndex];
+
+      setMemberAttributes(header->attributes, change->fileIndex, change->mtime,
+                          hash);
+
+      snprintf(message, 100, "file %s didn't change, skipping it", files[i]);
+      logVerbose(message);
+
+      skippedCount++;
+      skippedBytes += change->size;
+      continue;
+    }
+
+    // a name that doesn't fit can't be the name of a member
+    if (!isMemberNameValid(get_filename(files[i]), map->preferRuns)) {
+      continue;
+    }
+
+    FILE *inputFile = fopen(files[i], "rb");
+
+    if (!inputFile) {
+      snprintf(message, 100,
+               "Error reading file %s, continuing with other files.", files[i]);
+      logError(message);
+      continue;
+    }
+
+    fseek(inputFile, 0, SEEK_END);
+    size_t newFileSize = ftell(inputFile);
+    fseek(inputFile, 0, SEEK_SET);
+    size_t newNumBlocks = blocksForSize(newFileSize);
+
+    int fileIndex;
+    bool isFileInArchive = isFileInFATTable(index, files[i], &fileIndex);
+
+    if (!isFileInArchive) {
+      logError("file not in archive... continuing...");
+
+      fclose(inputFile);
+
+      continue;
+    }
+
+    struct posix_file_info *fileInfo = &header->files[fileIndex];
+
+    size_t existingBlocks = blocksForSize(field_to_size_t(fileInfo->size));
+
+    snprintf(message, 100,
+             "file %s has %d blocks and will require now %d blocks.",
+             fileInfo->filename, (int) existingBlocks, (int) newNumBlocks);
+    logVerbose(message);
+
+    size_t currentBlockIndex = field_to_size_t(fileInfo->blockAddress);
+
+    // every block written is recorded, so the extents can be stored after
+    struct extent_list extents;
+    initExtentList(&extents);
+
+    // the blocks are compared with their hashes, so only the ones whose data
+    // changed are written
+    struct block_delta blockDelta;
+    struct block_delta *delta =
+        !header->dedup && newNumBlocks > 0 &&
+                prepareBlockDelta(header, fileIndex, existingBlocks,
+                                  newNumBlocks, &blockDelta) == 0
+            ? &blockDelta
+            : NULL;
+
+    if (header->dedup) {
+      // shared blocks can't be overwritten, so the new chain is written
+      // first, sharing what didn't change, and the old one is released after
+      size_t oldSize = field_to_size_t(fileInfo->size);
+      size_t blocksWritten = 0;
+
+      size_t_to_field(fileInfo->size, newFileSize);
+
+      if (writeDedupMember(header, fileIndex, archive, fileno(inputFile), map,
+                           &extents, &blocksWritten) != 0) {
+        size_t_to_field(fileInfo->size, oldSize);
+        fclose(inputFile);
+        continue;
+      }
+
+      if (existingBlocks > 0) {
+        releaseDedupChain(currentBlockIndex, archive, map, header->dedup);
+      }
+    } else if (existingBlocks == 0) {
+      // There is nothing to overwrite, every block comes from the free map
+      if (newNumBlocks > 0) {
+        size_t firstPosition = map->preferRuns ? allocateRun(map, newNumBlocks)
+                                               : allocateBlock(map);
+
+        updateAtNewBlocks(0, newNumBlocks, firstPosition, inputFile, archive,
+                          map, &extents, fileInfo->filename, delta);
+        size_t_to_field(fileInfo->blockAddress, firstPosition);
+      }
+    } else if (newNumBlocks == 0) {
+      markRemainingBlocksAsFree(&currentBlockIndex, archive, map);
+    } else if (existingBlocks >= newNumBlocks) {
+      // Update existing blocks
+      size_t blockCount = 0;
+
+      overwriteExistingBlocks(fileInfo->filename, &currentBlockIndex,
+                              &blockCount, &newNumBlocks, archive, inputFile,
+                              &extents, delta);
+
+      // If the file is smaller, end the chain and release remaining blocks
+      if (existingBlocks > newNumBlocks) {
+        size_t remainingBlockIndex = readBlockNext(archive, currentBlockIndex);
+
+        writeBlockNext(archive, currentBlockIndex, 0);
+        markRemainingBlocksAsFree(&remainingBlockIndex, archive, map);
+      }
+    } else {
+      updateWhenFileSizeIsGreater(fileInfo->filename, existingBlocks,
+                                  currentBlockIndex, newNumBlocks, archive,
+                                  inputFile, map, &extents, delta);
+    }
+
+    // Update file info in the header
+    size_t_to_field(fileInfo->size, newFileSize);
+
+    if (delta) {
+      examinedBlocks += delta->examinedCount;
+      writtenBlocks += delta->writtenCount;
+    }
+
+    // the checksum, the blocks and the hashes of the member are kept when
+    // every block went through the delta, or found again with the header
+    uint64_t contentHash =
+        finishBlockDelta(header, fileIndex, delta, newNumBlocks);
+
+    if (change && contentHash != 0) {
+      change->hash = contentHash;
+    }
+
+    if (map->preferRuns) {
+      storeFileExtents(fileInfo, &extents);
+    }
+
+    if (header->attributes) {
+      setMemberAttributes(header->attributes, fileIndex,
+                          change ? change->mtime : 0,
+                          wasFileKept(inputFile, change) ? change->hash : 0);
+    }
+
+    updatedCount++;
+
+    fclose(inputFile);
+  }
+
+  free(changes);
+
+  if (skippedCount > 0) {
+    snprintf(message, 100,
+             "%d files didn't change, %zu bytes (%.1f MB) not written",
+             skippedCount, skippedBytes, skippedBytes / (1024.0 * 1024.0));
+    logInfo(message);
+  }
+
+  if (examinedBlocks > 0) {
+    snprintf(message, 100, "%zu blocks examined, %zu written", examinedBlocks,
+             writtenBlocks);
+    logInfo(message);
+  }
+
+  return updatedCount + skippedCount;
+}
+
+/**
+ * @description: prepares the update of a member block by block. The hashes
+ * stored for its blocks, when there are any, tell which ones didn't change,
+ * and the block table gives the chain without reading it. The checksum of
+ * the member is kept up to date when it had one, so its blocks don't have to
+ * be read back when the header is written.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (fileIndex) the position of the member
+ * @parameter: (existingBlocks) the amount of blocks the member has
+ * @parameter: (newNumBlocks) the amount of blocks of the new data
+ * @parameter: (delta) the delta to prepare. This will be set in the function.
+ * @output: the exit code, 1 when the member is written without a delta
+ */
+int prepareBlockDelta(struct posix_header *header, int fileIndex,
+                      size_t existingBlocks, size_t newNumBlocks,
+                      struct block_delta *delta) {
+  struct member_attributes *attributes = header->attributes;
+  struct block_table *table = header->blockTable;
+  struct block_checksums *checksums = header->checksums;
+
+  if (!attributes) {
+    return 1;
+  }
+
+  memset(delta, 0, sizeof(*delta));
+  delta->hashes = malloc(newNumBlocks * sizeof(uint64_t));
+  delta->blocks = malloc(newNumBlocks * sizeof(size_t));
+
+  if (!delta->hashes || !delta->blocks) {
+    free(delta->hashes);
+    free(delta->blocks);
+    return 1;
+  }
+
+  reserveMemberAttributes(attributes, header->count);
+
+  if (attributes->blockCounts[fileIndex] == existingBlocks) {
+    delta->storedHashes = attributes->blockHashes[fileIndex];
+    delta->storedCount = existingBlocks;
+  }
+
+  if (table && (size_t)fileIndex < table->capacity &&
+      table->counts[fileIndex] == existingBlocks) {
+    delta->storedBlocks = table->blocks[fileIndex];
+    delta->storedBlockCount = existingBlocks;
+  }
+
+  if (checksums) {
+    reserveMemberChecksums(checksums, header->count);
+
+    if (checksums->members[fileIndex] != 0) {
+      delta->checksums = checksums;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * @description: tells if a block of the new data is the same as the block
+ * stored at its position in the chain, and takes its hash
+ * @parameter: (delta) the delta of the member
+ * @parameter: (block) the position of the block in the chain
+ * @parameter: (data) the new data of the block
+ * @parameter: (length) the amount of bytes of data
+ * @output: true if the stored block already has the data
+ */
+bool isBlockUnchanged(struct block_delta *delta, size_t block,
+                      const char *data, size_t length) {
+  uint64_t hash = hashBlockData(data, length);
+
+  delta->hashes[block] = hash;
+  delta->examinedCount++;
+
+  return delta->storedHashes && block < delta->storedCount &&
+         delta->storedHashes[block] == hash;
+}
+
+/**
+ * @description: records where a block of the member went and adds it to the
+ * checksum of the member
+ * @parameter: (delta) the delta of the member
+ * @parameter: (block) the position of the block in the chain
+ * @parameter: (position) the block of the archive that holds it
+ * @parameter: (data) the block as it was written
+ * @parameter: (isWritten) false when the stored block was kept
+ * @output: n/a
+ */
+void recordDeltaBlock(struct block_delta *delta, size_t block, size_t position,
+                      const struct block_data *data, bool isWritten) {
+  struct block_checksums *checksums = delta->checksums;
+
+  delta->blocks[block] = position;
+
+  if (isWritten) {
+    delta->writtenCount++;
+  }
+
+  if (!checksums) {
+    return;
+  }
+
+  reserveBlockChecksums(checksums, position + 1);
+
+  if (isWritten) {
+    checksums->blocks[position] = blockDataChecksum(data);
+  }
+
+  delta->memberChecksum =
+      foldBlockChecksum(delta->memberChecksum, checksums->blocks[position]);
+}
+
+/**
+ * @description: keeps what the delta found out about the member once it is
+ * written. When a block didn't go through the delta the checksum, the blocks
+ * and the hashes of the member are found again with the header.
+ * @parameter: (header) the FAT header, with the new size of the member
+ * @parameter: (fileIndex) the position of the member
+ * @parameter: (delta) the delta of the member, NULL when it had none
+ * @parameter: (blockCount) the amount of blocks of the new data
+ * @output: the hash of the new data, 0 when it is not known
+ */
+uint64_t finishBlockDelta(struct posix_header *header, int fileIndex,
+                          struct block_delta *delta, size_t blockCount) {
+  bool isComplete = delta && delta->examinedCount == blockCount;
+  uint64_t contentHash = 0;
+
+  if (header->checksums) {
+    reserveMemberChecksums(header->checksums, header->count);
+    header->checksums->members[fileIndex] =
+        isComplete && delta->checksums ? delta->memberChecksum : 0;
+  }
+
+  if (header->blockTable && isComplete) {
+    setMemberBlocks(header->blockTable, fileIndex, delta->blocks, blockCount);
+    delta->blocks = NULL;
+  } else if (header->blockTable) {
+    forgetMemberBlocks(header->blockTable, fileIndex);
+  }
+
+  if (header->attributes && isComplete) {
+    contentHash = keepMemberHashes(header, fileIndex, delta->hashes,
+                                   blockCount);
+    delta->hashes = NULL;
+  } else if (header->attributes) {
+    forgetMemberBlockHashes(header->attributes, fileIndex);
+  }
+
+  if (delta) {
+    free(delta->hashes);
+    free(delta->blocks);
+  }
+
+  return contentHash;
+}
+
+/**
+ * @description: tells if a file is still the one that was hashed before the
+ * update, so its hash can be kept for the member
+ * @parameter: (inputFile) the file written to the archive
+ * @parameter: (change) what was found for the file before the update
+ * @output: true if the hash of the file is still the same
+ */
+bool wasFileKept(FILE *inputFile, struct member_change *change) {
+  struct stat status;
+
+  return change && change->hash != 0 &&
+         fstat(fileno(inputFile), &status) == 0 &&
+         (size_t)status.st_size == change->size &&
+         fileModificationTime(&status) == change->mtime;
+}
+
+/**
+ * @description: will determine if a certain file is present in the FAT table
+ * @parameter: (index) the name index of the header
+ * @parameter: (path) the filename with its path to look for
+ * @parameter: (indexPosition) the position of the newest copy of the file,
+ * the one extract reads. This will be set in the function.
+ * @output: true if the file exists in the header
+ */
+bool isFileInFATTable(struct name_index *index, char *path,
+                      int *indexPosition) {
+  char message[100];
+  (*indexPosition) = findLastName(index, get_filename(path));
+
+  if ((*indexPosition) < 0) {
+    return false;
+  }
+
+  snprintf(message, 100, "file %s exists in header", get_filename(path));
+  logVerbose(message);
+
+  return true;
+}
+
+/**
+ * @description: will overwrite the exiting blocks of a file inside the tar file
+ * @parameter: (filename) the filename of the file to overwrite
+ * @parameter: (currentBlockIndex) the block address where the file starts. It
+ * will be set to the last block written.
+ * @parameter: (blockCount) the amount of blocks used. This will be set in the
+ * function
+ * @parameter: (newNumBlocks) the new amount of blocks required.
+ * @parameter: (archive) the tar FILE
+ * @parameter: (inputFile) the new file to be packaged
+ * @parameter: (extents) the extents where every written block is added
+ * @parameter: (delta) the hashes the blocks are compared with, NULL to write
+ * every block
+ * @output: n/a
+ */
+void overwriteExistingBlocks(char *filename, size_t *currentBlockIndex,
+                             size_t *blockCount, size_t *newNumBlocks,
+                             FILE *archive, FILE *inputFile,
+                             struct extent_list *extents,
+                             struct block_delta *delta) {
+  char message[100];
+  struct block_data *block = acquireBlockBuffers(1);
+
+  if (!block) {
+    return;
+  }
+
+  while ((*blockCount) < (*newNumBlocks)) {
+    // only the data changes, the chain stays as it is. The data is stored
+    // raw, even if the block was compressed.
+    size_t read = fread(block->data, 1, BLOCK_DATA_SIZE, inputFile);
+    memset(block->data + read, 0, BLOCK_DATA_SIZE - read);
+    size_t_to_field(block->storedLength, 0);
+
+    bool isUnchanged =
+        delta && isBlockUnchanged(delta, *blockCount, block->data, read);
+
+    snprintf(message, 100, "%s block #%d for file %s",
+             isUnchanged ? "keeping" : "overwriting", (int) *currentBlockIndex,
+             filename);
+    logVerbose(message);
+
+    if (!isUnchanged) {
+      fseek(archive, blockOffset(*currentBlockIndex) + 12, SEEK_SET);
+      fwrite(block->storedLength, 12 + BLOCK_DATA_SIZE, 1, archive);
+    }
+
+    if (delta) {
+      recordDeltaBlock(delta, *blockCount, *currentBlockIndex, block,
+                       !isUnchanged);
+    }
+
+    addExtentBlock(extents, *currentBlockIndex);
+
+    if (++(*blockCount) >= (*newNumBlocks)) {
+      break;
+    }
+
+    // the chain is taken from the block table when it is known
+    size_t nextBlockIndex =
+        delta && delta->storedBlocks
+            ? (*blockCount < delta->storedBlockCount
+                   ? delta->storedBlocks[*blockCount]
+                   : 0)
+            : readBlockNext(archive, *currentBlockIndex);
+
+    if (nextBlockIndex == 0) {
+      break;
+    }
+
+    (*currentBlockIndex) = nextBlockIndex;
+  }
+
+  releaseBlockBuffers(block, 1);
+}
+
+/**
+ * @description: will release a chain of blocks, starting at a certain block
+ * @parameter: (currentBlockIndex) the first block to release
+ * @parameter: (archive) the tar FILE
+ * @parameter: (map) the free map where the blocks are released
+ * @output: n/a
+ */
+void markRemainingBlocksAsFree(size_t *currentBlockIndex, FILE *archive,
+                               struct free_map *map) {
+  char isFree[FIELD_SIZE];
+
+  size_t_to_field(isFree, 1);
+
+  // a chain can't be longer than the archive, this protects broken chains
+  size_t hops = 0;
+
+  do {
+    size_t nextBlockIndex = readBlockNext(archive, *currentBlockIndex);
+
+    fseek(archive, blockOffset(*currentBlockIndex) + FIELD_SIZE, SEEK_SET);
+    fwrite(isFree, FIELD_SIZE, 1, archive); // Mark block as free
+
+    releaseBlock(map, *currentBlockIndex);
+
+    (*currentBlockIndex) = nextBlockIndex; // Move to the next block
+  } while ((*currentBlockIndex) != 0 && ++hops < map->blockCount);
+}
+
+/**
+ * @description: will update the blocks when file size is bigger. The extra
+ * blocks are taken from the free map, which recycles freed blocks before
+ * growing the file.
+ * @parameter: (filename) the name of the file updating
+ * @parameter: (existingBlocks) the amount of current existing blocks
+ * @parameter: (currentBlockIndex) the current block position of the file
+ * @parameter: (newNumBlocks) the new amount of blocks required
+ * @parameter: (archive) the tar FILE
+ * @parameter: (inputFile) the new FILE
+ * @parameter: (map) the free map used to allocate blocks
+ * @parameter: (extents) the extents where every written block is added
+ * @parameter: (delta) the hashes the blocks are compared with, NULL to write
+ * every block
+ * @output: n/a
+ */
+void updateWhenFileSizeIsGreater(char *filename, size_t existingBlocks,
+                                 size_t currentBlockIndex, size_t newNumBlocks,
+                                 FILE *archive, FILE *inputFile,
+                                 struct free_map *map,
+                                 struct extent_list *extents,
+                                 struct block_delta *delta) {
+  char message[100];
+
+  size_t blockCount = 0;
+
+  overwriteExistingBlocks(filename, &currentBlockIndex, &blockCount,
+                          &newNumBlocks, archive, inputFile, extents, delta);
+
+  snprintf(message, 100, "starting to add new blocks for file %s", filename);
+  logVerbose(message);
+
+  // This is where new blocks will start, right after the old ones if possible
+  size_t firstPosition = map->preferRuns
+                             ? allocateBlockAfter(map, currentBlockIndex)
+                             : allocateBlock(map);
+
+  updateAtNewBlocks(blockCount, newNumBlocks, firstPosition, inputFile,
+                    archive, map, extents, filename, delta);
+
+  linkUpdatedBlocks(currentBlockIndex, firstPosition, archive, filename);
+}
+
+/**
+ * @description: will add new blocks for a file. Each block is allocated before
+ * the previous one is written, so its next pointer is known up front.
+ * @parameter: (blockCount) the counter for blocks
+ * @parameter: (newNumBlocks) the new amount of blocks required
+ * @parameter: (firstPosition) the block already allocated for the first write
+ * @parameter: (inputFile) the new FILE
+ * @parameter: (archive) the tar FILE
+ * @parameter: (map) the free map used to allocate blocks
+ * @parameter: (extents) the extents where every written block is added
+ * @parameter: (filename) the name of the updated file
+ * @parameter: (delta) where the hashes of the new blocks are taken, NULL when
+ * they are not needed
+ * @output: n/a
+ */
+void updateAtNewBlocks(size_t blockCount, size_t newNumBlocks,
+                       size_t firstPosition, FILE *inputFile, FILE *archive,
+                       struct free_map *map, struct extent_list *extents,
+                       char *filename, struct block_delta *delta) {
+  char message[100];
+  struct block_data *newBlock = acquireBlockBuffers(1);
+
+  if (!newBlock) {
+    return;
+  }
+
+  size_t pos = firstPosition;
+
+  for (; blockCount < newNumBlocks; blockCount++) {
+    memset(newBlock, 0, BLOCK_SIZE);
+
+    // Read file content into block
+    size_t read = fread(newBlock->data, 1, BLOCK_DATA_SIZE, inputFile);
+
+    size_t nextPosition = 0;
+
+    if (blockCount < newNumBlocks - 1) {
+      nextPosition = map->preferRuns ? allocateBlockAfter(map, pos)
+                                     : allocateBlock(map);
+    }
+
+    size_t_to_field(newBlock->next, nextPosition);
+    size_t_to_field(newBlock->storedLength, 0);
+
+    snprintf(message, 100,
+             "new block for %s is at block #%zu and its next will be #%zu",
+             filename, pos, nextPosition);
+    logVerbose(message);
+
+    fseek(archive, blockOffset(pos), SEEK_SET);
+    fwrite(newBlock, BLOCK_SIZE, 1, archive);
+
+    // new blocks are always written, their hashes are taken for the next
+    // update
+    if (delta) {
+      isBlockUnchanged(delta, blockCount, newBlock->data, read);
+      recordDeltaBlock(delta, blockCount, pos, newBlock, true);
+    }
+
+    addExtentBlock(extents, pos);
+
+    pos = nextPosition;
+  }
+
+  releaseBlockBuffers(newBlock, 1);
+}
+
+/**
+ * @description: will link the old blocks with the new ones
+ * @parameter: (lastBlockIndex) the last block position
+ * @parameter: (firstPosition) the first position of the new block added
+ * @parameter: (archive) the tar FILE
+ * @parameter: (filename) the name of the updated file
+ * @output: n/a
+ */
+void linkUpdatedBlocks(size_t lastBlockIndex, size_t firstPosition,
+                       FILE *archive, char *filename) {
+  char message[100];
+
+  snprintf(message, 100, "new next in %s at block #%zu will be %d", filename,
+           lastBlockIndex, (int) firstPosition);
+  logVerbose(message);
+
+  writeBlockNext(archive, lastBlockIndex, firstPosition);
+}
+
+/**
+ * ------------------------------------------
+ *          APPEND COMMAND
+ * ------------------------------------------
+ */
+int updateHeader(struct posix_header *header, struct name_index *index,
+                 char *filename, size_t fileSize) {
+    char message[100];
+
+    // Validación básica de los parámetros de entrada
+    if (!header) {
+        logError("error reading header...");
+        return -1;
+    }
+    if (!filename) {
+        logError("error reading header data...");
+        return -1;
+    }
+
+    // Mensaje de depuración
+    snprintf(message, 100, "updating file header with new file \"%s\"", filename);
+    logVerbose(message);
+
+    // Las entradas son contiguas, la primera vacía es la siguiente al final
+    int emptyIndex = header->count;
+
+    // Si no se encontró una entrada vacía, el encabezado ya está lleno
+    if (emptyIndex >= MAX_FILES) {
+        logError("there is no more space for files...");
+        return -1;
+    }
+
+    snprintf(message, 100, "index found is #%d", emptyIndex);
+    logVerbose(message);
+
+    // Actualiza la entrada vacía con la información del nuevo archivo
+    struct posix_file_info info;
+    memset(&info, 0, sizeof(info));
+
+    bool useExtents = archiveFlags(header) & ARCHIVE_FLAG_EXTENTS;
+
+    if (!isMemberNameValid(get_filename(filename), useExtents)) {
+        return -1;
+    }
+
+    snprintf(info.filename, useExtents ? EXTENT_NAME_SIZE : sizeof(info.filename),
+             "%s", get_filename(filename));
+
+    // El tamaño lo obtiene quien abrió el archivo
+    size_t_to_field(info.size, fileSize);
+    size_t_to_field(info.blockAddress, (size_t) 0);
+
+    // la tabla puede moverse al crecer, el índice lee los nombres de ella
+    reserveHeader(header, emptyIndex + 1);
+    setNameTable(index, header->files[0].filename);
+
+    header->files[emptyIndex] = info;
+    header->count++;
+    addName(index, emptyIndex);
+
+    // the new member is sealed with the header, once its blocks are written
+    if (header->checksums) {
+      reserveMemberChecksums(header->checksums, header->count);
+      header->checksums->members[emptyIndex] = 0;
+    }
+
+    if (header->blockTable) {
+      forgetMemberBlocks(header->blockTable, emptyIndex);
+    }
+
+    if (header->attributes) {
+      setMemberAttributes(header->attributes, emptyIndex, 0, 0);
+      forgetMemberBlockHashes(header->attributes, emptyIndex);
+    }
+
+    snprintf(message, 100, "file added %s to header at position %d with size %zu bytes", get_filename(filename), emptyIndex, fileSize);
+    logVerbose(message);
+
+    return emptyIndex;
+}
+
+/**
+ * @description: will add n new archives to the tar file
+ * @parameter: (files) the files name to be deleted
+ * @parameter: (fileCount) the amount of files to be deleted
+ * @parameter: (filename) the tar filename to be listed
+ * @output: the exit code
+ */
+int append(char *files[], int fileCount, char *filename) {
+  char message[100];
+
+  snprintf(message, 100, "starting to add new archives inside %s", filename);
+  logVerbose(message);
+
+  FILE *archive = fopen(filename, "r+b");
+
+  if (!archive) {
+    logError("Failed to open tar archive file. Double check if the input file "
+             "exists.");
+    return 1;
+  }
+
+  struct posix_header *header = loadHeader(archive);
+
+  if (!header) {
+    fclose(archive);
+    return 1;
+  }
+
+  struct free_map map;
+  loadFreeMap(header, archive, &map);
+  loadDedupIndex(header, archive, &map);
+  loadBlockTable(header, archive);
+  loadBlockHashes(header, archive);
+
+  struct name_index index;
+  buildNameIndex(header, &index);
+
+  appendFilesByTarFile(header, archive, files, fileCount, &map, &index);
+
+  // Escribe el encabezado actualizado al principio del archivo TAR
+  int result = commitHeader(header, archive, &map);
+
+  destroyNameIndex(&index);
+  destroyFreeMap(&map);
+  destroyHeader(header);
+  fclose(archive);
+
+  return result;
+}
+
+  /**
+ * @description: append all the files to a tar file
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archive) the tar file to be read.
+ * @parameter: (files) the files that are going to be append.
+ * @parameter: (fileCount) quantity of files to be append.
+ * @parameter: (map) the free map used to allocate blocks
+ * @parameter: (index) the name index of the header
+ * @output: the amount of files added
+ */
+int appendFilesByTarFile(struct posix_header *header, FILE *archive,
+                         char *files[], int fileCount, struct free_map *map,
+                         struct name_index *index) {
+  char message[100];
+  int filesAdded = 0;
+
+  // with the I/O engine the blocks of every file stay in flight together
+  struct block_stream stream;
+  struct member_copy *members = NULL;
+
+  if (isGlobalAsyncIO && !header->dedup) {
+    members = calloc(fileCount > 0 ? fileCount : 1, sizeof(struct member_copy));
+
+    if (!members || openBlockStream(&stream, fileno(archive), false) != 0) {
+      logWarning("appending without the I/O engine");
+      free(members);
+      members = NULL;
+    }
+  }
+
+  for (int i = 0; i < fileCount; i++) {
+    // the file is opened once, its size comes from the same descriptor
+    struct stat status;
+    FILE *inputFile = fopen(files[i], "rb");
+
+    inputOpenCount++;
+
+    if (!inputFile || fstat(fileno(inputFile), &status) != 0) {
+      snprintf(message, 100, "couldn't open file %s", files[i]);
+      logError(message);
+
+      if (inputFile) {
+        fclose(inputFile);
+      }
+
+      continue;
+    }
+
+    inputStatCount++;
+
+    int fileIndex = updateHeader(header, index, files[i], status.st_size);
+
+    if (fileIndex < 0) {
+      fclose(inputFile);
+      continue;
+    }
+
+    if (header->attributes) {
+      setMemberAttributes(header->attributes, fileIndex,
+                          fileModificationTime(&status), 0);
+    }
+
+    struct posix_file_info *fileInfo = &header->files[fileIndex];
+
+    size_t numBlocks = blocksForSize(field_to_size_t(fileInfo->size));
+
+    snprintf(message, 100,
+             "num blocks [%d] for [%s] because of size [%d / %d]",
+             (int) numBlocks, fileInfo->filename,
+             (int) field_to_size_t(fileInfo->size), BLOCK_DATA_SIZE);
+
+    logVerbose(message);
+
+    struct extent_list extents;
+    initExtentList(&extents);
+
+    if (header->dedup) {
+      size_t blocksWritten = 0;
+
+      if (writeDedupMember(header, fileIndex, archive, fileno(inputFile), map,
+                           &extents, &blocksWritten) != 0) {
+        removeHeaderEntry(header, index, fileIndex);
+        fclose(inputFile);
+        continue;
+      }
+    } else if (numBlocks > 0) {
+      // Freed blocks are recycled before the archive grows
+      size_t firstPosition = map->preferRuns ? allocateRun(map, numBlocks)
+                                             : allocateBlock(map);
+
+      size_t_to_field(fileInfo->blockAddress, firstPosition);
+
+      if (members) {
+        queueAppendedBlocks(&stream, &members[i], header, fileIndex, files[i],
+                            fileno(inputFile), numBlocks, firstPosition, map,
+                            &extents);
+      } else {
+        updateAtNewBlocks(0, numBlocks, firstPosition, inputFile, archive, map,
+                          &extents, fileInfo->filename, NULL);
+      }
+    }
+
+    if (map->preferRuns) {
+      storeFileExtents(fileInfo, &extents);
+    }
+
+    filesAdded++;
+
+    fclose(inputFile);
+  }
+
+  if (members) {
+    closeBlockStream(&stream);
+
+    // members left behind by a failed transfer
+    for (int i = 0; i < fileCount; i++) {
+      if (members[i].isOwnFd) {
+        close(members[i].inputFd);
+      }
+
+      free(members[i].blocks);
+      free(members[i].hashes);
+    }
+
+    free(members);
+  }
+
+  snprintf(message, sizeof(message), "%d files added", filesAdded);
+  logVerbose(message);
+
+  snprintf(message, 100, "%zu opens and %zu stats for %d members",
+           (size_t)inputOpenCount, (size_t)inputStatCount, fileCount);
+  logVerbose(message);
+
+  return filesAdded;
+}
+
+
+/**
+ * @description: allocates the blocks of an appended file and queues their
+ * copy in the block stream. The blocks are allocated the same way as when
+ * they are written one by one, so the layout doesn't change.
+ * @parameter: (stream) the block stream
+ * @parameter: (member) the member of the file
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (fileIndex) the header entry of the file
+ * @parameter: (inputPath) the file being appended
+ * @parameter: (inputFd) the file, it is duplicated for the copy
+ * @parameter: (numBlocks) the amount of blocks of the file
+ * @parameter: (firstPosition) the first block, already allocated
+ * @parameter: (map) the free map used to allocate blocks
+ * @parameter: (extents) the extents of the file. This will be set in the
+ * function.
+ * @output: n/a
+ */
+void queueAppendedBlocks(struct block_stream *stream,
+                         struct member_copy *member,
+                         struct posix_header *header, size_t fileIndex,
+                         char *inputPath, int inputFd, size_t numBlocks,
+                         size_t firstPosition, struct free_map *map,
+                         struct extent_list *extents) {
+  char message[100];
+  size_t fileSize = field_to_size_t(header->files[fileIndex].size);
+
+  member->header = header;
+  member->fileIndex = fileIndex;
+  member->inputPath = inputPath;
+  member->inputFd = dup(inputFd);
+  member->isOwnFd = member->inputFd >= 0;
+  member->blocks = header->checksums && numBlocks > 0
+                       ? malloc(numBlocks * sizeof(size_t))
+                       : NULL;
+  member->hashes = member->blocks && header->attributes
+                       ? malloc(numBlocks * sizeof(uint64_t))
+                       : NULL;
+
+  if (member->inputFd < 0) {
+    snprintf(message, sizeof(message), "couldn't open file %s", inputPath);
+    logError(message);
+    stream->result = 1;
+    return;
+  }
+
+  size_t pos = firstPosition;
+
+  for (size_t b = 0; b < numBlocks; b++) {
+    size_t nextPosition = 0;
+    size_t length = fileSize - b * BLOCK_DATA_SIZE;
+
+    if (length > BLOCK_DATA_SIZE) {
+      length = BLOCK_DATA_SIZE;
+    }
+
+    if (b < numBlocks - 1) {
+      nextPosition = map->preferRuns ? allocateBlockAfter(map, pos)
+                                     : allocateBlock(map);
+    }
+
+    snprintf(message, 100,
+             "new block for %s is at block #%zu and its next will be #%zu",
+             header->files[fileIndex].filename, pos, nextPosition);
+    logVerbose(message);
+
+    queueBlockCopy(stream, member, pos, nextPosition, b * BLOCK_DATA_SIZE,
+                   length);
+    addExtentBlock(extents, pos);
+
+    pos = nextPosition;
+  }
+
+  finishQueuedMember(stream, member);
+}
+
+/**
+ * ------------------------------------------
+ *          PACK COMMAND
+ * ------------------------------------------
+ */
+
+/**
+ * @description: will desfragment the tar file to free unused space. Every
+ * chain is walked once to build a table with the new position of each block,
+ * then the blocks are moved in batches and the archive is truncated.
+ * @parameter: (filename) the tar filename to be listed
+ * @output: the exit code
+ */
+int pack(char *filename) {
+  char message[100];
+  snprintf(message, 100, "starting to desfragment the tar file %s", filename);
+  logVerbose(message);
+
+  FILE *archive = fopen(filename, "r+b");
+
+  if (archive == NULL) {
+    snprintf(message, 100, "error opening the tar file. %s", filename);
+    logError(message);
+    return 1;
+  }
+
+  struct posix_header *header = loadHeader(archive);
+
+  if (!header) {
+    fclose(archive);
+    return 1;
+  }
+
+  struct free_map map;
+  loadFreeMap(header, archive, &map);
+  loadDedupIndex(header, archive, &map);
+  loadBlockTable(header, archive);
+  loadBlockHashes(header, archive);
+
+  // the blocks are moved with O_DIRECT, the header is still kept with stdio
+  int directFd = isGlobalDirectIO ? openDirect(filename, O_RDWR) : -1;
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  size_t bytesMoved = 0;
+  int result = compactArchive(header, archive, directFd, &map, &bytesMoved);
+
+  if (result == 0) {
+    // rewrite the header with new directions
+    result = commitHeader(header, archive, &map);
+  }
+
+  fflush(archive);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double seconds =
+      (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  double megabytes = bytesMoved / (1024.0 * 1024.0);
+
+  snprintf(message, 100, "packed %zu blocks, moved %.1f MB in %.2fs (%.1f MB/s)",
+           map.blockCount, megabytes, seconds,
+           seconds > 0 ? megabytes / seconds : 0.0);
+  logInfo(message);
+
+  logArchiveCache(filename);
+
+  if (directFd >= 0) {
+    close(directFd);
+  }
+
+  destroyFreeMap(&map);
+  destroyHeader(header);
+  fclose(archive);
+
+  if (result == 0) {
+    logVerbose("file desfragmented successfully");
+  }
+
+  return result;
+}
+
+/**
+ * @description: moves every block in use to the start of the archive, keeping
+ * their order, and updates the chains and the header with the new positions.
+ * A next pointer of 0 ends a chain, so when block 0 is free the first block of
+ * a file is moved there and every other block slides after it.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archive) the tar FILE
+ * @parameter: (directFd) the tar file opened with O_DIRECT, -1 to move the
+ * blocks with stdio
+ * @parameter: (map) the free map. It will be set to the packed layout.
+ * @parameter: (bytesMoved) the amount of bytes written. This will be set in the
+ * function.
+ * @output: the exit code
+ */
+int compactArchive(struct posix_header *header, FILE *archive, int directFd,
+                   struct free_map *map, size_t *bytesMoved) {
+  char message[100];
+  size_t blockCount = map->blockCount;
+
+  (*bytesMoved) = 0;
+
+  if (blockCount == 0) {
+    return 0;
+  }
+
+  size_t *nextBlocks = malloc(blockCount * sizeof(size_t));
+  size_t *remap = malloc(blockCount * sizeof(size_t));
+
+  if (!nextBlocks || !remap) {
+    logError("memory allocation for the block table failed.");
+    free(nextBlocks);
+    free(remap);
+    return 1;
+  }
+
+  size_t firstHead = walkChains(header, archive, blockCount, nextBlocks);
+  size_t liveBlocks = buildBlockRemap(nextBlocks, blockCount, firstHead, remap);
+
+  snprintf(message, 100, "%zu blocks in use out of %zu", liveBlocks,
+           blockCount);
+  logVerbose(message);
+
+  int result = moveLiveBlocks(archive, directFd, nextBlocks, remap,
+                              blockCount, firstHead, bytesMoved);
+
+  if (result == 0) {
+    for (size_t i = 0; i < header->count; i++) {
+      if (blocksForSize(field_to_size_t(header->files[i].size)) == 0) {
+        continue;
+      }
+
+      size_t blockAddress = field_to_size_t(header->files[i].blockAddress);
+
+      if (blockAddress < blockCount && remap[blockAddress] != UNUSED_BLOCK) {
+        size_t_to_field(header->files[i].blockAddress, remap[blockAddress]);
+      }
+
+      if (map->preferRuns) {
+        remapFileExtents(&header->files[i], blockAddress, nextBlocks, remap,
+                         blockCount);
+      }
+    }
+
+    // the hashes don't depend on the positions, only the blocks move
+    if (header->dedup) {
+      remapDedupIndex(header->dedup, remap, blockCount, liveBlocks);
+    }
+
+    // neither do the checksums, the blocks keep their data
+    if (header->checksums) {
+      remapBlockChecksums(header->checksums, remap, blockCount, liveBlocks);
+    }
+
+    // the chains keep their order, so only the positions in the table move
+    if (header->blockTable) {
+      remapBlockTable(header->blockTable, remap, blockCount);
+    }
+
+    // after packing there are no free blocks left
+    destroyFreeMap(map);
+    initFreeMap(map, liveBlocks);
+  }
+
+  free(nextBlocks);
+  free(remap);
+
+  return result;
+}
+
+/**
+ * @description: records the extents a file has after packing, following its
+ * chain in memory with the new position of every block
+ * @parameter: (fileInfo) the info of the file
+ * @parameter: (firstBlock) the first block of the file before packing
+ * @parameter: (nextBlocks) the next pointer of each block before packing
+ * @parameter: (remap) the new position of each block
+ * @parameter: (blockCount) the amount of blocks before packing
+ * @output: n/a
+ */
+void remapFileExtents(struct posix_file_info *fileInfo, size_t firstBlock,
+                      size_t *nextBlocks, size_t *remap, size_t blockCount) {
+  struct extent_list extents;
+  initExtentList(&extents);
+
+  size_t currentBlockIndex = firstBlock;
+  size_t hops = 0;
+
+  while (currentBlockIndex < blockCount &&
+         remap[currentBlockIndex] != UNUSED_BLOCK && hops++ < blockCount) {
+    addExtentBlock(&extents, remap[currentBlockIndex]);
+
+    if (nextBlocks[currentBlockIndex] == 0) {
+      break;
+    }
+
+    currentBlockIndex = nextBlocks[currentBlockIndex];
+  }
+
+  storeFileExtents(fileInfo, &extents);
+}
+
+/**
+ * @description: follows the chain of every file once and saves the next
+ * pointer of each block in use. In archives that share blocks a file can
+ * start in the middle of another chain, and such a block can't be moved to
+ * block 0, so the first head is the lowest one no block points to.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archive) the tar FILE
+ * @parameter: (blockCount) the amount of blocks in the archive
+ * @parameter: (nextBlocks) the next pointer of each block, UNUSED_BLOCK when
+ * the block is not part of any chain. This will be set in the function.
+ * @output: the lowest block that starts a chain, UNUSED_BLOCK if none
+ */
+size_t walkChains(struct posix_header *header, FILE *archive,
+                  size_t blockCount, size_t *nextBlocks) {
+  size_t firstHead = UNUSED_BLOCK;
+
+  for (size_t block = 0; block < blockCount; block++) {
+    nextBlocks[block] = UNUSED_BLOCK;
+  }
+
+  for (size_t i = 0; i < header->count; i++) {
+    if (blocksForSize(field_to_size_t(header->files[i].size)) == 0) {
+      continue;
+    }
+
+    size_t currentBlockIndex = field_to_size_t(header->files[i].blockAddress);
+
+    // a block already seen means the chain is broken and loops, or that the
+    // rest of the chain is shared and was already walked
+    while (currentBlockIndex < blockCount &&
+           nextBlocks[currentBlockIndex] == UNUSED_BLOCK) {
+      size_t nextBlockIndex = readBlockNext(archive, currentBlockIndex);
+
+      nextBlocks[currentBlockIndex] = nextBlockIndex;
+
+      if (nextBlockIndex == 0) {
+        break;
+      }
+
+      currentBlockIndex = nextBlockIndex;
+    }
+  }
+
+  bool *isPointedTo = calloc(blockCount, sizeof(bool));
+
+  if (!isPointedTo) {
+    return UNUSED_BLOCK;
+  }
+
+  for (size_t block = 0; block < blockCount; block++) {
+    if (nextBlocks[block] != UNUSED_BLOCK && nextBlocks[block] < blockCount) {
+      isPointedTo[nextBlocks[block]] = true;
+    }
+  }
+
+  for (size_t i = 0; i < header->count; i++) {
+    if (blocksForSize(field_to_size_t(header->files[i].size)) == 0) {
+      continue;
+    }
+
+    size_t head = field_to_size_t(header->files[i].blockAddress);
+
+    if (head < firstHead && head < blockCount && !isPointedTo[head]) {
+      firstHead = head;
+    }
+  }
+
+  free(isPointedTo);
+
+  return firstHead;
+}
+
+/**
+ * @description: calculates the new position of every block in use. Blocks
+ * keep their order, so a block never moves after its current position.
+ * @parameter: (nextBlocks) the next pointer of each block in use
+ * @parameter: (blockCount) the amount of blocks in the archive
+ * @parameter: (firstHead) the lowest block that starts a chain
+ * @parameter: (remap) the new position of each block. This will be set in the
+ * function.
+ * @output: the amount of blocks in use
+ */
+size_t buildBlockRemap(size_t *nextBlocks, size_t blockCount, size_t firstHead,
+                       size_t *remap) {
+  bool relocateHead =
+      firstHead != UNUSED_BLOCK && nextBlocks[0] == UNUSED_BLOCK;
+  size_t newIndex = relocateHead ? 1 : 0;
+
+  for (size_t block = 0; block < blockCount; block++) {
+    if (nextBlocks[block] == UNUSED_BLOCK) {
+      remap[block] = UNUSED_BLOCK;
+    } else if (relocateHead && block == firstHead) {
+      remap[block] = 0;
+    } else {
+      // a next pointer of 0 ends a chain, without a head to move there
+      // block 0 is left empty
+      if (newIndex == 0 && nextBlocks[0] == UNUSED_BLOCK) {
+        newIndex = 1;
+      }
+
+      remap[block] = newIndex++;
+    }
+  }
+
+  return newIndex;
+}
+
+/**
+ * @description: moves the blocks in use to their new position. Runs of
+ * consecutive blocks are read and written together, and blocks that keep
+ * their position and their next pointer are not touched.
+ * @parameter: (archive) the tar FILE
+ * @parameter: (directFd) the tar file opened with O_DIRECT, -1 if not used
+ * @parameter: (nextBlocks) the next pointer of each block in use
+ * @parameter: (remap) the new position of each block
+ * @parameter: (blockCount) the amount of blocks in the archive
+ * @parameter: (firstHead) the lowest block that starts a chain
+ * @parameter: (bytesMoved) the amount of bytes written. This will be set in the
+ * function.
+ * @output: the exit code
+ */
+int moveLiveBlocks(FILE *archive, int directFd, size_t *nextBlocks,
+                   size_t *remap, size_t blockCount, size_t firstHead,
+                   size_t *bytesMoved) {
+  char message[100];
+  char *buffer = acquireBlockBuffers(BATCH_BLOCKS);
+
+  if (!buffer) {
+    return 1;
+  }
+
+  // block 0 is free, the first chain takes it before anything else moves
+  if (firstHead != UNUSED_BLOCK && remap[firstHead] == 0 && firstHead != 0) {
+    if (moveBlockRun(archive, directFd, buffer, firstHead, 1, nextBlocks,
+                     remap) != 0) {
+      releaseBlockBuffers(buffer, BATCH_BLOCKS);
+      return 1;
+    }
+
+    (*bytesMoved) += BLOCK_SIZE;
+  }
+
+  if (isGlobalAsyncIO) {
+    releaseBlockBuffers(buffer, BATCH_BLOCKS);
+    fflush(archive);
+
+    return moveAsyncBlocks(directFd >= 0 ? directFd : fileno(archive),
+                           nextBlocks, remap, blockCount, firstHead,
+                           bytesMoved);
+  }
+
+  size_t block = 0;
+
+  while (block < blockCount) {
+    if (nextBlocks[block] == UNUSED_BLOCK ||
+        (remap[block] == 0 && block == firstHead && block != 0)) {
+      block++;
+      continue;
+    }
+
+    // blocks that stay the same don't need to be written
+    size_t next = nextBlocks[block];
+
+    if (remap[block] == block && (next == 0 || remap[next] == next)) {
+      block++;
+      continue;
+    }
+
+    size_t runLength = 1;
+
+    while (runLength < BATCH_BLOCKS && block + runLength < blockCount &&
+           nextBlocks[block + runLength] != UNUSED_BLOCK &&
+           remap[block + runLength] == remap[block] + runLength) {
+      runLength++;
+    }
+
+    snprintf(message, 100, "moving blocks #%zu-#%zu to #%zu", block,
+             block + runLength - 1, remap[block]);
+    logVerbose(message);
+
+    if (moveBlockRun(archive, directFd, buffer, block, runLength, nextBlocks,
+                     remap) != 0) {
+      releaseBlockBuffers(buffer, BATCH_BLOCKS);
+      return 1;
+    }
+
+    (*bytesMoved) += runLength * BLOCK_SIZE;
+    block += runLength;
+  }
+
+  releaseBlockBuffers(buffer, BATCH_BLOCKS);
+
+  return 0;
+}
+
+/**
+ * @description: moves a run of consecutive blocks, rewriting their next
+ * pointers with the new positions
+ * @parameter: (archive) the tar FILE
+ * @parameter: (directFd) the tar file opened with O_DIRECT, -1 to use stdio
+ * @parameter: (buffer) a page aligned buffer big enough for the run
+ * @parameter: (firstBlock) the first block of the run
+ * @parameter: (runLength) the amount of blocks in the run
+ * @parameter: (nextBlocks) the next pointer of each block in use
+ * @parameter: (remap) the new position of each block
+ * @output: the exit code
+ */
+int moveBlockRun(FILE *archive, int directFd, char *buffer, size_t firstBlock,
+                 size_t runLength, size_t *nextBlocks, size_t *remap) {
+  size_t runSize = runLength * BLOCK_SIZE;
+
+  if (directFd >= 0) {
+    if (preadFull(directFd, buffer, runSize, blockOffset(firstBlock)) !=
+        (ssize_t)runSize) {
+      logError("failed to read blocks while packing.");
+      return 1;
+    }
+  } else {
+    fseek(archive, blockOffset(firstBlock), SEEK_SET);
+
+    if (fread(buffer, BLOCK_SIZE, runLength, archive) != runLength) {
+      logError("failed to read blocks while packing.");
+      return 1;
+    }
+  }
+
+  for (size_t i = 0; i < runLength; i++) {
+    struct block_data *block = (struct block_data *)(buffer + i * BLOCK_SIZE);
+    size_t next = nextBlocks[firstBlock + i];
+
+    size_t_to_field(block->next, next == 0 ? 0 : remap[next]);
+  }
+
+  if (directFd >= 0) {
+    if (pwriteFull(directFd, buffer, runSize, blockOffset(remap[firstBlock])) !=
+        (ssize_t)runSize) {
+      logError("failed to write blocks while packing.");
+      return 1;
+    }
+  } else {
+    fseek(archive, blockOffset(remap[firstBlock]), SEEK_SET);
+
+    if (fwrite(buffer, BLOCK_SIZE, runLength, archive) != runLength ||
+        fflush(archive) != 0) {
+      logError("failed to write blocks while packing.");
+      return 1;
+    }
+  }
+
+  // the blocks were written whole, the space after compressed data is freed
+  for (size_t i = 0; i < runLength; i++) {
+    punchStoredTail(directFd >= 0 ? directFd : fileno(archive),
+                    remap[firstBlock] + i,
+                    (struct block_data *)(buffer + i * BLOCK_SIZE));
+  }
+
+  return 0;
+}
+
+/**
+ * @description: moves the blocks in use through the I/O engine. The blocks
+ * are read in order of position with many reads in flight. Blocks only move
+ * to lower positions, so a block is written as soon as every block that was
+ * at its new position has been read.
+ * @parameter: (archiveFd) the file descriptor of the tar file
+ * @parameter: (nextBlocks) the next pointer of each block in use
+ * @parameter: (remap) the new position of each block
+ * @parameter: (blockCount) the amount of blocks in the archive
+ * @parameter: (firstHead) the lowest block that starts a chain, already moved
+ * @parameter: (bytesMoved) the amount of bytes written. This will be set in the
+ * function.
+ * @output: the exit code
+ */
+int moveAsyncBlocks(int archiveFd, size_t *nextBlocks, size_t *remap,
+                    size_t blockCount, size_t firstHead, size_t *bytesMoved) {
+  struct io_engine engine;
+  struct move_slot slots[IO_QUEUE_DEPTH];
+  char *buffers = acquireBlockBuffers(IO_QUEUE_DEPTH);
+
+  if (!buffers) {
+    return 1;
+  }
+
+  if (initIOEngine(&engine, IO_QUEUE_DEPTH) != 0) {
+    releaseBlockBuffers(buffers, IO_QUEUE_DEPTH);
+    return 1;
+  }
+
+  memset(slots, 0, sizeof(slots));
+
+  for (int s = 0; s < IO_QUEUE_DEPTH; s++) {
+    slots[s].request.fd = archiveFd;
+    slots[s].request.buffer = buffers + (size_t)s * BLOCK_SIZE;
+    slots[s].request.length = BLOCK_SIZE;
+    slots[s].request.owner = &slots[s];
+  }
+
+  int result = 0;
+  size_t block = 0;
+
+  while (true) {
+    for (int s = 0; s < IO_QUEUE_DEPTH && block < blockCount && result == 0;
+         s++) {
+      if (slots[s].isUsed) {
+        continue;
+      }
+
+      // the same blocks the synchronous path skips
+      while (block < blockCount &&
+             (nextBlocks[block] == UNUSED_BLOCK ||
+              (remap[block] == 0 && block == firstHead && block != 0) ||
+              (remap[block] == block &&
+               (nextBlocks[block] == 0 ||
+                remap[nextBlocks[block]] == nextBlocks[block])))) {
+        block++;
+      }
+
+      if (block == blockCount) {
+        break;
+      }
+
+      slots[s].isUsed = true;
+      slots[s].isRead = false;
+      slots[s].isWriting = false;
+      slots[s].block = block++;
+      slots[s].request.offset = blockOffset(slots[s].block);
+      slots[s].request.isWrite = false;
+
+      submitIO(&engine, &slots[s].request);
+    }
+
+    // every position below this one was already read
+    size_t lowestUnread = block;
+
+    for (int s = 0; s < IO_QUEUE_DEPTH; s++) {
+      if (slots[s].isUsed && !slots[s].isRead &&
+          slots[s].block < lowestUnread) {
+        lowestUnread = slots[s].block;
+      }
+    }
+
+    for (int s = 0; s < IO_QUEUE_DEPTH && result == 0; s++) {
+      struct move_slot *slot = &slots[s];
+
+      if (!slot->isUsed || !slot->isRead || slot->isWriting ||
+          remap[slot->block] >= lowestUnread) {
+        continue;
+      }
+
+      struct block_data *data = slot->request.buffer;
+      size_t next = nextBlocks[slot->block];
+
+      size_t_to_field(data->next, next == 0 ? 0 : remap[next]);
+
+      slot->isWriting = true;
+      slot->request.offset = blockOffset(remap[slot->block]);
+      slot->request.isWrite = true;
+
+      submitIO(&engine, &slot->request);
+    }
+
+    struct io_request *request = waitIO(&engine);
+
+    if (!request) {
+      break;
+    }
+
+    struct move_slot *slot = request->owner;
+
+    if (request->result != BLOCK_SIZE) {
+      logError(request->isWrite ? "failed to write blocks while packing."
+                                : "failed to read blocks while packing.");
+      result = 1;
+      slot->isUsed = false;
+    } else if (request->isWrite) {
+      punchStoredTail(archiveFd, remap[slot->block], request->buffer);
+      (*bytesMoved) += BLOCK_SIZE;
+      slot->isUsed = false;
+    } else {
+      slot->isRead = true;
+    }
+  }
+
+  destroyIOEngine(&engine);
+  releaseBlockBuffers(buffers, IO_QUEUE_DEPTH);
+
+  return result;
+}
+
+/**
+ * @description: will remove unused blocks at the end of file. The free map
+ * tells which blocks are free, so no block has to be read.
+ * @parameter: (archive) the tar FILE
+ * @parameter: (map) the free map of the archive
+ * @output: the exit code
+ */
+int removeFreeBlocksAtEnd(FILE *archive, struct free_map *map) {
+  char message[100];
+
+  size_t counter = trimFreeBlocks(map);
+
+  snprintf(message, 100, "found %zu free blocks at the end", counter);
+  logVerbose(message);
+
+  fflush(archive);
+  fseek(archive, 0, SEEK_END);
+
+  if (ftell(archive) > blockOffset(map->blockCount)) {
+    if (ftruncate(fileno(archive), blockOffset(map->blockCount)) != 0) {
+      logError("failed to truncate the tar file.");
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * ------------------------------------------
+ *          VERIFY COMMAND
+ * ------------------------------------------
+ */
+
+/**
+ * @description: checks every chain and every checksum of an archive. The
+ * blocks are read in large runs by a pool of threads, from the start of the
+ * archive to its end, and the chains are followed after in memory.
+ * @parameter: (filename) the tar file to be verified
+ * @output: the exit code, 1 when anything is damaged
+ */
+int verify(char *filename) {
+  char message[100];
+  FILE *archive = fopen(filename, "rb");
+
+  if (!archive) {
+    logError("Failed to open tar archive file. Double check if the input file "
+             "exists.");
+    return 1;
+  }
+
+  struct posix_header *header = loadHeader(archive);
+
+  if (!header) {
+    fclose(archive);
+    return 1;
+  }
+
+  if (!header->checksums) {
+    logWarning("the archive has no checksums, only its chains are verified");
+  }
+
+  struct verify_job job;
+
+  job.isOctalFields = isGlobalOctalFields;
+  job.blockCount = archiveBlockCount(header, archive);
+  job.nextBlock = 0;
+  job.bytesRead = 0;
+  job.result = 0;
+  job.nextBlocks = malloc((job.blockCount + 1) * sizeof(size_t));
+  job.checksums = malloc((job.blockCount + 1) * sizeof(uint32_t));
+
+  if (!job.nextBlocks || !job.checksums) {
+    logError("memory allocation for the block table failed.");
+    free(job.nextBlocks);
+    free(job.checksums);
+    destroyHeader(header);
+    fclose(archive);
+    return 1;
+  }
+
+  // direct reads leave the page cache to the rest of the machine
+  int directFd = isGlobalDirectIO ? openDirect(filename, O_RDONLY) : -1;
+
+  job.archiveFd = directFd >= 0 ? directFd : fileno(archive);
+
+  if (directFd < 0) {
+    posix_fadvise(job.archiveFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  }
+
+  pthread_mutex_init(&job.lock, NULL);
+
+  // like the codec, every CPU is used unless --jobs says otherwise
+  int workerCount = codecThreadCount();
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  pthread_t workers[MAX_JOBS];
+  int startedWorkers = 0;
+
+  for (int w = 1; w < workerCount; w++) {
+    if (pthread_create(&workers[startedWorkers], NULL, verifyWorker, &job) !=
+        0) {
+      logWarning("couldn't start a verify worker");
+      break;
+    }
+
+    startedWorkers++;
+  }
+
+  // the calling thread reads as well
+  verifyWorker(&job);
+
+  for (int w = 0; w < startedWorkers; w++) {
+    pthread_join(workers[w], NULL);
+  }
+
+  size_t errorCount = job.result == 0 ? verifyChains(header, &job) : 1;
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double seconds =
+      (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  double gigabytes = job.bytesRead / (1024.0 * 1024.0 * 1024.0);
+
+  snprintf(message, 100, "verified %zu members in %zu blocks, %zu errors",
+           header->count, job.blockCount, errorCount);
+  errorCount > 0 ? logError(message) : logInfo(message);
+
+  snprintf(message, 100,
+           "read %.2f GB with %d threads%s in %.2fs (%.2f GB/s)", gigabytes,
+           startedWorkers + 1, directFd >= 0 ? ", direct I/O" : "", seconds,
+           seconds > 0 ? gigabytes / seconds : 0.0);
+  logVerbose(message);
+
+  pthread_mutex_destroy(&job.lock);
+
+  if (directFd >= 0) {
+    close(directFd);
+  }
+
+  free(job.nextBlocks);
+  free(job.checksums);
+  destroyHeader(header);
+  fclose(archive);
+
+  return errorCount > 0 ? 1 : 0;
+}
+
+/**
+ * @description: takes runs of blocks from the job and reads each one at once,
+ * keeping the next pointer and the checksum of the data of every block
+ * @parameter: (argument) the verify_job shared by the workers
+ * @output: NULL
+ */
+void *verifyWorker(void *argument) {
+  struct verify_job *job = argument;
+  char *buffer = NULL;
+  size_t bytesRead = 0;
+
+  isGlobalOctalFields = job->isOctalFields;
+
+  // direct reads need an aligned buffer, and a run is too big for the pool
+  if (posix_memalign((void **)&buffer, DIRECT_IO_ALIGNMENT,
+                     BATCH_BLOCKS * BLOCK_SIZE) != 0) {
+    logError("memory allocation for the verify buffer failed.");
+    pthread_mutex_lock(&job->lock);
+    job->result = 1;
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+  }
+
+  while (true) {
+    pthread_mutex_lock(&job->lock);
+    size_t firstBlock = job->nextBlock;
+    job->nextBlock += BATCH_BLOCKS;
+    pthread_mutex_unlock(&job->lock);
+
+    if (firstBlock >= job->blockCount) {
+      break;
+    }
+
+    size_t count = job->blockCount - firstBlock;
+
+    if (count > BATCH_BLOCKS) {
+      count = BATCH_BLOCKS;
+    }
+
+    ssize_t result = preadFull(job->archiveFd, buffer, count * BLOCK_SIZE,
+                               blockOffset(firstBlock));
+    size_t length = result > 0 ? result : 0;
+
+    bytesRead += length;
+
+    for (size_t b = 0; b < count; b++) {
+      struct block_data *block = (struct block_data *)(buffer + b * BLOCK_SIZE);
+      size_t available = length > b * BLOCK_SIZE ? length - b * BLOCK_SIZE : 0;
+
+      if (available < sizeof(struct block_metadata)) {
+        job->nextBlocks[firstBlock + b] = UNUSED_BLOCK;
+        continue;
+      }
+
+      // the last block of old archives can be shorter
+      if (available < BLOCK_SIZE) {
+        memset((char *)block + available, 0, BLOCK_SIZE - available);
+      }
+
+      job->nextBlocks[firstBlock + b] = field_to_size_t(block->next);
+      job->checksums[firstBlock + b] = blockDataChecksum(block);
+    }
+  }
+
+  pthread_mutex_lock(&job->lock);
+  job->bytesRead += bytesRead;
+  pthread_mutex_unlock(&job->lock);
+
+  free(buffer);
+
+  return NULL;
+}
+
+/**
+ * @description: follows the chain of every member with the blocks read by the
+ * workers. A chain must stay inside the archive, reach as many blocks as its
+ * size needs without looping, and only share blocks in archives that store
+ * identical blocks once. Every block and every member must match its
+ * checksum.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (job) the verify_job with the blocks already read
+ * @output: the amount of errors found
+ */
+size_t verifyChains(struct posix_header *header, struct verify_job *job) {
+  char message[100];
+  size_t errorCount = 0;
+  bool isShared = archiveFlags(header) & ARCHIVE_FLAG_DEDUP;
+
+  // the member plus one that went through each block last
+  size_t *owners = calloc(job->blockCount + 1, sizeof(size_t));
+
+  if (!owners) {
+    logError("memory allocation for the block table failed.");
+    return 1;
+  }
+
+  for (size_t i = 0; i < header->count; i++) {
+    struct posix_file_info *fileInfo = &header->files[i];
+    struct block_checksums *checksums = memberChecksums(header, i);
+    size_t numBlocks = blocksForSize(field_to_size_t(fileInfo->size));
+    size_t currentBlockIndex = field_to_size_t(fileInfo->blockAddress);
+    uint32_t memberChecksum = 0;
+    const char *problem = NULL;
+
+    for (size_t b = 0; b < numBlocks && !problem; b++) {
+      if (currentBlockIndex >= job->blockCount) {
+        problem = "goes past the end of the archive";
+      } else if (job->nextBlocks[currentBlockIndex] == UNUSED_BLOCK) {
+        problem = "has a block that can't be read";
+      } else if (owners[currentBlockIndex] == i + 1) {
+        problem = "loops";
+      } else if (!isShared && owners[currentBlockIndex] != 0) {
+        problem = "goes through the blocks of another member";
+      }
+
+      if (problem) {
+        break;
+      }
+
+      owners[currentBlockIndex] = i + 1;
+
+      if (checksums) {
+        uint32_t expected = currentBlockIndex < checksums->blockCapacity
+                                ? checksums->blocks[currentBlockIndex]
+                                : 0;
+
+        memberChecksum = foldBlockChecksum(memberChecksum, expected);
+
+        if (job->checksums[currentBlockIndex] != expected) {
+          snprintf(message, sizeof(message),
+                   "block #%zu of %s doesn't match its checksum",
+                   currentBlockIndex, fileInfo->filename);
+          logError(message);
+          errorCount++;
+        }
+      }
+
+      size_t nextBlockIndex = job->nextBlocks[currentBlockIndex];
+
+      if (nextBlockIndex == 0 && b + 1 < numBlocks) {
+        problem = "ends before its last block";
+      }
+
+      currentBlockIndex = nextBlockIndex;
+    }
+
+    if (problem) {
+      snprintf(message, sizeof(message), "the chain of %s %s",
+               fileInfo->filename, problem);
+      logError(message);
+      errorCount++;
+    } else if (checksums && checksums->members[i] != memberChecksum) {
+      snprintf(message, sizeof(message),
+               "the chain of %s doesn't match its checksum",
+               fileInfo->filename);
+      logError(message);
+      errorCount++;
+    } else if (header->checksums && !checksums && numBlocks > 0) {
+      snprintf(message, sizeof(message),
+               "%s has no checksum, only its chain was verified",
+               fileInfo->filename);
+      logWarning(message);
+    }
+  }
+
+  free(owners);
+
+  return errorCount;
+}
+
+/**
+ * @description: finds out how many blocks the archive has. The free map keeps
+ * the count, and archives without one are measured.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archive) the tar FILE
+ * @output: the amount of blocks
+ */
+size_t archiveBlockCount(struct posix_header *header, FILE *archive) {
+  struct free_map_info *info = (struct free_map_info *)header->tail;
+
+  if (memcmp(info->magic, FREE_MAP_MAGIC, sizeof(info->magic)) == 0 ||
+      memcmp(info->magic, FREE_MAP_MAGIC_V1, sizeof(info->magic)) == 0) {
+    return octal_to_size_t(info->blockCount);
+  }
+
+  fseek(archive, 0, SEEK_END);
+  long endPos = ftell(archive);
+
+  if (endPos <= MAX_HEADER_SIZE) {
+    return 0;
+  }
+
+  return (endPos - MAX_HEADER_SIZE + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
+
+/**
+ * ------------------------------------------
+ *          BATCH COMMAND
+ * ------------------------------------------
+ */
+
+/**
+ * @description: applies a list of operations to an archive loading its
+ * header once, and writes the header once at the end. Each line of the list
+ * is "add PATH", "update PATH", "delete NAME" or "extract NAME", and empty
+ * lines or lines starting with # are skipped. The whole list is read before
+ * the archive is touched, so a wrong line leaves the archive as it was. An
+ * operation that fails doesn't stop the others, but the batch fails.
+ * @parameter: (files) the file with the operations, stdin when there is none
+ * @parameter: (fileCount) the amount of files received
+ * @parameter: (filename) the tar filename to be changed
+ * @output: the exit code
+ */
+int batch(char *files[], int fileCount, char *filename) {
+  char message[100];
+
+  if (fileCount > 1) {
+    logError("--batch reads the operations out of one file");
+    return 1;
+  }
+
+  FILE *input = fileCount == 1 ? fopen(files[0], "r") : stdin;
+
+  if (!input) {
+    snprintf(message, 100, "couldn't open the operations file %s", files[0]);
+    logError(message);
+    return 1;
+  }
+
+  size_t operationCount = 0;
+  struct batch_operation *operations =
+      readBatchOperations(input, &operationCount);
+
+  if (input != stdin) {
+    fclose(input);
+  }
+
+  if (!operations) {
+    return 1;
+  }
+
+  FILE *archive = fopen(filename, "r+b");
+
+  if (!archive) {
+    logError("Failed to open tar archive file. Double check if the input file "
+             "exists.");
+    freeBatchOperations(operations, operationCount);
+    return 1;
+  }
+
+  struct posix_header *header = loadHeader(archive);
+
+  if (!header) {
+    fclose(archive);
+    freeBatchOperations(operations, operationCount);
+    return 1;
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  struct free_map map;
+  loadFreeMap(header, archive, &map);
+  loadDedupIndex(header, archive, &map);
+  loadBlockTable(header, archive);
+  loadBlockHashes(header, archive);
+
+  struct name_index index;
+  buildNameIndex(header, &index);
+
+  char **arguments = malloc(operationCount * sizeof(char *));
+  size_t counts[BATCH_OPERATION_COUNT] = {0};
+  int result = arguments ? 0 : 1;
+
+  // consecutive operations of the same kind go together, like the files
+  // of a single command
+  for (size_t first = 0; arguments && first < operationCount;) {
+    BatchOperation type = operations[first].type;
+    size_t last = first;
+
+    while (last < operationCount && operations[last].type == type) {
+      arguments[last - first] = operations[last].argument;
+      last++;
+    }
+
+    size_t appliedCount = 0;
+
+    if (applyBatchOperations(header, archive, &map, &index, type, arguments,
+                             last - first, &appliedCount) != 0) {
+      result = 1;
+    }
+
+    counts[type] += appliedCount;
+    first = last;
+  }
+
+  if (commitHeader(header, archive, &map) != 0) {
+    result = 1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double seconds =
+      (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+  size_t appliedCount = counts[BATCH_ADD] + counts[BATCH_UPDATE] +
+                        counts[BATCH_DELETE] + counts[BATCH_EXTRACT];
+
+  snprintf(message, 100,
+           "applied %zu of %zu operations (%zu added, %zu updated, %zu "
+           "deleted, %zu extracted) in %.2fs",
+           appliedCount, operationCount, counts[BATCH_ADD],
+           counts[BATCH_UPDATE], counts[BATCH_DELETE], counts[BATCH_EXTRACT],
+           seconds);
+  logInfo(message);
+
+  free(arguments);
+  destroyNameIndex(&index);
+  destroyFreeMap(&map);
+  destroyHeader(header);
+  fclose(archive);
+  freeBatchOperations(operations, operationCount);
+
+  return result;
+}
+
+/**
+ * @description: reads every operation of a batch. If there is an error in
+ * malloc it will exit the program.
+ * @parameter: (input) the file with the operations
+ * @parameter: (operationCount) the amount of operations read. This will be
+ * set in the function.
+ * @output: the operations, NULL when a line is wrong
+ */
+struct batch_operation *readBatchOperations(FILE *input,
+                                            size_t *operationCount) {
+  char message[100];
+  struct batch_operation *operations = NULL;
+  size_t capacity = 0;
+  char *line = NULL;
+  size_t lineSize = 0;
+  size_t lineNumber = 0;
+  bool isValid = true;
+
+  *operationCount = 0;
+
+  while (getline(&line, &lineSize, input) >= 0) {
+    lineNumber++;
+    line[strcspn(line, "\r\n")] = '\0';
+
+    char *text = line + strspn(line, " \t");
+
+    if (text[0] == '\0' || text[0] == '#') {
+      continue;
+    }
+
+    if (*operationCount == capacity) {
+      capacity = capacity > 0 ? capacity * 2 : 64;
+      operations = realloc(operations,
+                           capacity * sizeof(struct batch_operation));
+
+      if (!operations) {
+        logError("memory allocation for the batch failed");
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    if (!parseBatchLine(text, &operations[*operationCount])) {
+      snprintf(message, 100, "line %zu of the batch is not an operation: %.40s",
+               lineNumber, text);
+      logError(message);
+      isValid = false;
+      continue;
+    }
+
+    (*operationCount)++;
+  }
+
+  free(line);
+
+  if (!isValid) {
+    freeBatchOperations(operations, *operationCount);
+    return NULL;
+  }
+
+  // an empty batch still gets an array, so it is told apart from errors
+  return operations ? operations : malloc(sizeof(struct batch_operation));
+}
+
+/**
+ * @description: reads an operation out of a line, made of its name and the
+ * file it works on, which can have spaces
+ * @parameter: (line) the line without its line break
+ * @parameter: (operation) the operation read. This will be set in the
+ * function.
+ * @output: true if the line is an operation
+ */
+bool parseBatchLine(char *line, struct batch_operation *operation) {
+  static const char *names[BATCH_OPERATION_COUNT] = {"add", "update",
+                                                     "delete", "extract"};
+  size_t nameLength = strcspn(line, " \t");
+  char *argument = line + nameLength + strspn(line + nameLength, " \t");
+  size_t argumentLength = strlen(argument);
+
+  while (argumentLength > 0 && (argument[argumentLength - 1] == ' ' ||
+                                argument[argumentLength - 1] == '\t')) {
+    argumentLength--;
+  }
+
+  if (argumentLength == 0) {
+    return false;
+  }
+
+  for (int type = 0; type < BATCH_OPERATION_COUNT; type++) {
+    if (strlen(names[type]) == nameLength &&
+        strncmp(line, names[type], nameLength) == 0) {
+      operation->type = type;
+      operation->argument = strndup(argument, argumentLength);
+
+      if (!operation->argument) {
+        logError("memory allocation for the batch failed");
+        exit(EXIT_FAILURE);
+      }
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * @description: applies a run of operations of the same kind to the header
+ * in memory. The blocks are written as they go, and extracting sees the
+ * members changed earlier in the batch.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archive) the tar FILE
+ * @parameter: (map) the free map of the archive
+ * @parameter: (index) the name index of the header
+ * @parameter: (type) the kind of the operations
+ * @parameter: (arguments) the file of each operation
+ * @parameter: (count) the amount of operations
+ * @parameter: (appliedCount) the amount of operations that worked. This will
+ * be set in the function.
+ * @output: the exit code, 1 when any of the operations failed
+ */
+int applyBatchOperations(struct posix_header *header, FILE *archive,
+                         struct free_map *map, struct name_index *index,
+                         BatchOperation type, char *arguments[],
+                         size_t count, size_t *appliedCount) {
+  int applied = 0;
+
+  *appliedCount = 0;
+
+  if (type == BATCH_ADD) {
+    applied = appendFilesByTarFile(header, archive, arguments, count, map,
+                                   index);
+  } else if (type == BATCH_UPDATE) {
+    applied = updateBlocksInFile(arguments, count, header, archive, map,
+                                 index);
+  } else if (type == BATCH_DELETE) {
+    applied = deleteFilesByTarFile(header, archive, arguments, count, map,
+                                   index);
+  }
+
+  if (type != BATCH_EXTRACT) {
+    *appliedCount = applied;
+    return (size_t)applied < count ? 1 : 0;
+  }
+
+  size_t memberCount = 0;
+  size_t missingCount = 0;
+  size_t *members =
+      selectMembers(header, arguments, count, &memberCount, &missingCount);
+
+  if (!members) {
+    return 1;
+  }
+
+  size_t errorCount = checksumErrorCount;
+
+  // the blocks written so far are read back with pread
+  fflush(archive);
+  extractFilesByTarFile(header, archive, NULL, -1, members, memberCount);
+  free(members);
+
+  *appliedCount = count - missingCount;
+
+  return missingCount > 0 || checksumErrorCount > errorCount ? 1 : 0;
+}
+
+/**
+ * @description: releases the operations of a batch
+ * @parameter: (operations) the operations
+ * @parameter: (count) the amount of operations
+ * @output: n/a
+ */
+void freeBatchOperations(struct batch_operation *operations, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    free(operations[i].argument);
+  }
+
+  free(operations);
+}
+
+/**
+ * ------------------------------------------
+ *          READ RANGES
+ * ------------------------------------------
+ */
+
+/**
+ * @description: reads a range of a member into a buffer. Each block of the
+ * range is read whole, checked against its checksum and decompressed when it
+ * needs to be, and only the part of the range is copied.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archive) the tar FILE
+ * @parameter: (fileIndex) the position of the member in the header
+ * @parameter: (offset) the first byte of the range inside the member
+ * @parameter: (length) the amount of bytes of the range
+ * @parameter: (buffer) where the range is copied, with room for length bytes
+ * @output: the amount of bytes read, less than length at the end of the
+ * member, or -1 on errors
+ */
+ssize_t readMemberRange(struct posix_header *header, FILE *archive,
+                        size_t fileIndex, size_t offset, size_t length,
+                        char *buffer) {
+  char message[100];
+  struct posix_file_info *fileInfo = &header->files[fileIndex];
+  size_t fileSize = field_to_size_t(fileInfo->size);
+
+  if (offset >= fileSize || length == 0) {
+    return 0;
+  }
+
+  if (length > fileSize - offset) {
+    length = fileSize - offset;
+  }
+
+  size_t firstBlock = offset / BLOCK_DATA_SIZE;
+  size_t count = (offset + length - 1) / BLOCK_DATA_SIZE - firstBlock + 1;
+  size_t *blocks = malloc(count * sizeof(size_t));
+  struct block_data *block = acquireBlockBuffers(2);
+
+  if (!blocks || !block) {
+    logError("memory allocation for the read failed.");
+    free(blocks);
+
+    if (block) {
+      releaseBlockBuffers(block, 2);
+    }
+
+    return -1;
+  }
+
+  // the second buffer holds the data of compressed blocks
+  struct block_data *plain = (struct block_data *)((char *)block + BLOCK_SIZE);
+  bool isCompressed = archiveFlags(header) & ARCHIVE_FLAG_COMPRESSED;
+  struct block_checksums *checksums = memberChecksums(header, fileIndex);
+  ssize_t result = length;
+  size_t copied = 0;
+
+  if (findMemberBlocks(header, archive, fileIndex, firstBlock, count,
+                       blocks) != 0) {
+    result = -1;
+  }
+
+  for (size_t b = 0; result >= 0 && b < count; b++) {
+    size_t blockStart = (firstBlock + b) * BLOCK_DATA_SIZE;
+    size_t blockLength = fileSize - blockStart < BLOCK_DATA_SIZE
+                             ? fileSize - blockStart
+                             : BLOCK_DATA_SIZE;
+    uint32_t memberChecksum = 0;
+
+    if (!readDirectBlock(fileno(archive), blocks[b], block)) {
+      snprintf(message, sizeof(message), "failed to read block #%zu of %s",
+               blocks[b], fileInfo->filename);
+      logError(message);
+      result = -1;
+      break;
+    }
+
+    if (checksums &&
+        !checkBlockChecksum(checksums, blocks[b], block,
+                            fileInfo->filename, &memberChecksum)) {
+      result = -1;
+      break;
+    }
+
+    const char *data = block->data;
+    size_t storedLength = field_to_size_t(block->storedLength);
+
+    if (isCompressed && storedLength > 0) {
+      if (storedLength > BLOCK_DATA_SIZE ||
+          decompressBlock(block->data, storedLength, plain->data,
+                          blockLength) != 0) {
+        snprintf(message, sizeof(message),
+                 "block #%zu couldn't be decompressed", blocks[b]);
+        logError(message);
+        result = -1;
+        break;
+      }
+
+      data = plain->data;
+    }
+
+    size_t from = offset > blockStart ? offset - blockStart : 0;
+    size_t to = offset + length - blockStart < blockLength
+                    ? offset + length - blockStart
+                    : blockLength;
+
+    memcpy(buffer + copied, data + from, to - from);
+    copied += to - from;
+  }
+
+  releaseBlockBuffers(block, 2);
+  free(blocks);
+
+  return result;
+}
+
+/**
+ * ------------------------------------------
+ *          LIBRARY
+ * ------------------------------------------
+ */
+
+/**
+ * @description: opens an archive and keeps its header in memory, with the
+ * index of the names and the block table, so members are found without
+ * reading the header again. Writable archives load their free map and dedup
+ * index as well.
+ * @parameter: (filename) the tar filename to be opened
+ * @parameter: (isWritable) set to append members to the archive
+ * @output: the handle of the archive, NULL on errors
+ */
+struct star_archive *starOpen(const char *filename, bool isWritable) {
+  struct star_archive *archive = calloc(1, sizeof(struct star_archive));
+
+  if (!archive) {
+    logError("memory allocation for the archive failed.");
+    return NULL;
+  }
+
+  archive->file = fopen(filename, isWritable ? "r+b" : "rb");
+
+  if (!archive->file) {
+    logError("Failed to open tar archive file. Double check if the input file "
+             "exists.");
+    free(archive);
+    return NULL;
+  }
+
+  archive->header = loadHeader(archive->file);
+
+  if (!archive->header) {
+    fclose(archive->file);
+    free(archive);
+    return NULL;
+  }
+
+  archive->isOctalFields = isGlobalOctalFields;
+  archive->isWritable = isWritable;
+
+  if (isWritable) {
+    loadFreeMap(archive->header, archive->file, &archive->map);
+    loadDedupIndex(archive->header, archive->file, &archive->map);
+  }
+
+  loadBlockTable(archive->header, archive->file);
+  loadBlockHashes(archive->header, archive->file);
+  buildNameIndex(archive->header, &archive->index);
+
+  return archive;
+}
+
+/**
+ * @description: writes the header of the archive when members were added
+ * since it was opened or last committed. Until then the header in the file
+ * still describes the archive as it was.
+ * @parameter: (archive) the handle of the archive
+ * @output: the exit code
+ */
+int starCommit(struct star_archive *archive) {
+  if (!archive->isChanged) {
+    return 0;
+  }
+
+  useStarArchive(archive);
+
+  int result = commitHeader(archive->header, archive->file, &archive->map);
+
+  fflush(archive->file);
+  archive->isChanged = false;
+
+  return result;
+}
+
+/**
+ * @description: commits the archive and releases everything the handle
+ * keeps in memory
+ * @parameter: (archive) the handle of the archive
+ * @output: the exit code
+ */
+int starClose(struct star_archive *archive) {
+  int result = starCommit(archive);
+
+  if (archive->isWritable) {
+    destroyFreeMap(&archive->map);
+  }
+
+  destroyNameIndex(&archive->index);
+  destroyHeader(archive->header);
+
+  if (fclose(archive->file) != 0) {
+    result = 1;
+  }
+
+  free(archive);
+
+  return result;
+}
+
+/**
+ * @description: describes a member found by its name. When the name is
+ * repeated the last member wins, like when extracting.
+ * @parameter: (archive) the handle of the archive
+ * @parameter: (name) the name of the member
+ * @parameter: (stat) where the member is described
+ * @output: the exit code, 1 when there is no member with the name
+ */
+int starStat(struct star_archive *archive, const char *name,
+             struct star_stat *stat) {
+  useStarArchive(archive);
+
+  int fileIndex = findLastName(&archive->index, name);
+
+  if (fileIndex < 0) {
+    return 1;
+  }
+
+  struct posix_header *header = archive->header;
+  struct block_checksums *checksums = memberChecksums(header, fileIndex);
+  struct block_table *table = header->blockTable;
+
+  stat->size = field_to_size_t(header->files[fileIndex].size);
+  stat->blockCount = blocksForSize(stat->size);
+  stat->checksum = checksums ? checksums->members[fileIndex] : 0;
+  stat->isIndexed =
+      table ? (size_t)fileIndex < table->capacity && table->blocks[fileIndex]
+            : header->blockTableOffset >= 0;
+
+  return 0;
+}
+
+/**
+ * @description: reads a range of a member found by its name, going straight
+ * to the blocks of the range
+ * @parameter: (archive) the handle of the archive
+ * @parameter: (name) the name of the member
+ * @parameter: (offset) the first byte of the range inside the member
+ * @parameter: (length) the amount of bytes of the range
+ * @parameter: (buffer) where the range is copied, with room for length bytes
+ * @output: the amount of bytes read, less than length at the end of the
+ * member, or -1 on errors
+ */
+ssize_t starRead(struct star_archive *archive, const char *name,
+                 size_t offset, size_t length, char *buffer) {
+  char message[100];
+
+  useStarArchive(archive);
+
+  int fileIndex = findLastName(&archive->index, name);
+
+  if (fileIndex < 0) {
+    snprintf(message, sizeof(message), "%s is not in the archive", name);
+    logError(message);
+    return -1;
+  }
+
+  return readMemberRange(archive->header, archive->file, fileIndex, offset,
+                         length, buffer);
+}
+
+/**
+ * @description: extracts a member found by its name into the working
+ * directory, checking its blocks against their checksums
+ * @parameter: (archive) the handle of the archive
+ * @parameter: (name) the name of the member
+ * @output: the exit code
+ */
+int starExtract(struct star_archive *archive, const char *name) {
+  char message[100];
+
+  useStarArchive(archive);
+
+  int fileIndex = findLastName(&archive->index, name);
+
+  if (fileIndex < 0) {
+    snprintf(message, sizeof(message), "%s is not in the archive", name);
+    logError(message);
+    return 1;
+  }
+
+  size_t member = fileIndex;
+  size_t errorCount = checksumErrorCount;
+
+  extractFilesByTarFile(archive->header, archive->file, NULL, -1, &member, 1);
+
+  return checksumErrorCount > errorCount ? 1 : 0;
+}
+
+/**
+ * @description: adds a file to a writable archive. Its blocks are written
+ * now, and the member is part of the archive once the header is committed.
+ * @parameter: (archive) the handle of the archive
+ * @parameter: (path) the file to be added
+ * @output: the exit code
+ */
+int starAppend(struct star_archive *archive, const char *path) {
+  if (!archive->isWritable) {
+    logError("the archive was opened read only, files can't be appended");
+    return 1;
+  }
+
+  useStarArchive(archive);
+
+  char *files[] = {(char *)path};
+
+  if (appendFilesByTarFile(archive->header, archive->file, files, 1,
+                           &archive->map, &archive->index) == 0) {
+    return 1;
+  }
+
+  archive->isChanged = true;
+
+  return 0;
+}
+
+/**
+ * @description: sets the format of the calling thread to the one of the
+ * archive used, since handles of many archives can be open at once
+ * @parameter: (archive) the handle of the archive
+ * @output: n/a
+ */
+void useStarArchive(struct star_archive *archive) {
+  isGlobalOctalFields = archive->isOctalFields;
+}
+
+/**
+ * ------------------------------------------
+ *          COMPRESSED BLOCKS
+ * ------------------------------------------
+ */
+
+/**
+ * @description: calculates how many threads compress or decompress blocks.
+ * --jobs sets it, and without it every online CPU is used.
+ * @output: the amount of threads
+ */
+int codecThreadCount() {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int threads = globalJobCount > 1 ? globalJobCount : (int)cpus;
+
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  return threads > MAX_JOBS ? MAX_JOBS : threads;
+}
+
+/**
+ * @description: prepares a batch of blocks and the threads that compress or
+ * decompress them
+ * @parameter: (batch) the batch to initialize
+ * @parameter: (output) the FILE where a stream is written, NULL to write the
+ * blocks at their position in archiveFd
+ * @parameter: (archiveFd) the descriptor of the archive
+ * @output: the exit code
+ */
+int openCodecBatch(struct codec_batch *batch, FILE *output, int archiveFd) {
+  batch->buffers = acquireBlockBuffers(CODEC_BATCH_BLOCKS * 2);
+
+  if (!batch->buffers) {
+    return 1;
+  }
+
+  for (size_t b = 0; b < CODEC_BATCH_BLOCKS; b++) {
+    batch->blocks[b].plain =
+        (struct block_data *)(batch->buffers + b * 2 * BLOCK_SIZE);
+    batch->blocks[b].stored =
+        (struct block_data *)(batch->buffers + (b * 2 + 1) * BLOCK_SIZE);
+  }
+
+  batch->output = output;
+  batch->archiveFd = archiveFd;
+  batch->checksums = NULL;
+  batch->count = 0;
+  batch->bytesStored = 0;
+  batch->result = 0;
+  batch->threadCount = codecThreadCount();
+
+  return initCodecPool(&batch->pool, batch->threadCount);
+}
+
+/**
+ * @description: stops the threads of a batch and releases its buffers
+ * @parameter: (batch) the batch
+ * @output: n/a
+ */
+void closeCodecBatch(struct codec_batch *batch) {
+  destroyCodecPool(&batch->pool);
+  releaseBlockBuffers(batch->buffers, CODEC_BATCH_BLOCKS * 2);
+}
+
+/**
+ * @description: writes the compressed blocks of a new archive at the
+ * positions set in the header. The archive is extended to its last block, so
+ * it has its whole size even if that block ends in a hole.
+ * @parameter: (file_header) the header or FAT table to be used.
+ * @parameter: (output) the tar FILE to be written.
+ * @parameter: (num_files) the amount of input files received
+ * @parameter: (input_files) the files to be written.
+ * @parameter: (inputFds) the descriptor of each input, -1 when it was closed
+ * @parameter: (blockCount) the amount of blocks of the archive
+ * @output: the exit code
+ */
+int createCompressedBlocks(struct posix_header *file_header, FILE *output,
+                           int num_files, char *input_files[],
+                           int inputFds[], size_t blockCount) {
+  char message[100];
+
+  if (isGlobalDirectIO || isGlobalAsyncIO) {
+    logVerbose("blocks are compressed, --direct and --async are not used");
+  }
+
+  // the blocks are written through the fd from now on
+  fflush(output);
+
+  size_t bytesWritten = 0;
+
+  for (int i = 0; i < num_files; i++) {
+    bytesWritten += field_to_size_t(file_header->files[i].size);
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  int result = compressMembers(file_header, NULL, fileno(output), num_files,
+                               input_files, inputFds);
+
+  if (result == 0 &&
+      ftruncate(fileno(output), blockOffset(blockCount)) != 0) {
+    logError("failed to extend the tar file.");
+    result = 1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double seconds =
+      (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  double megabytes = bytesWritten / (1024.0 * 1024.0);
+
+  snprintf(message, 100, "archived %.1f MB compressed in %.2fs (%.1f MB/s)",
+           megabytes, seconds, seconds > 0 ? megabytes / seconds : 0.0);
+  logVerbose(message);
+
+  return result;
+}
+
+/**
+ * @description: writes the blocks of every member compressed. The data of
+ * the files is read in order and compressed in batches by a pool of threads.
+ * Blocks that don't shrink enough are stored raw. Only the bytes in use are
+ * written, so the rest of each block stays as a hole in the archive.
+ * @parameter: (header) the FAT header, with the blocks already placed
+ * @parameter: (output) the FILE where a stream is written, NULL to write the
+ * blocks at their position in archiveFd
+ * @parameter: (archiveFd) the descriptor of the archive
+ * @parameter: (num_files) the amount of input files received
+ * @parameter: (input_files) the files to be written
+ * @parameter: (inputFds) the descriptor of each input, -1 when it was closed
+ * @output: the exit code
+ */
+int compressMembers(struct posix_header *header, FILE *output, int archiveFd,
+                    int num_files, char *input_files[], int inputFds[]) {
+  char message[100];
+  struct codec_batch batch;
+
+  size_t bytesRead = 0;
+
+  if (openCodecBatch(&batch, output, archiveFd) != 0) {
+    return 1;
+  }
+
+  // the checksums are taken as the blocks are written, so they aren't read
+  // back, and the members whose blocks were all read are sealed at the end
+  // with the hashes of their plain data
+  batch.checksums = header->checksums;
+
+  bool *isRead = header->checksums ? calloc(num_files, sizeof(bool)) : NULL;
+  uint64_t **hashes = isRead && header->attributes
+                          ? calloc(num_files, sizeof(uint64_t *))
+                          : NULL;
+
+  for (int i = 0; i < num_files && batch.result == 0; i++) {
+    struct posix_file_info *fileInfo = &header->files[i];
+    size_t fileSize = field_to_size_t(fileInfo->size);
+    size_t firstBlock = field_to_size_t(fileInfo->blockAddress);
+    size_t numBlocks = blocksForSize(fileSize);
+    int input = inputFds[i];
+
+    if (input < 0) {
+      input = open(input_files[i], O_RDONLY | O_CLOEXEC);
+      inputOpenCount++;
+    }
+
+    if (input < 0) {
+      snprintf(message, sizeof(message), "couldn't open file %s",
+               input_files[i]);
+      logError(message);
+      batch.result = 1;
+      break;
+    }
+
+    size_t bytesCopied = 0;
+
+    if (hashes && numBlocks > 0) {
+      hashes[i] = malloc(numBlocks * sizeof(uint64_t));
+    }
+
+    for (size_t b = 0; b < numBlocks; b++) {
+      struct codec_block *block = &batch.blocks[batch.count];
+      size_t length = fileSize - b * BLOCK_DATA_SIZE;
+
+      if (length > BLOCK_DATA_SIZE) {
+        length = BLOCK_DATA_SIZE;
+      }
+
+      ssize_t copied =
+          preadFull(input, block->plain->data, length, b * BLOCK_DATA_SIZE);
+
+      if (copied < 0) {
+        snprintf(message, sizeof(message), "failed to read %s",
+                 input_files[i]);
+        logError(message);
+        batch.result = 1;
+        break;
+      }
+
+      block->blockIndex = firstBlock + b;
+      block->nextBlockIndex = b + 1 < numBlocks ? firstBlock + b + 1 : 0;
+      block->length = copied;
+      bytesCopied += copied;
+      bytesRead += copied;
+
+      if (hashes && hashes[i]) {
+        hashes[i][b] = hashBlockData(block->plain->data, copied);
+      }
+
+      if (++batch.count == CODEC_BATCH_BLOCKS) {
+        flushCompressedBatch(&batch);
+      }
+    }
+
+    if (batch.result == 0 && bytesCopied < fileSize) {
+      snprintf(message, sizeof(message), "%s got shorter while it was archived",
+               input_files[i]);
+      logWarning(message);
+      size_t_to_field(fileInfo->size, bytesCopied);
+    } else if (batch.result == 0 && isRead) {
+      isRead[i] = true;
+    }
+
+    if (inputFds[i] < 0) {
+      close(input);
+    }
+  }
+
+  if (batch.result == 0) {
+    flushCompressedBatch(&batch);
+  }
+
+  for (int i = 0; i < num_files && isRead; i++) {
+    uint64_t *memberHashes = hashes ? hashes[i] : NULL;
+
+    if (isRead[i] && batch.result == 0) {
+      sealWrittenMember(header, i, NULL, memberHashes);
+    } else {
+      free(memberHashes);
+    }
+  }
+
+  free(isRead);
+  free(hashes);
+
+  snprintf(message, sizeof(message),
+           "compressed %.1f MB into %.1f MB with %d threads",
+           bytesRead / (1024.0 * 1024.0),
+           batch.bytesStored / (1024.0 * 1024.0), batch.threadCount);
+  logVerbose(message);
+
+  closeCodecBatch(&batch);
+
+  return batch.result;
+}
+
+/**
+ * @description: compresses the blocks of a batch on the pool and writes them
+ * in order
+ * @parameter: (batch) the batch of blocks read from the files
+ * @output: n/a
+ */
+void flushCompressedBatch(struct codec_batch *batch) {
+  for (size_t b = 0; b < batch->count; b++) {
+    struct codec_block *block = &batch->blocks[b];
+
+    batch->tasks[b].isCompress = true;
+    batch->tasks[b].input = block->plain->data;
+    batch->tasks[b].inputLength = block->length;
+    batch->tasks[b].output = block->stored->data;
+    batch->tasks[b].outputLength = BLOCK_DATA_SIZE;
+  }
+
+  runCodecTasks(&batch->pool, batch->tasks, batch->count);
+
+  for (size_t b = 0; b < batch->count && batch->result == 0; b++) {
+    struct codec_block *block = &batch->blocks[b];
+    size_t storedLength = batch->tasks[b].outputLength;
+
+    // blocks that didn't shrink enough are written as they are
+    struct block_data *data = storedLength > 0 ? block->stored : block->plain;
+    size_t length = storedLength > 0 ? storedLength : block->length;
+
+    size_t_to_field(data->next, block->nextBlockIndex);
+    size_t_to_field(data->storedLength, storedLength);
+
+    // a stream can't leave holes, the rest of the block is written as zeros,
+    // and the checksum of a raw block reads its hole as zeros as well
+    if (batch->output || storedLength == 0) {
+      memset(data->data + length, 0, BLOCK_DATA_SIZE - length);
+    }
+
+    if (batch->checksums) {
+      batch->checksums->blocks[block->blockIndex] = blockDataChecksum(data);
+    }
+
+    if (batch->output) {
+      if (fwrite(data, BLOCK_SIZE, 1, batch->output) != 1) {
+        logError("failed to write the archive.");
+        batch->result = 1;
+      }
+    } else if (pwriteFull(batch->archiveFd, data, 12 * 2 + length,
+                          blockOffset(block->blockIndex)) !=
+               (ssize_t)(12 * 2 + length)) {
+      logError("failed to write a block of the archive.");
+      batch->result = 1;
+    }
+
+    batch->bytesStored += 12 * 2 + length;
+  }
+
+  batch->count = 0;
+}
+
+/**
+ * @description: extracts the members of a compressed archive, measuring how
+ * long it takes. The blocks are always read through the page cache.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archive) the tar FILE
+ * @parameter: (members) the members to extract, in the order they are read
+ * @parameter: (memberCount) the amount of members to extract
+ * @output: n/a
+ */
+void extractCompressedArchive(struct posix_header *header, FILE *archive,
+                              size_t *members, size_t memberCount) {
+  char message[100];
+  size_t bytesExtracted = 0;
+  size_t bytesStored = 0;
+
+  if (isGlobalDirectIO || isGlobalAsyncIO || isGlobalMappedRead) {
+    logVerbose("blocks are compressed, --direct, --async and --mmap are not "
+               "used");
+  }
+
+  for (size_t m = 0; m < memberCount; m++) {
+    bytesExtracted += field_to_size_t(header->files[members[m]].size);
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  extractCompressedMembers(header, archive, members, memberCount,
+                           &bytesStored);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double seconds =
+      (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  double megabytes = bytesExtracted / (1024.0 * 1024.0);
+
+  snprintf(message, 100,
+           "extracted %.1f MB out of %.1f MB compressed in %.2fs (%.1f MB/s)",
+           megabytes, bytesStored / (1024.0 * 1024.0), seconds,
+           seconds > 0 ? megabytes / seconds : 0.0);
+  logVerbose(message);
+}
+
+/**
+ * @description: extracts the selected members of a compressed archive. The
+ * chains are read in order and the blocks are decompressed in batches by a
+ * pool of threads, then written to their files.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archive) the tar FILE
+ * @parameter: (members) the members to extract, in the order they are read
+ * @parameter: (memberCount) the amount of members to extract
+ * @parameter: (bytesStored) the bytes read from the archive. This will be set
+ * in the function.
+ * @output: the exit code
+ */
+int extractCompressedMembers(struct posix_header *header, FILE *archive,
+                             size_t *members, size_t memberCount,
+                             size_t *bytesStored) {
+  char message[100];
+  struct codec_batch batch;
+
+  if (openCodecBatch(&batch, NULL, fileno(archive)) != 0) {
+    return 1;
+  }
+
+  for (size_t m = 0; m < memberCount; m++) {
+    size_t i = members[m];
+    struct posix_file_info *fileInfo = &header->files[i];
+    size_t fileSize = field_to_size_t(fileInfo->size);
+    size_t numBlocks = blocksForSize(fileSize);
+    size_t currentBlockIndex = field_to_size_t(fileInfo->blockAddress);
+    int outputFd =
+        open(fileInfo->filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+
+    if (outputFd < 0) {
+      snprintf(message, sizeof(message), "Failed to create file %s",
+               fileInfo->filename);
+      logError(message);
+      continue;
+    }
+
+    snprintf(message, sizeof(message), "starting to create %s",
+             fileInfo->filename);
+    logVerbose(message);
+
+    bool isComplete = numBlocks == 0;
+    struct block_checksums *checksums = memberChecksums(header, i);
+    uint32_t memberChecksum = 0;
+
+    for (size_t b = 0; b < numBlocks; b++) {
+      struct codec_block *block = &batch.blocks[batch.count];
+      size_t length = fileSize - b * BLOCK_DATA_SIZE;
+
+      if (length > BLOCK_DATA_SIZE) {
+        length = BLOCK_DATA_SIZE;
+      }
+
+      // the rest of a block is a hole, reading it costs no disk I/O
+      ssize_t result = preadFull(batch.archiveFd, block->stored, BLOCK_SIZE,
+                                 blockOffset(currentBlockIndex));
+
+      if (result < 12 * 2) {
+        snprintf(message, sizeof(message), "failed to read block #%zu",
+                 currentBlockIndex);
+        logError(message);
+        break;
+      }
+
+      // the checksum is taken before the data is decompressed
+      if (checksums) {
+        memset((char *)block->stored + result, 0, BLOCK_SIZE - result);
+        checkBlockChecksum(checksums, currentBlockIndex, block->stored,
+                           fileInfo->filename, &memberChecksum);
+
+        if (b + 1 == numBlocks) {
+          checkMemberChecksum(checksums, i, memberChecksum,
+                              fileInfo->filename);
+        }
+      }
+
+      block->blockIndex = currentBlockIndex;
+      block->nextBlockIndex = field_to_size_t(block->stored->next);
+      block->length = length;
+      block->fd = outputFd;
+      block->fileOffset = b * BLOCK_DATA_SIZE;
+      block->closesFile = b + 1 == numBlocks;
+
+      if (block->closesFile) {
+        isComplete = true;
+      }
+
+      if (++batch.count == CODEC_BATCH_BLOCKS) {
+        flushDecompressedBatch(&batch);
+      }
+
+      if (block->closesFile) {
+        break;
+      }
+
+      if (block->nextBlockIndex == 0) {
+        snprintf(message, sizeof(message), "the chain of %s is broken",
+                 fileInfo->filename);
+        logError(message);
+        break;
+      }
+
+      currentBlockIndex = block->nextBlockIndex;
+    }
+
+    // the blocks already queued are written before the file is closed
+    if (!isComplete) {
+      flushDecompressedBatch(&batch);
+      batch.result = 1;
+    }
+
+    if (numBlocks == 0 || !isComplete) {
+      close(outputFd);
+    }
+  }
+
+  flushDecompressedBatch(&batch);
+
+  (*bytesStored) = batch.bytesStored;
+  closeCodecBatch(&batch);
+
+  return batch.result;
+}
+
+/**
+ * @description: decompresses the blocks of a batch on the pool and writes
+ * their data to the files. Files are closed after their last block.
+ * @parameter: (batch) the batch of blocks read from the archive
+ * @output: n/a
+ */
+void flushDecompressedBatch(struct codec_batch *batch) {
+  char message[100];
+  size_t taskCount = 0;
+
+  for (size_t b = 0; b < batch->count; b++) {
+    struct codec_block *block = &batch->blocks[b];
+    size_t storedLength = field_to_size_t(block->stored->storedLength);
+
+    block->task = NULL;
+    batch->bytesStored += 12 * 2 + (storedLength > 0 ? storedLength
+                                                     : block->length);
+
+    // raw blocks are written straight from the block read
+    if (storedLength == 0) {
+      continue;
+    }
+
+    block->task = &batch->tasks[taskCount++];
+    block->task->isCompress = false;
+    block->task->input = block->stored->data;
+    block->task->inputLength =
+        storedLength < BLOCK_DATA_SIZE ? storedLength : BLOCK_DATA_SIZE;
+    block->task->output = block->plain->data;
+    block->task->outputLength = block->length;
+  }
+
+  runCodecTasks(&batch->pool, batch->tasks, taskCount);
+
+  for (size_t b = 0; b < batch->count; b++) {
+    struct codec_block *block = &batch->blocks[b];
+    const char *data = block->task ? block->plain->data : block->stored->data;
+
+    if (block->task && block->task->result != 0) {
+      snprintf(message, sizeof(message), "block #%zu couldn't be decompressed",
+               block->blockIndex);
+      logError(message);
+      batch->result = 1;
+    } else if (pwriteFull(block->fd, data, block->length,
+                          block->fileOffset) != (ssize_t)block->length) {
+      logError("failed to write an extracted file.");
+      batch->result = 1;
+    }
+
+    if (block->closesFile) {
+      close(block->fd);
+    }
+  }
+
+  batch->count = 0;
+}
+
+/**
+ * @description: frees the disk space after the data of a compressed block,
+ * which is written whole when blocks are moved
+ * @parameter: (archiveFd) the descriptor of the archive
+ * @parameter: (blockIndex) the position of the block
+ * @parameter: (block) the block as it was written
+ * @output: n/a
+ */
+void punchStoredTail(int archiveFd, size_t blockIndex,
+                     const struct block_data *block) {
+  size_t storedLength = field_to_size_t(block->storedLength);
+
+  if (storedLength == 0 || storedLength > BLOCK_DATA_SIZE) {
+    return;
+  }
+
+  size_t start = 12 * 2 + storedLength;
+
+  // only whole pages can be freed
+  start = (start + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT *
+          DIRECT_IO_ALIGNMENT;
+
+  if (start < BLOCK_SIZE) {
+    punchHole(archiveFd, blockOffset(blockIndex) + start, BLOCK_SIZE - start);
+  }
+}
+
+/**
+ * ------------------------------------------
+ *          DEDUPLICATED BLOCKS
+ * ------------------------------------------
+ */
+
+/**
+ * @description: writes the blocks of every member of a new archive that
+ * stores identical blocks once. Members are written one by one, since each
+ * one can point to the blocks of the ones before it, so --jobs, --async and
+ * --direct are not used.
+ * @parameter: (header) the FAT header, with the size of every member
+ * @parameter: (output) the tar FILE, opened for reading and writing
+ * @parameter: (map) the free map of the new archive, with no blocks yet
+ * @parameter: (num_files) the amount of input files received
+ * @parameter: (input_files) the files to be written
+ * @parameter: (inputFds) the descriptor of each input, -1 when it was closed
+ * @output: the exit code
+ */
+int createDedupBlocks(struct posix_header *header, FILE *output,
+                      struct free_map *map, int num_files,
+                      char *input_files[], int inputFds[]) {
+  char message[100];
+
+  if (globalJobCount > 1 || isGlobalAsyncIO || isGlobalDirectIO) {
+    logVerbose("deduplicated archives are written by a single thread, "
+               "--jobs, --async and --direct are ignored");
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  size_t bytesRead = 0;
+  size_t blocksWritten = 0;
+  size_t blocksTotal = 0;
+  int result = 0;
+
+  for (int i = 0; i < num_files && result == 0; i++) {
+    int input = inputFds[i];
+
+    if (input < 0) {
+      input = open(input_files[i], O_RDONLY | O_CLOEXEC);
+      inputOpenCount++;
+    }
+
+    if (input < 0) {
+      snprintf(message, sizeof(message), "couldn't open file %s",
+               input_files[i]);
+      logError(message);
+      return 1;
+    }
+
+    struct extent_list extents;
+    initExtentList(&extents);
+
+    result = writeDedupMember(header, i, output, input, map, &extents,
+                              &blocksWritten);
+
+    if (map->preferRuns) {
+      storeFileExtents(&header->files[i], &extents);
+    }
+
+    if (input != inputFds[i]) {
+      close(input);
+    }
+
+    bytesRead += field_to_size_t(header->files[i].size);
+    blocksTotal += blocksForSize(field_to_size_t(header->files[i].size));
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double seconds =
+      (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  double megabytes = bytesRead / (1024.0 * 1024.0);
+
+  snprintf(message, 100,
+           "archived %.1f MB writing %zu of %zu blocks in %.2fs (%.1f MB/s)",
+           megabytes, blocksWritten, blocksTotal, seconds,
+           seconds > 0 ? megabytes / seconds : 0.0);
+  logVerbose(message);
+
+  return result;
+}
+
+/**
+ * @description: writes the blocks of a member to an archive that stores
+ * identical blocks once. The chain of the member is hashed from its last
+ * block back, each block together with the rest of its chain. While a block
+ * with the same hash is in the archive, and its data and next pointer are the
+ * same, the member points to it. The blocks before it are written as new
+ * ones, the last of them pointing to the blocks that were found. Since a block
+ * has a single next pointer, members share their ends: identical files share
+ * every block, and files that only differ at the start share the rest. The
+ * member is sealed with the checksums taken as its blocks are written.
+ * @parameter: (header) the FAT header. The member gets its first block.
+ * @parameter: (fileIndex) the header entry of the member
+ * @parameter: (archive) the tar FILE, opened for reading and writing
+ * @parameter: (inputFd) the file of the member
+ * @parameter: (map) the free map used to allocate blocks
+ * @parameter: (extents) the extents of the member. This will be set in the
+ * function.
+ * @parameter: (blocksWritten) the amount of new blocks written. This will be
+ * increased in the function.
+ * @output: the exit code
+ */
+int writeDedupMember(struct posix_header *header, size_t fileIndex,
+                     FILE *archive, int inputFd, struct free_map *map,
+                     struct extent_list *extents, size_t *blocksWritten) {
+  char message[100];
+  struct dedup_index *dedup = header->dedup;
+  struct posix_file_info *fileInfo = &header->files[fileIndex];
+  size_t fileSize = field_to_size_t(fileInfo->size);
+  size_t numBlocks = blocksForSize(fileSize);
+  int archiveFd = fileno(archive);
+
+  if (numBlocks == 0) {
+    return 0;
+  }
+
+  uint64_t *hashes = malloc(numBlocks * sizeof(uint64_t));
+  uint64_t *dataHashes = malloc(numBlocks * sizeof(uint64_t));
+  size_t *blocks = malloc(numBlocks * sizeof(size_t));
+  struct block_data *block = acquireBlockBuffers(2);
+
+  if (!hashes || !dataHashes || !blocks || !block) {
+    logError("memory allocation for the block hashes failed.");
+    free(hashes);
+    free(dataHashes);
+    free(blocks);
+
+    if (block) {
+      releaseBlockBuffers(block, 2);
+    }
+
+    return 1;
+  }
+
+  // the blocks are read and written through the fd from now on
+  fflush(archive);
+
+  int result = 0;
+
+  for (size_t b = 0; b < numBlocks && result == 0; b++) {
+    size_t length = readDedupBlock(inputFd, fileSize, b, block);
+
+    if (length == 0) {
+      result = 1;
+      break;
+    }
+
+    dataHashes[b] = hashBlockData(block->data, length);
+  }
+
+  // each block is hashed with the rest of its chain, so the last one is first
+  uint64_t nextHash = 0;
+
+  for (size_t b = numBlocks; b-- > 0 && result == 0;) {
+    hashes[b] = hashBlockLink(dataHashes[b], nextHash);
+    nextHash = hashes[b];
+  }
+
+  size_t sharedFrom = numBlocks;
+  size_t nextBlockIndex = 0;
+
+  for (size_t b = numBlocks; b-- > 0 && result == 0;) {
+    size_t candidate = findDedupBlock(dedup, hashes[b]);
+
+    if (candidate == DEDUP_NO_BLOCK ||
+        !matchDedupBlock(archiveFd, inputFd, fileSize, b, candidate,
+                         nextBlockIndex, block)) {
+      break;
+    }
+
+    blocks[b] = candidate;
+    nextBlockIndex = candidate;
+    sharedFrom = b;
+  }
+
+  // block 0 is not in the slots since nothing can point to it, but a member
+  // can still start there
+  if (result == 0 && sharedFrom == 1 && dedup->blockCapacity > 0 &&
+      dedup->refCounts[0] > 0 && dedup->hashes[0] == hashes[0] &&
+      matchDedupBlock(archiveFd, inputFd, fileSize, 0, 0, nextBlockIndex,
+                      block)) {
+    blocks[0] = 0;
+    sharedFrom = 0;
+  }
+
+  // the blocks before the shared ones are new, allocated like any file
+  size_t position = 0;
+
+  if (result == 0 && sharedFrom > 0) {
+    position = map->preferRuns ? allocateRun(map, sharedFrom)
+                               : allocateBlock(map);
+  }
+
+  for (size_t b = 0; b < sharedFrom && result == 0; b++) {
+    size_t length = readDedupBlock(inputFd, fileSize, b, block);
+    size_t next = nextBlockIndex;
+
+    if (length > 0 && b + 1 < sharedFrom) {
+      next = map->preferRuns ? allocateBlockAfter(map, position)
+                             : allocateBlock(map);
+    }
+
+    size_t_to_field(block->next, next);
+    size_t_to_field(block->storedLength, 0);
+
+    if (length == 0 || pwriteFull(archiveFd, block, BLOCK_SIZE,
+                                  blockOffset(position)) != BLOCK_SIZE) {
+      if (length > 0) {
+        logError("failed to write a block of the archive.");
+      }
+
+      // the blocks of the member are given back, it is not in the archive
+      releaseBlock(map, position);
+
+      if (next != nextBlockIndex) {
+        releaseBlock(map, next);
+      }
+
+      for (size_t k = 0; k < b; k++) {
+        releaseDedupBlock(dedup, blocks[k]);
+        releaseBlock(map, blocks[k]);
+      }
+
+      result = 1;
+      break;
+    }
+
+    // the shared blocks already have their checksums
+    if (header->checksums) {
+      reserveBlockChecksums(header->checksums, position + 1);
+      header->checksums->blocks[position] = blockDataChecksum(block);
+    }
+
+    addDedupBlock(dedup, position, hashes[b]);
+    blocks[b] = position;
+    position = next;
+  }
+
+  if (result == 0) {
+    for (size_t b = sharedFrom; b < numBlocks; b++) {
+      retainDedupBlock(dedup, blocks[b]);
+    }
+
+    for (size_t b = 0; b < numBlocks; b++) {
+      addExtentBlock(extents, blocks[b]);
+    }
+
+    size_t_to_field(fileInfo->blockAddress, blocks[0]);
+    (*blocksWritten) += sharedFrom;
+
+    snprintf(message, 100, "%s shares %zu of its %zu blocks",
+             fileInfo->filename, numBlocks - sharedFrom, numBlocks);
+    logVerbose(message);
+
+    if (header->checksums) {
+      sealWrittenMember(header, fileIndex, blocks, dataHashes);
+      blocks = NULL;
+      dataHashes = NULL;
+    }
+  }
+
+  releaseBlockBuffers(block, 2);
+  free(hashes);
+  free(dataHashes);
+  free(blocks);
+
+  return result;
+}
+
+/**
+ * @description: reads the data of a block of a member, filling the rest of
+ * the block with zeros
+ * @parameter: (inputFd) the file of the member
+ * @parameter: (fileSize) the size of the member
+ * @parameter: (position) the position of the block in the chain
+ * @parameter: (block) where the block is read
+ * @output: the amount of bytes of data, 0 if the file couldn't be read
+ */
+size_t readDedupBlock(int inputFd, size_t fileSize, size_t position,
+                      struct block_data *block) {
+  size_t offset = position * BLOCK_DATA_SIZE;
+  size_t length = fileSize - offset;
+
+  if (length > BLOCK_DATA_SIZE) {
+    length = BLOCK_DATA_SIZE;
+  }
+
+  if (preadFull(inputFd, block->data, length, offset) != (ssize_t)length) {
+    logError("couldn't read a file, it may have changed while archiving.");
+    return 0;
+  }
+
+  memset(block->data + length, 0, BLOCK_DATA_SIZE - length);
+
+  return length;
+}
+
+/**
+ * @description: checks that a block found by its hash has the same data as a
+ * block of a member and continues the chain the same way, so a collision of
+ * the hashes can't mix the data of two files
+ * @parameter: (archiveFd) the descriptor of the archive
+ * @parameter: (inputFd) the file of the member
+ * @parameter: (fileSize) the size of the member
+ * @parameter: (position) the position of the block in the chain of the member
+ * @parameter: (blockIndex) the block of the archive with the same hash
+ * @parameter: (nextBlockIndex) the block the member continues with, 0 at the
+ * end of its chain
+ * @parameter: (buffers) two block buffers, for the member and the archive
+ * @output: true when the block can be shared
+ */
+bool matchDedupBlock(int archiveFd, int inputFd, size_t fileSize,
+                     size_t position, size_t blockIndex,
+                     size_t nextBlockIndex, struct block_data *buffers) {
+  struct block_data *stored = buffers + 1;
+  size_t length = readDedupBlock(inputFd, fileSize, position, buffers);
+
+  if (length == 0 ||
+      preadFull(archiveFd, stored, 12 * 2 + length, blockOffset(blockIndex)) !=
+          (ssize_t)(12 * 2 + length)) {
+    return false;
+  }
+
+  return field_to_size_t(stored->next) == nextBlockIndex &&
+         field_to_size_t(stored->storedLength) == 0 &&
+         memcmp(stored->data, buffers->data, length) == 0;
+}
+
+/**
+ * @description: removes a member from the blocks of its chain. A block is
+ * released only when no other member goes through it.
+ * @parameter: (blockIndex) the first block of the member
+ * @parameter: (archive) the tar FILE
+ * @parameter: (map) the free map where the blocks are released
+ * @parameter: (dedup) the dedup index of the archive
+ * @output: n/a
+ */
+void releaseDedupChain(size_t blockIndex, FILE *archive, struct free_map *map,
+                       struct dedup_index *dedup) {
+  int archiveFd = fileno(archive);
+  char isFree[FIELD_SIZE];
+
+  size_t_to_field(isFree, 1);
+
+  // a chain can't be longer than the archive, this protects broken chains
+  size_t hops = 0;
+
+  fflush(archive);
+
+  do {
+    size_t nextBlockIndex = preadBlockNext(archiveFd, blockIndex);
+
+    if (releaseDedupBlock(dedup, blockIndex)) {
+      pwrite(archiveFd, isFree, FIELD_SIZE,
+             blockOffset(blockIndex) + FIELD_SIZE);
+      releaseBlock(map, blockIndex);
+    }
+
+    blockIndex = nextBlockIndex;
+  } while (blockIndex != 0 && ++hops < map->blockCount);
+}
+
+/**
+ * @description: prepares the empty dedup index of a new archive. If there is
+ * an error in malloc it returns 1.
+ * @parameter: (header) the FAT header of the tar file
+ * @output: the exit code
+ */
+int attachDedupIndex(struct posix_header *header) {
+  header->dedup = malloc(sizeof(struct dedup_index));
+
+  if (!header->dedup) {
+    logError("memory allocation for dedup index failed.");
+    return 1;
+  }
+
+  initDedupIndex(header->dedup, 0);
+
+  return 0;
+}
+
+/**
+ * @description: loads the dedup index stored after the last block. Archives
+ * without the dedup flag don't have one. When it can't be read, the owners of
+ * every block are counted again following the chains, and the hashes are
+ * left unknown, so only the blocks written from now on are shared.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archive) the tar FILE
+ * @parameter: (map) the free map of the archive
+ * @output: n/a
+ */
+void loadDedupIndex(struct posix_header *header, FILE *archive,
+                    struct free_map *map) {
+  char message[100];
+
+  if (!(archiveFlags(header) & ARCHIVE_FLAG_DEDUP) ||
+      attachDedupIndex(header) != 0) {
+    return;
+  }
+
+  struct free_map_info *info = (struct free_map_info *)header->tail;
+  size_t blockCount = octal_to_size_t(info->blockCount);
+  struct dedup_info dedupInfo;
+
+  reserveDedupBlocks(header->dedup, map->blockCount);
+
+  fseek(archive, blockOffset(blockCount), SEEK_SET);
+
+  if (fread(&dedupInfo, sizeof(dedupInfo), 1, archive) != 1 ||
+      memcmp(dedupInfo.magic, DEDUP_MAGIC, sizeof(dedupInfo.magic)) != 0 ||
+      octal_to_size_t(dedupInfo.blockCount) != blockCount ||
+      blockCount > map->blockCount ||
+      readDedupRecords(header->dedup, archive, blockCount) != 0) {
+    logWarning("the dedup index of the archive is missing, identical blocks "
+               "already stored won't be shared");
+    rebuildDedupIndex(header, archive, map);
+    return;
+  }
+
+  snprintf(message, 100, "dedup index loaded with %zu hashed blocks",
+           header->dedup->count);
+  logVerbose(message);
+}
+
+/**
+ * @description: reads the hash and the owners of every block
+ * @parameter: (dedup) the dedup index to be set
+ * @parameter: (archive) the tar FILE, right after the dedup_info
+ * @parameter: (blockCount) the amount of blocks stored
+ * @output: the exit code
+ */
+int readDedupRecords(struct dedup_index *dedup, FILE *archive,
+                     size_t blockCount) {
+  struct dedup_record records[HEADER_READ_ENTRIES];
+  char hash[sizeof(records[0].hash) + 1];
+
+  for (size_t block = 0; block < blockCount;) {
+    size_t count = blockCount - block;
+
+    if (count > HEADER_READ_ENTRIES) {
+      count = HEADER_READ_ENTRIES;
+    }
+
+    if (fread(records, sizeof(struct dedup_record), count, archive) != count) {
+      return 1;
+    }
+
+    for (size_t r = 0; r < count; r++, block++) {
+      size_t refCount = octal_to_size_t(records[r].refCount);
+
+      if (refCount == 0) {
+        continue;
+      }
+
+      memcpy(hash, records[r].hash, sizeof(records[r].hash));
+      hash[sizeof(records[r].hash)] = '\0';
+
+      addDedupBlock(dedup, block, strtoull(hash, NULL, 16));
+      dedup->refCounts[block] = refCount;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * @description: counts the owners of every block following the chain of each
+ * member. A member goes through every block after the first one it shares,
+ * so the walk goes on until the end of each chain.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archive) the tar FILE
+ * @parameter: (map) the free map of the archive
+ * @output: n/a
+ */
+void rebuildDedupIndex(struct posix_header *header, FILE *archive,
+                       struct free_map *map) {
+  destroyDedupIndex(header->dedup);
+  initDedupIndex(header->dedup, map->blockCount);
+
+  for (size_t i = 0; i < header->count; i++) {
+    if (blocksForSize(field_to_size_t(header->files[i].size)) == 0) {
+      continue;
+    }
+
+    size_t currentBlockIndex = field_to_size_t(header->files[i].blockAddress);
+    size_t hops = 0;
+
+    while (currentBlockIndex < map->blockCount && hops++ < map->blockCount) {
+      retainDedupBlock(header->dedup, currentBlockIndex);
+
+      currentBlockIndex = readBlockNext(archive, currentBlockIndex);
+
+      if (currentBlockIndex == 0) {
+        break;
+      }
+    }
+  }
+}
+
+/**
+ * @description: writes the dedup index after the last block of the archive,
+ * with the hash and the owners of every block. The blocks written later go
+ * over it, so it is written again each time the header is.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archive) the tar FILE
+ * @parameter: (blockCount) the amount of blocks of the archive
+ * @output: the exit code
+ */
+int storeDedupIndex(struct posix_header *header, FILE *archive,
+                    size_t blockCount) {
+  struct dedup_index *dedup = header->dedup;
+  struct dedup_info dedupInfo;
+  struct dedup_record records[HEADER_READ_ENTRIES];
+  char hash[sizeof(records[0].hash) + 1];
+
+  reserveDedupBlocks(dedup, blockCount);
+
+  memset(&dedupInfo, 0, sizeof(dedupInfo));
+  memcpy(dedupInfo.magic, DEDUP_MAGIC, sizeof(dedupInfo.magic));
+  size_t_to_octal(dedupInfo.blockCount, blockCount);
+
+  fseek(archive, blockOffset(blockCount), SEEK_SET);
+
+  if (fwrite(&dedupInfo, sizeof(dedupInfo), 1, archive) != 1) {
+    logError("failed to write the dedup index.");
+    return 1;
+  }
+
+  for (size_t block = 0; block < blockCount;) {
+    size_t count = blockCount - block;
+
+    if (count > HEADER_READ_ENTRIES) {
+      count = HEADER_READ_ENTRIES;
+    }
+
+    for (size_t r = 0; r < count; r++, block++) {
+      snprintf(hash, sizeof(hash), "%016llx",
+               (unsigned long long)dedup->hashes[block]);
+      memcpy(records[r].hash, hash, sizeof(records[r].hash));
+      size_t_to_octal(records[r].refCount, dedup->refCounts[block]);
+    }
+
+    if (fwrite(records, sizeof(struct dedup_record), count, archive) !=
+        count) {
+      logError("failed to write the dedup index.");
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * ------------------------------------------
+ *          CHECKSUMS
+ * ------------------------------------------
+ */
+
+/**
+ * @description: prepares the empty checksums of an archive. If there is an
+ * error in malloc it returns 1.
+ * @parameter: (header) the FAT header of the tar file
+ * @output: the exit code
+ */
+int attachBlockChecksums(struct posix_header *header) {
+  header->checksums = malloc(sizeof(struct block_checksums));
+
+  if (!header->checksums) {
+    logError("memory allocation for the checksums failed.");
+    return 1;
+  }
+
+  initBlockChecksums(header->checksums, 0, header->count);
+
+  return 0;
+}
+
+/**
+ * @description: calculates the checksum of the data of a block as it is
+ * stored. Compressed blocks only have data up to their stored length, what
+ * comes after it can be a hole, so it is left out.
+ * @parameter: (block) the whole block
+ * @output: the CRC32C of the data
+ */
+uint32_t blockDataChecksum(const struct block_data *block) {
+  size_t storedLength = field_to_size_t(block->storedLength);
+  size_t length = storedLength > 0 && storedLength <= BLOCK_DATA_SIZE
+                      ? storedLength
+                      : BLOCK_DATA_SIZE;
+
+  return crc32c(0, block->data, length);
+}
+
+/**
+ * @description: returns the checksums that the blocks of a member are checked
+ * against. Members that couldn't be sealed have none.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (fileIndex) the position of the member
+ * @output: the checksums of the archive, NULL when the member has none
+ */
+struct block_checksums *memberChecksums(struct posix_header *header,
+                                        size_t fileIndex) {
+  struct block_checksums *checksums = header->checksums;
+
+  if (!checksums || fileIndex >= checksums->memberCapacity ||
+      checksums->members[fileIndex] == 0) {
+    return NULL;
+  }
+
+  return checksums;
+}
+
+/**
+ * @description: checks a block read from the archive against its checksum.
+ * The checksum stored for the block is added to the one of its member, so a
+ * chain that goes through the wrong block is noticed at the end of it.
+ * @parameter: (checksums) the checksums of the archive
+ * @parameter: (blockIndex) the position of the block
+ * @parameter: (block) the whole block
+ * @parameter: (filename) the member the block belongs to
+ * @parameter: (memberChecksum) the checksum of the blocks of the member read
+ * so far. This will be set in the function.
+ * @output: true if the block is intact
+ */
+bool checkBlockChecksum(struct block_checksums *checksums, size_t blockIndex,
+                        const struct block_data *block, const char *filename,
+                        uint32_t *memberChecksum) {
+  char message[100];
+  uint32_t expected =
+      blockIndex < checksums->blockCapacity ? checksums->blocks[blockIndex] : 0;
+
+  (*memberChecksum) = foldBlockChecksum(*memberChecksum, expected);
+
+  if (blockIndex < checksums->blockCapacity &&
+      blockDataChecksum(block) == expected) {
+    return true;
+  }
+
+  snprintf(message, sizeof(message),
+           "block #%zu of %s doesn't match its checksum", blockIndex, filename);
+  logError(message);
+  checksumErrorCount++;
+
+  return false;
+}
+
+/**
+ * @description: checks the blocks read for a member against its checksum
+ * @parameter: (checksums) the checksums of the archive
+ * @parameter: (fileIndex) the position of the member
+ * @parameter: (memberChecksum) the checksum of every block of the member
+ * @parameter: (filename) the name of the member
+ * @output: true if the member went through the right blocks
+ */
+bool checkMemberChecksum(struct block_checksums *checksums, size_t fileIndex,
+                         uint32_t memberChecksum, const char *filename) {
+  char message[100];
+
+  if (checksums->members[fileIndex] == memberChecksum) {
+    return true;
+  }
+
+  snprintf(message, sizeof(message),
+           "the chain of %s doesn't match its checksum", filename);
+  logError(message);
+  checksumErrorCount++;
+
+  return false;
+}
+
+/**
+ * @description: takes the checksums of the members that don't have one yet,
+ * which are the ones written or changed since the archive was opened without
+ * being sealed on the way. Their blocks are read back, so the checksums match
+ * what reached the archive. A member whose chain can't be followed is left
+ * without a checksum.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archiveFd) the descriptor of the archive, -1 for a stream,
+ * whose blocks follow each other and already have their checksums
+ * @parameter: (blockCount) the amount of blocks of the archive
+ * @output: the exit code
+ */
+int sealMemberChecksums(struct posix_header *header, int archiveFd,
+                        size_t blockCount) {
+  char message[100];
+  struct block_checksums *checksums = header->checksums;
+  struct block_data *block = NULL;
+  size_t sealedCount = 0;
+
+  reserveBlockChecksums(checksums, blockCount);
+  reserveMemberChecksums(checksums, header->count);
+
+  if (archiveFd >= 0 && !(block = acquireBlockBuffers(1))) {
+    return 1;
+  }
+
+  for (size_t i = 0; i < header->count; i++) {
+    size_t fileSize = field_to_size_t(header->files[i].size);
+    size_t numBlocks = blocksForSize(fileSize);
+    size_t currentBlockIndex = field_to_size_t(header->files[i].blockAddress);
+    uint32_t memberChecksum = 0;
+    bool isSealed = true;
+
+    // every empty member has the same data
+    if (numBlocks == 0 && header->attributes) {
+      keepMemberHashes(header, i, NULL, 0);
+    }
+
+    if (numBlocks == 0 || checksums->members[i] != 0) {
+      continue;
+    }
+
+    // the data read back is hashed as well, unless it is compressed
+    uint64_t *hashes = block && header->attributes
+                           ? malloc(numBlocks * sizeof(uint64_t))
+                           : NULL;
+
+    for (size_t b = 0; b < numBlocks && isSealed; b++) {
+      size_t nextBlockIndex = currentBlockIndex + 1;
+      size_t length = fileSize - b * BLOCK_DATA_SIZE;
+
+      if (length > BLOCK_DATA_SIZE) {
+        length = BLOCK_DATA_SIZE;
+      }
+
+      if (currentBlockIndex >= blockCount ||
+          (block && !readDirectBlock(archiveFd, currentBlockIndex, block))) {
+        isSealed = false;
+        break;
+      }
+
+      if (block) {
+        checksums->blocks[currentBlockIndex] = blockDataChecksum(block);
+        nextBlockIndex = field_to_size_t(block->next);
+
+        if (hashes && field_to_size_t(block->storedLength) == 0) {
+          hashes[b] = hashBlockData(block->data, length);
+        } else {
+          free(hashes);
+          hashes = NULL;
+        }
+
+        // with --direct the blocks read back don't stay in the page cache
+        if (isGlobalDirectIO) {
+          dropCachedRange(archiveFd, blockOffset(currentBlockIndex),
+                          BLOCK_SIZE);
+        }
+      }
+
+      memberChecksum = foldBlockChecksum(memberChecksum,
+                                         checksums->blocks[currentBlockIndex]);
+
+      isSealed = nextBlockIndex != 0 || b + 1 == numBlocks;
+      currentBlockIndex = nextBlockIndex;
+    }
+
+    if (!isSealed) {
+      snprintf(message, sizeof(message),
+               "the chain of %s is broken, it has no checksum",
+               header->files[i].filename);
+      logWarning(message);
+      free(hashes);
+      continue;
+    }
+
+    checksums->members[i] = memberChecksum;
+    sealedCount++;
+
+    if (hashes) {
+      keepMemberHashes(header, i, hashes, numBlocks);
+    }
+  }
+
+  if (block) {
+    releaseBlockBuffers(block, 1);
+  }
+
+  snprintf(message, sizeof(message), "checksums taken for %zu members%s",
+           sealedCount, isCrc32cAccelerated() ? " with SSE4.2" : "");
+  logVerbose(message);
+
+  return 0;
+}
+
+/**
+ * @description: makes room for the checksums, the attributes and the blocks
+ * of every member and block of the header, so the members can be sealed by
+ * many workers at once as their blocks are written
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (blockCount) the amount of blocks of the archive
+ * @output: n/a
+ */
+void reserveWrittenMembers(struct posix_header *header, size_t blockCount) {
+  if (header->checksums) {
+    reserveBlockChecksums(header->checksums, blockCount);
+    reserveMemberChecksums(header->checksums, header->count);
+  }
+
+  if (header->attributes) {
+    reserveMemberAttributes(header->attributes, header->count);
+  }
+
+  if (header->blockTable) {
+    reserveBlockTable(header->blockTable, header->count);
+  }
+}
+
+/**
+ * @description: seals a member whose blocks got their checksums as they were
+ * written, so they don't have to be read back when the header is committed.
+ * Its blocks are kept in the block table, and the hash of its data with its
+ * attributes. When many workers seal their members at once,
+ * reserveWrittenMembers has to be called before.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (fileIndex) the position of the member
+ * @parameter: (blocks) the blocks of the member in chain order, allocated
+ * with malloc. The block table keeps them. NULL when they follow each other
+ * from the first block of the member.
+ * @parameter: (hashes) the hash of the data of each block in chain order,
+ * allocated with malloc. NULL when they weren't taken.
+ * @output: n/a
+ */
+void sealWrittenMember(struct posix_header *header, size_t fileIndex,
+                       size_t *blocks, uint64_t *hashes) {
+  struct block_checksums *checksums = header->checksums;
+  size_t numBlocks =
+      blocksForSize(field_to_size_t(header->files[fileIndex].size));
+
+  if (!blocks && numBlocks > 0) {
+    size_t firstBlock = field_to_size_t(header->files[fileIndex].blockAddress);
+
+    if (!(blocks = malloc(numBlocks * sizeof(size_t)))) {
+      logWarning("the blocks of a member will be read back for its checksum");
+      free(hashes);
+      return;
+    }
+
+    for (size_t b = 0; b < numBlocks; b++) {
+      blocks[b] = firstBlock + b;
+    }
+  }
+
+  if (checksums) {
+    uint32_t memberChecksum = 0;
+
+    for (size_t b = 0; b < numBlocks; b++) {
+      memberChecksum =
+          foldBlockChecksum(memberChecksum, checksums->blocks[blocks[b]]);
+    }
+
+    reserveMemberChecksums(checksums, fileIndex + 1);
+    checksums->members[fileIndex] = memberChecksum;
+  }
+
+  if (header->blockTable) {
+    setMemberBlocks(header->blockTable, fileIndex, blocks, numBlocks);
+  } else {
+    free(blocks);
+  }
+
+  if (header->attributes && (hashes || numBlocks == 0)) {
+    keepMemberHashes(header, fileIndex, hashes, numBlocks);
+  } else {
+    free(hashes);
+  }
+}
+
+/**
+ * @description: calculates where the checksums are stored, right after the
+ * last block or after the dedup index when the archive has one
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (blockCount) the amount of blocks of the archive
+ * @output: the offset of the checksums in the archive
+ */
+long checksumOffset(struct posix_header *header, size_t blockCount) {
+  long offset = blockOffset(blockCount);
+
+  if (archiveFlags(header) & ARCHIVE_FLAG_DEDUP) {
+    offset += sizeof(struct dedup_info) +
+              blockCount * sizeof(struct dedup_record);
+  }
+
+  return offset;
+}
+
+/**
+ * @description: loads the checksums of the archive. Archives without the
+ * checksum flag don't have them. When they can't be read the flag is
+ * dropped, so the archive is handled like one without checksums.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archive) the tar FILE
+ * @parameter: (offset) the position of the checksums in the archive
+ * @parameter: (blockCount) the amount of blocks of the archive
+ * @output: n/a
+ */
+void loadBlockChecksums(struct posix_header *header, FILE *archive,
+                        long offset, size_t blockCount) {
+  char message[100];
+  struct checksum_info info;
+
+  if (!(archiveFlags(header) & ARCHIVE_FLAG_CHECKSUMS) ||
+      attachBlockChecksums(header) != 0) {
+    return;
+  }
+
+  reserveBlockChecksums(header->checksums, blockCount);
+
+  fseek(archive, offset, SEEK_SET);
+
+  if (fread(&info, sizeof(info), 1, archive) != 1 ||
+      memcmp(info.magic, CHECKSUM_MAGIC, sizeof(info.magic)) != 0 ||
+      octal_to_size_t(info.blockCount) != blockCount ||
+      octal_to_size_t(info.memberCount) != header->count ||
+      readChecksumRecords(header->checksums->blocks, blockCount, archive) !=
+          0 ||
+      readChecksumRecords(header->checksums->members, header->count,
+                          archive) != 0) {
+    logWarning("the checksums of the archive are missing, its blocks won't "
+               "be checked");
+
+    destroyBlockChecksums(header->checksums);
+    free(header->checksums);
+    header->checksums = NULL;
+    setArchiveFlags(header, archiveFlags(header) & ~ARCHIVE_FLAG_CHECKSUMS);
+    return;
+  }
+
+  snprintf(message, 100, "checksums loaded for %zu blocks and %zu members",
+           blockCount, header->count);
+  logVerbose(message);
+}
+
+/**
+ * @description: reads a list of checksums stored in hexadecimal
+ * @parameter: (values) where the checksums are set
+ * @parameter: (count) the amount of checksums
+ * @parameter: (archive) the tar FILE, right at the first checksum
+ * @output: the exit code
+ */
+int readChecksumRecords(uint32_t *values, size_t count, FILE *archive) {
+  char records[HEADER_READ_ENTRIES * CHECKSUM_RECORD_SIZE];
+  char record[CHECKSUM_RECORD_SIZE + 1];
+
+  record[CHECKSUM_RECORD_SIZE] = '\0';
+
+  for (size_t value = 0; value < count;) {
+    size_t chunk = count - value;
+
+    if (chunk > HEADER_READ_ENTRIES) {
+      chunk = HEADER_READ_ENTRIES;
+    }
+
+    if (fread(records, CHECKSUM_RECORD_SIZE, chunk, archive) != chunk) {
+      return 1;
+    }
+
+    for (size_t r = 0; r < chunk; r++, value++) {
+      memcpy(record, records + r * CHECKSUM_RECORD_SIZE, CHECKSUM_RECORD_SIZE);
+      values[value] = strtoul(record, NULL, 16);
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * @description: writes the checksums of every block and every member at the
+ * current position of the archive. The blocks written later go over them, so
+ * they are written again each time the header is.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archive) the tar FILE
+ * @parameter: (blockCount) the amount of blocks of the archive
+ * @output: the exit code
+ */
+int storeBlockChecksums(struct posix_header *header, FILE *archive,
+                        size_t blockCount) {
+  struct checksum_info info;
+
+  reserveBlockChecksums(header->checksums, blockCount);
+  reserveMemberChecksums(header->checksums, header->count);
+
+  memset(&info, 0, sizeof(info));
+  memcpy(info.magic, CHECKSUM_MAGIC, sizeof(info.magic));
+  size_t_to_octal(info.blockCount, blockCount);
+  size_t_to_octal(info.memberCount, header->count);
+
+  if (fwrite(&info, sizeof(info), 1, archive) != 1 ||
+      writeChecksumRecords(header->checksums->blocks, blockCount, archive) !=
+          0 ||
+      writeChecksumRecords(header->checksums->members, header->count,
+                           archive) != 0) {
+    logError("failed to write the checksums.");
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * @description: writes a list of checksums in hexadecimal
+ * @parameter: (values) the checksums
+ * @parameter: (count) the amount of checksums
+ * @parameter: (archive) the tar FILE
+ * @output: the exit code
+ */
+int writeChecksumRecords(const uint32_t *values, size_t count,
+                         FILE *archive) {
+  char records[HEADER_READ_ENTRIES * CHECKSUM_RECORD_SIZE + 1];
+
+  for (size_t value = 0; value < count;) {
+    size_t chunk = count - value;
+
+    if (chunk > HEADER_READ_ENTRIES) {
+      chunk = HEADER_READ_ENTRIES;
+    }
+
+    for (size_t r = 0; r < chunk; r++, value++) {
+      snprintf(records + r * CHECKSUM_RECORD_SIZE, CHECKSUM_RECORD_SIZE + 1,
+               "%08x", values[value]);
+    }
+
+    if (fwrite(records, CHECKSUM_RECORD_SIZE, chunk, archive) != chunk) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
 
 /**
  * ------------------------------------------
- *          LIST COMMAND
+ *          MEMBER ATTRIBUTES
  * ------------------------------------------
  */
 
 /**
- * @description: will list all the filenames
- * @parameter: (filename) the tar filename to be listed
+ * @description: prepares the empty attributes of an archive, filled as its
+ * members are written. If there is an error in malloc it returns 1.
+ * @parameter: (header) the FAT header of the tar file
+ * @output: the exit code
+ */
+int attachMemberAttributes(struct posix_header *header) {
+  header->attributes = malloc(sizeof(struct member_attributes));
+
+  if (!header->attributes) {
+    logError("memory allocation for the member attributes failed.");
+    return 1;
+  }
+
+  initMemberAttributes(header->attributes, header->count);
+
+  return 0;
+}
+
+/**
+ * @description: keeps the hashes of the blocks of a member with its
+ * attributes, so its first update only writes the blocks that changed, and
+ * the hash of its data, which comes from them the same way a file is hashed
+ * to be compared with it
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (fileIndex) the position of the member
+ * @parameter: (hashes) the hash of the data of each block in chain order,
+ * allocated with malloc, NULL for an empty member. The attributes keep them.
+ * @parameter: (count) the amount of blocks
+ * @output: the hash of the data of the member
+ */
+uint64_t keepMemberHashes(struct posix_header *header, size_t fileIndex,
+                          uint64_t *hashes, size_t count) {
+  struct member_attributes *attributes = header->attributes;
+  uint64_t contentHash =
+      foldContentHash(0, field_to_size_t(header->files[fileIndex].size));
+
+  for (size_t b = 0; b < count; b++) {
+    contentHash = foldContentHash(contentHash, hashes[b]);
+  }
+
+  reserveMemberAttributes(attributes, fileIndex + 1);
+  setMemberAttributes(attributes, fileIndex, attributes->mtimes[fileIndex],
+                      contentHash);
+  setMemberBlockHashes(attributes, fileIndex, hashes, count);
+
+  return contentHash;
+}
+
+/**
+ * @description: calculates where the member attributes are stored, right
+ * after the checksums
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (offset) the position of the checksums in the archive
+ * @parameter: (blockCount) the amount of blocks of the archive
+ * @output: the offset of the member attributes in the archive
+ */
+long attributesOffset(struct posix_header *header, long offset,
+                      size_t blockCount) {
+  if (archiveFlags(header) & ARCHIVE_FLAG_CHECKSUMS) {
+    offset += sizeof(struct checksum_info) +
+              (blockCount + header->count) * CHECKSUM_RECORD_SIZE;
+  }
+
+  return offset;
+}
+
+/**
+ * @description: loads the member attributes stored after the checksums.
+ * Version 2 archives without them get empty ones, which are stored with the
+ * header the next time it is written. Version 1 archives never get them,
+ * since older versions of star would leave them behind without updating
+ * them.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archive) the tar FILE
+ * @parameter: (offset) the position of the attributes in the archive
+ * @output: n/a
+ */
+void loadMemberAttributes(struct posix_header *header, FILE *archive,
+                          long offset) {
+  struct attributes_info info;
+
+  if (isGlobalOctalFields || attachMemberAttributes(header) != 0 ||
+      !(archiveFlags(header) & ARCHIVE_FLAG_ATTRIBUTES)) {
+    return;
+  }
+
+  size_t *records = malloc((header->count * 2 + 1) * sizeof(size_t));
+
+  fseek(archive, offset, SEEK_SET);
+
+  bool isLoaded =
+      records && fread(&info, sizeof(info), 1, archive) == 1 &&
+      memcmp(info.magic, ATTRIBUTES_MAGIC, sizeof(info.magic)) == 0 &&
+      octal_to_size_t(info.memberCount) == header->count &&
+      readTableRecords(records, header->count * 2, archive) == 0;
+
+  for (size_t i = 0; isLoaded && i < header->count; i++) {
+    setMemberAttributes(header->attributes, i, records[i * 2],
+                        records[i * 2 + 1]);
+  }
+
+  if (!isLoaded) {
+    logWarning("the member attributes can't be read, every member will be "
+               "written again when it is updated");
+  }
+
+  free(records);
+}
+
+/**
+ * @description: writes the modification time and the hash of every member
+ * at the current position of the archive
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archive) the tar FILE
+ * @output: the exit code
+ */
+int storeMemberAttributes(struct posix_header *header, FILE *archive) {
+  struct member_attributes *attributes = header->attributes;
+  struct attributes_info info;
+  size_t *records = malloc((header->count * 2 + 1) * sizeof(size_t));
+
+  if (!records) {
+    logError("memory allocation for the member attributes failed.");
+    return 1;
+  }
+
+  reserveMemberAttributes(attributes, header->count);
+
+  for (size_t i = 0; i < header->count; i++) {
+    records[i * 2] = attributes->mtimes[i];
+    records[i * 2 + 1] = attributes->hashes[i];
+  }
+
+  memset(&info, 0, sizeof(info));
+  memcpy(info.magic, ATTRIBUTES_MAGIC, sizeof(info.magic));
+  size_t_to_octal(info.memberCount, header->count);
+
+  int result = fwrite(&info, sizeof(info), 1, archive) != 1 ||
+               writeTableRecords(records, header->count * 2, archive) != 0;
+
+  free(records);
+
+  if (result != 0) {
+    logError("failed to write the member attributes.");
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * @description: calculates where the block hashes are stored, right after
+ * the block table
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archive) the tar FILE
+ * @output: the offset of the block hashes, -1 when the archive has no table
+ */
+long blockHashesOffset(struct posix_header *header, FILE *archive) {
+  struct block_table_info info;
+
+  if (header->blockTableOffset < 0 ||
+      pread(fileno(archive), &info, sizeof(info), header->blockTableOffset) !=
+          sizeof(info)) {
+    return -1;
+  }
+
+  return header->blockTableOffset + sizeof(info) +
+         (header->count + octal_to_size_t(info.entryCount)) * FIELD_SIZE;
+}
+
+/**
+ * @description: loads the hashes of the blocks of every member, so an update
+ * can tell the blocks that changed without reading them. The hashes of a
+ * member are kept only when its checksum is still the one they were stored
+ * with, since a version of star that doesn't know them can change the member
+ * and leave them behind.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archive) the tar FILE
+ * @output: n/a
+ */
+void loadBlockHashes(struct posix_header *header, FILE *archive) {
+  struct block_hashes_info info;
+  struct block_checksums *checksums = header->checksums;
+  long offset = blockHashesOffset(header, archive);
+
+  if (!header->attributes || !checksums || offset < 0 ||
+      !(archiveFlags(header) & ARCHIVE_FLAG_BLOCK_HASHES)) {
+    return;
+  }
+
+  size_t *members = malloc((header->count * 2 + 1) * sizeof(size_t));
+
+  fseek(archive, offset, SEEK_SET);
+
+  bool isLoaded =
+      members && fread(&info, sizeof(info), 1, archive) == 1 &&
+      memcmp(info.magic, BLOCK_HASHES_MAGIC, sizeof(info.magic)) == 0 &&
+      octal_to_size_t(info.memberCount) == header->count &&
+      readTableRecords(members, header->count * 2, archive) == 0;
+
+  reserveMemberChecksums(checksums, header->count);
+
+  for (size_t i = 0; isLoaded && i < header->count; i++) {
+    size_t count = members[i * 2 + 1];
+
+    // the hashes of a member that changed are passed over without reading
+    if (count == 0 || checksums->members[i] == 0 ||
+        members[i * 2] != checksums->members[i] ||
+        count != blocksForSize(field_to_size_t(header->files[i].size))) {
+      isLoaded = fseek(archive, count * FIELD_SIZE, SEEK_CUR) == 0;
+      continue;
+    }
+
+    uint64_t *hashes = malloc(count * sizeof(uint64_t));
+
+    if (!hashes || readTableRecords((size_t *)hashes, count, archive) != 0) {
+      free(hashes);
+      isLoaded = false;
+      break;
+    }
+
+    setMemberBlockHashes(header->attributes, i, hashes, count);
+  }
+
+  if (!isLoaded) {
+    logWarning("the block hashes can't be read, the members will be written "
+               "whole when they are updated");
+  }
+
+  free(members);
+}
+
+/**
+ * @description: writes the hashes of the blocks of every member at the
+ * current position of the archive, right after the block table. Each member
+ * has its checksum and the amount of its hashes, then come the hashes of all
+ * of them, each one a number like the ones of the blocks.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archive) the tar FILE
  * @output: the exit code
  */
-int list(char *filename) { char message[100];
-  FILE *archive = fopen(filename, "rb");
-  if (!archive) {
-    logError("Failed to open tar archive file. Double check if the input file "
-             "exists.");
+int storeBlockHashes(struct posix_header *header, FILE *archive) {
+  struct member_attributes *attributes = header->attributes;
+  struct block_checksums *checksums = header->checksums;
+  struct block_hashes_info info;
+  size_t *members = malloc((header->count * 2 + 1) * sizeof(size_t));
+  int result = 0;
+
+  if (!members) {
+    logError("memory allocation for the block hashes failed.");
     return 1;
   }
 
-  struct posix_header *header = malloc(sizeof(struct posix_header));
+  reserveMemberAttributes(attributes, header->count);
+  reserveMemberChecksums(checksums, header->count);
 
-  if (!header) {
-    logError("Memory allocation for header failed.");
-    fclose(archive);
-    return 1;
-  }
+  // only the hashes that match the member and its checksum are kept
+  for (size_t i = 0; i < header->count; i++) {
+    size_t count = attributes->blockCounts[i];
+    bool isKept =
+        count > 0 && checksums->members[i] != 0 &&
+        count == blocksForSize(field_to_size_t(header->files[i].size));
 
-  if (fread(header, MAX_HEADER_SIZE, 1, archive) != 1) {
-    logError("Failed to read header.");
-    free(header);
-    fclose(archive);
-    return 1;
+    members[i * 2] = isKept ? checksums->members[i] : 0;
+    members[i * 2 + 1] = isKept ? count : 0;
   }
 
-  listFilesByTarFile(header, archive);
+  memset(&info, 0, sizeof(info));
+  memcpy(info.magic, BLOCK_HASHES_MAGIC, sizeof(info.magic));
+  size_t_to_octal(info.memberCount, header->count);
 
-  free(header);
-  fclose(archive);
-  return 0;
+  result = fwrite(&info, sizeof(info), 1, archive) != 1 ||
+           writeTableRecords(members, header->count * 2, archive) != 0;
+
+  for (size_t i = 0; result == 0 && i < header->count; i++) {
+    size_t count = members[i * 2 + 1];
+
+    result = writeTableRecords((const size_t *)attributes->blockHashes[i],
+                               count, archive);
   }
-  /**
- * @description: list all the files out of a tar file
- * @parameter: (header) the FAT header of the tar file
- * @parameter: (archive) the tar file to be read.
- * @output: n/a
- */
-void listFilesByTarFile(struct posix_header *header, FILE *archive) {
-  char message[100];
 
-  for (int i = 0; i < MAX_FILES && strlen(header->files[i].filename) > 0; i++) {
-    printf("this is a file present: %s\n", header->files[i].filename);
+  free(members);
+
+  if (result != 0) {
+    logError("failed to write the block hashes.");
+    return 1;
   }
+
+  return 0;
 }
 
 /**
- * ------------------------------------------
- *          DELETE COMMAND
- * ------------------------------------------
+ * @description: returns the modification time of a file
+ * @parameter: (status) the status of the file
+ * @output: the modification time in nanoseconds
  */
+uint64_t fileModificationTime(const struct stat *status) {
+  return (uint64_t)status->st_mtim.tv_sec * 1000000000ULL +
+         status->st_mtim.tv_nsec;
+}
 
 /**
- * @description: will remove certain files from the tar file
- * @parameter: (files) the files name to be deleted
- * @parameter: (fileCount) the amount of files to be deleted
- * @parameter: (filename) the tar filename to be listed
- * @output: the exit code
+ * @description: hashes the data of a file the way it is split in blocks, so
+ * the hash can be compared with the one of a member
+ * @parameter: (fd) the descriptor of the file
+ * @parameter: (size) the amount of bytes of the file
+ * @parameter: (buffer) room for BATCH_BLOCKS blocks of data
+ * @output: the hash of the data, 0 if the file couldn't be read
  */
-int delete(char *files[], int fileCount, char *filename) {
-  char message[100];
-  snprintf(message, 100, "starting to delete archives inside %s", filename);
-  logVerbose(message);
-  FILE *archive = fopen(filename, "r+b");
-  if (!archive) {
-    logError("Failed to open tar archive file. Double check if the input file "
-             "exists.");
-    return 1;
-  }
+uint64_t hashFileContent(int fd, size_t size, char *buffer) {
+  uint64_t hash = foldContentHash(0, size);
 
-  struct posix_header *header = malloc(sizeof(struct posix_header));
+  for (size_t offset = 0; offset < size;) {
+    size_t length = size - offset;
 
-  if (!header) {
-    logError("Memory allocation for header failed.");
-    fclose(archive);
-    return 1;
-  }
+    if (length > BATCH_BLOCKS * BLOCK_DATA_SIZE) {
+      length = BATCH_BLOCKS * BLOCK_DATA_SIZE;
+    }
 
-  if (fread(header, MAX_HEADER_SIZE, 1, archive) != 1) {
-    logError("Failed to read header.");
-    free(header);
-    fclose(archive);
-    return 1;
-  }
+    if (preadFull(fd, buffer, length, offset) != (ssize_t)length) {
+      return 0;
+    }
 
-  deleteFilesByTarFile(header, archive, files, fileCount);
+    for (size_t start = 0; start < length; start += BLOCK_DATA_SIZE) {
+      size_t blockLength = length - start < BLOCK_DATA_SIZE ? length - start
+                                                            : BLOCK_DATA_SIZE;
 
-  free(header);
-  fclose(archive);
+      hash = foldContentHash(hash, hashBlockData(buffer + start, blockLength));
+    }
 
-  return 0;
+    offset += length;
+  }
+
+  return hash;
 }
 
-  /**
- * @description: delete all the files out of a tar file
+/**
+ * @description: finds the files of an update that are the same as their
+ * members. A file is the same when its size and modification time didn't
+ * change. With --hash the files of the same size are hashed, and the hash
+ * decides for the members that have one.
+ * @parameter: (files) the files to be updated
+ * @parameter: (fileCount) the amount of files
  * @parameter: (header) the FAT header of the tar file
- * @parameter: (archive) the tar file to be read.
+ * @parameter: (index) the name index of the header
+ * @parameter: (changes) what is found for each file. This will be set in the
+ * function.
  * @output: n/a
  */
-void deleteFilesByTarFile(struct posix_header *header, FILE *archive, char *files[], int fileCount) {
-  char message[100];
+void findUnchangedMembers(char *files[], int fileCount,
+                          struct posix_header *header,
+                          struct name_index *index,
+                          struct member_change *changes) {
+  struct member_attributes *attributes = header->attributes;
+  struct hash_job job;
+
+  memset(&job, 0, sizeof(job));
+  job.files = files;
+  job.changes = changes;
+  job.count = fileCount;
 
-  for (int i = 0; i < MAX_FILES && strlen(header->files[i].filename) > 0; i++) {
-    for (int x = 0; x<fileCount; x++){
-      if (strcmp (header->files[i].filename, get_filename(files[x])) == 0){
-        struct posix_file_info fileInfo = header->files[i];
-        deleteFileByTarFile(archive, &fileInfo);
-      }
+  for (int i = 0; i < fileCount; i++) {
+    struct stat status;
+    struct member_change *change = &changes[i];
+
+    memset(change, 0, sizeof(*change));
+    change->fileIndex = findLastName(index, get_filename(files[i]));
+
+    if (change->fileIndex < 0 || stat(files[i], &status) != 0) {
+      continue;
+    }
+
+    change->size = status.st_size;
+    change->mtime = fileModificationTime(&status);
+
+    if (!attributes ||
+        field_to_size_t(header->files[change->fileIndex].size) !=
+            change->size) {
+      continue;
+    }
+
+    reserveMemberAttributes(attributes, header->count);
+
+    uint64_t mtime = attributes->mtimes[change->fileIndex];
+
+    change->isUnchanged = mtime != 0 && mtime == change->mtime;
+    change->isHashed = isGlobalHashCheck;
+  }
+
+  if (!isGlobalHashCheck) {
+    return;
+  }
+
+  pthread_mutex_init(&job.lock, NULL);
+
+  // the files are read in parallel, every CPU is used unless --jobs is set
+  int workerCount = codecThreadCount();
+  pthread_t workers[MAX_JOBS];
+  int startedWorkers = 0;
+
+  for (int w = 1; w < workerCount && w < fileCount; w++) {
+    if (pthread_create(&workers[startedWorkers], NULL, hashWorker, &job) !=
+        0) {
+      logWarning("couldn't start a hash worker");
+      break;
+    }
+
+    startedWorkers++;
+  }
+
+  hashWorker(&job);
+
+  for (int w = 0; w < startedWorkers; w++) {
+    pthread_join(workers[w], NULL);
+  }
+
+  pthread_mutex_destroy(&job.lock);
+
+  for (int i = 0; i < fileCount; i++) {
+    struct member_change *change = &changes[i];
+
+    if (!change->isHashed) {
+      continue;
+    }
+
+    uint64_t hash = attributes->hashes[change->fileIndex];
+
+    // members without a hash keep the answer of their modification time
+    if (change->hash == 0) {
+      change->isUnchanged = false;
+    } else if (hash != 0) {
+      change->isUnchanged = hash == change->hash;
     }
   }
 }
-void deleteFileByTarFile(FILE *archive, struct posix_file_info *fileInfo) {  
-  char message[100];
-  snprintf(message, 100, "INFO: [N : %s] [B : %ld] [S : %ld]", fileInfo->filename, octal_to_size_t(fileInfo->blockAddress), octal_to_size_t(fileInfo->size));
-  logVerbose(message);
 
-  // Obtener el bloque de datos del archivo
-  long blockAddress = octal_to_size_t(fileInfo->blockAddress);
-  fseek(archive, blockAddress * BLOCK_SIZE + MAX_HEADER_SIZE, SEEK_SET);
+/**
+ * @description: hashes the files of an update until there are none left, run
+ * by each worker
+ * @parameter: (argument) the hash_job shared by the workers
+ * @output: NULL
+ */
+void *hashWorker(void *argument) {
+  struct hash_job *job = argument;
+  char *buffer = malloc(BATCH_BLOCKS * BLOCK_DATA_SIZE);
 
-  // // Marcar el bloque como libre
-  struct block_data block;
-  fread(&block, BLOCK_SIZE, 1, archive);
-  size_t_to_octal(block.isFree, 1);
-  fseek(archive, blockAddress * BLOCK_SIZE + MAX_HEADER_SIZE, SEEK_SET);
-  fwrite(&block, BLOCK_SIZE, 1, archive);
+  while (buffer) {
+    pthread_mutex_lock(&job->lock);
+    size_t i = job->next++;
+    pthread_mutex_unlock(&job->lock);
 
-  // // Eliminar la entrada del archivo del encabezado
-  fseek(archive, 0, SEEK_SET);
-  struct posix_header *header = malloc(MAX_HEADER_SIZE);
-  struct posix_header *new_header = malloc(MAX_HEADER_SIZE);
+    if (i >= job->count) {
+      break;
+    }
 
-  int c = 0;
+    struct member_change *change = &job->changes[i];
 
-  while (fread(header, MAX_HEADER_SIZE, 1, archive) == 1) {
-      for (int i = 0; i < MAX_FILES && strlen(header->files[i].filename) > 0; i++) {
-          if (strcmp(header->files[i].filename, fileInfo->filename) != 0) {
-              new_header->files[c] = header->files[i];
-              c++;
-          }
-      }
+    if (!change->isHashed) {
+      continue;
+    }
+
+    int fd = open(job->files[i], O_RDONLY | O_CLOEXEC);
+
+    if (fd >= 0) {
+      posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+      change->hash = hashFileContent(fd, change->size, buffer);
+      close(fd);
+    }
   }
 
-  fseek(archive, 0, SEEK_SET);
-  fwrite(new_header, MAX_HEADER_SIZE, 1, archive);
-  free(new_header);
+  free(buffer);
 
-  snprintf(message, 100, "file deleted successfully: %s", fileInfo->filename);
-  logVerbose(message);
+  return NULL;
 }
 
 /**
  * ------------------------------------------
- *          UPDATE COMMAND
+ *          BLOCK TABLE
  * ------------------------------------------
  */
 
 /**
- * @description: will update the content of n archives
- * @parameter: (files) the files name to be deleted
- * @parameter: (fileCount) the amount of files to be deleted
- * @parameter: (filename) the tar filename to be listed
+ * @description: prepares the empty block table of an archive, where the
+ * blocks of every member are unknown until the header is committed. If there
+ * is an error in malloc it returns 1.
+ * @parameter: (header) the FAT header of the tar file
  * @output: the exit code
  */
-int update(char *files[], int fileCount, char *filename) {
-  char message[100];
-  snprintf(message, 100, "Starting to update archives inside %s", filename);
-  logVerbose(message);
+int attachBlockTable(struct posix_header *header) {
+  header->blockTable = malloc(sizeof(struct block_table));
 
-  FILE *archive = fopen(filename, "r+b");
-  if (!archive) {
-    logError("Failed to open tar archive file. Double check if the input file "
-             "exists.");
+  if (!header->blockTable) {
+    logError("memory allocation for the block table failed.");
     return 1;
   }
 
-  struct posix_header *header = malloc(sizeof(struct posix_header));
+  initBlockTable(header->blockTable, header->count);
 
-  if (!header) {
-    logError("Memory allocation for header failed.");
-    fclose(archive);
-    return 1;
-  }
+  return 0;
+}
 
-  if (fread(header, MAX_HEADER_SIZE, 1, archive) != 1) {
-    logError("Failed to read header.");
-    free(header);
-    fclose(archive);
-    return 1;
+/**
+ * @description: calculates where the block table is stored, right after the
+ * checksums and the member attributes
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (offset) the position of the checksums in the archive
+ * @parameter: (blockCount) the amount of blocks of the archive
+ * @output: the offset of the block table in the archive
+ */
+long blockTableOffset(struct posix_header *header, long offset,
+                      size_t blockCount) {
+  offset = attributesOffset(header, offset, blockCount);
+
+  if (archiveFlags(header) & ARCHIVE_FLAG_ATTRIBUTES) {
+    offset += sizeof(struct attributes_info) + header->count * 2 * FIELD_SIZE;
   }
 
-  updateBlocksInFile(files, fileCount, header, archive);
+  return offset;
+}
 
-  // Rewrite the header if any changes
-  fseek(archive, 0, SEEK_SET);
-  fwrite(header, MAX_HEADER_SIZE, 1, archive);
+/**
+ * @description: finds the block table of the archive without reading it, so
+ * a range of a member is found with two small reads. Archives without the
+ * block table flag don't have one, and a table that doesn't match the header
+ * is not used.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archive) the tar FILE
+ * @parameter: (offset) the position of the block table in the archive
+ * @output: n/a
+ */
+void findBlockTable(struct posix_header *header, FILE *archive, long offset) {
+  struct block_table_info info;
 
-  free(header);
-  fclose(archive);
-  return 0;
+  header->blockTableOffset = -1;
+
+  if (!(archiveFlags(header) & ARCHIVE_FLAG_BLOCK_TABLE)) {
+    return;
+  }
+
+  if (pread(fileno(archive), &info, sizeof(info), offset) != sizeof(info) ||
+      memcmp(info.magic, BLOCK_TABLE_MAGIC, sizeof(info.magic)) != 0 ||
+      octal_to_size_t(info.memberCount) != header->count) {
+    logWarning("the block table of the archive is missing, the chains will "
+               "be followed");
+    return;
+  }
+
+  header->blockTableOffset = offset;
 }
 
 /**
- * @description: will update the blocks with the new files information
- * @parameter: (files) the files name to be updated
- * @parameter: (fileCount) the amount of files to be deleted
- * @parameter: (header) the FAT Header to be used
+ * @description: loads the whole block table, so it can be written again with
+ * the header. The members whose blocks can't be read are found again by
+ * following their chains when the header is committed. Version 1 archives
+ * never get a table, since older versions of star would leave it behind
+ * without updating it.
+ * @parameter: (header) the FAT header of the tar file
  * @parameter: (archive) the tar FILE
  * @output: n/a
  */
-void updateBlocksInFile(char *files[], int fileCount,
-                        struct posix_header *header, FILE *archive) {
+void loadBlockTable(struct posix_header *header, FILE *archive) {
   char message[100];
+  struct block_table_info info;
 
-  for (int i = 0; i < fileCount; i++) {
-    FILE *inputFile = fopen(files[i], "rb");
+  if (isGlobalOctalFields || attachBlockTable(header) != 0 ||
+      header->blockTableOffset < 0) {
+    return;
+  }
 
-    if (!inputFile) {
-      snprintf(message, 100,
-               "Error reading file %s, continuing with other files.", files[i]);
-      logError(message);
+  size_t *starts = malloc((header->count + 1) * sizeof(size_t));
+  size_t *entries = NULL;
+  size_t entryCount = 0;
+
+  fseek(archive, header->blockTableOffset, SEEK_SET);
+
+  bool isLoaded =
+      starts && fread(&info, sizeof(info), 1, archive) == 1 &&
+      readTableRecords(starts, header->count, archive) == 0;
+
+  if (isLoaded) {
+    entryCount = octal_to_size_t(info.entryCount);
+    entries = malloc((entryCount + 1) * sizeof(size_t));
+    isLoaded = entries && readTableRecords(entries, entryCount, archive) == 0;
+  }
+
+  for (size_t i = 0; isLoaded && i < header->count; i++) {
+    size_t count = blocksForSize(field_to_size_t(header->files[i].size));
+
+    if (count == 0 || starts[i] > entryCount ||
+        count > entryCount - starts[i]) {
       continue;
     }
 
-    fseek(inputFile, 0, SEEK_END);
-    size_t newFileSize = ftell(inputFile);
-    fseek(inputFile, 0, SEEK_SET);
-    size_t newNumBlocks =
-        (newFileSize + BLOCK_SIZE - 24 - 1) / (BLOCK_SIZE - 24);
+    size_t *blocks = malloc(count * sizeof(size_t));
 
-    int fileIndex;
-    bool isFileInArchive = isFileInFATTable(header, files[i], &fileIndex);
+    if (!blocks) {
+      break;
+    }
 
-    if (!isFileInArchive) {
-      logError("file not in archive... continuing...");
+    memcpy(blocks, entries + starts[i], count * sizeof(size_t));
+    setMemberBlocks(header->blockTable, i, blocks, count);
+  }
 
-      fclose(inputFile);
+  if (!isLoaded) {
+    logWarning("the block table of the archive can't be read, it will be "
+               "built again");
+  } else {
+    snprintf(message, 100, "block table loaded with %zu blocks", entryCount);
+    logVerbose(message);
+  }
+
+  free(starts);
+  free(entries);
+}
+
+/**
+ * @description: finds the blocks of the members that aren't in the table
+ * yet, which are the ones written or changed since the archive was opened,
+ * by following their chains. A member whose chain is broken stays out of the
+ * table.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archiveFd) the descriptor of the archive, -1 for a stream,
+ * whose blocks follow each other
+ * @parameter: (blockCount) the amount of blocks of the archive
+ * @output: n/a
+ */
+void fillBlockTable(struct posix_header *header, int archiveFd,
+                    size_t blockCount) {
+  char message[100];
+  struct block_table *table = header->blockTable;
 
+  reserveBlockTable(table, header->count);
+
+  for (size_t i = 0; i < header->count; i++) {
+    size_t count = blocksForSize(field_to_size_t(header->files[i].size));
+
+    if (count == 0 || table->blocks[i]) {
       continue;
     }
 
-    size_t existingBlocks =
-        (octal_to_size_t(header->files[fileIndex].size) + BLOCK_SIZE - 24 - 1) /
-        (BLOCK_SIZE - 24);
+    size_t *blocks = malloc(count * sizeof(size_t));
+    size_t currentBlockIndex = field_to_size_t(header->files[i].blockAddress);
+    size_t found = 0;
 
-    snprintf(message, 100,
-             "file %s has %d blocks and will require now %d blocks.",
-             header->files[fileIndex].filename, (int) existingBlocks, (int) newNumBlocks);
-    logVerbose(message);
+    if (!blocks) {
+      logError("memory allocation for the block table failed.");
+      return;
+    }
 
-    size_t currentBlockIndex =
-        octal_to_size_t(header->files[fileIndex].blockAddress);
+    while (found < count && currentBlockIndex < blockCount) {
+      blocks[found++] = currentBlockIndex;
 
-    if (existingBlocks >= newNumBlocks) {
-      // Update existing blocks
-      size_t blockCount = 0;
+      size_t nextBlockIndex = archiveFd >= 0
+                                  ? preadBlockNext(archiveFd, currentBlockIndex)
+                                  : currentBlockIndex + 1;
+
+      if (nextBlockIndex == 0) {
+        break;
+      }
+
+      currentBlockIndex = nextBlockIndex;
+    }
+
+    if (found < count) {
+      snprintf(message, sizeof(message),
+               "the chain of %s is broken, it is left out of the block table",
+               header->files[i].filename);
+      logWarning(message);
+      free(blocks);
+      continue;
+    }
+
+    setMemberBlocks(table, i, blocks, count);
+  }
+}
+
+/**
+ * @description: writes the block table at the current position of the
+ * archive. The position of the first block of every member in the list comes
+ * first, followed by the list with the blocks of every member in chain order.
+ * Members left out of the table have no position.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archive) the tar FILE
+ * @output: the exit code
+ */
+int storeBlockTable(struct posix_header *header, FILE *archive) {
+  struct block_table *table = header->blockTable;
+  struct block_table_info info;
+  size_t *starts = malloc((header->count + 1) * sizeof(size_t));
+  size_t entryCount = 0;
+
+  if (!starts) {
+    logError("memory allocation for the block table failed.");
+    return 1;
+  }
+
+  reserveBlockTable(table, header->count);
+
+  for (size_t i = 0; i < header->count; i++) {
+    starts[i] = table->blocks[i] ? entryCount : UNUSED_BLOCK;
+    entryCount += table->blocks[i] ? table->counts[i] : 0;
+  }
+
+  memset(&info, 0, sizeof(info));
+  memcpy(info.magic, BLOCK_TABLE_MAGIC, sizeof(info.magic));
+  size_t_to_octal(info.memberCount, header->count);
+  size_t_to_octal(info.entryCount, entryCount);
+
+  int result = fwrite(&info, sizeof(info), 1, archive) != 1 ||
+               writeTableRecords(starts, header->count, archive) != 0;
+
+  for (size_t i = 0; result == 0 && i < header->count; i++) {
+    if (table->blocks[i]) {
+      result = writeTableRecords(table->blocks[i], table->counts[i], archive);
+    }
+  }
+
+  free(starts);
+
+  if (result != 0) {
+    logError("failed to write the block table.");
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * @description: reads a list of block table records
+ * @parameter: (values) where the records are set
+ * @parameter: (count) the amount of records
+ * @parameter: (archive) the tar FILE, right at the first record
+ * @output: the exit code
+ */
+int readTableRecords(size_t *values, size_t count, FILE *archive) {
+  char records[HEADER_READ_ENTRIES * FIELD_SIZE];
 
-      overwriteExistingBlocks(header->files[fileIndex].filename,
-                              &currentBlockIndex, &blockCount, &newNumBlocks,
-                              archive, inputFile);
+  for (size_t value = 0; value < count;) {
+    size_t chunk = count - value;
 
-      // If the file is smaller, mark remaining blocks as free
-      if (existingBlocks > newNumBlocks) {
-        markRemainingBlocksAsFree(&currentBlockIndex, archive);
-      }
-    } else {
-      updateWhenFileSizeIsGreater(header->files[fileIndex].filename,
-                                  existingBlocks, currentBlockIndex,
-                                  newNumBlocks, archive, inputFile);
+    if (chunk > HEADER_READ_ENTRIES) {
+      chunk = HEADER_READ_ENTRIES;
+    }
 
-      // Update file info in the header
-      size_t_to_octal(header->files[fileIndex].size, newFileSize);
+    if (fread(records, FIELD_SIZE, chunk, archive) != chunk) {
+      return 1;
     }
 
-    fclose(inputFile);
+    for (size_t r = 0; r < chunk; r++, value++) {
+      values[value] = field_to_size_t(records + r * FIELD_SIZE);
+    }
   }
+
+  return 0;
 }
 
 /**
- * @description: will determine if a certain file is present in the FAT table
- * @parameter: (header) the FAT Header to be used
- * @parameter: (path) the filename with its path to look for
- * @parameter: (indexPosition) the position where the file is. This will be set
- * in the function.
- * @output: true if the file exists in the header
+ * @description: writes a list of block table records, each one a number like
+ * the ones of the blocks
+ * @parameter: (values) the records
+ * @parameter: (count) the amount of records
+ * @parameter: (archive) the tar FILE
+ * @output: the exit code
  */
-bool isFileInFATTable(struct posix_header *header, char *path,
-                      int *indexPosition) {
-  char message[100];
-  (*indexPosition) = -1;
+int writeTableRecords(const size_t *values, size_t count, FILE *archive) {
+  char records[HEADER_READ_ENTRIES * FIELD_SIZE];
+
+  for (size_t value = 0; value < count;) {
+    size_t chunk = count - value;
 
-  for (int j = 0; j < MAX_FILES && strlen(header->files[j].filename) > 0; j++) {
-    if (strcmp(header->files[j].filename, get_filename(path)) == 0) {
+    if (chunk > HEADER_READ_ENTRIES) {
+      chunk = HEADER_READ_ENTRIES;
+    }
 
-      (*indexPosition) = j;
+    for (size_t r = 0; r < chunk; r++, value++) {
+      size_t_to_field(records + r * FIELD_SIZE, values[value]);
+    }
 
-      snprintf(message, 100, "file %s exists in header will continue to update",
-               get_filename(path));
-      logVerbose(message);
-      return true;
+    if (fwrite(records, FIELD_SIZE, chunk, archive) != chunk) {
+      return 1;
     }
   }
 
-  return false;
+  return 0;
 }
 
 /**
- * @description: will overwrite the exiting blocks of a file inside the tar file
- * @parameter: (filename) the filename of the file to overwrite
- * @parameter: (currentBlockIndex) the block address where the file starts
- * @parameter: (blockCount) the amount of blocks used. This will be set in the
- * function
- * @parameter: (newNumBlocks) the new amount of blocks required.
+ * @description: finds a run of blocks of a member. The table in memory is
+ * used when it was loaded, and the stored one is read in place otherwise,
+ * with one read for the position of the member in the list and one for its
+ * blocks. Archives without a table follow the chain up to the first block.
+ * @parameter: (header) the FAT header of the tar file
  * @parameter: (archive) the tar FILE
- * @parameter: (inputFile) the new file to be packaged
- * @output: n/a
+ * @parameter: (fileIndex) the position of the member in the header
+ * @parameter: (firstBlock) the first block of the run, counted from the
+ * start of the member
+ * @parameter: (count) the amount of blocks of the run
+ * @parameter: (blocks) where the position of each block is set
+ * @output: the exit code
  */
-void overwriteExistingBlocks(char *filename, size_t *currentBlockIndex,
-                             size_t *blockCount, size_t *newNumBlocks,
-                             FILE *archive, FILE *inputFile) {
-  char message[100];
+int findMemberBlocks(struct posix_header *header, FILE *archive,
+                     size_t fileIndex, size_t firstBlock, size_t count,
+                     size_t *blocks) {
+  struct block_table *table = header->blockTable;
+  int archiveFd = fileno(archive);
+
+  if (table && fileIndex < table->capacity && table->blocks[fileIndex] &&
+      firstBlock + count <= table->counts[fileIndex]) {
+    memcpy(blocks, table->blocks[fileIndex] + firstBlock,
+           count * sizeof(size_t));
+    return 0;
+  }
 
-  while ((*blockCount) < (*newNumBlocks)) {
-    snprintf(message, 100, "reading block #%d for file ", (int) *currentBlockIndex);
-    logVerbose(message);
+  if (!table && header->blockTableOffset >= 0) {
+    long listStart = header->blockTableOffset +
+                     sizeof(struct block_table_info) +
+                     header->count * FIELD_SIZE;
+    char record[FIELD_SIZE];
+    char *records = malloc(count * FIELD_SIZE);
+
+    if (records &&
+        pread(archiveFd, record, FIELD_SIZE,
+              header->blockTableOffset + sizeof(struct block_table_info) +
+                  fileIndex * FIELD_SIZE) == FIELD_SIZE) {
+      size_t start = field_to_size_t(record);
+
+      if (start != UNUSED_BLOCK &&
+          pread(archiveFd, records, count * FIELD_SIZE,
+                listStart + (start + firstBlock) * FIELD_SIZE) ==
+              (ssize_t)(count * FIELD_SIZE)) {
+        for (size_t b = 0; b < count; b++) {
+          blocks[b] = field_to_size_t(records + b * FIELD_SIZE);
+        }
 
-    fseek(archive, MAX_HEADER_SIZE + (*currentBlockIndex) * BLOCK_SIZE,
-          SEEK_SET);
-    struct block_data block;
-    fread(&block, sizeof(struct block_data), 1, archive);
+        free(records);
+        return 0;
+      }
+    }
 
-    fread(block.data, 1, BLOCK_SIZE - 24, inputFile);
-    fseek(archive, MAX_HEADER_SIZE + (*currentBlockIndex) * BLOCK_SIZE,
-          SEEK_SET);
-    fwrite(&block, sizeof(struct block_data), 1, archive);
+    free(records);
+  }
 
-    size_t nextBlockIndex = octal_to_size_t(block.next);
+  size_t numBlocks =
+      blocksForSize(field_to_size_t(header->files[fileIndex].size));
+  size_t currentBlockIndex =
+      field_to_size_t(header->files[fileIndex].blockAddress);
 
-    if (nextBlockIndex == 0 || ++(*blockCount) >= (*newNumBlocks)) {
-      break;
+  for (size_t b = 0; b < firstBlock + count && b < numBlocks; b++) {
+    if (b > 0) {
+      currentBlockIndex = preadBlockNext(archiveFd, currentBlockIndex);
     }
 
-    (*currentBlockIndex) = nextBlockIndex;
+    if (b > 0 && currentBlockIndex == 0) {
+      logError("the chain of the member is broken.");
+      return 1;
+    }
+
+    if (b >= firstBlock) {
+      blocks[b - firstBlock] = currentBlockIndex;
+    }
   }
+
+  return 0;
 }
 
 /**
- * @description: will set the rest of the blocks as free
- * @parameter: (currentBlockIndex) the block address where the file starts
+ * ------------------------------------------
+ *          FREE MAP
+ * ------------------------------------------
+ */
+
+/**
+ * @description: loads the free map stored after the FAT table. Archives
+ * without a stored free map get one built out of their chains.
+ * @parameter: (header) the FAT header of the tar file
  * @parameter: (archive) the tar FILE
+ * @parameter: (map) the free map to be set
  * @output: n/a
  */
-void markRemainingBlocksAsFree(size_t *currentBlockIndex, FILE *archive) {
-  struct block_data block;
+void loadFreeMap(struct posix_header *header, FILE *archive,
+                 struct free_map *map) {
+  char message[100];
+  struct free_map_info *info =
+      (struct free_map_info *)header->tail;
+  size_t flags = archiveFlags(header);
+  unsigned char *bits = (unsigned char *)(info + 1);
+
+  // the first free maps were stored without flags, right after the count
+  if (memcmp(info->magic, FREE_MAP_MAGIC_V1, sizeof(info->magic)) == 0) {
+    bits = (unsigned char *)info->flags;
+  } else if (memcmp(info->magic, FREE_MAP_MAGIC, sizeof(info->magic)) != 0 ||
+             (flags & ARCHIVE_FLAG_NO_FREE_MAP)) {
+    rebuildFreeMap(header, archive, map);
+    map->preferRuns = flags & ARCHIVE_FLAG_EXTENTS;
+    return;
+  }
 
-  while ((*currentBlockIndex) != 0) {
-    fseek(archive, MAX_HEADER_SIZE + (*currentBlockIndex) * BLOCK_SIZE,
-          SEEK_SET);
-    fread(&block, sizeof(struct block_data), 1, archive);
-    size_t_to_octal(block.isFree, 1); // Mark block as free
-    fwrite(&block, sizeof(struct block_data), 1,
-           archive); // Update block
+  size_t blockCount = octal_to_size_t(info->blockCount);
+
+  if (blockCount > FREE_MAP_CAPACITY) {
+    rebuildFreeMap(header, archive, map);
+    map->preferRuns = flags & ARCHIVE_FLAG_EXTENTS;
+    return;
+  }
+
+  initFreeMap(map, blockCount);
+  map->preferRuns = flags & ARCHIVE_FLAG_EXTENTS;
+
+  for (size_t byte = 0; byte < (blockCount + 7) / 8; byte++) {
+    // only whole bytes with free blocks have to be looked at
+    if (bits[byte] == 0) {
+      continue;
+    }
 
-    (*currentBlockIndex) =
-        octal_to_size_t(block.next); // Move to the next block
+    for (size_t block = byte * 8; block < byte * 8 + 8 && block < blockCount;
+         block++) {
+      if ((bits[byte] >> (block % 8)) & 1) {
+        releaseBlock(map, block);
+      }
+    }
   }
+
+  snprintf(message, 100, "free map loaded with %zu free blocks out of %zu",
+           map->freeCount, map->blockCount);
+  logVerbose(message);
 }
 
 /**
- * @description: will update the blocks when file size is bigger. This requires
- * to find free blocks or allocate new blocks in the file.
- * @parameter: (filename) the name of the file updating
- * @parameter: (existingBlocks) the amount of current existing blocks
- * @parameter: (currentBlockIndex) the current block position of the file
- * @parameter: (newNumBlocks) the new amount of blocks required
+ * @description: builds the free map following the chain of every file. Any
+ * block that is not reachable from the FAT table is free.
+ * @parameter: (header) the FAT header of the tar file
  * @parameter: (archive) the tar FILE
- * @parameter: (inputFile) the new FILE
+ * @parameter: (map) the free map to be set
  * @output: n/a
  */
-void updateWhenFileSizeIsGreater(char *filename, size_t existingBlocks,
-                                 size_t currentBlockIndex, size_t newNumBlocks,
-                                 FILE *archive, FILE *inputFile) {
+void rebuildFreeMap(struct posix_header *header, FILE *archive,
+                    struct free_map *map) {
   char message[100];
 
+  fseek(archive, 0, SEEK_END);
+  long endPos = ftell(archive);
+
   size_t blockCount = 0;
-  size_t lastBlockIndex = 0;
 
-  overwriteExistingBlocks(filename, &currentBlockIndex, &blockCount,
-                          &newNumBlocks, archive, inputFile);
+  if (endPos > MAX_HEADER_SIZE) {
+    blockCount = (endPos - MAX_HEADER_SIZE + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  }
 
-  snprintf(message, 100, "starting to add new blocks for file %s", filename);
-  logVerbose(message);
+  initFreeMap(map, blockCount);
 
-  fseek(archive, 0, SEEK_END);
+  for (size_t block = 0; block < blockCount; block++) {
+    releaseBlock(map, block);
+  }
 
-  // This is where new blocks will start
-  size_t appendPosition = ftell(archive);
+  for (size_t i = 0; i < header->count; i++) {
+    if (blocksForSize(field_to_size_t(header->files[i].size)) == 0) {
+      continue;
+    }
 
-  size_t firstPosition = (appendPosition - (MAX_HEADER_SIZE)) / (BLOCK_SIZE);
+    size_t currentBlockIndex = field_to_size_t(header->files[i].blockAddress);
 
-  updateAtNewBlocks(blockCount, newNumBlocks, &appendPosition, inputFile,
-                    archive, filename);
+    // a block already in use means the chain is broken and loops
+    while (currentBlockIndex < blockCount &&
+           isBlockFree(map, currentBlockIndex)) {
+      markBlockUsed(map, currentBlockIndex);
 
-  appendPosition = ftell(archive);
+      currentBlockIndex = readBlockNext(archive, currentBlockIndex);
 
-  if (existingBlocks > 0) {
-    linkUpdatedBlocks(lastBlockIndex, firstPosition, archive, filename);
+      if (currentBlockIndex == 0) {
+        break;
+      }
+    }
   }
+
+  snprintf(message, 100, "free map rebuilt with %zu free blocks out of %zu",
+           map->freeCount, map->blockCount);
+  logVerbose(message);
 }
 
 /**
- * @description: will add new blocks for the updated file
- * @parameter: (blockCount) the counter for blocks
- * @parameter: (newNumBlocks) the new amount of blocks required
- * @parameter: (appendPosition) the current block position. This will be set in
- * the function.
- * @parameter: (inputFile) the new FILE
- * @parameter: (archive) the tar FILE
- * @parameter: (filename) the name of the updated file
+ * @description: stores the free map in the header, right after the FAT table.
+ * If the archive has more blocks than the space left in the header, the map is
+ * not stored and it will be rebuilt the next time the archive is opened.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (map) the free map to be stored
  * @output: n/a
  */
-void updateAtNewBlocks(size_t blockCount, size_t newNumBlocks,
-                       size_t *appendPosition, FILE *inputFile, FILE *archive,
-                       char *filename) {
-  char message[100];
-  struct block_data newBlock;
-
-  for (; blockCount < newNumBlocks; blockCount++) {
-    size_t pos = ((*appendPosition) - (MAX_HEADER_SIZE)) / (BLOCK_SIZE);
-
-    memset(&newBlock, 0, sizeof(newBlock));
-
-    // Read file content into block
-    size_t readSize = fread(newBlock.data, 1, BLOCK_SIZE - 24, inputFile);
-
-    if (blockCount < newNumBlocks - 1) {
-      size_t_to_octal(newBlock.next, pos + +1);
-    } else {
-      size_t_to_octal(newBlock.next, 0);
-    }
+void storeFreeMap(struct posix_header *header, struct free_map *map) {
+  struct free_map_info *info =
+      (struct free_map_info *)header->tail;
+  size_t flags = archiveFlags(header) & ~ARCHIVE_FLAG_NO_FREE_MAP;
+
+  // the count is kept without the map, the dedup index is found with it
+  size_t_to_octal(info->blockCount, map->blockCount);
+
+  if (map->blockCount > FREE_MAP_CAPACITY) {
+    logWarning("the archive is too big to store its free map in the header");
+    setArchiveFlags(header, flags | ARCHIVE_FLAG_NO_FREE_MAP);
+    return;
+  }
 
-    snprintf(message, 100,
-             "new block for %s is at block #%zu and its next will be #%d",
-             filename, pos, (int) octal_to_size_t(newBlock.next));
-    logVerbose(message);
+  setArchiveFlags(header, flags);
 
-    fwrite(&newBlock, BLOCK_SIZE, 1, archive);
-    (*appendPosition) += BLOCK_SIZE;
+  // an empty archive has no map to copy
+  if (map->blockCount > 0) {
+    memcpy(info + 1, map->bits, (map->blockCount + 7) / 8);
   }
 }
 
 /**
- * @description: will link the old blocks with the new ones
- * @parameter: (lastBlockIndex) the last block position
- * @parameter: (firstPosition) the first position of the new block added
- * @parameter: (archive) the tar FILE
- * @parameter: (filename) the name of the updated file
- * @output: n/a
+ * @description: reads the flags of the archive, stored with the free map
+ * @parameter: (header) the FAT header of the tar file
+ * @output: the archive flags, 0 for archives without them
  */
-void linkUpdatedBlocks(size_t lastBlockIndex, size_t firstPosition,
-                       FILE *archive, char *filename) {
-  char message[100];
+size_t archiveFlags(struct posix_header *header) {
+  struct free_map_info *info =
+      (struct free_map_info *)header->tail;
 
-  fseek(archive, MAX_HEADER_SIZE + lastBlockIndex * BLOCK_SIZE, SEEK_SET);
-
-  struct block_data lastBlock;
+  if (memcmp(info->magic, FREE_MAP_MAGIC, sizeof(info->magic)) != 0) {
+    return 0;
+  }
 
-  fread(&lastBlock, BLOCK_SIZE, 1, archive);
+  return octal_to_size_t(info->flags);
+}
 
-  snprintf(message, 100, "new next in %s at block #%zu will be %d", filename,
-           lastBlockIndex, (int) firstPosition);
-  logVerbose(message);
+/**
+ * @description: sets the flags of the archive, stored with the free map
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (flags) the archive flags
+ * @output: n/a
+ */
+void setArchiveFlags(struct posix_header *header, size_t flags) {
+  struct free_map_info *info =
+      (struct free_map_info *)header->tail;
 
-  size_t_to_octal(lastBlock.next, firstPosition);
-  fseek(archive, MAX_HEADER_SIZE + lastBlockIndex * BLOCK_SIZE, SEEK_SET);
-  fwrite(&lastBlock, BLOCK_SIZE, 1, archive);
+  memcpy(info->magic, FREE_MAP_MAGIC, sizeof(info->magic));
+  size_t_to_octal(info->flags, flags);
 }
 
 /**
  * ------------------------------------------
- *          APPEND COMMAND
+ *          EXTENTS
  * ------------------------------------------
  */
-int updateHeader(struct posix_header *header, char *filename) {
-    char message[100];
-
-    // Validación básica de los parámetros de entrada
-    if (!header) {
-        logError("error reading header...");
-        return -1;
-    }
-    if (!filename) {
-        logError("error reading header data...");
-        return -1;
-    }
 
-    // Mensaje de depuración
-    snprintf(message, 100, "updating file header with new file \"%s\"", filename);
-    logVerbose(message);
+/**
+ * @description: prepares an empty list of extents
+ * @parameter: (extents) the list to initialize
+ * @output: n/a
+ */
+void initExtentList(struct extent_list *extents) {
+  memset(extents, 0, sizeof(struct extent_list));
+  extents->isComplete = true;
+}
 
-    // Encuentra una entrada vacía en el encabezado
-    int emptyIndex = -1;
+/**
+ * @description: adds the next block of a file to its extents. The block
+ * extends the last extent when it follows it, otherwise it starts a new one.
+ * Blocks after the last extent that can be recorded are left to the chain.
+ * @parameter: (extents) the list of extents
+ * @parameter: (block) the block index
+ * @output: n/a
+ */
+void addExtentBlock(struct extent_list *extents, size_t block) {
+  if (!extents->isComplete) {
+    return;
+  }
 
-    for (int i = 0; i < MAX_FILES; i++) {
-        snprintf(message, 100, "reading file %s at index #%d", header->files[i].filename, i);
-        logVerbose(message);
+  size_t last = extents->count - 1;
 
-        if (strlen(header->files[i].filename) == 0) {
-            emptyIndex = i;
-            break;
-        }
-    }
+  if (extents->count > 0 &&
+      extents->start[last] + extents->length[last] == block &&
+      extents->length[last] < MAX_EXTENT_VALUE) {
+    extents->length[last]++;
+    return;
+  }
 
-    // Si no se encontró una entrada vacía, el encabezado ya está lleno
-    if (emptyIndex == -1) {
-        logError("there is no more space for files...");
-        return -1;
-    }
+  if (extents->count == MAX_EXTENTS || block > MAX_EXTENT_VALUE) {
+    extents->isComplete = false;
+    return;
+  }
 
-    snprintf(message, 100, "index found is #%d", emptyIndex);
-    logVerbose(message);
+  extents->start[extents->count] = block;
+  extents->length[extents->count] = 1;
+  extents->count++;
+}
 
-    // Actualiza la entrada vacía con la información del nuevo archivo
-    struct posix_file_info info;
+/**
+ * @description: reads the extents recorded at the end of the filename
+ * @parameter: (fileInfo) the info of the file
+ * @parameter: (extents) the list of extents. This will be set in the function
+ * @output: n/a
+ */
+void loadFileExtents(struct posix_file_info *fileInfo,
+                     struct extent_list *extents) {
+  struct file_extent *fileExtents =
+      (struct file_extent *)(fileInfo->filename + EXTENT_NAME_SIZE);
 
-    snprintf(info.filename, sizeof(info.filename), "%s", get_filename(filename));
+  initExtentList(extents);
 
-    // Abrir el archivo para obtener su tamaño
-    FILE *file = fopen(filename, "rb");
+  for (int e = 0; e < MAX_EXTENTS; e++) {
+    size_t length = octal_to_size_t(fileExtents[e].length);
 
-    if (!file) {
-        snprintf(message, 100, "couldn't open file %s", filename);
-        logError(message);
-        return -1;
+    if (length == 0) {
+      break;
     }
 
-    fseek(file, 0, SEEK_END);
-    long fileSize = ftell(file);
-    fclose(file);
-
-    size_t_to_octal(info.size, (size_t) fileSize);
-    size_t_to_octal(info.blockAddress, (size_t) 0);
-
-    header->files[emptyIndex] = info;
-
-    snprintf(message, 100, "file added %s to header at position %d with size %ld bytes", get_filename(filename), emptyIndex, fileSize);
-    logVerbose(message);
+    extents->start[e] = octal_to_size_t(fileExtents[e].start);
+    extents->length[e] = length;
+    extents->count++;
+  }
+}
 
-    return emptyIndex;
+/**
+ * @description: records the extents at the end of the filename
+ * @parameter: (fileInfo) the info of the file
+ * @parameter: (extents) the list of extents
+ * @output: n/a
+ */
+void storeFileExtents(struct posix_file_info *fileInfo,
+                      struct extent_list *extents) {
+  struct file_extent *fileExtents =
+      (struct file_extent *)(fileInfo->filename + EXTENT_NAME_SIZE);
+
+  memset(fileExtents, 0, sizeof(struct file_extent) * MAX_EXTENTS);
+
+  for (size_t e = 0; e < extents->count; e++) {
+    snprintf(fileExtents[e].start, sizeof(fileExtents[e].start), "%07lo",
+             (unsigned long)extents->start[e]);
+    snprintf(fileExtents[e].length, sizeof(fileExtents[e].length), "%07lo",
+             (unsigned long)extents->length[e]);
+  }
 }
 
 /**
- * @description: will add n new archives to the tar file
- * @parameter: (files) the files name to be deleted
- * @parameter: (fileCount) the amount of files to be deleted
- * @parameter: (filename) the tar filename to be listed
+ * @description: writes the header back to the archive together with its free
+ * map, dropping any free block left at the end of the archive. The dedup
+ * index, the checksums and the block table are written after the last block.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archive) the tar FILE
+ * @parameter: (map) the free map of the archive
  * @output: the exit code
  */
-int append(char *files[], int fileCount, char *filename) {
-  char message[100];
-
-  snprintf(message, 100, "starting to add new archives inside %s", filename);
-  logVerbose(message);
-
-  FILE *archive = fopen(filename, "r+b");
-  
-  if (!archive) {
-    logError("Failed to open tar archive file. Double check if the input file "
-             "exists.");
+int commitHeader(struct posix_header *header, FILE *archive,
+                 struct free_map *map) {
+  if (removeFreeBlocksAtEnd(archive, map) != 0) {
     return 1;
   }
 
-  struct posix_header *header = malloc(sizeof(struct posix_header));
-
-  if (!header) {
-    logError("Memory allocation for header failed.");
-    fclose(archive);
+  // the blocks written since the archive was opened get their checksums
+  if (header->checksums &&
+      sealMemberChecksums(header, fileno(archive), map->blockCount) != 0) {
     return 1;
   }
 
-  if (fread(header, MAX_HEADER_SIZE, 1, archive) != 1) {
-    logError("Failed to read header.");
-    free(header);
-    fclose(archive);
+  if (header->blockTable) {
+    fillBlockTable(header, fileno(archive), map->blockCount);
+  }
+
+  if (header->dedup &&
+      storeDedupIndex(header, archive, map->blockCount) != 0) {
     return 1;
   }
 
-  appendFilesByTarFile(header, archive, files, fileCount);
+  if (header->checksums) {
+    fseek(archive, checksumOffset(header, map->blockCount), SEEK_SET);
 
-  free(header);
-  fclose(archive);
+    if (storeBlockChecksums(header, archive, map->blockCount) != 0) {
+      return 1;
+    }
+  }
 
-  return 0;
-}
+  if (header->attributes) {
+    setArchiveFlags(header, archiveFlags(header) | ARCHIVE_FLAG_ATTRIBUTES);
+    fseek(archive,
+          attributesOffset(header, checksumOffset(header, map->blockCount),
+                           map->blockCount),
+          SEEK_SET);
 
-  /**
- * @description: append all the files to a tar file
- * @parameter: (header) the FAT header of the tar file
- * @parameter: (archive) the tar file to be read.
- * @parameter: (files) the files that are going to be append.
- * @parameter: (fileCount) quantity of files to be append.
- * @output: n/a
- */
-void appendFilesByTarFile(struct posix_header *header, FILE *archive, char *files[], int fileCount) {
-    char message[100];
+    if (storeMemberAttributes(header, archive) != 0) {
+      return 1;
+    }
+  }
 
-    // Encuentra el final del archivo
-    fseek(archive, 0, SEEK_END);
-    long endPosition = ftell(archive);
+  if (header->blockTable) {
+    header->blockTableOffset = blockTableOffset(
+        header, checksumOffset(header, map->blockCount), map->blockCount);
 
-    // Calcula el tamaño del encabezado
-    long headerSize = MAX_HEADER_SIZE;
+    fseek(archive, header->blockTableOffset, SEEK_SET);
 
-    // Actualiza el encabezado con información sobre los nuevos archivos
-    int filesAdded = 0;
-    int firstIndex = 0;
+    if (storeBlockTable(header, archive) != 0) {
+      return 1;
+    }
 
-    for (int i = 0; i < MAX_FILES && filesAdded < fileCount; i++) {
-        if (strlen(header->files[i].filename) == 0) {
-          int resultIndex = updateHeader(header, files[filesAdded]);
+    setArchiveFlags(header, archiveFlags(header) | ARCHIVE_FLAG_BLOCK_TABLE);
 
-          if (filesAdded == 0) {
-            firstIndex = resultIndex;
-          }
+    // the block hashes go right after the table
+    if (header->attributes && header->checksums) {
+      if (storeBlockHashes(header, archive) != 0) {
+        return 1;
+      }
 
-          filesAdded++;
-        }
+      setArchiveFlags(header,
+                      archiveFlags(header) | ARCHIVE_FLAG_BLOCK_HASHES);
     }
+  }
 
-    fseek(archive, 0, SEEK_END);
+  storeFreeMap(header, map);
 
-    int blocksCreated = (endPosition - (MAX_HEADER_SIZE)) / (BLOCK_SIZE);
+  return writeHeader(header, archive);
+}
 
-  for (int i = 0; i < fileCount; i++) {
-    struct posix_file_info fileInfo = header->files[firstIndex + i];
+/**
+ * @description: creates an empty header, with no files and no free map. If
+ * there is an error in malloc it returns NULL.
+ * @output: the new header
+ */
+struct posix_header *createEmptyHeader() {
+  struct posix_header *header = malloc(sizeof(struct posix_header));
+
+  if (!header) {
+    logError("Memory allocation for header failed.");
+    return NULL;
+  }
+
+  header->files = NULL;
+  header->count = 0;
+  header->capacity = 0;
+  header->tail = calloc(1, HEADER_TAIL_SIZE);
+  header->dedup = NULL;
+  header->checksums = NULL;
+  header->blockTable = NULL;
+  header->blockTableOffset = -1;
+  header->attributes = NULL;
+
+  if (!header->tail) {
+    logError("Memory allocation for header failed.");
+    free(header);
+    return NULL;
+  }
 
-    int numBlocks = (octal_to_size_t(fileInfo.size) + BLOCK_SIZE - 12 - 1) /
-                    (BLOCK_SIZE - 12);
+  reserveHeader(header, HEADER_READ_ENTRIES);
 
-    snprintf(message, 100,
-             "num blocks [%d] for [%s] because of size [%d / %d]", numBlocks,
-             fileInfo.filename, (int) octal_to_size_t(fileInfo.size),
-             BLOCK_SIZE - 12);
+  return header;
+}
 
-    logVerbose(message);
+/**
+ * @description: reads the header of the archive. Only the bytes used by the
+ * header are read, and archives with the fixed layout are read as well.
+ * @parameter: (archive) the tar FILE
+ * @output: the header, NULL if it couldn't be read
+ */
+struct posix_header *loadHeader(FILE *archive) {
+  char message[100];
+  struct posix_header *header = createEmptyHeader();
 
-    FILE *inputFile = fopen(files[i], "rb");
+  if (!header) {
+    return NULL;
+  }
 
-    size_t bytes_to_read = BLOCK_SIZE - 12 * 2;
+  struct archive_superblock superblock;
 
-    size_t_to_octal(header->files[firstIndex + i].blockAddress, blocksCreated);
+  fseek(archive, 0, SEEK_SET);
 
-    for (int b = 0; b < numBlocks; b++) {
-      struct block_data * block = malloc(sizeof(struct block_data));
+  if (fread(&superblock, sizeof(superblock), 1, archive) != 1) {
+    logError("Failed to read header.");
+    destroyHeader(header);
+    return NULL;
+  }
 
-      if (!block) {
-        logError("Memory allocation for block failed");
-        return;
-      }
+  bool isStream =
+      memcmp(superblock.magic, STREAM_MAGIC, sizeof(superblock.magic)) == 0;
+  bool hasSuperblock =
+      isStream ||
+      memcmp(superblock.magic, ARCHIVE_MAGIC, sizeof(superblock.magic)) == 0;
+  size_t version = octal_to_size_t(superblock.version);
 
-      size_t read = fread(block->data, 1, BLOCK_SIZE - 12 * 2, inputFile);
+  // archives without a superblock are older than the binary numbers
+  isGlobalOctalFields = !hasSuperblock || version == ARCHIVE_VERSION_OCTAL;
 
-      // Zero-fill the rest of the block
-      if (read < BLOCK_SIZE - 12 * 2) {
-        memset(block->data + read, 0, (BLOCK_SIZE - 12 * 2) - read);
-      }
+  if (isStream) {
+    if (version != ARCHIVE_VERSION && version != ARCHIVE_VERSION_OCTAL) {
+      snprintf(message, 100, "unsupported archive header version %zu",
+               version);
+      logError(message);
+      destroyHeader(header);
+      return NULL;
+    }
 
-      int nextBlock = b + 1 < numBlocks ? blocksCreated + b + 1 : 0;
+    if (loadStreamIndex(header, archive) != 0) {
+      destroyHeader(header);
+      return NULL;
+    }
 
-      snprintf(message, sizeof(message), "block #%d", blocksCreated + b);
-      logVerbose(message);
+    return header;
+  }
 
-      size_t_to_octal(block->next, nextBlock);
-      size_t_to_octal(block->isFree, 0);
+  if (!hasSuperblock) {
+    logVerbose("archive with the fixed header layout, it will be converted "
+               "when written");
 
-      // Write block to output file
-      fwrite(block, BLOCK_SIZE, 1, archive);
+    fseek(archive, 0, SEEK_SET);
 
-      free(block);
+    if (readHeaderEntries(header, archive, MAX_FILES) != 0 ||
+        readHeaderTail(header, archive, FAT_TABLE_SIZE, HEADER_TAIL_SIZE) !=
+            0) {
+      destroyHeader(header);
+      return NULL;
     }
 
-    blocksCreated += numBlocks;
+    return header;
+  }
 
-    fclose(inputFile);
+  size_t entryCount = octal_to_size_t(superblock.entryCount);
+  size_t entrySize = octal_to_size_t(superblock.entrySize);
+  size_t headerLength = octal_to_size_t(superblock.headerLength);
+  size_t entriesEnd =
+      sizeof(struct archive_superblock) + entryCount * entrySize;
+
+  if ((version != ARCHIVE_VERSION && version != ARCHIVE_VERSION_OCTAL) ||
+      entrySize != sizeof(struct posix_file_info) || entryCount > MAX_FILES ||
+      headerLength < entriesEnd ||
+      headerLength - entriesEnd > HEADER_TAIL_SIZE) {
+    snprintf(message, 100, "unsupported archive header version %zu", version);
+    logError(message);
+    destroyHeader(header);
+    return NULL;
   }
 
-    // Escribe el encabezado actualizado al principio del archivo TAR
-    fseek(archive, 0, SEEK_SET);
-    fwrite(header, MAX_HEADER_SIZE, 1, archive);
+  if (readHeaderEntries(header, archive, entryCount) != 0 ||
+      header->count != entryCount ||
+      readHeaderTail(header, archive, entriesEnd, headerLength - entriesEnd) !=
+          0) {
+    logError("Failed to read header.");
+    destroyHeader(header);
+    return NULL;
+  }
 
-    snprintf(message, sizeof(message), "%d files added", fileCount);
-    logVerbose(message);
-}
+  snprintf(message, 100, "header of %zu bytes with %zu files", headerLength,
+           entryCount);
+  logVerbose(message);
 
+  struct free_map_info *info = (struct free_map_info *)header->tail;
+  size_t blockCount = octal_to_size_t(info->blockCount);
 
-/**
- * ------------------------------------------
- *          PACK COMMAND
- * ------------------------------------------
- */
+  long offset = checksumOffset(header, blockCount);
+
+  // the attributes and the table go after the checksums, even if they
+  // can't be loaded
+  findBlockTable(header, archive,
+                 blockTableOffset(header, offset, blockCount));
+  loadMemberAttributes(header, archive,
+                       attributesOffset(header, offset, blockCount));
+  loadBlockChecksums(header, archive, offset, blockCount);
+
+  return header;
+}
 
 /**
- * @description: will desfragment the tar file to free unused space
- * @parameter: (filename) the tar filename to be listed
+ * @description: reads the header of an archive written as a stream, which is
+ * after its last block. The footer at the end of the archive tells where it
+ * starts. The header is written back at the start the first time the archive
+ * changes, and the index after the blocks is dropped.
+ * @parameter: (header) the FAT header. The entries will be added to it.
+ * @parameter: (archive) the tar FILE
  * @output: the exit code
  */
-int pack(char *filename) {
+int loadStreamIndex(struct posix_header *header, FILE *archive) {
   char message[100];
-  snprintf(message, 100, "starting to desfragment the tar file %s", filename);
-  logVerbose(message);
+  struct stream_footer footer;
 
-  FILE *archive = fopen(filename, "r+b");
-
-  if (archive == NULL) {
-    snprintf(message, 100, "error opening the tar file. %s", filename);
-    logError(message);
+  if (fseek(archive, -(long)sizeof(footer), SEEK_END) != 0 ||
+      fread(&footer, sizeof(footer), 1, archive) != 1 ||
+      memcmp(footer.magic, STREAM_FOOTER_MAGIC, sizeof(footer.magic)) != 0) {
+    logError("the index of the archive is missing, it may be truncated");
     return 1;
   }
 
-  struct posix_header *header = malloc(sizeof(struct posix_header));
+  size_t entryCount = octal_to_size_t(footer.entryCount);
+  size_t blockCount = octal_to_size_t(footer.blockCount);
+  size_t tailLength = octal_to_size_t(footer.tailLength);
+  long entriesStart = blockOffset(blockCount);
 
-  if (!header) {
-    logError("memory allocation for header failed.");
-    fclose(archive);
+  if (entryCount > MAX_FILES || tailLength > HEADER_TAIL_SIZE) {
+    logError("the index of the archive is corrupted");
     return 1;
   }
 
-  if (fread(header, MAX_HEADER_SIZE, 1, archive) != 1) {
-    logError("failed to read header.");
-    free(header);
-    fclose(archive);
-    return 1;
-  }
+  fseek(archive, entriesStart, SEEK_SET);
 
-  // Check and remove free blocks at the end of the file
-  if (removeFreeBlocksAtEnd(archive, header) != 0) {
-    free(header);
-    fclose(archive);
+  if (readHeaderEntries(header, archive, entryCount) != 0 ||
+      header->count != entryCount ||
+      readHeaderTail(header, archive,
+                     entriesStart +
+                         entryCount * sizeof(struct posix_file_info),
+                     tailLength) != 0) {
+    logError("Failed to read the index of the archive.");
     return 1;
   }
 
-  size_t endPos = ftell(archive);
+  snprintf(message, 100, "streamed archive with %zu files in %zu blocks",
+           entryCount, blockCount);
+  logVerbose(message);
 
-  for (int i = 0; i < MAX_FILES && strlen(header->files[i].filename) > 0; i++) {
-    snprintf(message, 100, "reading info of file %s",
-             header->files[i].filename);
-    logVerbose(message);
+  // the checksums, the attributes and the block table are between the header
+  // and the footer
+  long offset = entriesStart + entryCount * sizeof(struct posix_file_info) +
+                tailLength;
 
-    // Determine the first free block and save its position
-    long firstFreeBlockPosition = -1;
-    long currentPos = MAX_HEADER_SIZE;
+  findBlockTable(header, archive,
+                 blockTableOffset(header, offset, blockCount));
+  loadMemberAttributes(header, archive,
+                       attributesOffset(header, offset, blockCount));
+  loadBlockChecksums(header, archive, offset, blockCount);
 
-    while (currentPos < endPos) {
-      struct block_data block;
+  return 0;
+}
 
-      fseek(archive, currentPos, SEEK_SET);
-      fread(&block, BLOCK_SIZE, 1, archive);
+/**
+ * @description: reads the FAT entries from the current position, in chunks,
+ * until an empty entry is found or the maximum amount of entries is read
+ * @parameter: (header) the FAT header. The entries will be added to it.
+ * @parameter: (archive) the tar FILE
+ * @parameter: (maxEntries) the maximum amount of entries to read
+ * @output: the exit code
+ */
+int readHeaderEntries(struct posix_header *header, FILE *archive,
+                      size_t maxEntries) {
+  while (header->count < maxEntries) {
+    size_t chunk = maxEntries - header->count < HEADER_READ_ENTRIES
+                       ? maxEntries - header->count
+                       : HEADER_READ_ENTRIES;
 
-      if (octal_to_size_t(block.isFree) == 1) {
-        firstFreeBlockPosition = currentPos;
-        break;
-      }
+    reserveHeader(header, header->count + chunk);
 
-      currentPos += BLOCK_SIZE;
-    }
+    struct posix_file_info *entries = &header->files[header->count];
 
-    if (firstFreeBlockPosition == -1) {
-      logVerbose("no more free blocks available.");
-      break;
+    if (fread(entries, sizeof(struct posix_file_info), chunk, archive) !=
+        chunk) {
+      logError("Failed to read header.");
+      return 1;
     }
 
-    snprintf(message, 100, "found a free block at %d", (int) firstFreeBlockPosition);
-    logVerbose(message);
-
-    // Save the previous blockAddress
-    size_t previousBlockAddress =
-        octal_to_size_t(header->files[i].blockAddress);
+    size_t used = 0;
 
-    // Set the header's blockAddress to the first free block
-    size_t_to_octal(header->files[i].blockAddress, firstFreeBlockPosition);
-
-    snprintf(message, 100, "updated block address for %s from %ld to %ld",
-             header->files[i].filename, previousBlockAddress,
-             firstFreeBlockPosition);
-    logVerbose(message);
+    while (used < chunk && strlen(entries[used].filename) > 0) {
+      used++;
+    }
 
-    size_t targetBlockAddress = firstFreeBlockPosition;
+    header->count += used;
 
-    while (previousBlockAddress != 0) {
-      struct block_data block;
+    if (used < chunk) {
+      break;
+    }
+  }
 
-      fseek(archive, previousBlockAddress, SEEK_SET);
-      fread(&block, BLOCK_SIZE, 1, archive);
+  // the entries read after the last file are not kept
+  memset(&header->files[header->count], 0,
+         (header->capacity - header->count) * sizeof(struct posix_file_info));
 
-      // Move block to the target address
-      size_t nextBlockAddress = octal_to_size_t(block.next);
+  return 0;
+}
 
-      size_t_to_octal(block.next, targetBlockAddress / (BLOCK_SIZE));
+/**
+ * @description: reads the free map stored after the FAT entries
+ * @parameter: (header) the FAT header
+ * @parameter: (archive) the tar FILE
+ * @parameter: (offset) the position of the free map in the archive
+ * @parameter: (length) the amount of bytes used by the free map
+ * @output: the exit code
+ */
+int readHeaderTail(struct posix_header *header, FILE *archive, long offset,
+                   size_t length) {
+  if (length == 0) {
+    return 0;
+  }
 
-      fseek(archive, targetBlockAddress, SEEK_SET);
-      fwrite(&block, BLOCK_SIZE, 1, archive);
+  fseek(archive, offset, SEEK_SET);
 
-      // Log the move
-      snprintf(message, 100, "moved block from %ld to %ld",
-               previousBlockAddress / (BLOCK_SIZE),
-               targetBlockAddress / (BLOCK_SIZE));
+  if (fread(header->tail, length, 1, archive) != 1) {
+    logError("Failed to read header.");
+    return 1;
+  }
 
-      logVerbose(message);
+  return 0;
+}
 
-      // Prepare for the next iteration
-      previousBlockAddress = nextBlockAddress;
-      targetBlockAddress += BLOCK_SIZE;
-    }
+/**
+ * @description: writes the header at the start of the archive, using only the
+ * bytes needed by the files and the free map
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (archive) the tar FILE
+ * @output: the exit code
+ */
+int writeHeader(struct posix_header *header, FILE *archive) {
+  struct archive_superblock superblock;
+  size_t tailLength = headerTailLength(header);
+
+  // archives keep the format of their blocks, which are never rewritten
+  size_t version = isGlobalOctalFields ? ARCHIVE_VERSION_OCTAL
+                                       : ARCHIVE_VERSION;
+
+  memset(&superblock, 0, sizeof(superblock));
+  memcpy(superblock.magic, ARCHIVE_MAGIC, sizeof(superblock.magic));
+  size_t_to_octal(superblock.version, version);
+  size_t_to_octal(superblock.entryCount, header->count);
+  size_t_to_octal(superblock.entrySize, sizeof(struct posix_file_info));
+  size_t_to_octal(superblock.headerLength,
+                  sizeof(superblock) +
+                      header->count * sizeof(struct posix_file_info) +
+                      tailLength);
 
-    // Mark the last block of this file as free and update in the archive
-    struct block_data block;
+  fseek(archive, 0, SEEK_SET);
 
-    memset(&block, 0, sizeof(block));
-    size_t_to_octal(block.isFree, 1);
+  if (fwrite(&superblock, sizeof(superblock), 1, archive) != 1 ||
+      fwrite(header->files, sizeof(struct posix_file_info), header->count,
+             archive) != header->count ||
+      fwrite(header->tail, 1, tailLength, archive) != tailLength) {
+    logError("failed to write header.");
+    return 1;
+  }
 
-    fseek(archive, targetBlockAddress - BLOCK_SIZE, SEEK_SET);
-    fwrite(&block, BLOCK_SIZE, 1, archive);
+  return 0;
+}
 
-    // Log final block update
-    snprintf(message, 100, "last block at %ld marked as free",
-             targetBlockAddress - sizeof(struct block_data));
-    logVerbose(message);
+/**
+ * @description: calculates the bytes used by the free map and the flags
+ * @parameter: (header) the FAT header of the tar file
+ * @output: the amount of bytes to store after the FAT entries
+ */
+size_t headerTailLength(struct posix_header *header) {
+  struct free_map_info *info = (struct free_map_info *)header->tail;
 
-    // Update header's block address to new starting position
-    size_t_to_octal(header->files[i].blockAddress, firstFreeBlockPosition);
+  if (memcmp(info->magic, FREE_MAP_MAGIC, sizeof(info->magic)) != 0) {
+    return 0;
   }
 
-  // Check and remove free blocks at the end of the file
-  if (removeFreeBlocksAtEnd(archive, header) != 0) {
-    free(header);
-    fclose(archive);
-    return 1;
+  if (archiveFlags(header) & ARCHIVE_FLAG_NO_FREE_MAP) {
+    return sizeof(struct free_map_info);
   }
 
-  // rewrite the header with new directions
-  fseek(archive, 0, SEEK_SET);
-  fwrite(header, MAX_HEADER_SIZE, 1, archive);
-
-  free(header);
-  fclose(archive);
-
-  logVerbose("file desfragmented successfully");
-
-  return 0;
+  return sizeof(struct free_map_info) +
+         (octal_to_size_t(info->blockCount) + 7) / 8;
 }
 
 /**
- * @description: will remove unused blocks at the end of file
- * @parameter: (archive) the tar FILE
- * @parameter: (header) the tar FAT header
- * @output: the exit code
+ * @description: grows the FAT table so it can hold at least the amount of
+ * files requested. If there is an error in realloc it will exit the program.
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (entries) the minimum amount of files the table must hold
+ * @output: n/a
  */
-int removeFreeBlocksAtEnd(FILE *archive, struct posix_header *header) {
-  char message[100];
+void reserveHeader(struct posix_header *header, size_t entries) {
+  if (entries <= header->capacity) {
+    return;
+  }
 
-  // Seek to the end of the file to find the last block
-  fseek(archive, 0, SEEK_END);
-  long end_pos = ftell(archive);
+  size_t capacity = header->capacity > 0 ? header->capacity : 64;
 
-  long current_pos = end_pos - BLOCK_SIZE;
-  int counter = 0;
+  while (capacity < entries) {
+    capacity *= 2;
+  }
 
-  while (current_pos >= MAX_HEADER_SIZE) {
-    struct block_data block;
+  struct posix_file_info *files =
+      realloc(header->files, capacity * sizeof(struct posix_file_info));
 
-    fseek(archive, current_pos, SEEK_SET);
-    fread(&block, BLOCK_SIZE, 1, archive);
+  if (files == NULL) {
+    logError("memory allocation for header failed");
+    exit(EXIT_FAILURE);
+  }
 
-    if (octal_to_size_t(block.isFree) == 0) {
-      break;
-    }
+  memset(files + header->capacity, 0,
+         (capacity - header->capacity) * sizeof(struct posix_file_info));
 
-    snprintf(message, 100, "block #%ld will be removed",
-             current_pos / (BLOCK_SIZE));
-    logVerbose(message);
+  header->files = files;
+  header->capacity = capacity;
+}
 
-    current_pos -= BLOCK_SIZE;
-    counter++;
+/**
+ * @description: releases the memory used by a header
+ * @parameter: (header) the header to destroy
+ * @output: n/a
+ */
+void destroyHeader(struct posix_header *header) {
+  if (header->dedup) {
+    destroyDedupIndex(header->dedup);
+    free(header->dedup);
   }
-  snprintf(message, 100, "found %d free blocks at the end", counter);
-  logVerbose(message);
 
-  if (counter > 0) {
+  if (header->checksums) {
+    destroyBlockChecksums(header->checksums);
+    free(header->checksums);
+  }
 
-    if (ftruncate(fileno(archive), current_pos) != 0) {
-      return -1;
-    }
+  if (header->blockTable) {
+    destroyBlockTable(header->blockTable);
+    free(header->blockTable);
   }
 
-  return 0;
+  if (header->attributes) {
+    destroyMemberAttributes(header->attributes);
+    free(header->attributes);
+  }
+
+  free(header->files);
+  free(header->tail);
+  free(header);
 }
 
 /**
@@ -1274,6 +8964,7 @@ int displayHelp() {
   printf("\nExamples:\n");
   printf("\tstar %s html-paq.tar index.html\n", textExampleCreateFilesFlags);
   printf("\tstar %s xxx.tar\n", textExampleExtractFilesFlags);
+  printf("\tstar %s xxx.tar data.dat\n", textExampleExtractFilesFlags);
   printf("\tstar %s foo.tar doc1.txt doc2.txt data.dat\n",
          textExampleCreateFilesFlags);
   printf("\tstar %s foo.tar data.dat\n", textExampleDeleteFilesFlags);
@@ -1287,10 +8978,35 @@ int displayHelp() {
   printf("\t-u, --update: update the contents of an archive\n");
   printf("\t-v, --verbose: display a verbose progress report\n");
   printf("\t-f, --file: archive contents from/to a file, if not present "
-         "assumes standard input\n");
+         "the archive is streamed to standard output when creating\n");
   printf("\t-r, --append: append contents to an archive\n");
   printf(
       "\t-p, --pack: pack the contents of an archive (not present in tar)\n");
+  printf("\t--verify: check the chains and the checksums of every block of an "
+         "archive (not present in tar)\n");
+  printf("\t--batch: apply the add, update, delete and extract operations "
+         "listed in a file or stdin, writing the header once (not present in "
+         "tar)\n");
+  printf("\t--read: write a range of a member to standard output, seeking "
+         "straight to its blocks (not present in tar)\n");
+  printf("\t--offset N, --length M: the range --read writes, from byte N "
+         "and up to M bytes\n");
+  printf("\t--extents: store each file as contiguous extents when creating\n");
+  printf("\t--mmap: read the archive mapped in memory when extracting or "
+         "listing\n");
+  printf("\t--jobs N: create or extract the files using N workers\n");
+  printf("\t--direct: read and write the archive blocks bypassing the page "
+         "cache when creating, extracting or packing\n");
+  printf("\t--async: keep many block reads and writes in flight with io_uring "
+         "when creating, extracting, appending or packing\n");
+  printf("\t--stream: write the header after the blocks when creating, so the "
+         "archive can go through a pipe\n");
+  printf("\t-z, --compress: compress the blocks with zlib when creating, using "
+         "a thread per CPU or --jobs N threads\n");
+  printf("\t--dedup: store identical blocks once when creating, appending "
+         "and updating the archive\n");
+  printf("\t--hash: when updating, hash the files that kept their size "
+         "instead of trusting their modification time\n");
 
   // free the memory
   free(textUsageOption);
@@ -1311,16 +9027,95 @@ int displayHelp() {
  */
 
 /**
- * @description: out of a string octal it will return the number
+ * @description: out of a string octal it will return the number. Every one of
+ * the 11 digits a field can hold is looked at, and the ones after the first
+ * character that isn't a digit are masked out instead of stopping there, so
+ * there are no branches that depend on the value.
  * @parameter: (octal) octal number in string format
  * @output: octal in number
  */
-size_t octal_to_size_t(char *octal) {
+size_t octal_to_size_t(const char *octal) {
   size_t size = 0;
-  sscanf(octal, "%zo", &size);
+  size_t isDigit = 1;
+
+  for (int i = 0; i < FIELD_SIZE - 1; i++) {
+    size_t digit = (size_t)(unsigned char)octal[i] - '0';
+
+    isDigit &= digit < 8;
+
+    // all ones while the digits last, and 0 from the first other character
+    size_t keep = -isDigit;
+
+    size = (((size << 3) | (digit & 7)) & keep) | (size & ~keep);
+  }
+
   return size;
 }
 
+/**
+ * @description: reads a number of a block or an entry. Version 2 archives
+ * keep it as a little-endian 64 bit integer, version 1 archives in octal.
+ * @parameter: (field) the 12 bytes of the number
+ * @output: the number
+ */
+size_t field_to_size_t(const char *field) {
+  if (isGlobalOctalFields) {
+    return octal_to_size_t(field);
+  }
+
+  uint64_t value;
+
+  memcpy(&value, field, sizeof(value));
+
+  return le64toh(value);
+}
+
+/**
+ * @description: writes a number of a block or an entry in the format of the
+ * archive in use
+ * @parameter: (field) the 12 bytes to be set
+ * @parameter: (value) the numeric value
+ * @output: n/a
+ */
+void size_t_to_field(char *field, size_t value) {
+  if (isGlobalOctalFields) {
+    size_t_to_octal(field, value);
+    return;
+  }
+
+  uint64_t encoded = htole64(value);
+
+  memcpy(field, &encoded, sizeof(encoded));
+  memset(field + sizeof(encoded), 0, FIELD_SIZE - sizeof(encoded));
+}
+
+/**
+ * @description: checks that a name fits in the entry of a member. Archives
+ * with the extent layout keep the extents at the end of the name, so their
+ * names are shorter. A name that doesn't fit is rejected instead of being
+ * cut, since the member couldn't be found by its name afterwards.
+ * @parameter: (name) the name of the member
+ * @parameter: (useExtents) the archive has the extent layout
+ * @output: true if the name fits
+ */
+bool isMemberNameValid(const char *name, bool useExtents) {
+  char message[100];
+  struct posix_file_info fileInfo;
+  size_t maxLength =
+      (useExtents ? EXTENT_NAME_SIZE : sizeof(fileInfo.filename)) - 1;
+
+  if (strlen(name) <= maxLength) {
+    return true;
+  }
+
+  snprintf(message, sizeof(message),
+           "the name %.32s... is longer than %zu characters%s", name, maxLength,
+           useExtents ? " with extents" : "");
+  logError(message);
+
+  return false;
+}
+
 /**
  * @description: removes the path directory out of a path to get the filename
  * @parameter: (path) the full path
@@ -1342,4 +9137,169 @@ const char *get_filename(const char *path) {
  */
 void size_t_to_octal(char *buffer, size_t value) {
   snprintf(buffer, 12, "%011lo", value);
-}
\ No newline at end of file
+}
+
+/**
+ * @description: calculates how many blocks are needed to store a file
+ * @parameter: (size) the size of the file in bytes
+ * @output: the amount of blocks
+ */
+size_t blocksForSize(size_t size) {
+  return (size + BLOCK_DATA_SIZE - 1) / BLOCK_DATA_SIZE;
+}
+
+/**
+ * @description: calculates where a block starts inside the tar file
+ * @parameter: (blockIndex) the block index
+ * @output: the offset of the block in bytes
+ */
+long blockOffset(size_t blockIndex) {
+  return MAX_HEADER_SIZE + (long)blockIndex * BLOCK_SIZE;
+}
+
+/**
+ * @description: reads the next pointer of a block without reading its data
+ * @parameter: (archive) the tar FILE
+ * @parameter: (blockIndex) the block index
+ * @output: the index of the next block, 0 if it is the last one
+ */
+size_t readBlockNext(FILE *archive, size_t blockIndex) {
+  char next[12];
+
+  fseek(archive, blockOffset(blockIndex), SEEK_SET);
+
+  if (fread(next, sizeof(next), 1, archive) != 1) {
+    return 0;
+  }
+
+  return field_to_size_t(next);
+}
+
+/**
+ * @description: reads the next pointer of a block with pread, so it can be
+ * used by several threads sharing the archive
+ * @parameter: (archiveFd) the file descriptor of the archive
+ * @parameter: (blockIndex) the block index
+ * @output: the index of the next block, 0 if it is the last one
+ */
+size_t preadBlockNext(int archiveFd, size_t blockIndex) {
+  char next[12];
+
+  if (pread(archiveFd, next, sizeof(next), blockOffset(blockIndex)) !=
+      sizeof(next)) {
+    return 0;
+  }
+
+  return field_to_size_t(next);
+}
+
+/**
+ * @description: writes the next pointer of a block without touching its data
+ * @parameter: (archive) the tar FILE
+ * @parameter: (blockIndex) the block index
+ * @parameter: (nextBlockIndex) the new next block index
+ * @output: n/a
+ */
+void writeBlockNext(FILE *archive, size_t blockIndex, size_t nextBlockIndex) {
+  char next[12];
+
+  size_t_to_field(next, nextBlockIndex);
+
+  fseek(archive, blockOffset(blockIndex), SEEK_SET);
+  fwrite(next, sizeof(next), 1, archive);
+}
+
+/**
+ * @description: shows how much of the archive is left in the page cache, to
+ * compare direct I/O with the default path. Only done in verbose mode. The
+ * archive is opened again because it may be open only for writing.
+ * @parameter: (filename) the tar filename
+ * @output: n/a
+ */
+void logArchiveCache(const char *filename) {
+  char message[100];
+  struct stat status;
+
+  if (!isGlobalVerbosed) {
+    return;
+  }
+
+  int archiveFd = open(filename, O_RDONLY | O_CLOEXEC);
+
+  if (archiveFd < 0) {
+    return;
+  }
+
+  if (fstat(archiveFd, &status) == 0) {
+    snprintf(message, sizeof(message),
+             "%.1f MB of the %.1f MB archive in the page cache",
+             cachedBytes(archiveFd) / (1024.0 * 1024.0),
+             status.st_size / (1024.0 * 1024.0));
+    logVerbose(message);
+  }
+
+  close(archiveFd);
+}
+
+/**
+ * @description: creates the pool of block buffers
+ * @output: n/a
+ */
+void initBlockPool() {
+  isBlockPoolReady =
+      initBufferPool(&blockPool, BLOCK_SIZE, BLOCK_POOL_SIZE) == 0;
+}
+
+/**
+ * @description: takes consecutive block buffers from the pool, creating it the
+ * first time. The buffers are page aligned and reused between calls, and
+ * allocated apart when the pool is full.
+ * @parameter: (count) the amount of blocks the buffer must hold
+ * @output: the buffer, NULL if it couldn't be allocated
+ */
+void *acquireBlockBuffers(size_t count) {
+  pthread_once(&blockPoolOnce, initBlockPool);
+
+  if (!isBlockPoolReady) {
+    return NULL;
+  }
+
+  return acquireBuffers(&blockPool, count);
+}
+
+/**
+ * @description: gives back block buffers to the pool
+ * @parameter: (buffer) the buffer taken with acquireBlockBuffers
+ * @parameter: (count) the amount of blocks of the buffer
+ * @output: n/a
+ */
+void releaseBlockBuffers(void *buffer, size_t count) {
+  releaseBuffers(&blockPool, buffer, count);
+}
+
+/**
+ * @description: releases the pool of block buffers, if it was created
+ * @output: n/a
+ */
+void destroyBlockPool() {
+  if (isBlockPoolReady) {
+    destroyBufferPool(&blockPool);
+    isBlockPoolReady = false;
+  }
+}
+
+/**
+ * @description: builds the name index of the header, so files can be found
+ * by their name without going through the whole table
+ * @parameter: (header) the FAT header of the tar file
+ * @parameter: (index) the name index to be set
+ * @output: n/a
+ */
+void buildNameIndex(struct posix_header *header, struct name_index *index) {
+  initNameIndex(index, header->files[0].filename,
+                sizeof(struct posix_file_info));
+
+  for (size_t i = 0; i < header->count; i++) {
+    addName(index, i);
+  }
+}
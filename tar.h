@@ -2,86 +2,687 @@
 #define SO_TAR_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
 struct posix_header;
 struct posix_file_info;
+struct free_map;
+struct extent_list;
+struct archive_map;
+struct name_index;
+struct block_data;
+struct create_job;
+struct extract_job;
+struct block_stream;
+struct member_copy;
+struct chain_reader;
+struct read_slot;
+struct io_request;
+struct codec_batch;
+struct dedup_index;
+struct block_checksums;
+struct verify_job;
+struct block_table;
+struct star_archive;
+struct batch_operation;
+struct member_change;
+struct block_delta;
+struct stat;
+
+// the operations a batch can apply to an archive
+typedef enum {
+  BATCH_ADD = 0,
+  BATCH_UPDATE,
+  BATCH_DELETE,
+  BATCH_EXTRACT,
+  BATCH_OPERATION_COUNT
+} BatchOperation;
+
+// set when new archives record the extents of their files
+extern bool isGlobalExtentLayout;
+extern bool isGlobalMappedRead;
+extern bool isGlobalDirectIO;
+extern bool isGlobalAsyncIO;
+extern bool isGlobalStreamOutput;
+extern bool isGlobalCompress;
+extern bool isGlobalDedup;
+extern bool isGlobalHashCheck;
+extern int globalJobCount;
 
 // Command Functions
 int displayHelp();
 int create(char *files[], int fileCount, char *filename);
-int extract(char *filename);
+int extract(char *files[], int fileCount, char *filename);
 int list(char *filename);
 int delete(char *files[], int fileCount, char *filename);
 int update(char *files[], int fileCount, char *filename);
 int append(char *files[], int fileCount, char *filename);
 int pack(char *filename);
+int verify(char *filename);
+int batch(char *files[], int fileCount, char *filename);
 
 // Utility functions
 
 // octal string to number
-size_t octal_to_size_t(char *octal);
+size_t octal_to_size_t(const char *octal);
 
 // removes the path out of a string to get the filename
 const char *get_filename(const char *path);
 
+// tells if a name fits in the entry of a member
+bool isMemberNameValid(const char *name, bool useExtents);
+
 // number to octal string
 void size_t_to_octal(char *buffer, size_t value);
 
+// number of a block or an entry to number, in the format of the archive
+size_t field_to_size_t(const char *field);
+
+// number to number of a block or an entry, in the format of the archive
+void size_t_to_field(char *field, size_t value);
+
 // creates the header using FAT standard
-void createHeader(struct posix_header *file_header, int num_files,
-                  char *input_files[]);
+int createHeader(struct posix_header *file_header, int num_files,
+                 char *input_files[], int inputFds[], size_t *blockCount);
+
+// amount of inputs that can be kept open at once
+size_t inputFdBudget();
+
+// closes the inputs that were kept open
+void closeInputFiles(int inputFds[], int count);
 
 // create FAT Cluster blocks in a file
 int createFATBlocks(struct posix_header *file_header, FILE *output,
-                    int num_files, char *input_files[]);
+                    int directFd, int num_files, char *input_files[],
+                    int inputFds[]);
+
+// writes the blocks of members until there are none left, run by each worker
+void *createWorker(void *argument);
+
+// writes the blocks of a member at the position set in its header entry
+int createMemberBlocks(int archiveFd, struct posix_header *header,
+                       size_t fileIndex, char *inputPath, int inputFd,
+                       bool isDirect);
+
+// writes a new archive in order, with the header after the blocks
+int writeArchiveStream(struct posix_header *header, FILE *output,
+                       int num_files, char *input_files[], int inputFds[]);
+
+// writes the blocks of every member to a streamed archive
+int writeStreamMembers(struct posix_header *header, FILE *output,
+                       int num_files, char *input_files[], int inputFds[]);
+
+// writes the blocks of a member to a streamed archive
+int writeStreamMember(FILE *output, struct posix_header *header,
+                      size_t fileIndex, char *inputPath, int inputFd,
+                      struct block_data *block);
+
+// writes the header and the footer after the blocks of a streamed archive
+int writeStreamIndex(struct posix_header *header, FILE *output,
+                     size_t blockCount);
+
+// writes a block whose data is copied from a file by the kernel
+ssize_t writeBlockData(int archiveFd, size_t blockIndex, size_t nextBlockIndex,
+                       int inputFd, size_t inputOffset, size_t length);
+
+// writes a whole block through a buffer holding its data
+ssize_t writeBufferedBlock(int archiveFd, size_t blockIndex,
+                           size_t nextBlockIndex, int inputFd,
+                           size_t inputOffset, size_t length,
+                           struct block_data *block);
+
+// writes a whole block with O_DIRECT through an aligned buffer
+ssize_t writeDirectBlock(int archiveFd, size_t blockIndex,
+                         size_t nextBlockIndex, int inputFd,
+                         size_t inputOffset, size_t length,
+                         struct block_data *block);
+
+// reads a whole block into an aligned buffer, as O_DIRECT needs
+const struct block_data *readDirectBlock(int archiveFd, size_t blockIndex,
+                                         struct block_data *block);
+
+// writes the blocks of every member through the I/O engine
+int createAsyncBlocks(struct create_job *job);
+
+// prepares a stream of block copies into the archive
+int openBlockStream(struct block_stream *stream, int archiveFd,
+                    bool isDirect);
+
+// queues the copy of a block from a file into the archive
+void queueBlockCopy(struct block_stream *stream, struct member_copy *member,
+                    size_t blockIndex, size_t nextBlockIndex,
+                    size_t inputOffset, size_t length);
+
+// handles a read or write of the block stream that completed
+void handleCopyCompletion(struct block_stream *stream,
+                          struct io_request *request);
+
+// marks that every block of a member was queued
+void finishQueuedMember(struct block_stream *stream,
+                        struct member_copy *member);
+
+// completes a member after its last block was written
+void completeMemberCopy(struct member_copy *member);
+
+// waits for every transfer of the stream and releases it
+int closeBlockStream(struct block_stream *stream);
+
+// copies the data of a block to a file inside the kernel
+int copyBlockData(FILE *archive, size_t blockIndex, FILE *outputFile,
+                  size_t outputOffset, size_t length);
 
 // extract files out of a tar file
-void extractFilesByTarFile(struct posix_header *header, FILE *archive);
+void extractFilesByTarFile(struct posix_header *header, FILE *archive,
+                           struct archive_map *mapped, int directFd,
+                           size_t *members, size_t memberCount);
+
+// extracts members until there are none left, run by each worker
+void *extractWorker(void *argument);
+
+// extracts the members through the I/O engine, reading their chains ahead
+int extractAsyncMembers(struct extract_job *job);
+
+// creates the output of a member and prepares its reader
+void startChainReader(struct chain_reader *reader,
+                      struct posix_file_info *fileInfo,
+                      struct block_checksums *checksums, size_t fileIndex);
+
+// finds the read in flight for a position of a chain
+struct read_slot *findReadSlot(struct read_slot *slots,
+                               struct chain_reader *reader, size_t position);
+
+// handles a block read that completed, writing the blocks in chain order
+void handleChainRead(struct read_slot *slots, struct read_slot *slot);
+
+// stops reading a member
+void finishChainReader(struct read_slot *slots, struct chain_reader *reader);
+
+// drops the reads of a member that are no longer needed
+void dropChainReads(struct read_slot *slots, struct chain_reader *reader);
+
+// selects the members to be extracted, the last one of each name
+size_t *selectMembers(struct posix_header *header, char *files[],
+                      int fileCount, size_t *memberCount,
+                      size_t *missingCount);
+
+// compares two members by their first block
+int compareMemberPositions(const void *first, const void *second);
 
 // extract a single file out of a tar file
-void extractFileByTarFile(FILE *archive, struct posix_file_info *fileInfo);
+void extractFileByTarFile(FILE *archive, struct archive_map *mapped,
+                          int directFd, struct posix_file_info *fileInfo,
+                          bool useExtents, struct block_checksums *checksums,
+                          size_t fileIndex);
+
+// extract the recorded extents of a file
+size_t extractFileExtents(int archiveFd, struct archive_map *mapped,
+                          struct posix_file_info *fileInfo, FILE *outputFile,
+                          struct block_checksums *checksums,
+                          uint32_t *memberChecksum,
+                          size_t *totalBytesWritten);
+
+// extract the recorded extents of a file out of the mapped archive
+size_t extractMappedExtents(struct archive_map *mapped,
+                            struct extent_list *extents,
+                            struct posix_file_info *fileInfo,
+                            FILE *outputFile, struct block_checksums *checksums,
+                            uint32_t *memberChecksum,
+                            size_t *totalBytesWritten);
 
 // updates the block in the tar file
-void updateBlocksInFile(char *files[], int fileCount,
-                        struct posix_header *header, FILE *archive);
+int updateBlocksInFile(char *files[], int fileCount,
+                       struct posix_header *header, FILE *archive,
+                       struct free_map *map, struct name_index *index);
+
+// tells if a file still has the hash found before the update
+bool wasFileKept(FILE *inputFile, struct member_change *change);
+
+// prepares the update of a member that only writes the blocks that changed
+int prepareBlockDelta(struct posix_header *header, int fileIndex,
+                      size_t existingBlocks, size_t newNumBlocks,
+                      struct block_delta *delta);
+
+// takes the hash of a new block and tells if the stored one is the same
+bool isBlockUnchanged(struct block_delta *delta, size_t block,
+                      const char *data, size_t length);
+
+// records a block of the member visited by the delta
+void recordDeltaBlock(struct block_delta *delta, size_t block, size_t position,
+                      const struct block_data *data, bool isWritten);
+
+// keeps the checksum, the blocks and the hashes found by the delta
+uint64_t finishBlockDelta(struct posix_header *header, int fileIndex,
+                          struct block_delta *delta, size_t blockCount);
 
 // will determine if a certain file is present in the FAT table
-bool isFileInFATTable(struct posix_header *header, char *path,
+bool isFileInFATTable(struct name_index *index, char *path,
                       int *indexPosition);
 
 // will overwrite the existing blocks
 void overwriteExistingBlocks(char *filename, size_t *currentBlockIndex,
                              size_t *blockCount, size_t *newNumBlocks,
-                             FILE *archive, FILE *inputFile);
+                             FILE *archive, FILE *inputFile,
+                             struct extent_list *extents,
+                             struct block_delta *delta);
 
 // will set the rest of the blocks as free
-void markRemainingBlocksAsFree(size_t *currentBlockIndex, FILE *archive);
+void markRemainingBlocksAsFree(size_t *currentBlockIndex, FILE *archive,
+                               struct free_map *map);
 
 // will update the blocks when the size of the file is bigger
 void updateWhenFileSizeIsGreater(char *filename, size_t existingBlocks,
                                  size_t currentBlockIndex, size_t newNumBlocks,
-                                 FILE *archive, FILE *inputFile);
+                                 FILE *archive, FILE *inputFile,
+                                 struct free_map *map,
+                                 struct extent_list *extents,
+                                 struct block_delta *delta);
 
 // will add new blocks for the updated file
 void updateAtNewBlocks(size_t blockCount, size_t newNumBlocks,
-                       size_t *appendPosition, FILE *inputFile, FILE *archive,
-                       char *filename);
+                       size_t firstPosition, FILE *inputFile, FILE *archive,
+                       struct free_map *map, struct extent_list *extents,
+                       char *filename, struct block_delta *delta);
 
 // will link the old blocks with the new ones
 void linkUpdatedBlocks(size_t lastBlockIndex, size_t firstPosition,
                        FILE *archive, char *filename);
 
+// moves the blocks in use to the start of the archive
+int compactArchive(struct posix_header *header, FILE *archive, int directFd,
+                   struct free_map *map, size_t *bytesMoved);
+
+// records the extents of a file after packing
+void remapFileExtents(struct posix_file_info *fileInfo, size_t firstBlock,
+                      size_t *nextBlocks, size_t *remap, size_t blockCount);
+
+// follows every chain once saving the next pointer of each block
+size_t walkChains(struct posix_header *header, FILE *archive,
+                  size_t blockCount, size_t *nextBlocks);
+
+// calculates the new position of every block in use
+size_t buildBlockRemap(size_t *nextBlocks, size_t blockCount, size_t firstHead,
+                       size_t *remap);
+
+// moves the blocks in use to their new position
+int moveLiveBlocks(FILE *archive, int directFd, size_t *nextBlocks,
+                   size_t *remap, size_t blockCount, size_t firstHead,
+                   size_t *bytesMoved);
+
+// moves a run of consecutive blocks rewriting their next pointers
+int moveBlockRun(FILE *archive, int directFd, char *buffer, size_t firstBlock,
+                 size_t runLength, size_t *nextBlocks, size_t *remap);
+
+// moves the blocks in use through the I/O engine
+int moveAsyncBlocks(int archiveFd, size_t *nextBlocks, size_t *remap,
+                    size_t blockCount, size_t firstHead, size_t *bytesMoved);
+
 // will go to the end of file and remove last unused blocks
-int removeFreeBlocksAtEnd(FILE *archive, struct posix_header *header);
+int removeFreeBlocksAtEnd(FILE *archive, struct free_map *map);
+
+void listFilesByTarFile(struct posix_header *header, FILE *archive,
+                        struct archive_map *mapped);
+
+size_t countChainBlocks(FILE *archive, struct archive_map *mapped,
+                        struct posix_file_info *fileInfo);
+
+int deleteFilesByTarFile(struct posix_header *header, FILE *archive,
+                         char *files[], int fileCount, struct free_map *map,
+                         struct name_index *index);
+
+void deleteFileByTarFile(FILE *archive, struct posix_file_info *fileInfo,
+                         struct free_map *map, struct dedup_index *dedup);
+
+// removes an entry of the header keeping the order of the others
+void removeHeaderEntry(struct posix_header *header, struct name_index *index,
+                       int position);
+
+// drops the removed entries of the header in one pass
+void compactHeaderEntries(struct posix_header *header,
+                          struct name_index *index, const bool *isRemoved);
+
+int appendFilesByTarFile(struct posix_header *header, FILE *archive,
+                         char *files[], int fileCount, struct free_map *map,
+                         struct name_index *index);
+
+// allocates the blocks of an appended file and queues their copy
+void queueAppendedBlocks(struct block_stream *stream,
+                         struct member_copy *member,
+                         struct posix_header *header, size_t fileIndex,
+                         char *inputPath, int inputFd, size_t numBlocks,
+                         size_t firstPosition, struct free_map *map,
+                         struct extent_list *extents);
+
+int updateHeader(struct posix_header *header, struct name_index *index,
+                 char *filename, size_t fileSize);
+
+// writes the blocks of every member of a new archive sharing identical blocks
+int createDedupBlocks(struct posix_header *header, FILE *output,
+                      struct free_map *map, int num_files,
+                      char *input_files[], int inputFds[]);
+
+// writes the blocks of a member pointing to the blocks already in the archive
+int writeDedupMember(struct posix_header *header, size_t fileIndex,
+                     FILE *archive, int inputFd, struct free_map *map,
+                     struct extent_list *extents, size_t *blocksWritten);
+
+// reads the data of a block of a member
+size_t readDedupBlock(int inputFd, size_t fileSize, size_t position,
+                      struct block_data *block);
+
+// checks that a block of the archive can be shared by a member
+bool matchDedupBlock(int archiveFd, int inputFd, size_t fileSize,
+                     size_t position, size_t blockIndex,
+                     size_t nextBlockIndex, struct block_data *buffers);
+
+// removes a member from its blocks, releasing the ones no member uses
+void releaseDedupChain(size_t blockIndex, FILE *archive, struct free_map *map,
+                       struct dedup_index *dedup);
+
+// prepares the empty dedup index of a new archive
+int attachDedupIndex(struct posix_header *header);
+
+// loads the dedup index stored after the blocks or rebuilds it
+void loadDedupIndex(struct posix_header *header, FILE *archive,
+                    struct free_map *map);
+
+// reads the hash and the owners of every block
+int readDedupRecords(struct dedup_index *dedup, FILE *archive,
+                     size_t blockCount);
+
+// counts the owners of every block out of the chains
+void rebuildDedupIndex(struct posix_header *header, FILE *archive,
+                       struct free_map *map);
+
+// writes the dedup index after the last block
+int storeDedupIndex(struct posix_header *header, FILE *archive,
+                    size_t blockCount);
+
+// prepares the empty checksums of a new archive
+int attachBlockChecksums(struct posix_header *header);
+
+// calculates the checksum of the data of a block as it is stored
+uint32_t blockDataChecksum(const struct block_data *block);
+
+// returns the checksums a member is checked with, NULL if it has none
+struct block_checksums *memberChecksums(struct posix_header *header,
+                                        size_t fileIndex);
+
+// checks a block read for a member against its checksum
+bool checkBlockChecksum(struct block_checksums *checksums, size_t blockIndex,
+                        const struct block_data *block, const char *filename,
+                        uint32_t *memberChecksum);
+
+// checks the blocks read for a member against the checksum of the member
+bool checkMemberChecksum(struct block_checksums *checksums, size_t fileIndex,
+                         uint32_t memberChecksum, const char *filename);
+
+// calculates the checksums of the members written since the last commit
+int sealMemberChecksums(struct posix_header *header, int archiveFd,
+                        size_t blockCount);
+
+// makes room to seal the members of the header from many workers
+void reserveWrittenMembers(struct posix_header *header, size_t blockCount);
+
+// seals a member with the checksums taken as its blocks were written
+void sealWrittenMember(struct posix_header *header, size_t fileIndex,
+                       size_t *blocks, uint64_t *hashes);
+
+// offset of the checksums inside the tar file
+long checksumOffset(struct posix_header *header, size_t blockCount);
+
+// loads the checksums stored after the blocks
+void loadBlockChecksums(struct posix_header *header, FILE *archive,
+                        long offset, size_t blockCount);
+
+// reads a list of checksums in hexadecimal
+int readChecksumRecords(uint32_t *values, size_t count, FILE *archive);
+
+// writes the checksums of every block and member
+int storeBlockChecksums(struct posix_header *header, FILE *archive,
+                        size_t blockCount);
+
+// writes a list of checksums in hexadecimal
+int writeChecksumRecords(const uint32_t *values, size_t count,
+                         FILE *archive);
+
+// prepares the empty member attributes of an archive
+int attachMemberAttributes(struct posix_header *header);
+
+// keeps the hashes of the blocks of a member and the hash of its data
+uint64_t keepMemberHashes(struct posix_header *header, size_t fileIndex,
+                          uint64_t *hashes, size_t count);
+
+// offset of the member attributes inside the tar file
+long attributesOffset(struct posix_header *header, long offset,
+                      size_t blockCount);
+
+// loads the modification time and the hash of every member
+void loadMemberAttributes(struct posix_header *header, FILE *archive,
+                          long offset);
+
+// writes the member attributes at the current position
+int storeMemberAttributes(struct posix_header *header, FILE *archive);
+
+// offset of the block hashes, right after the block table
+long blockHashesOffset(struct posix_header *header, FILE *archive);
+
+// loads the hashes of the blocks of every member that didn't change
+void loadBlockHashes(struct posix_header *header, FILE *archive);
+
+// writes the hashes of the blocks of every member after the block table
+int storeBlockHashes(struct posix_header *header, FILE *archive);
+
+// modification time of a file in nanoseconds
+uint64_t fileModificationTime(const struct stat *status);
+
+// hashes the data of a file block by block, like the hash of a member
+uint64_t hashFileContent(int fd, size_t size, char *buffer);
+
+// finds the files of an update whose members already have their data
+void findUnchangedMembers(char *files[], int fileCount,
+                          struct posix_header *header,
+                          struct name_index *index,
+                          struct member_change *changes);
+
+// hashes the files of an update, run by each worker
+void *hashWorker(void *argument);
+
+// prepares the empty block table of a new archive
+int attachBlockTable(struct posix_header *header);
+
+// offset of the block table inside the tar file
+long blockTableOffset(struct posix_header *header, long offset,
+                      size_t blockCount);
+
+// finds the block table stored after the blocks, without reading it
+void findBlockTable(struct posix_header *header, FILE *archive, long offset);
+
+// loads the block table of an archive that is going to be written again
+void loadBlockTable(struct posix_header *header, FILE *archive);
+
+// follows the chains of the members whose blocks are not known yet
+void fillBlockTable(struct posix_header *header, int archiveFd,
+                   size_t blockCount);
+
+// writes the blocks of every member after the checksums
+int storeBlockTable(struct posix_header *header, FILE *archive);
+
+// reads a list of block numbers
+int readTableRecords(size_t *values, size_t count, FILE *archive);
+
+// writes a list of block numbers
+int writeTableRecords(const size_t *values, size_t count, FILE *archive);
+
+// finds the blocks that hold a range of a member
+int findMemberBlocks(struct posix_header *header, FILE *archive,
+                     size_t fileIndex, size_t firstBlock, size_t count,
+                     size_t *blocks);
+
+// reads every operation of a batch, NULL when a line is wrong
+struct batch_operation *readBatchOperations(FILE *input,
+                                            size_t *operationCount);
+
+// reads an operation out of a line of a batch
+bool parseBatchLine(char *line, struct batch_operation *operation);
+
+// applies a run of operations of the same kind to the header in memory
+int applyBatchOperations(struct posix_header *header, FILE *archive,
+                         struct free_map *map, struct name_index *index,
+                         BatchOperation type, char *arguments[],
+                         size_t count, size_t *appliedCount);
+
+// releases the operations of a batch
+void freeBatchOperations(struct batch_operation *operations, size_t count);
+
+// reads a range of a member into a buffer
+ssize_t readMemberRange(struct posix_header *header, FILE *archive,
+                        size_t fileIndex, size_t offset, size_t length,
+                        char *buffer);
+
+// sets the state shared by the archives to the one of a library handle
+void useStarArchive(struct star_archive *archive);
+
+// loads the free map stored in the header or rebuilds it
+void loadFreeMap(struct posix_header *header, FILE *archive,
+                 struct free_map *map);
+
+// builds the free map out of the chains of every file
+void rebuildFreeMap(struct posix_header *header, FILE *archive,
+                    struct free_map *map);
+
+// stores the free map in the header
+void storeFreeMap(struct posix_header *header, struct free_map *map);
+
+// reads the flags of the archive
+size_t archiveFlags(struct posix_header *header);
+
+// sets the flags of the archive
+void setArchiveFlags(struct posix_header *header, size_t flags);
+
+// prepares an empty list of extents
+void initExtentList(struct extent_list *extents);
+
+// adds the next block of a file to its extents
+void addExtentBlock(struct extent_list *extents, size_t block);
+
+// reads the extents recorded for a file
+void loadFileExtents(struct posix_file_info *fileInfo,
+                     struct extent_list *extents);
+
+// records the extents of a file
+void storeFileExtents(struct posix_file_info *fileInfo,
+                      struct extent_list *extents);
+
+// writes the header and the free map back to the archive
+int commitHeader(struct posix_header *header, FILE *archive,
+                 struct free_map *map);
+
+// creates a header with no files
+struct posix_header *createEmptyHeader();
+
+// reads the header of the archive, keeping only the entries in use
+struct posix_header *loadHeader(FILE *archive);
+
+// reads the header written after the blocks of a streamed archive
+int loadStreamIndex(struct posix_header *header, FILE *archive);
+
+// reads the FAT entries until an empty one or the maximum is found
+int readHeaderEntries(struct posix_header *header, FILE *archive,
+                      size_t maxEntries);
+
+// reads the free map stored after the FAT entries
+int readHeaderTail(struct posix_header *header, FILE *archive, long offset,
+                   size_t length);
+
+// writes the header at the start of the archive
+int writeHeader(struct posix_header *header, FILE *archive);
+
+// amount of bytes used by the free map and the flags
+size_t headerTailLength(struct posix_header *header);
+
+// grows the FAT table to hold at least a certain amount of files
+void reserveHeader(struct posix_header *header, size_t entries);
+
+// releases the memory used by the header
+void destroyHeader(struct posix_header *header);
+
+// amount of blocks needed to store a file of a certain size
+size_t blocksForSize(size_t size);
+
+// offset of a block inside the tar file
+long blockOffset(size_t blockIndex);
+
+// reads the next pointer of a block
+size_t readBlockNext(FILE *archive, size_t blockIndex);
+
+// reads the next pointer of a block with pread
+size_t preadBlockNext(int archiveFd, size_t blockIndex);
+
+// writes the next pointer of a block
+void writeBlockNext(FILE *archive, size_t blockIndex, size_t nextBlockIndex);
+
+// shows how much of the archive is in the page cache
+void logArchiveCache(const char *filename);
+
+// creates the pool of block buffers
+void initBlockPool();
+
+// takes consecutive block buffers from the pool
+void *acquireBlockBuffers(size_t count);
+
+// gives back block buffers to the pool
+void releaseBlockBuffers(void *buffer, size_t count);
+
+// releases the pool of block buffers
+void destroyBlockPool();
+
+// amount of threads that compress or decompress blocks
+int codecThreadCount();
+
+// prepares a batch of blocks and the threads of the codec
+int openCodecBatch(struct codec_batch *batch, FILE *output, int archiveFd);
+
+// stops the threads of a batch and releases its buffers
+void closeCodecBatch(struct codec_batch *batch);
+
+// writes the compressed blocks of a new archive
+int createCompressedBlocks(struct posix_header *file_header, FILE *output,
+                           int num_files, char *input_files[],
+                           int inputFds[], size_t blockCount);
+
+// writes the blocks of every member compressed by the codec threads
+int compressMembers(struct posix_header *header, FILE *output, int archiveFd,
+                    int num_files, char *input_files[], int inputFds[]);
+
+// compresses a batch of blocks and writes them
+void flushCompressedBatch(struct codec_batch *batch);
+
+// extracts the members of a compressed archive
+void extractCompressedArchive(struct posix_header *header, FILE *archive,
+                              size_t *members, size_t memberCount);
+
+// reads the chains of the members and decompresses them in batches
+int extractCompressedMembers(struct posix_header *header, FILE *archive,
+                             size_t *members, size_t memberCount,
+                             size_t *bytesStored);
+
+// decompresses a batch of blocks and writes their data to the files
+void flushDecompressedBatch(struct codec_batch *batch);
 
-void listFilesByTarFile(struct posix_header *header, FILE *archive);
+// frees the disk space after the data of a compressed block
+void punchStoredTail(int archiveFd, size_t blockIndex,
+                     const struct block_data *block);
 
-void deleteFilesByTarFile(struct posix_header *header, FILE *archive, char *files[], int fileCount);
+// reads the blocks of the archive, run by each verify worker
+void *verifyWorker(void *argument);
 
-void deleteFileByTarFile(FILE *archive, struct posix_file_info *fileInfo);
+// follows the chain of every member with the blocks already read
+size_t verifyChains(struct posix_header *header, struct verify_job *job);
 
-void appendFilesByTarFile(struct posix_header *header, FILE *archive, char *files[], int fileCount);
+// amount of blocks of an archive
+size_t archiveBlockCount(struct posix_header *header, FILE *archive);
 
-int updateHeader(struct posix_header *header, char *filename);
+// builds the name index of the header
+void buildNameIndex(struct posix_header *header, struct name_index *index);
 #endif
\ No newline at end of file